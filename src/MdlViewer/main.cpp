@@ -311,8 +311,11 @@ int main(int argc, char* argv[])
     auto texNum = g_ctxt.getTextureNum();
 
     for (int i = 0; i < texNum; i++) {
+        // The slot of the removed texture is empty.
         auto tex = g_ctxt.getTexture(i);
-        tex->initAsGLTexture();
+        if (tex) {
+            tex->initAsGLTexture();
+        }
     }
 
     // TODO
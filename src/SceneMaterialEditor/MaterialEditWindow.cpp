@@ -115,9 +115,10 @@ static void getMaterialsFromContext(
 {
     auto mtrlNum = ctxt.getMaterialNum();
     for (int i = 0; i < mtrlNum; i++) {
+        // Keep the empty slot of the removed material not to change the indices of the others.
         auto mtrl = ctxt.getMaterial(i);
         mtrls.push_back(mtrl);
-        mtrlNames.push_back(mtrl->name());
+        mtrlNames.push_back(mtrl ? mtrl->name() : "");
     }
 }
 
@@ -160,8 +161,7 @@ void MaterialEditWindow::buildScene()
 
                 for (int i = 0; i < texNum; i++) {
                     auto t = s_ctxt.getTexture(i);
-                    tex.push_back(
-                        idaten::TextureResource(t->colors(), t->width(), t->height()));
+                    tex.push_back(idaten::TextureResource::create(t));
                 }
             }
 
@@ -194,10 +194,12 @@ void MaterialEditWindow::buildScene()
     getMaterialsFromContext(s_ctxt, s_mtrls, s_mtrlNames);
 
     // Update material.
-    std::vector<aten::MaterialParameter> params(1);
-    params[0] = s_mtrls[0]->param();
-    s_tracer.updateMaterial(params);
-    s_tracer.reset();
+    if (!s_mtrls.empty() && s_mtrls[0]) {
+        std::vector<aten::MaterialParameter> params(1);
+        params[0] = s_mtrls[0]->param();
+        s_tracer.updateMaterial(params);
+        s_tracer.reset();
+    }
 }
 
 void MaterialEditWindow::onRun(aten::window* window)
@@ -261,46 +263,49 @@ void MaterialEditWindow::onRun(aten::window* window)
             s_pickMtrlIdNotifier(s_pickedMtrlId);
         }
 
-        static const char* items[] = {
-            "Emissive",
-            "Lambert",
-            "OrneNayar",
-            "Specular",
-            "Refraction",
-            "Blinn",
-            "GGX",
-            "Beckman",
-        };
-        int mtrlType = (int)mtrl->param().type;
-        if (ImGui::Combo("mode", &mtrlType, items, AT_COUNTOF(items))) {
-            auto newMtrl = aten::MaterialFactory::createMaterialWithDefaultValue((aten::MaterialType)mtrlType);
-
-            newMtrl->copyParamEx(mtrl->param());
-            newMtrl->setName(mtrl->name());
-
-            mtrl = newMtrl;
-            s_mtrls[s_pickedMtrlId] = mtrl;
-
-            s_needUpdateMtrl = true;
-        }
+        // The slot of the removed material is empty, and it is not editable.
+        if (mtrl) {
+            static const char* items[] = {
+                "Emissive",
+                "Lambert",
+                "OrneNayar",
+                "Specular",
+                "Refraction",
+                "Blinn",
+                "GGX",
+                "Beckman",
+            };
+            int mtrlType = (int)mtrl->param().type;
+            if (ImGui::Combo("mode", &mtrlType, items, AT_COUNTOF(items))) {
+                auto newMtrl = aten::MaterialFactory::createMaterialWithDefaultValue((aten::MaterialType)mtrlType);
+
+                newMtrl->copyParamEx(mtrl->param());
+                newMtrl->setName(mtrl->name());
+
+                mtrl = newMtrl;
+                s_mtrls[s_pickedMtrlId] = mtrl;
+
+                s_needUpdateMtrl = true;
+            }
 
-        if (mtrl->edit(&s_mtrlParamEditor)) {
-            s_needUpdateMtrl = true;
-        }
+            if (mtrl->edit(&s_mtrlParamEditor)) {
+                s_needUpdateMtrl = true;
+            }
 
-        static char str[128];
-        sprintf(str, "%s\0", mtrl->name());
-        if (ImGui::InputText("MaterialName", str, AT_COUNTOF(str))) {
-            mtrl->setName(str);
-        }
+            static char str[128];
+            sprintf(str, "%s\0", mtrl->name());
+            if (ImGui::InputText("MaterialName", str, AT_COUNTOF(str))) {
+                mtrl->setName(str);
+            }
 
-        if (s_needUpdateMtrl) {
-            std::vector<aten::MaterialParameter> params(1);
-            params[0] = mtrl->param();
-            s_tracer.updateMaterial(params);
-            s_tracer.reset();
+            if (s_needUpdateMtrl) {
+                std::vector<aten::MaterialParameter> params(1);
+                params[0] = mtrl->param();
+                s_tracer.updateMaterial(params);
+                s_tracer.reset();
 
-            s_needUpdateMtrl = false;
+                s_needUpdateMtrl = false;
+            }
         }
 
         if (ImGui::Button("Export")) {
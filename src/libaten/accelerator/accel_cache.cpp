@@ -0,0 +1,221 @@
+#include <string.h>
+
+#include "accelerator/accel_cache.h"
+#include "misc/atomicfile.h"
+
+namespace aten
+{
+    const uint32_t AccelCache::SectionAlignment;
+
+    struct AccelCacheFileHeader {
+        uint8_t magic[4];
+        uint8_t version[4];
+        uint32_t accelType;
+        uint32_t sectionNum;
+        uint64_t key;
+        uint64_t fileSize;
+    };
+
+    struct AccelCacheSectionHeader {
+        uint32_t id;
+        uint32_t stride;
+        uint32_t num;
+        uint32_t padding;
+        uint64_t offset;
+    };
+
+    static inline uint64_t alignOffset(uint64_t offset)
+    {
+        return (offset + AccelCache::SectionAlignment - 1) / AccelCache::SectionAlignment * AccelCache::SectionAlignment;
+    }
+
+    void AccelCacheWriter::addSection(
+        uint32_t id,
+        const void* data,
+        uint32_t stride,
+        uint32_t num)
+    {
+        AT_ASSERT(stride > 0);
+        AT_ASSERT(data || num == 0);
+
+        for (const auto& s : m_sections) {
+            AT_ASSERT(s.id != id);
+        }
+
+        Section section;
+        section.id = id;
+        section.stride = stride;
+        section.num = num;
+        section.data = data;
+
+        m_sections.push_back(section);
+    }
+
+    bool AccelCacheWriter::write(const std::string& path) const
+    {
+        const uint32_t sectionNum = (uint32_t)m_sections.size();
+
+        std::vector<AccelCacheSectionHeader> sections(sectionNum);
+
+        uint64_t offset = sizeof(AccelCacheFileHeader) + sizeof(AccelCacheSectionHeader) * sectionNum;
+
+        for (uint32_t i = 0; i < sectionNum; i++) {
+            const auto& src = m_sections[i];
+            auto& dst = sections[i];
+
+            offset = alignOffset(offset);
+
+            dst.id = src.id;
+            dst.stride = src.stride;
+            dst.num = src.num;
+            dst.padding = 0;
+            dst.offset = offset;
+
+            offset += (uint64_t)src.stride * src.num;
+        }
+
+        AccelCacheFileHeader header;
+        {
+            header.magic[0] = 'A';
+            header.magic[1] = 'T';
+            header.magic[2] = 'A';
+            header.magic[3] = 'C';
+
+            header.version[0] = 0;
+            header.version[1] = 0;
+            header.version[2] = 0;
+            header.version[3] = 1;
+
+            header.accelType = m_accelType;
+            header.sectionNum = sectionNum;
+            header.key = m_key;
+            header.fileSize = offset;
+        }
+
+        const auto tmpPath = AtomicFile::getTemporaryPath(path);
+
+        FILE* fp = fopen(tmpPath.c_str(), "wb");
+        if (!fp) {
+            AT_PRINTF("Failed to open %s\n", tmpPath.c_str());
+            return false;
+        }
+
+        bool isSaved = (fwrite(&header, sizeof(header), 1, fp) == 1)
+            && (sectionNum == 0 || fwrite(&sections[0], sizeof(AccelCacheSectionHeader), sectionNum, fp) == sectionNum);
+
+        uint64_t pos = sizeof(AccelCacheFileHeader) + sizeof(AccelCacheSectionHeader) * sectionNum;
+
+        static const uint8_t zeros[AccelCache::SectionAlignment] = { 0 };
+
+        for (uint32_t i = 0; isSaved && i < sectionNum; i++) {
+            const auto& section = sections[i];
+
+            // Fill zero until the aligned offset.
+            auto padding = (size_t)(section.offset - pos);
+            isSaved = (padding == 0 || fwrite(zeros, 1, padding, fp) == padding);
+
+            const auto size = (size_t)section.stride * section.num;
+            const auto& src = m_sections[i];
+            const void* data = src.data ? src.data : src.copied.data();
+
+            isSaved = isSaved && (size == 0 || fwrite(data, 1, size, fp) == size);
+
+            pos = section.offset + size;
+        }
+
+        isSaved = (fclose(fp) == 0) && isSaved;
+
+        if (!isSaved) {
+            AT_PRINTF("Failed to write %s\n", tmpPath.c_str());
+            remove(tmpPath.c_str());
+            return false;
+        }
+
+        return AtomicFile::replace(tmpPath, path);
+    }
+
+    bool AccelCacheReader::open(
+        const std::string& path,
+        uint32_t accelType,
+        uint64_t key)
+    {
+        if (!m_file.open(path)) {
+            return false;
+        }
+
+        const auto size = (uint64_t)m_file.size();
+
+        bool isValid = size >= sizeof(AccelCacheFileHeader);
+
+        if (isValid) {
+            const auto& header = *reinterpret_cast<const AccelCacheFileHeader*>(m_file.data());
+
+            isValid = memcmp(header.magic, "ATAC", 4) == 0
+                && header.version[3] == 1
+                && header.accelType == accelType
+                && header.key == key
+                && header.fileSize == size
+                && sizeof(AccelCacheFileHeader) + sizeof(AccelCacheSectionHeader) * (uint64_t)header.sectionNum <= size;
+
+            // Check if all sections are in the file.
+            auto sections = reinterpret_cast<const AccelCacheSectionHeader*>(m_file.data() + sizeof(AccelCacheFileHeader));
+
+            for (uint32_t i = 0; isValid && i < header.sectionNum; i++) {
+                const auto& s = sections[i];
+                isValid = (s.offset % AccelCache::SectionAlignment) == 0
+                    && s.offset + (uint64_t)s.stride * s.num <= size;
+            }
+        }
+
+        if (!isValid) {
+            AT_PRINTF("%s is not the valid cache\n", path.c_str());
+            m_file.close();
+        }
+
+        return isValid;
+    }
+
+    const void* AccelCacheReader::getSection(
+        uint32_t id,
+        uint32_t stride,
+        uint32_t& num) const
+    {
+        num = 0;
+
+        if (!m_file.isOpened()) {
+            return nullptr;
+        }
+
+        const auto& header = *reinterpret_cast<const AccelCacheFileHeader*>(m_file.data());
+        auto sections = reinterpret_cast<const AccelCacheSectionHeader*>(m_file.data() + sizeof(AccelCacheFileHeader));
+
+        for (uint32_t i = 0; i < header.sectionNum; i++) {
+            const auto& s = sections[i];
+
+            if (s.id == id) {
+                if (s.stride != stride) {
+                    return nullptr;
+                }
+
+                num = s.num;
+                return m_file.data() + s.offset;
+            }
+        }
+
+        return nullptr;
+    }
+
+    std::string AccelCache::getPath(const std::string& dir, uint64_t key)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.accel", (unsigned long long)key);
+
+        std::string path(dir);
+        if (!path.empty() && path.back() != '/' && path.back() != '\\') {
+            path += "/";
+        }
+        path += name;
+
+        return path;
+    }
+}
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "defs.h"
+#include "types.h"
+#include "misc/mappedfile.h"
+
+namespace aten
+{
+    /**
+     * @brief Hash to make the key of the cached structure tree.
+     * It is 64 bit FNV-1a.
+     */
+    class AccelCacheHasher {
+    public:
+        AccelCacheHasher() {}
+        ~AccelCacheHasher() {}
+
+    public:
+        void add(const void* data, size_t size)
+        {
+            auto p = (const uint8_t*)data;
+
+            for (size_t i = 0; i < size; i++) {
+                m_hash ^= p[i];
+                m_hash *= 0x100000001b3ULL;
+            }
+        }
+
+        /**
+         * @brief Add the value.
+         * @note The value must not have any padding, because the padding is not initialized.
+         */
+        template <typename T>
+        void add(const T& v)
+        {
+            add(&v, sizeof(T));
+        }
+
+        uint64_t value() const
+        {
+            return m_hash;
+        }
+
+    private:
+        uint64_t m_hash{ 0xcbf29ce484222325ULL };
+    };
+
+    /**
+     * @brief Writer of the file to cache the structure tree.
+     *
+     * The file has the sections which are the arrays of the structure tree's data.
+     * Each section is aligned with SectionAlignment in the file,
+     * so the mapped file can be accessed directly as the arrays.
+     */
+    class AccelCacheWriter {
+    public:
+        AccelCacheWriter(uint32_t accelType, uint64_t key)
+            : m_accelType(accelType), m_key(key)
+        {}
+        ~AccelCacheWriter() {}
+
+    public:
+        /**
+         * @brief Add the section.
+         * @note The data is not copied, so it has to be kept until the file is written.
+         * @param id Id of the section, which is unique in the file.
+         * @param stride Size of the item in the section.
+         * @param num Number of the items in the section.
+         */
+        void addSection(
+            uint32_t id,
+            const void* data,
+            uint32_t stride,
+            uint32_t num);
+
+        /**
+         * @brief Add the section which has only one value.
+         * The value is copied, so it doesn't need to be kept.
+         */
+        template <typename T>
+        void addValue(uint32_t id, const T& v)
+        {
+            addSection(id, &v, (uint32_t)sizeof(T), 1);
+            m_sections.back().copied.assign((const uint8_t*)&v, (const uint8_t*)&v + sizeof(T));
+            m_sections.back().data = nullptr;
+        }
+
+        /**
+         * @brief Write the file.
+         * The file is written to the temporary file at first, and it is renamed to the specified path.
+         */
+        bool write(const std::string& path) const;
+
+    private:
+        struct Section {
+            uint32_t id;
+            uint32_t stride;
+            uint32_t num;
+            const void* data;
+
+            // If the data is copied, it is stored here.
+            std::vector<uint8_t> copied;
+        };
+
+        uint32_t m_accelType;
+        uint64_t m_key;
+
+        std::vector<Section> m_sections;
+    };
+
+    /**
+     * @brief Reader of the file to cache the structure tree.
+     * The file is mapped to the memory, and the sections are returned as the pointers in the mapped file.
+     */
+    class AccelCacheReader {
+    public:
+        AccelCacheReader() {}
+        ~AccelCacheReader() {}
+
+        AccelCacheReader(const AccelCacheReader&) = delete;
+        AccelCacheReader& operator=(const AccelCacheReader&) = delete;
+
+    public:
+        /**
+         * @brief Open the file, and validate it.
+         * @return If the file is for the specified type of the structure tree and the key, return true.
+         */
+        bool open(
+            const std::string& path,
+            uint32_t accelType,
+            uint64_t key);
+
+        void close()
+        {
+            m_file.close();
+        }
+
+        /**
+         * @brief Return the section.
+         * @param id Id of the section.
+         * @param stride Size of the item in the section. It has to be same as the written one.
+         * @param num Number of the items in the section.
+         * @return Pointer to the top of the section in the mapped file. If the section is not found, return nullptr.
+         */
+        const void* getSection(
+            uint32_t id,
+            uint32_t stride,
+            uint32_t& num) const;
+
+        template <typename T>
+        const T* getSection(uint32_t id, uint32_t& num) const
+        {
+            return reinterpret_cast<const T*>(getSection(id, (uint32_t)sizeof(T), num));
+        }
+
+    private:
+        MappedFile m_file;
+    };
+
+    /**
+     * @brief Utility for the file to cache the structure tree.
+     */
+    class AccelCache {
+    private:
+        AccelCache() {}
+        ~AccelCache() {}
+
+    public:
+        static const uint32_t SectionAlignment = 64;
+
+        /**
+         * @brief Return the path of the cache file for the key.
+         */
+        static std::string getPath(const std::string& dir, uint64_t key);
+    };
+}
@@ -2,10 +2,14 @@
 #include "accelerator/bvh.h"
 #include "accelerator/sbvh.h"
 #include "accelerator/threaded_bvh.h"
+#include "accelerator/lbvh.h"
+#include "accelerator/bvh8.h"
+#include "geometry/face.h"
 
 namespace aten {
     AccelType accelerator::s_internalType = AccelType::Bvh;
     std::function<accelerator*()> accelerator::s_userDefsInternalAccelCreator = nullptr;
+    std::string accelerator::s_cacheDir;
 
     void accelerator::setInternalAccelType(AccelType type)
     {
@@ -24,6 +28,80 @@ namespace aten {
         }
     }
 
+    void accelerator::setCacheDirectory(const std::string& dir)
+    {
+        s_cacheDir = dir;
+    }
+
+    const std::string& accelerator::getCacheDirectory()
+    {
+        return s_cacheDir;
+    }
+
+    void accelerator::buildWithCache(
+        const context& ctxt,
+        hitable** list,
+        uint32_t num,
+        aabb* bbox)
+    {
+        // NOTE
+        // The exported tree is built without the cache, because it has the relative triangle indices.
+        if (s_cacheDir.empty() || m_isExporting || !isCacheSupported() || num == 0) {
+            build(ctxt, list, num, bbox);
+            return;
+        }
+
+        // Make the key from the triangles and the build settings.
+        // The absolute indices are hashed, because the structure tree has them.
+        AccelCacheHasher hasher;
+        {
+            hasher.add((uint32_t)m_type);
+            hasher.add(m_isNested);
+            hashBuildSettings(hasher);
+
+            hasher.add(num);
+
+            for (uint32_t i = 0; i < num; i++) {
+                const auto tri = (const AT_NAME::face*)list[i];
+                const auto& param = tri->getParam();
+
+                hasher.add(tri->getId());
+                hasher.add(tri->geomid());
+
+                hasher.add(param.idx);
+                hasher.add(param.mtrlid);
+                hasher.add(param.gemoid);
+                hasher.add(param.needNormal);
+
+                for (int n = 0; n < 3; n++) {
+                    const auto& pos = ctxt.getVertex(param.idx[n]).pos;
+                    hasher.add(pos);
+                }
+            }
+        }
+
+        const auto key = hasher.value();
+        const auto path = AccelCache::getPath(s_cacheDir, key);
+
+        {
+            AccelCacheReader reader;
+
+            if (reader.open(path, (uint32_t)m_type, key)
+                && importCache(ctxt, reader))
+            {
+                return;
+            }
+        }
+
+        build(ctxt, list, num, bbox);
+
+        AccelCacheWriter writer((uint32_t)m_type, key);
+
+        if (exportCache(ctxt, writer)) {
+            writer.write(path);
+        }
+    }
+
     accelerator* accelerator::createAccelerator(AccelType type/*= AccelType::Default*/)
     {
         accelerator* ret = nullptr;
@@ -43,6 +121,12 @@ namespace aten {
             case AccelType::ThreadedBvh:
                 ret = new ThreadedBVH();
                 break;
+            case AccelType::Lbvh:
+                ret = new LBVH();
+                break;
+            case AccelType::Bvh8:
+                ret = new bvh8();
+                break;
             default:
                 ret = new bvh();
                 AT_ASSERT(false);
@@ -52,4 +136,95 @@ namespace aten {
 
         return ret;
     }
+
+    uint32_t accelerator::hit(
+        const context& ctxt,
+        const RayPacket& packet,
+        real t_min, real t_max,
+        Intersection* isects) const
+    {
+        uint32_t ret = 0;
+
+        for (uint32_t i = 0; i < packet.num; i++) {
+            if ((packet.activeMask & (1 << i)) == 0) {
+                continue;
+            }
+
+            isects[i] = Intersection();
+
+            if (hit(ctxt, packet.rays[i], t_min, t_max, false, isects[i])) {
+                ret |= (1 << i);
+            }
+        }
+
+        return ret;
+    }
+
+    uint32_t accelerator::occluded(
+        const context& ctxt,
+        const RayPacket& packet,
+        real t_min, real t_max) const
+    {
+        // NOTE
+        // No any-hit traversal in default, so find the closest hit.
+        Intersection isects[RayPacket::MaxRayNum];
+        return hit(ctxt, packet, t_min, t_max, isects);
+    }
+
+    void accelerator::hit(
+        const context& ctxt,
+        const ray* rays,
+        const bool* isActive,
+        uint32_t num,
+        real t_min, real t_max,
+        Intersection* isects,
+        bool* isHit) const
+    {
+        RayPacket packet;
+
+        for (uint32_t start = 0; start < num; start += RayPacket::MaxRayNum) {
+            packet.clear();
+
+            auto end = std::min(start + RayPacket::MaxRayNum, num);
+
+            for (uint32_t i = start; i < end; i++) {
+                packet.add(rays[i], isActive ? isActive[i] : true);
+            }
+
+            auto mask = hit(ctxt, packet, t_min, t_max, &isects[start]);
+
+            if (isHit) {
+                for (uint32_t i = start; i < end; i++) {
+                    isHit[i] = ((mask & (1 << (i - start))) > 0);
+                }
+            }
+        }
+    }
+
+    void accelerator::occluded(
+        const context& ctxt,
+        const ray* rays,
+        const bool* isActive,
+        uint32_t num,
+        real t_min, real t_max,
+        bool* isOccluded) const
+    {
+        RayPacket packet;
+
+        for (uint32_t start = 0; start < num; start += RayPacket::MaxRayNum) {
+            packet.clear();
+
+            auto end = std::min(start + RayPacket::MaxRayNum, num);
+
+            for (uint32_t i = start; i < end; i++) {
+                packet.add(rays[i], isActive ? isActive[i] : true);
+            }
+
+            auto mask = occluded(ctxt, packet, t_min, t_max);
+
+            for (uint32_t i = start; i < end; i++) {
+                isOccluded[i] = ((mask & (1 << (i - start))) > 0);
+            }
+        }
+    }
 }
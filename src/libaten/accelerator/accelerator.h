@@ -1,9 +1,12 @@
 #pragma once
 
+#include <string>
 #include <vector>
 #include "scene/hitable.h"
 #include "math/frustum.h"
 #include "scene/context.h"
+#include "accelerator/ray_packet.h"
+#include "accelerator/accel_cache.h"
 
 namespace aten {
     /**
@@ -17,6 +20,8 @@ namespace aten {
         ThreadedBvh,    ///< Threaded BVH.
         StacklessBvh,    ///< Stackless BVH.
         StacklessQbvh,    ///< Stackless QBVH.
+        Lbvh,           ///< Linear BVH.
+        Bvh8,           ///< 8-wide BVH.
         UserDefs,        ///< User defined.
 
         Default,        ///< Default type.
@@ -44,6 +49,8 @@ namespace aten {
         static AccelType s_internalType;
         static std::function<accelerator*()> s_userDefsInternalAccelCreator;
 
+        static std::string s_cacheDir;
+
         /**
          * @brief Return a created acceleration structure for internal used.
          */
@@ -73,6 +80,17 @@ namespace aten {
          */
         static void setUserDefsInternalAccelCreator(std::function<accelerator*()> creator);
 
+        /**
+         * @brief Set the directory to cache the structure trees which are built by buildWithCache.
+         * If it is empty, the structure trees are not cached.
+         */
+        static void setCacheDirectory(const std::string& dir);
+
+        /**
+         * @brief Return the directory to cache the structure trees.
+         */
+        static const std::string& getCacheDirectory();
+
         /**
          * @brief Bulid structure tree from the specified list.
          */
@@ -82,6 +100,18 @@ namespace aten {
             uint32_t num,
             aabb* bbox) = 0;
 
+        /**
+         * @brief Bulid structure tree from the specified triangles, or load it from the cache.
+         * The cache is keyed by the hash of the vertices, the indices and the build settings.
+         * If the cache is not found, the structure tree is built and cached.
+         * @note All items in the list have to be triangles.
+         */
+        void buildWithCache(
+            const context& ctxt,
+            hitable** list,
+            uint32_t num,
+            aabb* bbox);
+
         /**
          * @brief Build voxel data from the structure tree.
          */
@@ -101,6 +131,69 @@ namespace aten {
             bool enableLod,
             Intersection& isect) const = 0;
 
+        /**
+         * @brief Test if a ray is occluded by any objects.
+         * @note The traversal can stop at the first hit, and the closest hit is not computed.
+         */
+        virtual bool occluded(
+            const context& ctxt,
+            const ray& r,
+            real t_min, real t_max) const override
+        {
+            Intersection isect;
+            return hit(ctxt, r, t_min, t_max, false, isect);
+        }
+
+        /**
+         * @brief Test if rays in the packet hit objects.
+         * @param isects Intersection for each ray in the packet.
+         * @return Bit mask of the rays which hit objects.
+         */
+        virtual uint32_t hit(
+            const context& ctxt,
+            const RayPacket& packet,
+            real t_min, real t_max,
+            Intersection* isects) const;
+
+        /**
+         * @brief Test if rays in the packet are occluded by any objects.
+         * @return Bit mask of the rays which are occluded.
+         */
+        virtual uint32_t occluded(
+            const context& ctxt,
+            const RayPacket& packet,
+            real t_min, real t_max) const;
+
+        /**
+         * @brief Test if rays in the stream hit objects.
+         * @note The stream is traversed as the packets.
+         * @param isActive Flag if the ray is traced. If it is nullptr, all rays are traced.
+         * @param isects Intersection for each ray in the stream.
+         * @param isHit Flag if the ray hits a object. If it is nullptr, it is not stored.
+         */
+        void hit(
+            const context& ctxt,
+            const ray* rays,
+            const bool* isActive,
+            uint32_t num,
+            real t_min, real t_max,
+            Intersection* isects,
+            bool* isHit) const;
+
+        /**
+         * @brief Test if rays in the stream are occluded by any objects.
+         * @note The stream is traversed as the packets.
+         * @param isActive Flag if the ray is traced. If it is nullptr, all rays are traced.
+         * @param isOccluded Flag if the ray is occluded.
+         */
+        void occluded(
+            const context& ctxt,
+            const ray* rays,
+            const bool* isActive,
+            uint32_t num,
+            real t_min, real t_max,
+            bool* isOccluded) const;
+
         /**
          * @brief Update the structure tree.
          */
@@ -163,6 +256,44 @@ namespace aten {
         }
 
     protected:
+        /**
+         * @brief Return whether the structure tree can be cached.
+         */
+        virtual bool isCacheSupported() const
+        {
+            return false;
+        }
+
+        /**
+         * @brief Add the settings which affect the built structure tree to the hash of the cache key.
+         */
+        virtual void hashBuildSettings(AccelCacheHasher& hasher) const
+        {
+        }
+
+        /**
+         * @brief Add the built structure data to the cache.
+         * @note The added data has to be kept until the cache is written.
+         */
+        virtual bool exportCache(
+            const context& ctxt,
+            AccelCacheWriter& writer)
+        {
+            AT_ASSERT(false);
+            return false;
+        }
+
+        /**
+         * @brief Import the structure data from the cache.
+         */
+        virtual bool importCache(
+            const context& ctxt,
+            const AccelCacheReader& reader)
+        {
+            AT_ASSERT(false);
+            return false;
+        }
+
         bool isExporting() const
         {
             return m_isExporting;
@@ -4,6 +4,7 @@
 #include "accelerator/bvh.h"
 #include "geometry/transformable.h"
 #include "geometry/object.h"
+#include "misc/timer.h"
 
 //#define TEST_NODE_LIST
 //#pragma optimize( "", off)
@@ -132,6 +133,36 @@ namespace aten {
         }
     }
 
+    bool bvhnode::occluded(
+        const context& ctxt,
+        const ray& r,
+        real t_min, real t_max) const
+    {
+        if (m_childrenNum > 0) {
+            for (int i = 0; i < m_childrenNum; i++) {
+                if (m_children[i]->occluded(ctxt, r, t_min, t_max)) {
+                    return true;
+                }
+            }
+
+            return false;
+        }
+        else if (m_item) {
+            return m_item->occluded(ctxt, r, t_min, t_max);
+        }
+        else {
+            auto bbox = getBoundingbox();
+            auto isHit = bbox.hit(r, t_min, t_max);
+
+            if (isHit) {
+                Intersection isect;
+                isHit = bvh::onHit(ctxt, this, r, t_min, t_max, isect, true);
+            }
+
+            return isHit;
+        }
+    }
+
     void bvhnode::drawAABB(
         aten::hitable::FuncDrawAABB func,
         const aten::mat4& mtxL2W) const
@@ -180,16 +211,73 @@ namespace aten {
         uint32_t num,
         aabb* bbox)
     {
-        int axis = 0;
+        timer timer;
+        timer.begin();
+
+        if (s_buildMode == BuildMode::Binned) {
+            buildByBinnedSAH(list, num);
+        }
+        else {
+            int axis = 0;
+
+            if (bbox) {
+                axis = findLongestAxis(*bbox);
+            }
+
+            sortList(list, num, axis);
+
+            m_root = new bvhnode(nullptr, nullptr, this);
+            buildBySAH(m_root, list, num, 0, m_root);
+        }
+
+        m_report.elapsed = timer.end();
+
+        computeBuildReport();
+    }
+
+    void bvh::computeBuildReport()
+    {
+        // Same estimation as the cost in SAH.
+        static const real T_tri = 1;
+        static const real T_aabb = 1;
+
+        m_report.nodeNum = 0;
+        m_report.leafNum = 0;
+        m_report.sahCost = real(0);
 
-        if (bbox) {
-            axis = findLongestAxis(*bbox);
+        if (!m_root) {
+            return;
         }
 
-        sortList(list, num, axis);
+        auto rootSurfaceArea = m_root->getBoundingbox().computeSurfaceArea();
+        rootSurfaceArea = (rootSurfaceArea > real(0) ? rootSurfaceArea : real(1));
+
+        std::vector<const bvhnode*> stack;
+        stack.push_back(m_root);
 
-        m_root = new bvhnode(nullptr, nullptr, this);
-        buildBySAH(m_root, list, num, 0, m_root);
+        while (!stack.empty()) {
+            auto node = stack.back();
+            stack.pop_back();
+
+            auto ratio = node->getBoundingbox().computeSurfaceArea() / rootSurfaceArea;
+
+            m_report.nodeNum++;
+
+            if (node->isLeaf()) {
+                m_report.leafNum++;
+                m_report.sahCost += T_tri * ratio;
+            }
+            else {
+                m_report.sahCost += T_aabb * ratio;
+
+                if (node->m_left) {
+                    stack.push_back(node->m_left);
+                }
+                if (node->m_right) {
+                    stack.push_back(node->m_right);
+                }
+            }
+        }
     }
 
     bool bvh::hit(
@@ -202,12 +290,23 @@ namespace aten {
         return isHit;
     }
 
+    bool bvh::occluded(
+        const context& ctxt,
+        const ray& r,
+        real t_min, real t_max) const
+    {
+        Intersection isect;
+        bool isHit = onHit(ctxt, m_root, r, t_min, t_max, isect, true);
+        return isHit;
+    }
+
     bool bvh::onHit(
         const context& ctxt,
         const bvhnode* root,
         const ray& r,
         real t_min, real t_max,
-        Intersection& isect)
+        Intersection& isect,
+        bool isOcclusion/*= false*/)
     {
         // NOTE
         // https://devblogs.nvidia.com/parallelforall/thinking-parallel-part-ii-tree-traversal-gpu/
@@ -226,6 +325,14 @@ namespace aten {
             stackpos -= 1;
 
             if (node->isLeaf()) {
+                if (isOcclusion) {
+                    // Any hit is enough.
+                    if (node->occluded(ctxt, r, t_min, t_max)) {
+                        return true;
+                    }
+                    continue;
+                }
+
                 Intersection isectTmp;
                 if (node->hit(ctxt, r, t_min, t_max, isectTmp)) {
                     if (isectTmp.t < isect.t) {
@@ -254,6 +361,132 @@ namespace aten {
         return (isect.objid >= 0);
     }
 
+    uint32_t bvh::hit(
+        const context& ctxt,
+        const RayPacket& packet,
+        real t_min, real t_max,
+        Intersection* isects) const
+    {
+        return onHit(ctxt, m_root, packet, t_min, t_max, isects, false);
+    }
+
+    uint32_t bvh::occluded(
+        const context& ctxt,
+        const RayPacket& packet,
+        real t_min, real t_max) const
+    {
+        Intersection isects[RayPacket::MaxRayNum];
+        return onHit(ctxt, m_root, packet, t_min, t_max, isects, true);
+    }
+
+    uint32_t bvh::onHit(
+        const context& ctxt,
+        const bvhnode* root,
+        const RayPacket& packet,
+        real t_min, real t_max,
+        Intersection* isects,
+        bool isOcclusion)
+    {
+        // NOTE
+        // The packet is traversed with one stack.
+        // Each entry has the mask of the rays which reach the node.
+
+        if (!root) {
+            return 0;
+        }
+
+        static const uint32_t stacksize = 64;
+
+        struct Entry {
+            const bvhnode* node;
+            uint32_t mask;
+        } stackbuf[stacksize];
+
+        const RayPacketTraverseRays rays(packet);
+
+        real tmax[RayPacket::MaxRayNum];
+
+        for (uint32_t i = 0; i < RayPacket::MaxRayNum; i++) {
+            tmax[i] = t_max;
+
+            if (packet.activeMask & (1 << i)) {
+                isects[i] = Intersection();
+            }
+        }
+
+        // Mask of the rays which are still traversed.
+        uint32_t activeMask = packet.activeMask;
+
+        uint32_t hitMask = 0;
+
+        stackbuf[0].node = root;
+        stackbuf[0].mask = activeMask;
+        int stackpos = 1;
+
+        while (stackpos > 0 && activeMask > 0) {
+            auto node = stackbuf[stackpos - 1].node;
+            auto mask = stackbuf[stackpos - 1].mask & activeMask;
+
+            stackpos -= 1;
+
+            if (mask == 0) {
+                continue;
+            }
+
+            if (node->isLeaf()) {
+                for (uint32_t i = 0; i < packet.num; i++) {
+                    if ((mask & (1 << i)) == 0) {
+                        continue;
+                    }
+
+                    if (isOcclusion) {
+                        // Any hit is enough.
+                        if (node->occluded(ctxt, packet.rays[i], t_min, tmax[i])) {
+                            hitMask |= (1 << i);
+                            activeMask &= ~(1 << i);
+                        }
+                        continue;
+                    }
+
+                    Intersection isectTmp;
+                    if (node->hit(ctxt, packet.rays[i], t_min, tmax[i], isectTmp)) {
+                        if (isectTmp.t < isects[i].t) {
+                            isects[i] = isectTmp;
+                            tmax[i] = isectTmp.t;
+
+                            hitMask |= (1 << i);
+                        }
+                    }
+                }
+            }
+            else {
+                const auto& bbox = node->getBoundingbox();
+
+                mask = intersectAABB(rays, bbox.minPos(), bbox.maxPos(), t_min, tmax, mask);
+
+                if (mask > 0) {
+                    if (node->m_left) {
+                        stackbuf[stackpos].node = node->m_left;
+                        stackbuf[stackpos].mask = mask;
+                        stackpos++;
+                    }
+                    if (node->m_right) {
+                        stackbuf[stackpos].node = node->m_right;
+                        stackbuf[stackpos].mask = mask;
+                        stackpos++;
+                    }
+
+                    if (stackpos > stacksize) {
+                        AT_ASSERT(false);
+                        return hitMask;
+                    }
+                }
+            }
+        }
+
+        return hitMask;
+    }
+
     template<typename T>
     static void pop_front(std::vector<T>& vec)
     {
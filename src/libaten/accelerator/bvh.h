@@ -31,6 +31,14 @@ namespace aten {
             real t_min, real t_max,
             Intersection& isect) const;
 
+        /**
+         * @brief Test if a ray is occluded by the node.
+         */
+        bool occluded(
+            const context& ctxt,
+            const ray& r,
+            real t_min, real t_max) const;
+
         /**
          * @brief Return a AABB which the node has.
          */
@@ -291,6 +299,46 @@ namespace aten {
         virtual ~bvh() {}
 
     public:
+        /**
+         * @enum BuildMode
+         * @brief Algorithm to find the split position while building the tree.
+         */
+        enum class BuildMode {
+            Sweep,      ///< Full sweep SAH which sorts all items for each axis at each level.
+            Binned,     ///< Binned SAH on centroid bounds with parallel subtree building.
+        };
+
+        /**
+         * @brief Statistics about the latest build.
+         */
+        struct BuildReport {
+            uint32_t nodeNum{ 0 };      ///< Number of all nodes.
+            uint32_t leafNum{ 0 };      ///< Number of leaf nodes.
+            real sahCost{ real(0) };    ///< SAH cost of the whole tree.
+            real elapsed{ real(0) };    ///< Elapsed time to build the tree [ms].
+        };
+
+        /**
+         * @brief Set the algorithm to build the tree for all bvh which will be built after this.
+         */
+        static void setBuildMode(BuildMode mode, uint32_t binNum = 16);
+
+        /**
+         * @brief Return the algorithm to build the tree.
+         */
+        static BuildMode getBuildMode()
+        {
+            return s_buildMode;
+        }
+
+        /**
+         * @brief Return statistics about the latest build.
+         */
+        const BuildReport& getBuildReport() const
+        {
+            return m_report;
+        }
+
         /**
          * @brief Bulid structure tree from the specified list.
          */
@@ -322,6 +370,34 @@ namespace aten {
             return hit(ctxt, r, t_min, t_max, isect);
         }
 
+        /**
+         * @brief Test if a ray is occluded by any objects.
+         */
+        virtual bool occluded(
+            const context& ctxt,
+            const ray& r,
+            real t_min, real t_max) const override;
+
+        /**
+         * @brief Test if rays in the packet hit objects.
+         */
+        virtual uint32_t hit(
+            const context& ctxt,
+            const RayPacket& packet,
+            real t_min, real t_max,
+            Intersection* isects) const override;
+
+        /**
+         * @brief Test if rays in the packet are occluded by any objects.
+         */
+        virtual uint32_t occluded(
+            const context& ctxt,
+            const RayPacket& packet,
+            real t_min, real t_max) const override;
+
+        using accelerator::hit;
+        using accelerator::occluded;
+
         /**
          * @brief Return AABB.
          */
@@ -465,13 +541,27 @@ namespace aten {
 
         /**
          * @brief Test whether a ray is hit to a object.
+         * @param isOcclusion Flag if the traversal is terminated at the first hit.
          */
         static bool onHit(
             const context& ctxt,
             const bvhnode* root,
             const ray& r,
             real t_min, real t_max,
-            Intersection& isect);
+            Intersection& isect,
+            bool isOcclusion = false);
+
+        /**
+         * @brief Test whether rays in the packet are hit to objects.
+         * @param isOcclusion Flag if the traversal is terminated at any hit for each ray.
+         */
+        static uint32_t onHit(
+            const context& ctxt,
+            const bvhnode* root,
+            const RayPacket& packet,
+            real t_min, real t_max,
+            Intersection* isects,
+            bool isOcclusion);
 
         /**
          * @brief Build the tree with Sufrace Area Heuristic.
@@ -483,6 +573,48 @@ namespace aten {
             int depth,
             bvhnode* parent);
 
+        struct BinnedPrimitive;
+
+        /**
+         * @brief Build the tree with binned Sufrace Area Heuristic.
+         */
+        void buildByBinnedSAH(
+            hitable** list,
+            uint32_t num);
+
+        /**
+         * @brief Build the sub tree with binned Sufrace Area Heuristic serially.
+         */
+        void buildSubTreeByBinnedSAH(
+            bvhnode* root,
+            BinnedPrimitive* prims,
+            uint32_t num,
+            int depth);
+
+        /**
+         * @brief Compute AABB of the node, and partition the items into two groups with binned SAH.
+         * @return Number of the items in the left group.
+         */
+        uint32_t splitByBinnedSAH(
+            bvhnode* root,
+            BinnedPrimitive* prims,
+            uint32_t num,
+            bool enableParallel);
+
+        /**
+         * @brief Register the items as leaves to the node which has only one or two items.
+         */
+        void registerLeaves(
+            bvhnode* root,
+            BinnedPrimitive* prims,
+            uint32_t num,
+            int depth);
+
+        /**
+         * @brief Compute statistics about the built tree.
+         */
+        void computeBuildReport();
+
         struct Candidate {
             bvhnode* node{ nullptr };
             bvhnode* instanceNode{ nullptr };
@@ -510,5 +642,14 @@ namespace aten {
 
         // Array of the node which will be re-fitted.
         std::vector<bvhnode*> m_refitNodes;
+
+        // Statistics about the latest build.
+        BuildReport m_report;
+
+        // Algorithm to build the tree.
+        static BuildMode s_buildMode;
+
+        // Number of bins per axis for binned SAH.
+        static uint32_t s_binNum;
     };
 }
@@ -0,0 +1,521 @@
+#include <algorithm>
+
+#include "accelerator/bvh8.h"
+#include "geometry/face.h"
+#include "geometry/transformable.h"
+
+// NOTE
+// Efficient Incoherent Ray Traversal on GPUs Through Compressed Wide BVHs.
+// https://research.nvidia.com/publication/2017-07_Efficient-Incoherent-Ray
+// Shallow Bounding Volume Hierarchies for Fast SIMD Ray Tracing of Incoherent Rays.
+// https://www.uni-ulm.de/fileadmin/website_uni_ulm/iui.inst.100/institut/Papers/QBVH.pdf
+
+// NOTE
+// 8-wide AVX is used if it is enabled by compiler option (ex. /arch:AVX2, -mavx2).
+// Otherwise, 8 children are tested by two 4-wide SSE on x64.
+// If real is double, float SIMD is not available.
+#if !defined(TYPE_DOUBLE) && defined(__AVX__)
+#define AT_ENABLE_BVH8_AVX
+#include <immintrin.h>
+#elif !defined(TYPE_DOUBLE) && (defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64))
+#define AT_ENABLE_BVH8_SSE
+#include <immintrin.h>
+#endif
+
+//#pragma optimize( "", off)
+
+namespace aten
+{
+    void bvh8::build(
+        const context& ctxt,
+        hitable** list,
+        uint32_t num,
+        aabb* bbox)
+    {
+        m_bvh.build(ctxt, list, num, bbox);
+
+        setBoundingBox(m_bvh.getBoundingbox());
+
+        convertFromBvh(ctxt);
+    }
+
+    int bvh8::collapseChildren(
+        bvhnode* node,
+        bvhnode* children[8])
+    {
+        int num = 0;
+
+        if (node->getLeft()) {
+            children[num++] = node->getLeft();
+        }
+        if (node->getRight()) {
+            children[num++] = node->getRight();
+        }
+
+        // Open the internal child which has the largest surface area until there are 8 children.
+        // Larger child is hit by more rays, so opening it reduces the number of nodes to be visited.
+        while (num < 8) {
+            int opened = -1;
+            real maxArea = real(-1);
+
+            for (int i = 0; i < num; i++) {
+                auto child = children[i];
+
+                if (child->isLeaf()) {
+                    continue;
+                }
+
+                // NOTE
+                // The internal node which has only one child is always opened.
+                int childNum = (child->getLeft() ? 1 : 0) + (child->getRight() ? 1 : 0);
+                if (num - 1 + childNum > 8) {
+                    continue;
+                }
+
+                auto area = childNum == 1
+                    ? AT_MATH_INF
+                    : child->getBoundingbox().computeSurfaceArea();
+
+                if (area > maxArea) {
+                    maxArea = area;
+                    opened = i;
+                }
+            }
+
+            if (opened < 0) {
+                break;
+            }
+
+            auto target = children[opened];
+
+            auto left = target->getLeft();
+            auto right = target->getRight();
+
+            if (left && right) {
+                children[opened] = left;
+                children[num++] = right;
+            }
+            else {
+                children[opened] = (left ? left : right);
+            }
+        }
+
+        return num;
+    }
+
+    int bvh8::registerLeaf(
+        const context& ctxt,
+        bvhnode* node)
+    {
+        Bvh8Leaf leaf;
+
+        hitable* item = node->getItem();
+
+        leaf.shapeid = ctxt.findTransformableIdxFromPointer(item);
+
+        // Get the instance's object.
+        auto internalObj = item->getHasObject();
+
+        if (internalObj) {
+            item = const_cast<hitable*>(internalObj);
+        }
+
+        leaf.meshid = item->geomid();
+
+        if (m_isNested) {
+            // Leaves of this tree are primitive.
+            leaf.primid = ctxt.findTriIdxFromPointer(item);
+        }
+
+        int idx = (int)m_leaves.size();
+        m_leaves.push_back(leaf);
+
+        return idx;
+    }
+
+    void bvh8::convertFromBvh(const context& ctxt)
+    {
+        m_nodes.clear();
+        m_leaves.clear();
+
+        auto root = m_bvh.getRoot();
+
+        if (!root) {
+            return;
+        }
+
+        struct StackEntry {
+            bvhnode* node;
+            int nodeIdx;
+        };
+
+        std::vector<StackEntry> stack;
+
+        m_nodes.push_back(Bvh8Node());
+        stack.push_back({ root, 0 });
+
+        bvhnode* children[8];
+
+        while (!stack.empty()) {
+            auto entry = stack.back();
+            stack.pop_back();
+
+            int numChildren = 0;
+
+            if (entry.node->isLeaf()) {
+                // NOTE
+                // Root might be leaf.
+                children[0] = entry.node;
+                numChildren = 1;
+            }
+            else {
+                numChildren = collapseChildren(entry.node, children);
+            }
+
+            // NOTE
+            // m_nodes might be re-allocated while registering children.
+            // So, fill the node after all children are registered.
+            Bvh8Node node;
+            node.numChildren = numChildren;
+
+            for (int i = 0; i < 8; i++) {
+                if (i < numChildren) {
+                    auto child = children[i];
+
+                    const auto& bbox = child->getBoundingbox();
+                    const auto& bmin = bbox.minPos();
+                    const auto& bmax = bbox.maxPos();
+
+                    node.bminx[i] = (float)bmin.x;
+                    node.bminy[i] = (float)bmin.y;
+                    node.bminz[i] = (float)bmin.z;
+
+                    node.bmaxx[i] = (float)bmax.x;
+                    node.bmaxy[i] = (float)bmax.y;
+                    node.bmaxz[i] = (float)bmax.z;
+
+                    if (child->isLeaf()) {
+                        int leafIdx = registerLeaf(ctxt, child);
+                        node.child[i] = ~leafIdx;
+                    }
+                    else {
+                        int childIdx = (int)m_nodes.size();
+                        m_nodes.push_back(Bvh8Node());
+
+                        node.child[i] = childIdx;
+                        stack.push_back({ child, childIdx });
+                    }
+                }
+                else {
+                    // Empty AABB never be hit.
+                    node.bminx[i] = node.bminy[i] = node.bminz[i] = AT_MATH_INF;
+                    node.bmaxx[i] = node.bmaxy[i] = node.bmaxz[i] = -AT_MATH_INF;
+
+                    node.child[i] = 0;
+                }
+            }
+
+            m_nodes[entry.nodeIdx] = node;
+        }
+    }
+
+    /**
+     * @brief Ray description which is computed once per traversal to test AABB.
+     */
+    struct Bvh8TraverseRay {
+        aten::vec3 invdir;      ///< Inverse of ray direction.
+        aten::vec3 orgInvdir;   ///< Ray origin multiplied by inverse of ray direction.
+        int isNegative[3];      ///< Flag if ray direction is negative per axis.
+
+        Bvh8TraverseRay(const aten::ray& r)
+        {
+            // NOTE
+            // Avoid 0 division, but keep the sign of the direction.
+            static const real eps = real(1e-20);
+
+            for (int i = 0; i < 3; i++) {
+                auto d = r.dir[i];
+                d = (aten::abs(d) > eps ? d : (d < real(0) ? -eps : eps));
+
+                invdir[i] = real(1) / d;
+                orgInvdir[i] = r.org[i] * invdir[i];
+                isNegative[i] = (d < real(0));
+            }
+        }
+    };
+
+    // Return bit mask of the children which ray hits, and distance to the children.
+    inline int intersectAABB(
+        float* result,
+        const Bvh8TraverseRay& r,
+        real t_min, real t_max,
+        const Bvh8Node& node)
+    {
+        // NOTE
+        // Near and far planes are selected by the sign of the ray direction.
+        const float* nearX = r.isNegative[0] ? node.bmaxx : node.bminx;
+        const float* farX = r.isNegative[0] ? node.bminx : node.bmaxx;
+        const float* nearY = r.isNegative[1] ? node.bmaxy : node.bminy;
+        const float* farY = r.isNegative[1] ? node.bminy : node.bmaxy;
+        const float* nearZ = r.isNegative[2] ? node.bmaxz : node.bminz;
+        const float* farZ = r.isNegative[2] ? node.bminz : node.bmaxz;
+
+#if defined(AT_ENABLE_BVH8_AVX)
+        const __m256 invdx = _mm256_set1_ps(r.invdir.x);
+        const __m256 invdy = _mm256_set1_ps(r.invdir.y);
+        const __m256 invdz = _mm256_set1_ps(r.invdir.z);
+
+        const __m256 ox = _mm256_set1_ps(r.orgInvdir.x);
+        const __m256 oy = _mm256_set1_ps(r.orgInvdir.y);
+        const __m256 oz = _mm256_set1_ps(r.orgInvdir.z);
+
+#ifdef __FMA__
+        __m256 nx = _mm256_fmsub_ps(_mm256_loadu_ps(nearX), invdx, ox);
+        __m256 fx = _mm256_fmsub_ps(_mm256_loadu_ps(farX), invdx, ox);
+        __m256 ny = _mm256_fmsub_ps(_mm256_loadu_ps(nearY), invdy, oy);
+        __m256 fy = _mm256_fmsub_ps(_mm256_loadu_ps(farY), invdy, oy);
+        __m256 nz = _mm256_fmsub_ps(_mm256_loadu_ps(nearZ), invdz, oz);
+        __m256 fz = _mm256_fmsub_ps(_mm256_loadu_ps(farZ), invdz, oz);
+#else
+        __m256 nx = _mm256_sub_ps(_mm256_mul_ps(_mm256_loadu_ps(nearX), invdx), ox);
+        __m256 fx = _mm256_sub_ps(_mm256_mul_ps(_mm256_loadu_ps(farX), invdx), ox);
+        __m256 ny = _mm256_sub_ps(_mm256_mul_ps(_mm256_loadu_ps(nearY), invdy), oy);
+        __m256 fy = _mm256_sub_ps(_mm256_mul_ps(_mm256_loadu_ps(farY), invdy), oy);
+        __m256 nz = _mm256_sub_ps(_mm256_mul_ps(_mm256_loadu_ps(nearZ), invdz), oz);
+        __m256 fz = _mm256_sub_ps(_mm256_mul_ps(_mm256_loadu_ps(farZ), invdz), oz);
+#endif
+
+        __m256 t0 = _mm256_max_ps(_mm256_max_ps(nx, ny), _mm256_max_ps(nz, _mm256_set1_ps(t_min)));
+        __m256 t1 = _mm256_min_ps(_mm256_min_ps(fx, fy), _mm256_min_ps(fz, _mm256_set1_ps(t_max)));
+
+        _mm256_storeu_ps(result, t0);
+
+        return _mm256_movemask_ps(_mm256_cmp_ps(t0, t1, _CMP_LE_OQ));
+#elif defined(AT_ENABLE_BVH8_SSE)
+        const __m128 invdx = _mm_set1_ps(r.invdir.x);
+        const __m128 invdy = _mm_set1_ps(r.invdir.y);
+        const __m128 invdz = _mm_set1_ps(r.invdir.z);
+
+        const __m128 ox = _mm_set1_ps(r.orgInvdir.x);
+        const __m128 oy = _mm_set1_ps(r.orgInvdir.y);
+        const __m128 oz = _mm_set1_ps(r.orgInvdir.z);
+
+        const __m128 tmin = _mm_set1_ps(t_min);
+        const __m128 tmax = _mm_set1_ps(t_max);
+
+        int ret = 0;
+
+        for (int i = 0; i < 8; i += 4) {
+            __m128 nx = _mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(nearX + i), invdx), ox);
+            __m128 fx = _mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(farX + i), invdx), ox);
+            __m128 ny = _mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(nearY + i), invdy), oy);
+            __m128 fy = _mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(farY + i), invdy), oy);
+            __m128 nz = _mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(nearZ + i), invdz), oz);
+            __m128 fz = _mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(farZ + i), invdz), oz);
+
+            __m128 t0 = _mm_max_ps(_mm_max_ps(nx, ny), _mm_max_ps(nz, tmin));
+            __m128 t1 = _mm_min_ps(_mm_min_ps(fx, fy), _mm_min_ps(fz, tmax));
+
+            _mm_storeu_ps(result + i, t0);
+
+            ret |= _mm_movemask_ps(_mm_cmple_ps(t0, t1)) << i;
+        }
+
+        return ret;
+#else
+        int ret = 0;
+
+        for (int i = 0; i < 8; i++) {
+            real nx = nearX[i] * r.invdir.x - r.orgInvdir.x;
+            real fx = farX[i] * r.invdir.x - r.orgInvdir.x;
+            real ny = nearY[i] * r.invdir.y - r.orgInvdir.y;
+            real fy = farY[i] * r.invdir.y - r.orgInvdir.y;
+            real nz = nearZ[i] * r.invdir.z - r.orgInvdir.z;
+            real fz = farZ[i] * r.invdir.z - r.orgInvdir.z;
+
+            real t0 = std::max(std::max(nx, ny), std::max(nz, t_min));
+            real t1 = std::min(std::min(fx, fy), std::min(fz, t_max));
+
+            result[i] = (float)t0;
+
+            ret |= (t0 <= t1 ? 1 : 0) << i;
+        }
+
+        return ret;
+#endif
+    }
+
+    bool bvh8::hitLeaf(
+        const context& ctxt,
+        const Bvh8Leaf& leaf,
+        const ray& r,
+        real t_min, real t_max,
+        Intersection& isect,
+        bool isOcclusion) const
+    {
+        bool isHit = false;
+
+        auto s = leaf.shapeid >= 0 ? ctxt.getTransformable(leaf.shapeid) : nullptr;
+
+        if (leaf.primid >= 0) {
+            // Hit test for a primitive.
+            isHit = face::hit(ctxt, leaf.primid, r, t_min, t_max, isect);
+            if (isHit) {
+                // Set dummy to return if ray hit.
+                isect.objid = s ? s->id() : 1;
+            }
+        }
+        else if (isOcclusion) {
+            isHit = s->occluded(ctxt, r, t_min, t_max);
+        }
+        else {
+            // Hit test for a shape.
+            isHit = s->hit(ctxt, r, t_min, t_max, isect);
+        }
+
+        return isHit;
+    }
+
+    bool bvh8::hit(
+        const context& ctxt,
+        const ray& r,
+        real t_min, real t_max,
+        Intersection& isect) const
+    {
+        return onHit(ctxt, r, t_min, t_max, isect, false);
+    }
+
+    bool bvh8::occluded(
+        const context& ctxt,
+        const ray& r,
+        real t_min, real t_max) const
+    {
+        Intersection isect;
+        return onHit(ctxt, r, t_min, t_max, isect, true);
+    }
+
+    bool bvh8::onHit(
+        const context& ctxt,
+        const ray& r,
+        real t_min, real t_max,
+        Intersection& isect,
+        bool isOcclusion) const
+    {
+        if (m_nodes.empty()) {
+            return false;
+        }
+
+        static const int stacksize = 256;
+
+        struct Intersect {
+            int child;
+            real t;
+        } stackbuf[stacksize];
+
+        stackbuf[0].child = 0;
+        stackbuf[0].t = t_min;
+        int stackpos = 1;
+
+        const Bvh8TraverseRay traverseRay(r);
+
+        float intersectT[8];
+
+        while (stackpos > 0) {
+            const auto entry = stackbuf[--stackpos];
+
+            if (entry.t > t_max) {
+                continue;
+            }
+
+            if (entry.child < 0) {
+                // Leaf.
+                Intersection isectTmp;
+
+                const auto& leaf = m_leaves[~entry.child];
+
+                if (hitLeaf(ctxt, leaf, r, t_min, t_max, isectTmp, isOcclusion)) {
+                    if (isOcclusion) {
+                        // Any hit is enough.
+                        return true;
+                    }
+
+                    if (isectTmp.t < isect.t) {
+                        isect = isectTmp;
+                        t_max = isect.t;
+                    }
+                }
+
+                continue;
+            }
+
+            const auto& node = m_nodes[entry.child];
+
+            auto res = intersectAABB(
+                intersectT,
+                traverseRay,
+                t_min, t_max,
+                node);
+
+            res &= (1 << node.numChildren) - 1;
+
+            if (res == 0) {
+                continue;
+            }
+
+            // Sort hit children by distance in descending order.
+            int hitChildren[8];
+            int hitNum = 0;
+
+            for (int i = 0; i < node.numChildren; i++) {
+                if ((res & (1 << i)) > 0) {
+                    int pos = hitNum++;
+
+                    while (pos > 0 && intersectT[hitChildren[pos - 1]] < intersectT[i]) {
+                        hitChildren[pos] = hitChildren[pos - 1];
+                        pos--;
+                    }
+
+                    hitChildren[pos] = i;
+                }
+            }
+
+            AT_ASSERT(stackpos + hitNum <= stacksize);
+
+            // Stack hit children from far to near, so that the nearest child is traversed first.
+            for (int i = 0; i < hitNum; i++) {
+                auto idx = hitChildren[i];
+
+                stackbuf[stackpos].child = node.child[idx];
+                stackbuf[stackpos].t = intersectT[idx];
+                stackpos++;
+            }
+        }
+
+        return (isect.objid >= 0);
+    }
+
+    void bvh8::drawAABB(
+        aten::hitable::FuncDrawAABB func,
+        const aten::mat4& mtxL2W)
+    {
+        for (const auto& node : m_nodes) {
+            for (int i = 0; i < node.numChildren; i++) {
+                aabb bbox(
+                    vec3(node.bminx[i], node.bminy[i], node.bminz[i]),
+                    vec3(node.bmaxx[i], node.bmaxy[i], node.bmaxz[i]));
+
+                auto transofrmedBox = aten::aabb::transform(bbox, mtxL2W);
+
+                aten::mat4 mtxScale;
+                mtxScale.asScale(transofrmedBox.size());
+
+                aten::mat4 mtxTrans;
+                mtxTrans.asTrans(transofrmedBox.minPos());
+
+                aten::mat4 mtx = mtxTrans * mtxScale;
+
+                func(mtx);
+            }
+        }
+    }
+}
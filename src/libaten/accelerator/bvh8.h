@@ -0,0 +1,170 @@
+#pragma once
+
+#include <vector>
+
+#include "scene/hitable.h"
+#include "accelerator/accelerator.h"
+#include "accelerator/bvh.h"
+
+namespace aten
+{
+    /**
+     * @brief Description for the node in 8-wide BVH.
+     * @note AABBs of the children are stored as SoA to test all children at once.
+     */
+    struct Bvh8Node {
+        float bminx[8];     ///< AABB min position x of the children.
+        float bmaxx[8];     ///< AABB max position x of the children.
+        float bminy[8];     ///< AABB min position y of the children.
+        float bmaxy[8];     ///< AABB max position y of the children.
+        float bminz[8];     ///< AABB min position z of the children.
+        float bmaxz[8];     ///< AABB max position z of the children.
+
+        /**
+         * Index of the children.
+         * If it is zero or positive, it is the index of the internal node.
+         * If it is negative, it is the index of the leaf as ~index.
+         */
+        int child[8];
+
+        int numChildren{ 0 };   ///< Number of children.
+        int padding[7];
+    };
+
+    /**
+     * @brief Description for the item which the leaf in 8-wide BVH has.
+     */
+    struct Bvh8Leaf {
+        int shapeid{ -1 };  ///< Object index.
+        int primid{ -1 };   ///< Triangle index.
+        int meshid{ -1 };   ///< Mesh id.
+        int padding{ 0 };
+    };
+
+    /**
+     * @brief 8-wide Bounding Volume Hierarchies.
+     *
+     * The tree is made by collapsing the binary bvh tree.
+     * The child which has the largest surface area is opened until a node has 8 children.
+     */
+    class bvh8 : public accelerator {
+    public:
+        bvh8() : accelerator(AccelType::Bvh8) {}
+        virtual ~bvh8() {}
+
+    public:
+        /**
+         * @brief Bulid structure tree from the specified list.
+         */
+        virtual void build(
+            const context& ctxt,
+            hitable** list,
+            uint32_t num,
+            aabb* bbox) override final;
+
+        /**
+         * @brief Test if a ray hits a object.
+         */
+        virtual bool hit(
+            const context& ctxt,
+            const ray& r,
+            real t_min, real t_max,
+            Intersection& isect) const override;
+
+        /**
+         * @brief Test if a ray hits a object.
+         */
+        virtual bool hit(
+            const context& ctxt,
+            const ray& r,
+            real t_min, real t_max,
+            bool enableLod,
+            Intersection& isect) const override
+        {
+            return hit(ctxt, r, t_min, t_max, isect);
+        }
+
+        /**
+         * @brief Test if a ray is occluded by any objects.
+         */
+        virtual bool occluded(
+            const context& ctxt,
+            const ray& r,
+            real t_min, real t_max) const override;
+
+        using accelerator::hit;
+        using accelerator::occluded;
+
+        /**
+         * @brief Draw all node's AABB in the structure tree.
+         */
+        virtual void drawAABB(
+            aten::hitable::FuncDrawAABB func,
+            const aten::mat4& mtxL2W) override final;
+
+        /**
+         * @brief Return all nodes.
+         */
+        const std::vector<Bvh8Node>& getNodes() const
+        {
+            return m_nodes;
+        }
+
+        /**
+         * @brief Return all leaves.
+         */
+        const std::vector<Bvh8Leaf>& getLeaves() const
+        {
+            return m_leaves;
+        }
+
+    private:
+        /**
+         * @brief Convert the binary bvh tree to 8-wide tree.
+         */
+        void convertFromBvh(const context& ctxt);
+
+        /**
+         * @brief Gather at most 8 descendants of the node to be children of 8-wide node.
+         * @return Number of the gathered descendants.
+         */
+        static int collapseChildren(
+            bvhnode* node,
+            bvhnode* children[8]);
+
+        /**
+         * @brief Register the item which the leaf has, and return its index.
+         */
+        int registerLeaf(
+            const context& ctxt,
+            bvhnode* node);
+
+        /**
+         * @brief Test if a ray hits the item which the leaf has.
+         */
+        bool hitLeaf(
+            const context& ctxt,
+            const Bvh8Leaf& leaf,
+            const ray& r,
+            real t_min, real t_max,
+            Intersection& isect,
+            bool isOcclusion) const;
+
+        /**
+         * @brief Traverse the tree.
+         * @param isOcclusion Flag if the traversal is terminated at the first hit.
+         */
+        bool onHit(
+            const context& ctxt,
+            const ray& r,
+            real t_min, real t_max,
+            Intersection& isect,
+            bool isOcclusion) const;
+
+    private:
+        bvh m_bvh;
+
+        std::vector<Bvh8Node> m_nodes;
+        std::vector<Bvh8Leaf> m_leaves;
+    };
+}
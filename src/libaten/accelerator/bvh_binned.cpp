@@ -0,0 +1,403 @@
+#include <algorithm>
+#include <vector>
+
+#include "accelerator/bvh.h"
+#include "misc/omputil.h"
+
+// NOTE
+// On fast Construction of SAH-based Bounding Volume Hierarchies.
+// http://www.sci.utah.edu/~wald/Publications/2007/ParallelBVHBuild/fastbuild.pdf
+
+namespace aten
+{
+    bvh::BuildMode bvh::s_buildMode = bvh::BuildMode::Sweep;
+    uint32_t bvh::s_binNum = 16;
+
+    // Max number of bins per axis.
+    static const uint32_t MaxBinNum = 64;
+
+    // Minimum number of items in the node to compute bins with multiple threads.
+    static const uint32_t ParallelBinningThreshold = 1 << 16;
+
+    // Minimum number of items in the sub tree which is built as one task.
+    static const uint32_t MinSubTreeItemNum = 256;
+
+    struct bvh::BinnedPrimitive {
+        hitable* item{ nullptr };
+        aabb bbox;
+        vec3 center;
+    };
+
+    struct BinnedSAHBin {
+        aabb bbox;
+        uint32_t num{ 0 };
+    };
+
+    void bvh::setBuildMode(BuildMode mode, uint32_t binNum/*= 16*/)
+    {
+        s_buildMode = mode;
+        s_binNum = aten::clamp<uint32_t>(binNum, 2, MaxBinNum);
+    }
+
+    // Return the index of the bin which the centroid belongs to.
+    inline int computeBinnedSAHBinIdx(
+        real center,
+        real minPos,
+        real k,
+        int binNum)
+    {
+        int idx = static_cast<int>((center - minPos) * k);
+        return aten::clamp(idx, 0, binNum - 1);
+    }
+
+    void bvh::buildByBinnedSAH(
+        hitable** list,
+        uint32_t num)
+    {
+        AT_ASSERT(num > 0);
+
+        // Cache AABB and centroid not to call virtual function in binning.
+        std::vector<BinnedPrimitive> prims(num);
+
+#ifdef ENABLE_OMP
+#pragma omp parallel for
+#endif
+        for (int i = 0; i < (int)num; i++) {
+            prims[i].item = list[i];
+            prims[i].bbox = list[i]->getBoundingbox();
+            prims[i].center = prims[i].bbox.getCenter();
+        }
+
+        m_root = new bvhnode(nullptr, nullptr, this);
+
+        struct BuildTask {
+            bvhnode* node;
+            uint32_t start;
+            uint32_t num;
+            int depth;
+
+            BuildTask(bvhnode* n, uint32_t s, uint32_t _num, int d)
+                : node(n), start(s), num(_num), depth(d)
+            {}
+        };
+
+        const auto threadNum = OMPUtil::getThreadNum();
+
+        // The sub tree which has items less than this is built by one thread.
+        uint32_t subTreeThreshold = (threadNum > 1
+            ? std::max(num / (threadNum * 4), MinSubTreeItemNum)
+            : num);
+
+        std::vector<BuildTask> stack;
+        std::vector<BuildTask> subTrees;
+
+        stack.push_back(BuildTask(m_root, 0, num, 0));
+
+        // Split top levels serially, and binning in the node is computed with multiple threads.
+        while (!stack.empty()) {
+            auto task = stack.back();
+            stack.pop_back();
+
+            if (task.num <= 2 || task.num <= subTreeThreshold) {
+                subTrees.push_back(task);
+                continue;
+            }
+
+            auto prim = &prims[task.start];
+
+            auto leftNum = splitByBinnedSAH(task.node, prim, task.num, true);
+            auto rightNum = task.num - leftNum;
+
+            task.node->m_left = new bvhnode(task.node, nullptr, this);
+            task.node->m_right = new bvhnode(task.node, nullptr, this);
+
+            task.node->m_left->setDepth(task.depth + 1);
+            task.node->m_right->setDepth(task.depth + 1);
+
+            stack.push_back(BuildTask(task.node->m_right, task.start + leftNum, rightNum, task.depth + 1));
+            stack.push_back(BuildTask(task.node->m_left, task.start, leftNum, task.depth + 1));
+        }
+
+        // Build sub trees in parallel.
+#ifdef ENABLE_OMP
+#pragma omp parallel for schedule(dynamic, 1)
+#endif
+        for (int i = 0; i < (int)subTrees.size(); i++) {
+            const auto& task = subTrees[i];
+            buildSubTreeByBinnedSAH(task.node, &prims[task.start], task.num, task.depth);
+        }
+
+        // Write back sorted order.
+        for (uint32_t i = 0; i < num; i++) {
+            list[i] = prims[i].item;
+        }
+    }
+
+    void bvh::buildSubTreeByBinnedSAH(
+        bvhnode* root,
+        BinnedPrimitive* prims,
+        uint32_t num,
+        int depth)
+    {
+        AT_ASSERT(num > 0);
+
+        if (num <= 2) {
+            registerLeaves(root, prims, num, depth);
+            return;
+        }
+
+        auto leftNum = splitByBinnedSAH(root, prims, num, false);
+        auto rightNum = num - leftNum;
+
+        root->m_left = new bvhnode(root, nullptr, this);
+        root->m_right = new bvhnode(root, nullptr, this);
+
+        root->m_left->setDepth(depth + 1);
+        root->m_right->setDepth(depth + 1);
+
+        buildSubTreeByBinnedSAH(root->m_left, prims, leftNum, depth + 1);
+        buildSubTreeByBinnedSAH(root->m_right, prims + leftNum, rightNum, depth + 1);
+    }
+
+    void bvh::registerLeaves(
+        bvhnode* root,
+        BinnedPrimitive* prims,
+        uint32_t num,
+        int depth)
+    {
+        AT_ASSERT(0 < num && num <= 2);
+
+        root->m_aabb = prims[0].bbox;
+
+        if (num == 1) {
+            root->m_left = new bvhnode(root, prims[0].item, this);
+
+            root->m_left->setBoundingBox(prims[0].bbox);
+            root->m_left->setDepth(depth + 1);
+        }
+        else {
+            root->m_aabb = aabb::merge(root->m_aabb, prims[1].bbox);
+
+            const auto& minPos = root->m_aabb.minPos();
+            const auto& maxPos = root->m_aabb.maxPos();
+
+            auto size = maxPos - minPos;
+            int axis = (size.x >= size.y && size.x >= size.z
+                ? 0
+                : size.y >= size.z ? 1 : 2);
+
+            // Same order as sorting by the minimum position of AABB.
+            if (prims[1].bbox.minPos()[axis] < prims[0].bbox.minPos()[axis]) {
+                std::swap(prims[0], prims[1]);
+            }
+
+            root->m_left = new bvhnode(root, prims[0].item, this);
+            root->m_right = new bvhnode(root, prims[1].item, this);
+
+            root->m_left->setBoundingBox(prims[0].bbox);
+            root->m_right->setBoundingBox(prims[1].bbox);
+
+            root->m_left->setDepth(depth + 1);
+            root->m_right->setDepth(depth + 1);
+        }
+    }
+
+    uint32_t bvh::splitByBinnedSAH(
+        bvhnode* root,
+        BinnedPrimitive* prims,
+        uint32_t num,
+        bool enableParallel)
+    {
+        AT_ASSERT(num > 2);
+
+        const int binNum = static_cast<int>(s_binNum);
+
+        aabb nodeBox;
+        aabb centerBox;
+
+        // Bins for each axis.
+        BinnedSAHBin bins[3][MaxBinNum];
+
+#ifdef ENABLE_OMP
+        const auto threadNum = OMPUtil::getThreadNum();
+        enableParallel = enableParallel && threadNum > 1 && num >= ParallelBinningThreshold;
+#else
+        enableParallel = false;
+#endif
+
+        if (enableParallel) {
+#ifdef ENABLE_OMP
+            std::vector<aabb> nodeBoxes(threadNum);
+            std::vector<aabb> centerBoxes(threadNum);
+
+#pragma omp parallel for
+            for (int t = 0; t < (int)threadNum; t++) {
+                uint32_t start = (uint32_t)(((uint64_t)num * t) / threadNum);
+                uint32_t end = (uint32_t)(((uint64_t)num * (t + 1)) / threadNum);
+
+                for (uint32_t i = start; i < end; i++) {
+                    nodeBoxes[t].expand(prims[i].bbox);
+                    centerBoxes[t].expand(prims[i].center);
+                }
+            }
+
+            for (uint32_t t = 0; t < threadNum; t++) {
+                nodeBox.expand(nodeBoxes[t]);
+                centerBox.expand(centerBoxes[t]);
+            }
+#endif
+        }
+        else {
+            for (uint32_t i = 0; i < num; i++) {
+                nodeBox.expand(prims[i].bbox);
+                centerBox.expand(prims[i].center);
+            }
+        }
+
+        root->m_aabb = nodeBox;
+
+        const auto& centerMin = centerBox.minPos();
+        const auto centerSize = centerBox.size();
+
+        // Coefficient to convert the position to the bin index.
+        real k[3];
+        for (int axis = 0; axis < 3; axis++) {
+            k[axis] = (centerSize[axis] > real(0)
+                ? binNum * (real(1) - AT_MATH_EPSILON) / centerSize[axis]
+                : real(0));
+        }
+
+        // Fill bins.
+        if (enableParallel) {
+#ifdef ENABLE_OMP
+            std::vector<BinnedSAHBin> threadBins(threadNum * 3 * binNum);
+
+#pragma omp parallel for
+            for (int t = 0; t < (int)threadNum; t++) {
+                uint32_t start = (uint32_t)(((uint64_t)num * t) / threadNum);
+                uint32_t end = (uint32_t)(((uint64_t)num * (t + 1)) / threadNum);
+
+                auto localBins = &threadBins[t * 3 * binNum];
+
+                for (uint32_t i = start; i < end; i++) {
+                    for (int axis = 0; axis < 3; axis++) {
+                        int idx = computeBinnedSAHBinIdx(prims[i].center[axis], centerMin[axis], k[axis], binNum);
+
+                        auto& bin = localBins[axis * binNum + idx];
+                        bin.bbox.expand(prims[i].bbox);
+                        bin.num++;
+                    }
+                }
+            }
+
+            for (uint32_t t = 0; t < threadNum; t++) {
+                auto localBins = &threadBins[t * 3 * binNum];
+
+                for (int axis = 0; axis < 3; axis++) {
+                    for (int b = 0; b < binNum; b++) {
+                        const auto& src = localBins[axis * binNum + b];
+                        bins[axis][b].bbox.expand(src.bbox);
+                        bins[axis][b].num += src.num;
+                    }
+                }
+            }
+#endif
+        }
+        else {
+            for (uint32_t i = 0; i < num; i++) {
+                for (int axis = 0; axis < 3; axis++) {
+                    int idx = computeBinnedSAHBinIdx(prims[i].center[axis], centerMin[axis], k[axis], binNum);
+
+                    auto& bin = bins[axis][idx];
+                    bin.bbox.expand(prims[i].bbox);
+                    bin.num++;
+                }
+            }
+        }
+
+        // Same estimation as the sweep SAH.
+        static const real T_tri = 1;
+        static const real T_aabb = 1;
+
+        auto rootSurfaceArea = nodeBox.computeSurfaceArea();
+
+        real bestCost = AT_MATH_INF;
+        int bestAxis = -1;
+        int bestSplit = -1;
+
+        for (int axis = 0; axis < 3; axis++) {
+            if (centerSize[axis] <= real(0)) {
+                continue;
+            }
+
+            // Surface area and count of the left side when splitting at the boundary of bin i.
+            real leftArea[MaxBinNum];
+            uint32_t leftNum[MaxBinNum];
+
+            aabb leftBox;
+            uint32_t leftCnt = 0;
+
+            for (int i = 0; i < binNum - 1; i++) {
+                leftBox.expand(bins[axis][i].bbox);
+                leftCnt += bins[axis][i].num;
+
+                leftArea[i + 1] = leftBox.computeSurfaceArea();
+                leftNum[i + 1] = leftCnt;
+            }
+
+            aabb rightBox;
+            uint32_t rightCnt = 0;
+
+            for (int i = binNum - 1; i > 0; i--) {
+                rightBox.expand(bins[axis][i].bbox);
+                rightCnt += bins[axis][i].num;
+
+                if (leftNum[i] == 0 || rightCnt == 0) {
+                    continue;
+                }
+
+                auto cost = 2 * T_aabb
+                    + (leftArea[i] * leftNum[i] + rightBox.computeSurfaceArea() * rightCnt) * T_tri / rootSurfaceArea;
+
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = i;
+                }
+            }
+        }
+
+        uint32_t leftNum = 0;
+
+        if (bestAxis >= 0) {
+            const auto minPos = centerMin[bestAxis];
+            const auto coeff = k[bestAxis];
+
+            auto mid = std::partition(
+                prims, prims + num,
+                [&](const BinnedPrimitive& prim) {
+                int idx = computeBinnedSAHBinIdx(prim.center[bestAxis], minPos, coeff, binNum);
+                return idx < bestSplit;
+            });
+
+            leftNum = static_cast<uint32_t>(mid - prims);
+        }
+
+        if (leftNum == 0 || leftNum == num) {
+            // All centroids are in the same bin, so split at the middle of the longest axis.
+            int axis = (centerSize.x >= centerSize.y && centerSize.x >= centerSize.z
+                ? 0
+                : centerSize.y >= centerSize.z ? 1 : 2);
+
+            leftNum = num / 2;
+
+            std::nth_element(
+                prims, prims + leftNum, prims + num,
+                [&](const BinnedPrimitive& a, const BinnedPrimitive& b) {
+                return a.center[axis] < b.center[axis];
+            });
+        }
+
+        return leftNum;
+    }
+}
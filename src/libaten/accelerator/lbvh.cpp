@@ -0,0 +1,462 @@
+#include <algorithm>
+#include <vector>
+
+#include "accelerator/lbvh.h"
+#include "geometry/face.h"
+#include "geometry/transformable.h"
+#include "math/morton.h"
+#include "misc/omputil.h"
+#include "misc/radixsort.h"
+#include "misc/timer.h"
+
+//#pragma optimize( "", off)
+
+// NOTE
+// http://research.nvidia.com/sites/default/files/publications/karras2012hpg_paper.pdf
+// http://devblogs.nvidia.com/parallelforall/thinking-parallel-part-iii-tree-construction-gpu/
+
+namespace aten
+{
+    LBVH::MortonCodeType LBVH::s_mortonCodeType = LBVH::MortonCodeType::Bit30;
+
+    inline int countLeadingZeros(uint32_t x)
+    {
+        return aten::clz(x);
+    }
+
+    inline int countLeadingZeros(uint64_t x)
+    {
+        uint32_t hi = (uint32_t)(x >> 32);
+        return hi != 0
+            ? aten::clz(hi)
+            : 32 + aten::clz((uint32_t)x);
+    }
+
+    // Return the length of the longest common prefix between the codes.
+    // If the codes are same, the indices are used as fallback.
+    template <typename T>
+    inline int computeLongestCommonPrefix(
+        const T* sortedCodes,
+        int num,
+        int idx0, int idx1)
+    {
+        if (idx1 < 0 || idx1 >= num) {
+            // NOTE
+            // delta(i, j) = -1 when not (0 <= j <= n - 1).
+            return -1;
+        }
+
+        auto code0 = sortedCodes[idx0];
+        auto code1 = sortedCodes[idx1];
+
+        if (code0 == code1) {
+            return (int)(sizeof(T) * 8) + countLeadingZeros((uint32_t)(idx0 ^ idx1));
+        }
+
+        return countLeadingZeros(code0 ^ code1);
+    }
+
+    void LBVH::build(
+        const context& ctxt,
+        hitable** list,
+        uint32_t num,
+        aabb* bbox)
+    {
+        m_items.assign(list, list + num);
+
+        registerLeafParams(ctxt);
+
+        onBuild();
+    }
+
+    void LBVH::update(const context& ctxt)
+    {
+        // Items are not changed, but they might move.
+        // So, rebuild whole tree.
+        onBuild();
+    }
+
+    void LBVH::registerLeafParams(const context& ctxt)
+    {
+        auto num = (int)m_items.size();
+        m_leafParams.resize(num);
+
+#ifdef ENABLE_OMP
+#pragma omp parallel for
+#endif
+        for (int i = 0; i < num; i++) {
+            hitable* item = m_items[i];
+            auto& param = m_leafParams[i];
+
+            param.shapeid = (float)ctxt.findTransformableIdxFromPointer(item);
+
+            // Get the instance's object.
+            auto internalObj = item->getHasObject();
+
+            if (internalObj) {
+                item = const_cast<hitable*>(internalObj);
+            }
+
+            param.meshid = (float)item->geomid();
+
+            if (m_isNested) {
+                // Leaves of this tree are primitive.
+                param.primid = (float)ctxt.findTriIdxFromPointer(item);
+            }
+            else {
+                // NOTE
+                // On CPU, the object which the leaf has is traversed by itself.
+                // So, external tree is not necessary.
+                param.primid = -1.0f;
+            }
+        }
+    }
+
+    void LBVH::onBuild()
+    {
+        timer timer;
+        timer.begin();
+
+        auto num = (int)m_items.size();
+
+        m_nodes.clear();
+
+        if (num == 0) {
+            m_lbvhNodes.clear();
+            m_sortedIndices.clear();
+            setBoundingBox(aabb());
+            return;
+        }
+
+        // Cache AABB not to call virtual function in building.
+        std::vector<aabb> bboxes(num);
+
+        auto threadNum = OMPUtil::getThreadNum();
+        std::vector<aabb> centerBoxes(threadNum);
+
+        for (auto& box : centerBoxes) {
+            box.empty();
+        }
+
+#ifdef ENABLE_OMP
+#pragma omp parallel for
+#endif
+        for (int i = 0; i < num; i++) {
+            bboxes[i] = m_items[i]->getBoundingbox();
+
+            auto idx = OMPUtil::getThreadIdx();
+            centerBoxes[idx].expand(bboxes[i].getCenter());
+        }
+
+        aabb centerBox = centerBoxes[0];
+        for (uint32_t i = 1; i < threadNum; i++) {
+            centerBox.expand(centerBoxes[i]);
+        }
+
+        if (s_mortonCodeType == MortonCodeType::Bit63) {
+            sortByMortonCode<uint64_t>(bboxes, centerBox);
+        }
+        else {
+            sortByMortonCode<uint32_t>(bboxes, centerBox);
+        }
+
+        registerThreadedBvhNode(bboxes);
+
+        setBoundingBox(aabb(m_nodes[0].boxmin, m_nodes[0].boxmax));
+
+        m_elapsed = timer.end();
+    }
+
+    template <typename T>
+    void LBVH::sortByMortonCode(
+        const std::vector<aabb>& bboxes,
+        const aabb& centerBox)
+    {
+        auto num = (int)bboxes.size();
+
+        std::vector<T> codes(num);
+        m_sortedIndices.resize(num);
+
+        // Compute Morton codes from the centroids which are normalized in the scene's bounds.
+        const auto& minPos = centerBox.minPos();
+        auto size = centerBox.size();
+
+        vec3 invSize(
+            size.x > real(0) ? real(1) / size.x : real(0),
+            size.y > real(0) ? real(1) / size.y : real(0),
+            size.z > real(0) ? real(1) / size.z : real(0));
+
+#ifdef ENABLE_OMP
+#pragma omp parallel for
+#endif
+        for (int i = 0; i < num; i++) {
+            auto p = (bboxes[i].getCenter() - minPos) * invSize;
+            computeMortonCode(p, codes[i]);
+            m_sortedIndices[i] = i;
+        }
+
+        // NOTE
+        // Bits which are used in Morton code is 30 or 63, so upper bits don't need to be sorted.
+        RadixSort<T> sorter;
+        sorter.sort(codes, m_sortedIndices, sizeof(T) == sizeof(uint32_t) ? 30 : 63);
+
+        buildTree(codes);
+    }
+
+    template <typename T>
+    void LBVH::buildTree(const std::vector<T>& sortedCodes)
+    {
+        auto num = (int)sortedCodes.size();
+
+        // NOTE
+        // [0, num - 1) is internal nodes, [num - 1, 2 * num - 1) is leaves.
+        // If only one item, root is leaf.
+        m_lbvhNodes.assign(2 * num - 1, LBVHNode());
+
+        const auto leafBaseIdx = num - 1;
+        const T* codes = &sortedCodes[0];
+
+#ifdef ENABLE_OMP
+#pragma omp parallel for
+#endif
+        for (int i = 0; i < num - 1; i++) {
+            // Determine direction of the range.
+            // Go to the direction which has longer common prefix.
+            auto lcp1 = computeLongestCommonPrefix(codes, num, i, i + 1);
+            auto lcp2 = computeLongestCommonPrefix(codes, num, i, i - 1);
+            int d = (lcp1 - lcp2) < 0 ? -1 : 1;
+
+            // Compute upper bound for the length of the range.
+            int minLcp = computeLongestCommonPrefix(codes, num, i, i - d);
+            int lMax = 2;
+            while (computeLongestCommonPrefix(codes, num, i, i + lMax * d) > minLcp) {
+                lMax *= 2;
+            }
+
+            // Find the other end with binary search.
+            int l = 0;
+            for (int t = lMax / 2; t >= 1; t /= 2) {
+                if (computeLongestCommonPrefix(codes, num, i, i + (l + t) * d) > minLcp) {
+                    l += t;
+                }
+            }
+
+            int j = i + l * d;
+
+            // Find the split position with binary search.
+            int nodeLcp = computeLongestCommonPrefix(codes, num, i, j);
+
+            int s = 0;
+            int divisor = 2;
+            for (;;) {
+                int t = (l + divisor - 1) / divisor;
+
+                if (computeLongestCommonPrefix(codes, num, i, i + (s + t) * d) > nodeLcp) {
+                    s += t;
+                }
+
+                if (t <= 1) {
+                    break;
+                }
+
+                divisor *= 2;
+            }
+
+            int split = i + s * d + std::min(d, 0);
+
+            auto& node = m_lbvhNodes[i];
+
+            node.leafNum = std::abs(j - i) + 1;
+            node.left = (std::min(i, j) == split ? leafBaseIdx + split : split);
+            node.right = (std::max(i, j) == split + 1 ? leafBaseIdx + split + 1 : split + 1);
+        }
+    }
+
+    void LBVH::registerThreadedBvhNode(const std::vector<aabb>& bboxes)
+    {
+        auto num = (int)m_items.size();
+        auto nodeNum = (int)m_lbvhNodes.size();
+
+        const auto leafBaseIdx = num - 1;
+
+        m_nodes.resize(nodeNum);
+
+        // Order in the threaded bvh node list to lbvh node index.
+        std::vector<int> order(nodeNum);
+
+        struct StackEntry {
+            int node;
+            int order;
+            int miss;
+        };
+
+        // Register the nodes by depth first order to make threaded bvh.
+        // The sub tree which has N leaves has 2 * N - 1 nodes,
+        // so the order of the right child and the miss link are known without traversing the left sub tree.
+        {
+            std::vector<StackEntry> stack;
+            stack.reserve(64);
+
+            stack.push_back({ 0, 0, -1 });
+
+            while (!stack.empty()) {
+                auto entry = stack.back();
+                stack.pop_back();
+
+                order[entry.order] = entry.node;
+
+                auto& gpunode = m_nodes[entry.order];
+
+                gpunode.miss = (float)entry.miss;
+
+                if (entry.node >= leafBaseIdx) {
+                    auto itemIdx = m_sortedIndices[entry.node - leafBaseIdx];
+                    const auto& param = m_leafParams[itemIdx];
+
+                    gpunode.shapeid = param.shapeid;
+                    gpunode.primid = param.primid;
+                    gpunode.meshid = param.meshid;
+                    gpunode.exid = -1.0f;
+
+                    // Leaf always goes to the next node.
+                    gpunode.hit = gpunode.miss;
+                }
+                else {
+                    const auto& node = m_lbvhNodes[entry.node];
+
+                    int leftOrder = entry.order + 1;
+                    int rightOrder = leftOrder + 2 * m_lbvhNodes[node.left].leafNum - 1;
+
+                    // Internal node goes to the left child if ray hits.
+                    gpunode.hit = (float)leftOrder;
+
+                    stack.push_back({ node.right, rightOrder, entry.miss });
+                    stack.push_back({ node.left, leftOrder, rightOrder });
+                }
+            }
+        }
+
+        // Compute AABB from the leaves to the root.
+        // In depth first order, children always come after their parent.
+        {
+            std::vector<aabb> nodeBoxes(nodeNum);
+
+            for (int i = nodeNum - 1; i >= 0; i--) {
+                auto idx = order[i];
+
+                if (idx >= leafBaseIdx) {
+                    auto itemIdx = m_sortedIndices[idx - leafBaseIdx];
+                    nodeBoxes[idx] = bboxes[itemIdx];
+                }
+                else {
+                    const auto& node = m_lbvhNodes[idx];
+                    nodeBoxes[idx] = aabb::merge(nodeBoxes[node.left], nodeBoxes[node.right]);
+                }
+
+                m_nodes[i].boxmin = nodeBoxes[idx].minPos();
+                m_nodes[i].boxmax = nodeBoxes[idx].maxPos();
+            }
+        }
+    }
+
+    bool LBVH::hit(
+        const context& ctxt,
+        const ray& r,
+        real t_min, real t_max,
+        Intersection& isect) const
+    {
+        return onHit(ctxt, r, t_min, t_max, isect, false);
+    }
+
+    bool LBVH::occluded(
+        const context& ctxt,
+        const ray& r,
+        real t_min, real t_max) const
+    {
+        Intersection isect;
+        return onHit(ctxt, r, t_min, t_max, isect, true);
+    }
+
+    bool LBVH::onHit(
+        const context& ctxt,
+        const ray& r,
+        real t_min, real t_max,
+        Intersection& isect,
+        bool isOcclusion) const
+    {
+        int nodeid = m_nodes.empty() ? -1 : 0;
+
+        while (nodeid >= 0) {
+            const ThreadedBvhNode* node = &m_nodes[nodeid];
+
+            bool isHit = false;
+
+            if (node->isLeaf()) {
+                Intersection isectTmp;
+
+                auto s = node->shapeid >= 0 ? ctxt.getTransformable((int)node->shapeid) : nullptr;
+
+                if (node->primid >= 0) {
+                    // Hit test for a primitive.
+                    isHit = face::hit(ctxt, (int)node->primid, r, t_min, t_max, isectTmp);
+                    if (isHit) {
+                        // Set dummy to return if ray hit.
+                        isectTmp.objid = s ? s->id() : 1;
+                    }
+                }
+                else if (isOcclusion) {
+                    isHit = s->occluded(ctxt, r, t_min, t_max);
+                }
+                else {
+                    // Hit test for a shape.
+                    isHit = s->hit(ctxt, r, t_min, t_max, isectTmp);
+                }
+
+                if (isHit && isOcclusion) {
+                    // Any hit is enough.
+                    return true;
+                }
+
+                if (isHit) {
+                    if (isectTmp.t < isect.t) {
+                        isect = isectTmp;
+                        t_max = isect.t;
+                    }
+                }
+            }
+            else {
+                isHit = aten::aabb::hit(r, node->boxmin, node->boxmax, t_min, t_max);
+            }
+
+            if (isHit) {
+                nodeid = (int)node->hit;
+            }
+            else {
+                nodeid = (int)node->miss;
+            }
+        }
+
+        return (isect.objid >= 0);
+    }
+
+    void LBVH::drawAABB(
+        aten::hitable::FuncDrawAABB func,
+        const aten::mat4& mtxL2W)
+    {
+        for (const auto& node : m_nodes) {
+            auto transofrmedBox = aten::aabb::transform(
+                aabb(node.boxmin, node.boxmax),
+                mtxL2W);
+
+            aten::mat4 mtxScale;
+            mtxScale.asScale(transofrmedBox.size());
+
+            aten::mat4 mtxTrans;
+            mtxTrans.asTrans(transofrmedBox.minPos());
+
+            aten::mat4 mtx = mtxTrans * mtxScale;
+
+            func(mtx);
+        }
+    }
+}
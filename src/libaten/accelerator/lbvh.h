@@ -0,0 +1,199 @@
+#pragma once
+
+#include <vector>
+
+#include "scene/hitable.h"
+#include "accelerator/accelerator.h"
+#include "accelerator/threaded_bvh.h"
+
+namespace aten
+{
+    /**
+     * @brief Linear Bounding Volume Hierarchies built with Morton codes on CPU.
+     *
+     * The tree is built in linear time (Morton code, radix sort, Karras's hierarchy generation),
+     * and it is stored as the threaded bvh nodes.
+     * The quality of the tree is lower than SAH, but it can be rebuilt every frame for dynamic scene.
+     */
+    class LBVH : public accelerator {
+    public:
+        LBVH() : accelerator(AccelType::Lbvh) {}
+        virtual ~LBVH() {}
+
+    public:
+        /**
+         * @enum MortonCodeType
+         * @brief Bit width of Morton code.
+         */
+        enum class MortonCodeType {
+            Bit30,  ///< 30 bit Morton code (10 bits per axis).
+            Bit63,  ///< 63 bit Morton code (21 bits per axis).
+        };
+
+        /**
+         * @brief Set bit width of Morton code for all LBVH which will be built after this.
+         */
+        static void setMortonCodeType(MortonCodeType type)
+        {
+            s_mortonCodeType = type;
+        }
+
+        /**
+         * @brief Return bit width of Morton code.
+         */
+        static MortonCodeType getMortonCodeType()
+        {
+            return s_mortonCodeType;
+        }
+
+        /**
+         * @brief Bulid structure tree from the specified list.
+         */
+        virtual void build(
+            const context& ctxt,
+            hitable** list,
+            uint32_t num,
+            aabb* bbox) override;
+
+        /**
+         * @brief Test if a ray hits a object.
+         */
+        virtual bool hit(
+            const context& ctxt,
+            const ray& r,
+            real t_min, real t_max,
+            Intersection& isect) const override;
+
+        /**
+         * @brief Test if a ray hits a object.
+         */
+        virtual bool hit(
+            const context& ctxt,
+            const ray& r,
+            real t_min, real t_max,
+            bool enableLod,
+            Intersection& isect) const override
+        {
+            return hit(ctxt, r, t_min, t_max, isect);
+        }
+
+        /**
+         * @brief Test if a ray is occluded by any objects.
+         */
+        virtual bool occluded(
+            const context& ctxt,
+            const ray& r,
+            real t_min, real t_max) const override;
+
+        using accelerator::hit;
+        using accelerator::occluded;
+
+        /**
+         * @brief Draw all node's AABB in the structure tree.
+         */
+        virtual void drawAABB(
+            aten::hitable::FuncDrawAABB func,
+            const aten::mat4& mtxL2W) override final;
+
+        /**
+         * @brief Rebuild the structure tree with the items which are specified at the latest build.
+         */
+        virtual void update(const context& ctxt) override;
+
+        /**
+         * @brief Return all nodes as threaded bvh nodes.
+         */
+        const std::vector<ThreadedBvhNode>& getNodes() const
+        {
+            return m_nodes;
+        }
+
+        /**
+         * @brief Return elapsed time to build the tree at the latest build [ms].
+         */
+        real getElapsedBuildTime() const
+        {
+            return m_elapsed;
+        }
+
+    private:
+        /**
+         * @brief Node in the tree which is generated from sorted Morton codes.
+         */
+        struct LBVHNode {
+            int left{ -1 };
+            int right{ -1 };
+            int leafNum{ 1 };   ///< Number of leaves in the sub tree.
+        };
+
+        /**
+         * @brief Description for the item which the leaf has.
+         */
+        struct LeafParam {
+            float shapeid{ -1 };    ///< Object index.
+            float primid{ -1 };     ///< Triangle index.
+            float meshid{ -1 };     ///< Mesh id.
+        };
+
+        /**
+         * @brief Collect the description for the items which the leaves have.
+         */
+        void registerLeafParams(const context& ctxt);
+
+        /**
+         * @brief Build the tree from the items which are registered.
+         */
+        void onBuild();
+
+        /**
+         * @brief Compute Morton codes and sort the items along them.
+         */
+        template <typename T>
+        void sortByMortonCode(
+            const std::vector<aabb>& bboxes,
+            const aabb& centerBox);
+
+        /**
+         * @brief Generate the hierarchy from sorted Morton codes.
+         */
+        template <typename T>
+        void buildTree(const std::vector<T>& sortedCodes);
+
+        /**
+         * @brief Convert the hierarchy to threaded bvh nodes, and compute AABB of all nodes.
+         */
+        void registerThreadedBvhNode(const std::vector<aabb>& bboxes);
+
+        /**
+         * @brief Traverse the tree.
+         * @param isOcclusion Flag if the traversal is terminated at the first hit.
+         */
+        bool onHit(
+            const context& ctxt,
+            const ray& r,
+            real t_min, real t_max,
+            Intersection& isect,
+            bool isOcclusion) const;
+
+    private:
+        // Items which the tree has.
+        std::vector<hitable*> m_items;
+
+        // Description for the items which the leaves have.
+        std::vector<LeafParam> m_leafParams;
+
+        // Item indices which are sorted along Morton codes.
+        std::vector<uint32_t> m_sortedIndices;
+
+        // Hierarchy. [0, num - 1) is internal nodes, [num - 1, 2 * num - 1) is leaves.
+        std::vector<LBVHNode> m_lbvhNodes;
+
+        std::vector<ThreadedBvhNode> m_nodes;
+
+        // Elapsed time to build the tree at the latest build [ms].
+        real m_elapsed{ real(0) };
+
+        // Bit width of Morton code.
+        static MortonCodeType s_mortonCodeType;
+    };
+}
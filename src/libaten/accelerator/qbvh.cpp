@@ -1,5 +1,13 @@
 #include "accelerator/qbvh.h"
 
+// NOTE
+// SSE is always available on x64.
+// If real is double, 4-wide float SIMD is not available.
+#if !defined(TYPE_DOUBLE) && (defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64))
+#define AT_ENABLE_QBVH_SSE
+#include <immintrin.h>
+#endif
+
 //#pragma optimize( "", off)
 
 namespace aten
@@ -144,8 +152,8 @@ namespace aten
                 children,
                 numChildren);
 
-            qbvhNode.leftChildrenIdx = (float)numNodes;
-            qbvhNode.numChildren = (float)numChildren;
+            qbvhNode.leftChildrenIdx = (int)numNodes;
+            qbvhNode.numChildren = numChildren;
 
             // push all children to the stack
             for (int i = 0; i < numChildren; i++) {
@@ -198,18 +206,16 @@ namespace aten
             for (int i = 0; i < numChildren; i++) {
                 auto ch = children[i];
 
-                // gID擾.
-                qbvhNode.shapeidx[i] = (float)transformable::findIdxAsHitable(ch);
+                qbvhNode.shapeidx[i] = ctxt.findTransformableIdxFromPointer(ch);
 
-                // ȂAlXgĂ̂ŐeID擾.
+                // If it is not found, the item is nested. So, use the parent's index.
                 if (qbvhNode.shapeidx[i] < 0) {
                     if (nestParent) {
-                        qbvhNode.shapeid = (float)transformable::findIdxAsHitable(nestParent);
-                        qbvhNode.shapeidx[i] = qbvhNode.shapeid;
+                        qbvhNode.shapeidx[i] = ctxt.findTransformableIdxFromPointer(nestParent);
                     }
                 }
 
-                // CX^X̎̂擾.
+                // Get the internal object of the instance.
                 auto internalObj = ch->getHasObject();
 
                 if (internalObj) {
@@ -218,40 +224,57 @@ namespace aten
 
                 if (isPrimitiveLeaf) {
                     // Leaves of this tree are primitive.
-                    qbvhNode.primidx[i] = (float)face::findIdx(ch);
-
-                    auto f = face::faces()[(int)qbvhNode.primidx[i]];
+                    qbvhNode.primidx[i] = ctxt.findTriIdxFromPointer(ch);
 
-                    const auto& v0 = aten::VertexManager::getVertex(f->param.idx[0]);
-                    const auto& v1 = aten::VertexManager::getVertex(f->param.idx[1]);
+                    // Store the precomputed vertex and edges as SoA to test all triangles at once.
+                    const auto f = ctxt.getTriangle(qbvhNode.primidx[i]);
 
-                    auto e1 = v1.pos - v0.pos;
+                    const auto v0 = f->getV0();
+                    const auto e1 = f->getE1();
+                    const auto e2 = f->getE2();
 
-                    qbvhNode.v0x[i] = v0.pos.x;
-                    qbvhNode.v0y[i] = v0.pos.y;
-                    qbvhNode.v0z[i] = v0.pos.z;
+                    qbvhNode.v0x[i] = v0.x;
+                    qbvhNode.v0y[i] = v0.y;
+                    qbvhNode.v0z[i] = v0.z;
 
                     qbvhNode.e1x[i] = e1.x;
                     qbvhNode.e1y[i] = e1.y;
                     qbvhNode.e1z[i] = e1.z;
 
-                    qbvhNode.exid = -1.0f;
+                    qbvhNode.e2x[i] = e2.x;
+                    qbvhNode.e2y[i] = e2.y;
+                    qbvhNode.e2z[i] = e2.z;
                 }
                 else {
-                    qbvhNode.shapeid = qbvhNode.shapeidx[i];
-                    qbvhNode.exid = (float)node->getExternalId();
+                    qbvhNode.primidx[i] = -1;
+                }
+
+                if (i == 0) {
+                    qbvhNode.meshid = ch->geomid();
                 }
             }
+
+            for (int i = numChildren; i < 4; i++) {
+                qbvhNode.shapeidx[i] = -1;
+                qbvhNode.primidx[i] = -1;
+            }
+
+            qbvhNode.shapeid = qbvhNode.shapeidx[0];
+            qbvhNode.primid = qbvhNode.primidx[0];
+
+            // NOTE
+            // Instance is never packed with other items, so the external tree is only for single item leaf.
+            qbvhNode.exid = (isPrimitiveLeaf ? -1 : node->getExternalId());
 #else
             hitable* item = node->getItem();
 
             // gID擾.
-            qbvhNode.shapeid = (float)ctxt.findTransformableIdxFromPointer(item);
+            qbvhNode.shapeid = ctxt.findTransformableIdxFromPointer(item);
 
             // ȂAlXgĂ̂ŐeID擾.
             if (qbvhNode.shapeid < 0) {
                 if (nestParent) {
-                    qbvhNode.shapeid = (float)ctxt.findTransformableIdxFromPointer(nestParent);
+                    qbvhNode.shapeid = ctxt.findTransformableIdxFromPointer(nestParent);
                 }
             }
 
@@ -262,19 +285,19 @@ namespace aten
                 item = const_cast<hitable*>(internalObj);
             }
 
-            qbvhNode.meshid = (float)item->geomid();
+            qbvhNode.meshid = item->geomid();
 
             if (isPrimitiveLeaf) {
                 // Leaves of this tree are primitive.
-                qbvhNode.primid = (float)ctxt.findTriIdxFromPointer(item);
-                qbvhNode.exid = -1.0f;
+                qbvhNode.primid = ctxt.findTriIdxFromPointer(item);
+                qbvhNode.exid = -1;
             }
             else {
-                qbvhNode.exid = (float)node->getExternalId();
+                qbvhNode.exid = node->getExternalId();
             }
 #endif
 
-            qbvhNode.isLeaf = (float)true;
+            qbvhNode.isLeaf = true;
         }
     }
 
@@ -378,132 +401,212 @@ namespace aten
         return numChildren;
     }
 
+    /**
+     * @brief Ray description which is computed once per traversal to test AABB.
+     */
+    struct QbvhTraverseRay {
+        aten::vec3 invdir;      ///< Inverse of ray direction.
+        aten::vec3 orgInvdir;   ///< Ray origin multiplied by inverse of ray direction.
+        int isNegative[3];      ///< Flag if ray direction is negative per axis.
+
+        QbvhTraverseRay(const aten::ray& r)
+        {
+            // NOTE
+            // Avoid 0 division, but keep the sign of the direction.
+            static const real eps = real(1e-20);
+
+            for (int i = 0; i < 3; i++) {
+                auto d = r.dir[i];
+                d = (aten::abs(d) > eps ? d : (d < real(0) ? -eps : eps));
+
+                invdir[i] = real(1) / d;
+                orgInvdir[i] = r.org[i] * invdir[i];
+                isNegative[i] = (d < real(0));
+            }
+        }
+    };
+
+    // Return bit mask of the children which ray hits, and distance to the children.
     inline int intersectAABB(
         aten::vec4& result,
-        const aten::ray& r,
+        const QbvhTraverseRay& r,
         real t_min, real t_max,
-        const aten::vec4& bminx, const aten::vec4& bmaxx,
-        const aten::vec4& bminy, const aten::vec4& bmaxy,
-        const aten::vec4& bminz, const aten::vec4& bmaxz)
+        const QbvhNode& node)
     {
         // NOTE
-        // No SSE...
-
-        aten::vec3 invdir = real(1) / (r.dir + aten::vec3(real(1e-6)));
-        aten::vec3 oxinvdir = -r.org * invdir;
-
-        aten::vec4 invdx(invdir.x);
-        aten::vec4 invdy(invdir.y);
-        aten::vec4 invdz(invdir.z);
-
-        aten::vec4 ox(oxinvdir.x);
-        aten::vec4 oy(oxinvdir.y);
-        aten::vec4 oz(oxinvdir.z);
-
-        aten::vec4 minus_inf(-AT_MATH_INF);
-        aten::vec4 plus_inf(AT_MATH_INF);
-
-        // X 
-        auto fx = bmaxx * invdx + ox;
-        auto nx = bminx * invdx + ox;
+        // Near and far planes are selected by the sign of the ray direction.
+        // So, min/max for each axis are not necessary.
+        const auto& nearX = r.isNegative[0] ? node.bmaxx : node.bminx;
+        const auto& farX = r.isNegative[0] ? node.bminx : node.bmaxx;
+        const auto& nearY = r.isNegative[1] ? node.bmaxy : node.bminy;
+        const auto& farY = r.isNegative[1] ? node.bminy : node.bmaxy;
+        const auto& nearZ = r.isNegative[2] ? node.bmaxz : node.bminz;
+        const auto& farZ = r.isNegative[2] ? node.bminz : node.bmaxz;
+
+#ifdef AT_ENABLE_QBVH_SSE
+        const __m128 invdx = _mm_set1_ps(r.invdir.x);
+        const __m128 invdy = _mm_set1_ps(r.invdir.y);
+        const __m128 invdz = _mm_set1_ps(r.invdir.z);
+
+        const __m128 ox = _mm_set1_ps(r.orgInvdir.x);
+        const __m128 oy = _mm_set1_ps(r.orgInvdir.y);
+        const __m128 oz = _mm_set1_ps(r.orgInvdir.z);
+
+#ifdef __FMA__
+        __m128 nx = _mm_fmsub_ps(_mm_loadu_ps(nearX.p), invdx, ox);
+        __m128 fx = _mm_fmsub_ps(_mm_loadu_ps(farX.p), invdx, ox);
+        __m128 ny = _mm_fmsub_ps(_mm_loadu_ps(nearY.p), invdy, oy);
+        __m128 fy = _mm_fmsub_ps(_mm_loadu_ps(farY.p), invdy, oy);
+        __m128 nz = _mm_fmsub_ps(_mm_loadu_ps(nearZ.p), invdz, oz);
+        __m128 fz = _mm_fmsub_ps(_mm_loadu_ps(farZ.p), invdz, oz);
+#else
+        __m128 nx = _mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(nearX.p), invdx), ox);
+        __m128 fx = _mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(farX.p), invdx), ox);
+        __m128 ny = _mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(nearY.p), invdy), oy);
+        __m128 fy = _mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(farY.p), invdy), oy);
+        __m128 nz = _mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(nearZ.p), invdz), oz);
+        __m128 fz = _mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(farZ.p), invdz), oz);
+#endif
 
-        // Y
-        auto fy = bmaxy * invdy + oy;
-        auto ny = bminy * invdy + oy;
+        __m128 t0 = _mm_max_ps(_mm_max_ps(nx, ny), _mm_max_ps(nz, _mm_set1_ps(t_min)));
+        __m128 t1 = _mm_min_ps(_mm_min_ps(fx, fy), _mm_min_ps(fz, _mm_set1_ps(t_max)));
 
-        // Z
-        auto fz = bmaxz * invdz + oz;
-        auto nz = bminz * invdz + oz;
+        _mm_storeu_ps(result.p, t0);
 
-        auto tmaxX = max(fx, nx);
-        auto tminX = min(fx, nx);
+        return _mm_movemask_ps(_mm_cmple_ps(t0, t1));
+#else
+        aten::vec4 invdx(r.invdir.x);
+        aten::vec4 invdy(r.invdir.y);
+        aten::vec4 invdz(r.invdir.z);
 
-        auto tmaxY = max(fy, ny);
-        auto tminY = min(fy, ny);
+        aten::vec4 ox(r.orgInvdir.x);
+        aten::vec4 oy(r.orgInvdir.y);
+        aten::vec4 oz(r.orgInvdir.z);
 
-        auto tmaxZ = max(fz, nz);
-        auto tminZ = min(fz, nz);
+        auto nx = nearX * invdx - ox;
+        auto fx = farX * invdx - ox;
+        auto ny = nearY * invdy - oy;
+        auto fy = farY * invdy - oy;
+        auto nz = nearZ * invdz - oz;
+        auto fz = farZ * invdz - oz;
 
-        auto t1 = min(min(tmaxX, tmaxY), min(tmaxZ, t_max));
-        auto t0 = max(max(tminX, tminY), max(tminZ, t_min));
+        auto t0 = max(max(nx, ny), max(nz, aten::vec4(t_min)));
+        auto t1 = min(min(fx, fy), min(fz, aten::vec4(t_max)));
 
-        int ret = cmpLEQ(t0, t1);
         result = t0;
-        return ret;
+
+        return cmpLEQ(t0, t1);
+#endif
     }
 
-    inline int intersectTriangle(
-        const context& ctxt,
-        const aten::ray& r,
-        real t_min, real t_max,
-        const float* primidx,
-        const QbvhNode& qnode,
+#ifdef ENABLE_BVH_MULTI_TRIANGLES
+    // Return bit mask of the triangles in the leaf which ray hits, and distance and barycentric coordinates of them.
+    inline int intersectTriangles(
         aten::vec4& resultT,
         aten::vec4& resultA,
-        aten::vec4& resultB)
+        aten::vec4& resultB,
+        const aten::ray& r,
+        real t_min, real t_max,
+        const QbvhNode& node)
     {
         // NOTE
         // https://github.com/githole/akari2/blob/master/qbvh.h
+        // Moller-Trumbore with the edges which are precomputed at build.
 
-        // NOTE
-        // No SSE...
+#ifdef AT_ENABLE_QBVH_SSE
+        const __m128 dx = _mm_set1_ps(r.dir.x);
+        const __m128 dy = _mm_set1_ps(r.dir.y);
+        const __m128 dz = _mm_set1_ps(r.dir.z);
 
-        aten::vec4 v2x;
-        aten::vec4 v2y;
-        aten::vec4 v2z;
+        const __m128 v0x = _mm_loadu_ps(node.v0x.p);
+        const __m128 v0y = _mm_loadu_ps(node.v0y.p);
+        const __m128 v0z = _mm_loadu_ps(node.v0z.p);
 
-        for (int i = 0; i < qnode.numChildren; i++) {
-            auto f = ctxt.getTriangle((int)primidx[i]);
+        const __m128 e1x = _mm_loadu_ps(node.e1x.p);
+        const __m128 e1y = _mm_loadu_ps(node.e1y.p);
+        const __m128 e1z = _mm_loadu_ps(node.e1z.p);
 
-            const auto& faceParam = f->getParam();
+        const __m128 e2x = _mm_loadu_ps(node.e2x.p);
+        const __m128 e2y = _mm_loadu_ps(node.e2y.p);
+        const __m128 e2z = _mm_loadu_ps(node.e2z.p);
 
-            const auto& v2 = ctxt.getVertex(faceParam.idx[2]);
+        // r = r.org - v0
+        const __m128 rx = _mm_sub_ps(_mm_set1_ps(r.org.x), v0x);
+        const __m128 ry = _mm_sub_ps(_mm_set1_ps(r.org.y), v0y);
+        const __m128 rz = _mm_sub_ps(_mm_set1_ps(r.org.z), v0z);
 
-            v2x[i] = v2.pos.x;
-            v2y[i] = v2.pos.y;
-            v2z[i] = v2.pos.z;
-        }
+        // u = cross(d, e2)
+        const __m128 ux = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+        const __m128 uy = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+        const __m128 uz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+
+        // v = cross(r, e1)
+        const __m128 vx = _mm_sub_ps(_mm_mul_ps(ry, e1z), _mm_mul_ps(rz, e1y));
+        const __m128 vy = _mm_sub_ps(_mm_mul_ps(rz, e1x), _mm_mul_ps(rx, e1z));
+        const __m128 vz = _mm_sub_ps(_mm_mul_ps(rx, e1y), _mm_mul_ps(ry, e1x));
+
+        // inv = real(1) / dot(u, e1)
+        const __m128 det = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(ux, e1x), _mm_mul_ps(uy, e1y)),
+            _mm_mul_ps(uz, e1z));
+        const __m128 inv = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+        // t = dot(v, e2) * inv
+        const __m128 t = _mm_mul_ps(
+            _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, e2x), _mm_mul_ps(vy, e2y)), _mm_mul_ps(vz, e2z)),
+            inv);
+
+        // beta = dot(u, r) * inv
+        const __m128 beta = _mm_mul_ps(
+            _mm_add_ps(_mm_add_ps(_mm_mul_ps(ux, rx), _mm_mul_ps(uy, ry)), _mm_mul_ps(uz, rz)),
+            inv);
 
-        // e1 = v1 - v0
-        const auto& e1_x = qnode.e1x;
-        const auto& e1_y = qnode.e1y;
-        const auto& e1_z = qnode.e1z;
+        // gamma = dot(v, d) * inv
+        const __m128 gamma = _mm_mul_ps(
+            _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, dx), _mm_mul_ps(vy, dy)), _mm_mul_ps(vz, dz)),
+            inv);
 
-        // e2 = v2 - v0
-        auto e2_x = v2x - qnode.v0x;
-        auto e2_y = v2y - qnode.v0y;
-        auto e2_z = v2z - qnode.v0z;
+        _mm_storeu_ps(resultT.p, t);
+        _mm_storeu_ps(resultA.p, beta);
+        _mm_storeu_ps(resultB.p, gamma);
 
-        vec4 ox = vec4(r.org.x, r.org.x, r.org.x, r.org.x);
-        vec4 oy = vec4(r.org.y, r.org.y, r.org.y, r.org.y);
-        vec4 oz = vec4(r.org.z, r.org.z, r.org.z, r.org.z);
+        // NOTE
+        // If the determinant is zero, the results are NaN or infinity and all comparisons fail.
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
 
-        // d
-        vec4 d_x = vec4(r.dir.x, r.dir.x, r.dir.x, r.dir.x);
-        vec4 d_y = vec4(r.dir.y, r.dir.y, r.dir.y, r.dir.y);
-        vec4 d_z = vec4(r.dir.z, r.dir.z, r.dir.z, r.dir.z);
+        __m128 mask = _mm_and_ps(_mm_cmpge_ps(beta, zero), _mm_cmpge_ps(gamma, zero));
+        mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(beta, gamma), one));
+        mask = _mm_and_ps(mask, _mm_cmpge_ps(t, zero));
+        mask = _mm_and_ps(mask, _mm_cmple_ps(t, _mm_set1_ps(t_max)));
+
+        int ret = _mm_movemask_ps(mask);
+#else
+        vec4 d_x(r.dir.x);
+        vec4 d_y(r.dir.y);
+        vec4 d_z(r.dir.z);
 
         // r = r.org - v0
-        auto r_x = ox - qnode.v0x;
-        auto r_y = oy - qnode.v0y;
-        auto r_z = oz - qnode.v0z;
+        auto r_x = vec4(r.org.x) - node.v0x;
+        auto r_y = vec4(r.org.y) - node.v0y;
+        auto r_z = vec4(r.org.z) - node.v0z;
 
         // u = cross(d, e2)
-        auto u_x = d_y * e2_z - d_z * e2_y;
-        auto u_y = d_z * e2_x - d_x * e2_z;
-        auto u_z = d_x * e2_y - d_y * e2_x;
+        auto u_x = d_y * node.e2z - d_z * node.e2y;
+        auto u_y = d_z * node.e2x - d_x * node.e2z;
+        auto u_z = d_x * node.e2y - d_y * node.e2x;
 
         // v = cross(r, e1)
-        auto v_x = r_y * e1_z - r_z * e1_y;
-        auto v_y = r_z * e1_x - r_x * e1_z;
-        auto v_z = r_x * e1_y - r_y * e1_x;
+        auto v_x = r_y * node.e1z - r_z * node.e1y;
+        auto v_y = r_z * node.e1x - r_x * node.e1z;
+        auto v_z = r_x * node.e1y - r_y * node.e1x;
 
         // inv = real(1) / dot(u, e1)
-        auto divisor = u_x * e1_x + u_y * e1_y + u_z * e1_z;
-        auto inv = real(1) / (divisor + real(1e-6));
+        auto det = u_x * node.e1x + u_y * node.e1y + u_z * node.e1z;
+        auto inv = vec4(real(1)) / det;
 
         // t = dot(v, e2) * inv
-        auto t = (v_x * e2_x + v_y * e2_y + v_z * e2_z) * inv;
+        auto t = (v_x * node.e2x + v_y * node.e2y + v_z * node.e2z) * inv;
 
         // beta = dot(u, r) * inv
         auto beta = (u_x * r_x + u_y * r_y + u_z * r_z) * inv;
@@ -515,20 +618,19 @@ namespace aten
         resultA = beta;
         resultB = gamma;
 
-        int res_b0 = cmpGEQ(beta, real(0));        // beta >= 0
-        int res_b1 = cmpLEQ(beta, real(1));        // beta <= 1
-
-        int res_g0 = cmpGEQ(gamma, real(0));    // gamma >= 0
-        int res_g1 = cmpLEQ(gamma, real(1));    // gamma <= 1
-
-        int res_bg1 = cmpLEQ(beta + gamma, real(1));    // beta + gammma <= 1
-
-        int res_t0 = cmpGEQ(t, real(0));        // t >= 0
+        int ret = cmpGEQ(beta, vec4(real(0)))
+            & cmpGEQ(gamma, vec4(real(0)))
+            & cmpLEQ(beta + gamma, vec4(real(1)))
+            & cmpGEQ(t, vec4(real(0)))
+            & cmpLEQ(t, vec4(t_max));
+#endif
 
-        int ret = res_b0 & res_b1 & res_g0 & res_g1 & res_bg1 & res_t0;
+        // Ignore empty slots.
+        ret &= (1 << node.numChildren) - 1;
 
         return ret;
     }
+#endif
 
     bool qbvh::hit(
         const context& ctxt,
@@ -536,7 +638,16 @@ namespace aten
         real t_min, real t_max,
         Intersection& isect) const
     {
-        return hit(ctxt, 0, m_listQbvhNode, r, t_min, t_max, isect);
+        return hit(ctxt, 0, m_listQbvhNode, r, t_min, t_max, isect, false);
+    }
+
+    bool qbvh::occluded(
+        const context& ctxt,
+        const ray& r,
+        real t_min, real t_max) const
+    {
+        Intersection isect;
+        return hit(ctxt, 0, m_listQbvhNode, r, t_min, t_max, isect, true);
     }
 
     bool qbvh::hit(
@@ -545,9 +656,10 @@ namespace aten
         const std::vector<std::vector<QbvhNode>>& listQbvhNode,
         const ray& r,
         real t_min, real t_max,
-        Intersection& isect) const
+        Intersection& isect,
+        bool isOcclusion) const
     {
-        static const uint32_t stacksize = 64;
+        static const int stacksize = 64;
 
         struct Intersect {
             const QbvhNode* node{ nullptr };
@@ -560,6 +672,8 @@ namespace aten
         stackbuf[0] = Intersect(&listQbvhNode[exid][0], t_max);
         int stackpos = 1;
 
+        const QbvhTraverseRay traverseRay(r);
+
         while (stackpos > 0) {
             const auto& node = stackbuf[stackpos - 1];
             stackpos -= 1;
@@ -577,139 +691,311 @@ namespace aten
 
                 bool isHit = false;
 
-#ifdef ENABLE_BVH_MULTI_TRIANGLES
-                if (pnode->exid >= 0) {
-                    // Traverse external qbvh.
-                    auto s = shapes[(int)pnode->shapeid];
-                    const auto& param = s->getParam();
+                isHit = hitLeaf(ctxt, listQbvhNode, *pnode, r, t_min, t_max, isectTmp, isOcclusion);
 
-                    int mtxid = param.mtxid;
+                if (isHit && isOcclusion) {
+                    // Any hit is enough.
+                    isect = isectTmp;
+                    return true;
+                }
 
-                    aten::ray transformedRay;
+                if (isHit) {
+                    if (isectTmp.t < isect.t) {
+                        isect = isectTmp;
+                        t_max = isect.t;
+                    }
+                }
+            }
+            else {
+                // Hit test children aabb.
+                aten::vec4 interserctT;
+                auto res = intersectAABB(
+                    interserctT,
+                    traverseRay,
+                    t_min, t_max,
+                    *pnode);
 
-                    if (mtxid >= 0) {
-                        const auto& mtxW2L = m_mtxs[mtxid * 2 + 1];
+                // Ignore empty children.
+                res &= (1 << numChildren) - 1;
 
-                        transformedRay = mtxW2L.applyRay(r);
-                    }
-                    else {
-                        transformedRay = r;
+                if (res > 0) {
+                    // Sort hit children by distance in descending order.
+                    int hitChildren[4];
+                    int hitNum = 0;
+
+                    for (int i = 0; i < numChildren; i++) {
+                        if ((res & (1 << i)) > 0) {
+                            int pos = hitNum++;
+
+                            while (pos > 0 && interserctT[hitChildren[pos - 1]] < interserctT[i]) {
+                                hitChildren[pos] = hitChildren[pos - 1];
+                                pos--;
+                            }
+
+                            hitChildren[pos] = i;
+                        }
                     }
 
-                    isHit = hit(
-                        (int)pnode->exid,
-                        listQbvhNode,
-                        transformedRay,
-                        t_min, t_max,
-                        isectTmp);
+                    AT_ASSERT(stackpos + hitNum <= stacksize);
+
+                    // Stack hit children from far to near, so that the nearest child is traversed first.
+                    for (int i = 0; i < hitNum; i++) {
+                        auto childIdx = hitChildren[i];
+
+                        stackbuf[stackpos] = Intersect(
+                            &listQbvhNode[exid][pnode->leftChildrenIdx + childIdx],
+                            interserctT[childIdx]);
+                        stackpos++;
+                    }
                 }
-                else {
-                    aten::vec4 resultT, resultA, resultB;
+            }
+        }
+
+        return (isect.objid >= 0);
+    }
+
+    bool qbvh::hitLeaf(
+        const context& ctxt,
+        const std::vector<std::vector<QbvhNode>>& listQbvhNode,
+        const QbvhNode& node,
+        const ray& r,
+        real t_min, real t_max,
+        Intersection& isect,
+        bool isOcclusion) const
+    {
+        bool isHit = false;
 
-                    int res = intersectTriangle(
-                        resultT, resultA, resultB,
-                        r,
-                        t_min, t_max,
-                        qnode->primidx,
-                        *pnode);
+#ifdef ENABLE_BVH_MULTI_TRIANGLES
+        if (node.exid < 0 && node.numChildren > 1) {
+            if (node.primid >= 0) {
+                // Test all triangles in the leaf at once.
+                aten::vec4 resultT, resultA, resultB;
 
-                    for (int i = 0; i < pnode->numChildren; i++) {
-                        if ((res & (1 << i)) && (resultT[i] < isectTmp.t)) {
-                            isectTmp.t = resultT[i];
-                            isectTmp.a = resultA[i];
-                            isectTmp.b = resultB[i];
+                int res = intersectTriangles(
+                    resultT, resultA, resultB,
+                    r,
+                    t_min, t_max,
+                    node);
 
-                            isectTmp.primid = (int)pnode->primidx[i];
-                            isectTmp.objid = (int)pnode->shapeidx[i];
+                int hitIdx = -1;
 
-                            auto f = prims[isectTmp.primid];
+                for (int i = 0; i < node.numChildren; i++) {
+                    if ((res & (1 << i)) && resultT[i] < isect.t) {
+                        hitIdx = i;
 
-                            isectTmp.mtrlid = f->param.mtrlid;
-                            isectTmp.area = f->param.area;
+                        isect.t = resultT[i];
+                        isect.a = resultA[i];
+                        isect.b = resultB[i];
 
-                            isHit = true;
+                        if (isOcclusion) {
+                            // Any hit is enough.
+                            break;
                         }
                     }
+                }
+
+                if (hitIdx >= 0) {
+                    auto s = ctxt.getTransformable(node.shapeidx[hitIdx]);
 
-                    if (isHit) {
-                        auto s = shapes[isectTmp.objid];
-                        isectTmp.objid = s->id();
+                    isect.primid = node.primidx[hitIdx];
+                    isect.objid = s->id();
+                    isect.mtrlid = ctxt.getTriangleParam(node.primidx[hitIdx]).mtrlid;
+
+                    isHit = true;
+                }
+            }
+            else {
+                // Multiple items (e.g. sphere, cube) in the leaf.
+                for (int i = 0; i < node.numChildren; i++) {
+                    auto s = ctxt.getTransformable(node.shapeidx[i]);
+
+                    if (isOcclusion) {
+                        if (s->occluded(ctxt, r, t_min, t_max)) {
+                            return true;
+                        }
+                    }
+                    else if (s->hit(ctxt, r, t_min, t_max, isect)) {
+                        t_max = isect.t;
+                        isHit = true;
                     }
                 }
-#else
-                auto s = ctxt.getTransformable((int)pnode->shapeid);
+            }
+
+            return isHit;
+        }
+#endif
 
-                if (pnode->exid >= 0) {
-                    // Traverse external qbvh.
-                    const auto& param = s->getParam();
+        auto s = ctxt.getTransformable(node.shapeid);
 
-                    int mtxid = param.mtxid;
+        if (node.exid >= 0) {
+            // Traverse external qbvh.
+            const auto& param = s->getParam();
 
-                    aten::ray transformedRay;
+            int mtxid = param.mtxid;
 
-                    if (mtxid >= 0) {
-                        const auto& mtxW2L = m_mtxs[mtxid * 2 + 1];
+            aten::ray transformedRay;
 
-                        transformedRay = mtxW2L.applyRay(r);
-                    }
-                    else {
-                        transformedRay = r;
-                    }
+            real tmin = t_min;
+            real tmax = t_max;
 
-                    isHit = hit(
-                        ctxt,
-                        (int)pnode->exid,
-                        listQbvhNode,
-                        transformedRay,
-                        t_min, t_max,
-                        isectTmp);
+            if (mtxid >= 0) {
+                const auto& mtxW2L = m_mtxs[mtxid * 2 + 1];
+
+                transformedRay = mtxW2L.applyRay(r);
+
+                if (isOcclusion) {
+                    // The direction is normalized in the local space, so the interval has to be scaled.
+                    auto scale = length(mtxW2L.applyXYZ(r.dir));
+                    tmin *= scale;
+                    tmax *= scale;
                 }
-                else if (pnode->primid >= 0) {
-                    auto f = ctxt.getTriangle((int)pnode->primid);
-                    isHit = f->hit(ctxt, r, t_min, t_max, isectTmp);
+            }
+            else {
+                transformedRay = r;
+            }
 
-                    if (isHit) {
-                        isectTmp.objid = s->id();
+            isHit = hit(
+                ctxt,
+                node.exid,
+                listQbvhNode,
+                transformedRay,
+                tmin, tmax,
+                isect,
+                isOcclusion);
+        }
+        else if (node.primid >= 0) {
+            isHit = face::hit(ctxt, node.primid, r, t_min, t_max, isect);
+
+            if (isHit) {
+                isect.objid = s->id();
+            }
+        }
+        else if (isOcclusion) {
+            isHit = s->occluded(ctxt, r, t_min, t_max);
+        }
+        else {
+            // sphere, cube.
+            isHit = s->hit(ctxt, r, t_min, t_max, isect);
+        }
+
+        return isHit;
+    }
+
+    uint32_t qbvh::hit(
+        const context& ctxt,
+        const RayPacket& packet,
+        real t_min, real t_max,
+        Intersection* isects) const
+    {
+        return hit(ctxt, m_listQbvhNode, packet, t_min, t_max, isects, false);
+    }
+
+    uint32_t qbvh::occluded(
+        const context& ctxt,
+        const RayPacket& packet,
+        real t_min, real t_max) const
+    {
+        Intersection isects[RayPacket::MaxRayNum];
+        return hit(ctxt, m_listQbvhNode, packet, t_min, t_max, isects, true);
+    }
+
+    uint32_t qbvh::hit(
+        const context& ctxt,
+        const std::vector<std::vector<QbvhNode>>& listQbvhNode,
+        const RayPacket& packet,
+        real t_min, real t_max,
+        Intersection* isects,
+        bool isOcclusion) const
+    {
+        // NOTE
+        // Only the top layer is traversed as the packet.
+        // The rays in the packet are transformed differently in the bottom layer,
+        // so the bottom layer is traversed per ray.
+
+        if (listQbvhNode.empty() || listQbvhNode[0].empty()) {
+            return 0;
+        }
+
+        static const int stacksize = 64;
+
+        struct Entry {
+            const QbvhNode* node;
+            uint32_t mask;
+        } stackbuf[stacksize];
+
+        const RayPacketTraverseRays rays(packet);
+
+        real tmax[RayPacket::MaxRayNum];
+
+        for (uint32_t i = 0; i < RayPacket::MaxRayNum; i++) {
+            tmax[i] = t_max;
+
+            if (packet.activeMask & (1 << i)) {
+                isects[i] = Intersection();
+            }
+        }
+
+        // Mask of the rays which are still traversed.
+        uint32_t activeMask = packet.activeMask;
+
+        uint32_t hitMask = 0;
+
+        stackbuf[0].node = &listQbvhNode[0][0];
+        stackbuf[0].mask = activeMask;
+        int stackpos = 1;
+
+        while (stackpos > 0 && activeMask > 0) {
+            auto pnode = stackbuf[stackpos - 1].node;
+            auto mask = stackbuf[stackpos - 1].mask & activeMask;
+
+            stackpos -= 1;
+
+            if (mask == 0) {
+                continue;
+            }
+
+            if (pnode->isLeaf) {
+                for (uint32_t i = 0; i < packet.num; i++) {
+                    if ((mask & (1 << i)) == 0) {
+                        continue;
                     }
-                }
-                else {
-                    // sphere, cube.
-                    isHit = s->hit(ctxt, r, t_min, t_max, isectTmp);
-                }
-#endif
 
-                if (isHit) {
-                    if (isectTmp.t < isect.t) {
-                        isect = isectTmp;
-                        t_max = isect.t;
+                    Intersection isectTmp;
+
+                    if (hitLeaf(ctxt, listQbvhNode, *pnode, packet.rays[i], t_min, tmax[i], isectTmp, isOcclusion)) {
+                        if (isOcclusion) {
+                            // Any hit is enough.
+                            hitMask |= (1 << i);
+                            activeMask &= ~(1 << i);
+                        }
+                        else if (isectTmp.t < isects[i].t) {
+                            isects[i] = isectTmp;
+                            tmax[i] = isectTmp.t;
+
+                            hitMask |= (1 << i);
+                        }
                     }
                 }
             }
             else {
-                // Hit test children aabb.
-                aten::vec4 interserctT;
-                auto res = intersectAABB(
-                    interserctT,
-                    r,
-                    t_min, t_max,
-                    pnode->bminx, pnode->bmaxx,
-                    pnode->bminy, pnode->bmaxy,
-                    pnode->bminz, pnode->bmaxz);
+                // Stack hit children in reverse order, so that the first child is traversed first.
+                for (int c = pnode->numChildren - 1; c >= 0; c--) {
+                    aten::vec3 bmin(pnode->bminx[c], pnode->bminy[c], pnode->bminz[c]);
+                    aten::vec3 bmax(pnode->bmaxx[c], pnode->bmaxy[c], pnode->bmaxz[c]);
 
-                // Stack hit children.
-                if (res > 0) {
-                    for (int i = 0; i < numChildren; i++) {
-                        if ((res & (1 << i)) > 0) {
-                            stackbuf[stackpos] = Intersect(
-                                &listQbvhNode[exid][(int)pnode->leftChildrenIdx + i],
-                                interserctT[i]);
-                            stackpos++;
-                        }
+                    auto childMask = intersectAABB(rays, bmin, bmax, t_min, tmax, mask);
+
+                    if (childMask > 0) {
+                        AT_ASSERT(stackpos < stacksize);
+
+                        stackbuf[stackpos].node = &listQbvhNode[0][pnode->leftChildrenIdx + c];
+                        stackbuf[stackpos].mask = childMask;
+                        stackpos++;
                     }
                 }
             }
         }
 
-        return (isect.objid >= 0);
+        return hitMask;
     }
 }
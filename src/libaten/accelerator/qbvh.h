@@ -8,20 +8,20 @@ namespace aten {
         union {
             aten::vec4 p0;
             struct {
-                float leftChildrenIdx;
-                float isLeaf;
-                float numChildren;
-                float padding;
+                int leftChildrenIdx;    ///< Index of the first child.
+                int isLeaf;             ///< Flag if the node is leaf.
+                int numChildren;        ///< Number of children.
+                int padding;
             };
         };
 
         union {
             aten::vec4 p1;
             struct {
-                float shapeid;    ///< Object index.
-                float primid;    ///< Triangle index.
-                float exid;        ///< External bvh index.
-                float meshid;    ///< Mesh id.
+                int shapeid;    ///< Object index.
+                int primid;     ///< Triangle index.
+                int exid;       ///< External bvh index.
+                int meshid;     ///< Mesh id.
             };
         };
 
@@ -59,21 +59,28 @@ namespace aten {
         union {
             aten::vec4 p2;
             struct {
-                float shapeidx[4];
+                int shapeidx[4];
             };
         };
         union {
             aten::vec4 p3;
             struct {
-                float primidx[4];
+                int primidx[4];
             };
         };
+
+        // e2 = v2 - v0 of the triangles in the leaf.
+        aten::vec4 e2x;
+        aten::vec4 e2y;
+        aten::vec4 e2z;
 #endif
 
         QbvhNode()
         {
+            leftChildrenIdx = 0;
             isLeaf = false;
             numChildren = 0;
+            padding = 0;
 
             shapeid = -1;
             primid = -1;
@@ -88,6 +95,10 @@ namespace aten {
 #ifdef ENABLE_BVH_MULTI_TRIANGLES
             p2 = rhs.p2;
             p3 = rhs.p3;
+
+            e2x = rhs.e2x;
+            e2y = rhs.e2y;
+            e2z = rhs.e2z;
 #endif
 
             bminx = rhs.bminx;
@@ -131,6 +142,25 @@ namespace aten {
             return hit(ctxt, r, t_min, t_max, isect);
         }
 
+        virtual bool occluded(
+            const context& ctxt,
+            const ray& r,
+            real t_min, real t_max) const override;
+
+        virtual uint32_t hit(
+            const context& ctxt,
+            const RayPacket& packet,
+            real t_min, real t_max,
+            Intersection* isects) const override;
+
+        virtual uint32_t occluded(
+            const context& ctxt,
+            const RayPacket& packet,
+            real t_min, real t_max) const override;
+
+        using accelerator::hit;
+        using accelerator::occluded;
+
         std::vector<std::vector<QbvhNode>>& getNodes()
         {
             return m_listQbvhNode;
@@ -189,7 +219,25 @@ namespace aten {
             const std::vector<std::vector<QbvhNode>>& listQbvhNode,
             const ray& r,
             real t_min, real t_max,
-            Intersection& isect) const;
+            Intersection& isect,
+            bool isOcclusion) const;
+
+        bool hitLeaf(
+            const context& ctxt,
+            const std::vector<std::vector<QbvhNode>>& listQbvhNode,
+            const QbvhNode& node,
+            const ray& r,
+            real t_min, real t_max,
+            Intersection& isect,
+            bool isOcclusion) const;
+
+        uint32_t hit(
+            const context& ctxt,
+            const std::vector<std::vector<QbvhNode>>& listQbvhNode,
+            const RayPacket& packet,
+            real t_min, real t_max,
+            Intersection* isects,
+            bool isOcclusion) const;
 
     private:
         bvh m_bvh;
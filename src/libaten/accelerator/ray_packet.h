@@ -0,0 +1,181 @@
+#pragma once
+
+#include <algorithm>
+
+#include "defs.h"
+#include "math/ray.h"
+#include "math/vec3.h"
+
+// NOTE
+// SSE is always available on x64.
+// If real is double, 4-wide float SIMD is not available.
+#if !defined(TYPE_DOUBLE) && (defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64))
+#define AT_ENABLE_RAY_PACKET_SSE
+#include <immintrin.h>
+#endif
+
+namespace aten
+{
+    /**
+     * @brief Packet of rays which are traversed together to share node fetches.
+     */
+    struct RayPacket {
+        static const uint32_t MaxRayNum = 16;   ///< Max number of rays in the packet.
+
+        ray rays[MaxRayNum];
+
+        uint32_t num{ 0 };          ///< Number of rays in the packet.
+        uint32_t activeMask{ 0 };   ///< Bit mask of the rays which are traced.
+
+        /**
+         * @brief Add a ray to the packet.
+         * @return Index of the ray in the packet.
+         */
+        uint32_t add(const ray& r, bool isActive = true)
+        {
+            AT_ASSERT(num < MaxRayNum);
+
+            auto idx = num++;
+            rays[idx] = r;
+
+            if (isActive) {
+                activeMask |= (1 << idx);
+            }
+
+            return idx;
+        }
+
+        void clear()
+        {
+            num = 0;
+            activeMask = 0;
+        }
+
+        bool isFull() const
+        {
+            return num == MaxRayNum;
+        }
+    };
+
+    /**
+     * @brief SoA description of the rays in the packet to test AABB with multiple rays at once.
+     */
+    struct RayPacketTraverseRays {
+        real invdirX[RayPacket::MaxRayNum];     ///< Inverse of ray direction x.
+        real invdirY[RayPacket::MaxRayNum];     ///< Inverse of ray direction y.
+        real invdirZ[RayPacket::MaxRayNum];     ///< Inverse of ray direction z.
+
+        real orgInvdirX[RayPacket::MaxRayNum];  ///< Ray origin x multiplied by inverse of ray direction x.
+        real orgInvdirY[RayPacket::MaxRayNum];  ///< Ray origin y multiplied by inverse of ray direction y.
+        real orgInvdirZ[RayPacket::MaxRayNum];  ///< Ray origin z multiplied by inverse of ray direction z.
+
+        RayPacketTraverseRays(const RayPacket& packet)
+        {
+            // NOTE
+            // Avoid 0 division, but keep the sign of the direction.
+            static const real eps = real(1e-20);
+
+            real* invdir[3] = { invdirX, invdirY, invdirZ };
+            real* orgInvdir[3] = { orgInvdirX, orgInvdirY, orgInvdirZ };
+
+            for (uint32_t i = 0; i < RayPacket::MaxRayNum; i++) {
+                for (int n = 0; n < 3; n++) {
+                    if (i < packet.num) {
+                        const auto& r = packet.rays[i];
+
+                        auto d = r.dir[n];
+                        d = (aten::abs(d) > eps ? d : (d < real(0) ? -eps : eps));
+
+                        invdir[n][i] = real(1) / d;
+                        orgInvdir[n][i] = r.org[n] * invdir[n][i];
+                    }
+                    else {
+                        invdir[n][i] = real(0);
+                        orgInvdir[n][i] = real(0);
+                    }
+                }
+            }
+        }
+    };
+
+    /**
+     * @brief Test if the rays in the packet hit AABB.
+     * @param mask Bit mask of the rays which are tested.
+     * @param t_max Max distance per ray.
+     * @return Bit mask of the rays which hit AABB.
+     */
+    inline uint32_t intersectAABB(
+        const RayPacketTraverseRays& rays,
+        const vec3& bmin, const vec3& bmax,
+        real t_min, const real* t_max,
+        uint32_t mask)
+    {
+        uint32_t ret = 0;
+
+#ifdef AT_ENABLE_RAY_PACKET_SSE
+        const __m128 bminx = _mm_set1_ps(bmin.x);
+        const __m128 bminy = _mm_set1_ps(bmin.y);
+        const __m128 bminz = _mm_set1_ps(bmin.z);
+
+        const __m128 bmaxx = _mm_set1_ps(bmax.x);
+        const __m128 bmaxy = _mm_set1_ps(bmax.y);
+        const __m128 bmaxz = _mm_set1_ps(bmax.z);
+
+        const __m128 tmin = _mm_set1_ps(t_min);
+
+        for (uint32_t i = 0; i < RayPacket::MaxRayNum; i += 4) {
+            if (((mask >> i) & 0x0f) == 0) {
+                continue;
+            }
+
+            const __m128 invdx = _mm_loadu_ps(rays.invdirX + i);
+            const __m128 invdy = _mm_loadu_ps(rays.invdirY + i);
+            const __m128 invdz = _mm_loadu_ps(rays.invdirZ + i);
+
+            const __m128 ox = _mm_loadu_ps(rays.orgInvdirX + i);
+            const __m128 oy = _mm_loadu_ps(rays.orgInvdirY + i);
+            const __m128 oz = _mm_loadu_ps(rays.orgInvdirZ + i);
+
+            __m128 t0x = _mm_sub_ps(_mm_mul_ps(bminx, invdx), ox);
+            __m128 t1x = _mm_sub_ps(_mm_mul_ps(bmaxx, invdx), ox);
+            __m128 t0y = _mm_sub_ps(_mm_mul_ps(bminy, invdy), oy);
+            __m128 t1y = _mm_sub_ps(_mm_mul_ps(bmaxy, invdy), oy);
+            __m128 t0z = _mm_sub_ps(_mm_mul_ps(bminz, invdz), oz);
+            __m128 t1z = _mm_sub_ps(_mm_mul_ps(bmaxz, invdz), oz);
+
+            __m128 tnear = _mm_max_ps(
+                _mm_max_ps(_mm_min_ps(t0x, t1x), _mm_min_ps(t0y, t1y)),
+                _mm_max_ps(_mm_min_ps(t0z, t1z), tmin));
+            __m128 tfar = _mm_min_ps(
+                _mm_min_ps(_mm_max_ps(t0x, t1x), _mm_max_ps(t0y, t1y)),
+                _mm_min_ps(_mm_max_ps(t0z, t1z), _mm_loadu_ps(t_max + i)));
+
+            ret |= (uint32_t)_mm_movemask_ps(_mm_cmple_ps(tnear, tfar)) << i;
+        }
+#else
+        for (uint32_t i = 0; i < RayPacket::MaxRayNum; i++) {
+            if ((mask & (1 << i)) == 0) {
+                continue;
+            }
+
+            real t0x = bmin.x * rays.invdirX[i] - rays.orgInvdirX[i];
+            real t1x = bmax.x * rays.invdirX[i] - rays.orgInvdirX[i];
+            real t0y = bmin.y * rays.invdirY[i] - rays.orgInvdirY[i];
+            real t1y = bmax.y * rays.invdirY[i] - rays.orgInvdirY[i];
+            real t0z = bmin.z * rays.invdirZ[i] - rays.orgInvdirZ[i];
+            real t1z = bmax.z * rays.invdirZ[i] - rays.orgInvdirZ[i];
+
+            real tnear = std::max(
+                std::max(std::min(t0x, t1x), std::min(t0y, t1y)),
+                std::max(std::min(t0z, t1z), t_min));
+            real tfar = std::min(
+                std::min(std::max(t0x, t1x), std::max(t0y, t1y)),
+                std::min(std::max(t0z, t1z), t_max[i]));
+
+            ret |= (tnear <= tfar ? 1 : 0) << i;
+        }
+#endif
+
+        return ret & mask;
+    }
+}
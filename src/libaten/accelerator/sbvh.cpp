@@ -2,9 +2,8 @@
 #include <iterator>
 #include <numeric>
 
-#include <omp.h>
-
 #include "accelerator/sbvh.h"
+#include "misc/omputil.h"
 
 //#pragma optimize( "", off)
 
@@ -31,51 +30,51 @@ namespace aten
         return false;
     }
 
-    template <class Iter, class Cmp>
-    void mergeSort(Iter first, Iter last, Cmp cmp)
+    // Number of the ranges which the references are divided into to be binned.
+    inline uint32_t getRangeNum(bool isParallel)
     {
-        const auto numThreads = ::omp_get_max_threads();
-
-        const auto numItems = last - first;
-        const auto numItemPerThread = numItems / numThreads;
+#ifdef ENABLE_OMP
+        return isParallel ? std::max<uint32_t>(OMPUtil::getThreadNum(), 1) : 1;
+#else
+        return 1;
+#endif
+    }
 
-        // Sort each blocks.
-#pragma omp parallel num_threads(numThreads)
-        {
-            const auto idx = ::omp_get_thread_num();
-        
-            const auto startPos = idx * numItemPerThread;
-            const auto endPos = (idx + 1 == numThreads ? numItems : startPos + numItemPerThread);
+    // Call the function for each range which the items are divided into.
+    template <class Func>
+    inline void forEachRange(
+        uint32_t num,
+        uint32_t rangeNum,
+        Func func)
+    {
+#ifdef ENABLE_OMP
+#pragma omp parallel for if (rangeNum > 1)
+#endif
+        for (int r = 0; r < (int)rangeNum; r++) {
+            uint32_t start = (uint32_t)(((uint64_t)num * r) / rangeNum);
+            uint32_t end = (uint32_t)(((uint64_t)num * (r + 1)) / rangeNum);
 
-            std::sort(first + startPos, first + endPos, cmp);
+            func(r, start, end);
         }
+    }
 
-        int blockNum = numThreads;
-
-        // Merge blocks.
-        while (blockNum >= 2)
-        {
-            const auto numItemsInBlocks = numItems / blockNum;
-
-            // Q̃ubNPɃ}[W.
-#pragma omp parallel num_threads(blockNum / 2)
-            {
-                const auto idx = ::omp_get_thread_num();
-
-                // Q̃ubNPɃ}[ŴŁAnumItemsInBlocks * 2 ƂȂ.
-                auto startPos = idx * numItemsInBlocks * 2;
-
-                // Ԓn_Ȃ̂ŁAnumItemsInBlocks * 2 ̔ numItemsInBlocks ƂȂ.
-                auto pivot = startPos + numItemsInBlocks;
-
-                // I[.
-                auto endPos = (idx + 1 == blockNum / 2 ? numItems : pivot + numItemsInBlocks);
-
-                std::inplace_merge(first + startPos, first + pivot, first + endPos);
+    // Merge the bins of each range in order.
+    // Only min/max and sum are used, so the result is same as binning all references at once.
+    template <class BIN>
+    inline void mergeBins(
+        std::vector<BIN>& bins,
+        const std::vector<BIN>& rangeBins,
+        uint32_t rangeNum)
+    {
+        const auto binNum = bins.size();
+
+        for (uint32_t r = 0; r < rangeNum; r++) {
+            for (size_t i = 0; i < binNum; i++) {
+                const auto& src = rangeBins[r * binNum + i];
+                bins[i].bbox.expand(src.bbox);
+                bins[i].start += src.start;
+                bins[i].end += src.end;
             }
-
-            // QPɃ}[ŴŁAɂȂ.
-            blockNum = (blockNum + 1) / 2;
         }
     }
 
@@ -197,7 +196,7 @@ namespace aten
         aabb rootBox;
 
         m_refs.clear();
-        m_refs.reserve(2 * tris.size());
+        m_refs.reserve((uint32_t)(tris.size() * m_maxRefRatio));
         m_refs.resize(tris.size());
 
         m_offsetTriIdx = INT32_MAX;
@@ -225,6 +224,134 @@ namespace aten
 
         auto rootSurfaceArea = rootBox.computeSurfaceArea();
 
+        // Number of the references which can be added by the spatial splits.
+        uint32_t budget = (uint32_t)(tris.size() * (m_maxRefRatio - real(1)));
+
+        m_nodes.clear();
+        m_nodes.push_back(SBVHNode());
+        m_nodes[0] = SBVHNode(std::move(refIndices), rootBox);
+
+        m_refIndexNum = 0;
+
+        m_maxDepth = 0;
+
+        // Build the top of the tree until the nodes become small enough.
+        std::vector<uint32_t> subtreeRoots;
+        {
+            ReferenceList refs(m_refs, false);
+            buildTree(m_nodes, refs, budget, rootSurfaceArea, &subtreeRoots, m_maxDepth, m_refIndexNum);
+        }
+
+        if (subtreeRoots.empty()) {
+            return;
+        }
+
+        const uint32_t subtreeNum = (uint32_t)subtreeRoots.size();
+
+        // Distribute the remaining budget to the subtrees in proportion to their references.
+        uint64_t subtreeRefNum = 0;
+        for (auto idx : subtreeRoots) {
+            subtreeRefNum += m_nodes[idx].refIds.size();
+        }
+
+        struct Subtree {
+            std::vector<SBVHNode> nodes;
+            std::vector<Reference> refs;
+            uint32_t maxDepth{ 0 };
+            uint32_t refIndexNum{ 0 };
+        };
+
+        std::vector<Subtree> subtrees(subtreeNum);
+
+        // The references which are added in the subtrees are indexed from it.
+        const uint32_t refBase = (uint32_t)m_refs.size();
+
+        // Build the subtrees.
+        // The shared nodes and references are not resized here, and each subtree has the exclusive references.
+#ifdef ENABLE_OMP
+#pragma omp parallel for schedule(dynamic, 1)
+#endif
+        for (int i = 0; i < (int)subtreeNum; i++) {
+            auto& subtree = subtrees[i];
+            auto& root = m_nodes[subtreeRoots[i]];
+
+            uint32_t subtreeBudget = (uint32_t)(((uint64_t)budget * root.refIds.size()) / subtreeRefNum);
+
+            subtree.nodes.push_back(std::move(root));
+
+            ReferenceList refs(m_refs, true);
+            AT_ASSERT(refs.base == refBase);
+
+            buildTree(subtree.nodes, refs, subtreeBudget, rootSurfaceArea, nullptr, subtree.maxDepth, subtree.refIndexNum);
+
+            subtree.refs = std::move(refs.added);
+        }
+
+        // Merge the subtrees in order.
+        size_t nodeNum = m_nodes.size();
+        for (const auto& subtree : subtrees) {
+            nodeNum += subtree.nodes.size() - 1;
+        }
+        m_nodes.reserve(nodeNum);
+
+        for (uint32_t i = 0; i < subtreeNum; i++) {
+            auto& subtree = subtrees[i];
+
+            const auto rootIdx = subtreeRoots[i];
+
+            // Offset to the references which are added in the subtree.
+            const auto refOffset = (uint32_t)m_refs.size() - refBase;
+
+            // Index of the second node of the subtree in the shared nodes.
+            const auto nodeBase = (int)m_nodes.size();
+
+            auto toSharedIdx = [rootIdx, nodeBase](int idx) {
+                return idx == 0 ? (int)rootIdx : nodeBase + idx - 1;
+            };
+
+            for (uint32_t n = 0; n < subtree.nodes.size(); n++) {
+                auto& node = subtree.nodes[n];
+
+                for (auto& id : node.refIds) {
+                    if (id >= refBase) {
+                        id += refOffset;
+                    }
+                }
+
+                if (!node.isLeaf()) {
+                    node.setChild(toSharedIdx(node.left), toSharedIdx(node.right));
+                }
+
+                if (n == 0) {
+                    // The root keeps the parent in the shared nodes.
+                    m_nodes[rootIdx] = std::move(node);
+                }
+                else {
+                    node.parent = toSharedIdx(node.parent);
+                    m_nodes.push_back(std::move(node));
+                }
+            }
+
+            m_refs.insert(m_refs.end(), subtree.refs.begin(), subtree.refs.end());
+
+            m_maxDepth = std::max(m_maxDepth, subtree.maxDepth);
+            m_refIndexNum += subtree.refIndexNum;
+
+            subtree = Subtree();
+        }
+
+        AT_ASSERT(m_nodes.size() == nodeNum);
+    }
+
+    void sbvh::buildTree(
+        std::vector<SBVHNode>& nodes,
+        ReferenceList& refs,
+        uint32_t& budget,
+        real rootSurfaceArea,
+        std::vector<uint32_t>* subtreeRoots,
+        uint32_t& maxDepth,
+        uint32_t& refIndexNum)
+    {
         // TODO
         const real areaAlpha = real(1e-5);
 
@@ -237,37 +364,38 @@ namespace aten
         } stack[128];
 
         int stackpos = 1;
-        stack[0] = SBVHEntry(0, 0);
-
-        m_nodes.reserve(m_refs.size() * 3);
-        m_nodes.push_back(SBVHNode());
-        m_nodes[0] = SBVHNode(std::move(refIndices), rootBox);
-
-        uint32_t numNodes = 1;
-
-        m_refIndexNum = 0;
-
-        m_maxDepth = 0;
+        stack[0] = SBVHEntry(0, nodes[0].depth);
 
         while (stackpos > 0)
         {
             auto top = stack[--stackpos];
-            auto& node = m_nodes[top.nodeIdx];
+            auto& node = nodes[top.nodeIdx];
 
-            m_maxDepth = std::max<uint32_t>(node.depth, m_maxDepth);
+            maxDepth = std::max<uint32_t>(node.depth, maxDepth);
+
+            const uint32_t refNum = (uint32_t)node.refIds.size();
 
             // enough triangles so far.
-            if (node.refIds.size() <= m_maxTriangles) {
-                m_refIndexNum += (uint32_t)node.refIds.size();
+            if (refNum <= m_maxTriangles) {
+                refIndexNum += refNum;
                 continue;
             }
 
+            // Small enough to be built as the subtree.
+            if (subtreeRoots && refNum <= SubtreeThreshold) {
+                subtreeRoots->push_back(top.nodeIdx);
+                continue;
+            }
+
+            // The large nodes at the top of the tree are binned in parallel.
+            const bool isParallel = subtreeRoots && refNum >= ParallelBinningThreshold;
+
             real objCost = 0.0f;
             aabb objLeftBB;
             aabb objRightBB;
             int sahBin = -1;
             int sahComponent = -1;
-            findObjectSplit(node, objCost, objLeftBB, objRightBB, sahBin, sahComponent);
+            findObjectSplit(node, refs, isParallel, objCost, objLeftBB, objRightBB, sahBin, sahComponent);
 
             // check whether the object split produces overlapping nodes
             // if so, check whether we are close enough to the root so that the spatial split makes sense.
@@ -277,7 +405,7 @@ namespace aten
             // Check if the surface area of merged AABBs is bigger than the specified cost.
             bool isOverrlap = checkAABBOverlap(objLeftBB, objRightBB, overlapCost);
 
-            if (isOverrlap) {
+            if (isOverrlap && budget > 0) {
                 // If the AABBs are overlapped, check whether the node is needed to split.
                 needComputeSpatial = (overlapCost / rootSurfaceArea) >= areaAlpha;
             }
@@ -293,11 +421,20 @@ namespace aten
             if (needComputeSpatial) {
                 findSpatialSplit(
                     node,
+                    refs,
+                    isParallel,
                     spatialCost,
                     leftCnt, rightCnt,
                     spatialLeftBB, spatialRightBB,
                     spatialDimension,
                     spatialSplitPlane);
+
+                // Don't split spatially, if the duplicated references exceed the budget.
+                if (spatialDimension >= 0
+                    && (uint32_t)(leftCnt + rightCnt) > refNum + budget)
+                {
+                    needComputeSpatial = false;
+                }
             }
 
             std::vector<uint32_t> leftList;
@@ -312,6 +449,7 @@ namespace aten
                 // use spatial split.
                 spatialSort(
                     node,
+                    refs,
                     spatialSplitPlane,
                     spatialDimension,
                     spatialCost,
@@ -323,6 +461,9 @@ namespace aten
                 objRightBB = spatialRightBB;
 
                 usedAxis = spatialDimension;
+
+                const auto duplicated = (uint32_t)(leftList.size() + rightList.size()) - refNum;
+                budget -= std::min(duplicated, budget);
             }
             else {
                 // use object split.
@@ -343,11 +484,14 @@ namespace aten
                     usedAxis = bestAxis;
 
                     // bestAxisɊÂbboẍʒuɉă\[g.
-                    mergeSort(
+                    // The index breaks the tie, so the order is always same.
+                    std::sort(
                         node.refIds.begin(),
                         node.refIds.end(),
-                        [bestAxis, this](const uint32_t a, const uint32_t b) {
-                        return m_refs[a].bbox.getCenter()[bestAxis] < m_refs[b].bbox.getCenter()[bestAxis];
+                        [bestAxis, &refs](const uint32_t a, const uint32_t b) {
+                        const auto ca = refs[a].bbox.getCenter()[bestAxis];
+                        const auto cb = refs[b].bbox.getCenter()[bestAxis];
+                        return ca < cb || (ca == cb && a < b);
                     });
 
                     // AABB̑傫Zbg.
@@ -358,7 +502,7 @@ namespace aten
                     // Eƍɋϓɕ.
                     for (int i = 0; i < node.refIds.size(); i++) {
                         const auto id = node.refIds[i];
-                        const auto& ref = m_refs[id];
+                        const auto& ref = refs[id];
 
                         if (i < node.refIds.size() / 2) {
                             leftList.push_back(node.refIds[i]);
@@ -373,6 +517,7 @@ namespace aten
                 else {
                     objectSort(
                         node,
+                        refs,
                         sahBin,
                         sahComponent,
                         leftList, rightList);
@@ -383,7 +528,7 @@ namespace aten
 
             // push left and right.
 
-            auto leftIdx = numNodes;
+            auto leftIdx = (uint32_t)nodes.size();
             auto rightIdx = leftIdx + 1;
 
             AT_ASSERT(leftList.size() + rightList.size() >= node.refIds.size());
@@ -394,25 +539,23 @@ namespace aten
 
             // copy node data to left and right children.
             //  push_back 邱ƂŁAstd::vector ̃\ς邱Ƃ̂ŁAQƂł node ̕ύX͂̑O܂łɏI点邱.
-            m_nodes.push_back(SBVHNode());
-            m_nodes.push_back(SBVHNode());
+            nodes.push_back(SBVHNode());
+            nodes.push_back(SBVHNode());
+
+            nodes[leftIdx] = SBVHNode(std::move(leftList), objLeftBB);
+            nodes[rightIdx] = SBVHNode(std::move(rightList), objRightBB);
 
-            m_nodes[leftIdx] = SBVHNode(std::move(leftList), objLeftBB);
-            m_nodes[rightIdx] = SBVHNode(std::move(rightList), objRightBB);
+            nodes[leftIdx].parent = top.nodeIdx;
+            nodes[leftIdx].depth = top.depth + 1;
 
-            m_nodes[leftIdx].parent = top.nodeIdx;
-            m_nodes[leftIdx].depth = top.depth + 1;
+            nodes[rightIdx].parent = top.nodeIdx;
+            nodes[rightIdx].depth = top.depth + 1;
 
-            m_nodes[rightIdx].parent = top.nodeIdx;
-            m_nodes[rightIdx].depth = top.depth + 1;
+            AT_ASSERT(stackpos + 2 <= AT_COUNTOF(stack));
 
             stack[stackpos++] = SBVHEntry(leftIdx, top.depth + 1);
             stack[stackpos++] = SBVHEntry(rightIdx, top.depth + 1);
-
-            numNodes += 2;
         }
-
-        AT_ASSERT(m_nodes.size() == numNodes);
     }
 
     inline real evalPreSplitCost(
@@ -424,6 +567,8 @@ namespace aten
 
     void sbvh::findObjectSplit(
         SBVHNode& node,
+        ReferenceList& refs,
+        bool isParallel,
         real& cost,
         aabb& leftBB,
         aabb& rightBB,
@@ -436,12 +581,23 @@ namespace aten
 
         uint32_t refNum = (uint32_t)node.refIds.size();
 
+        const auto rangeNum = getRangeNum(isParallel);
+        std::vector<Bin> rangeBins(rangeNum * m_numBins);
+
         // compute the aabb of all centroids.
-        for (uint32_t i = 0; i < refNum; i++) {
-            auto id = node.refIds[i];
-            const auto& ref = m_refs[id];
-            auto center = ref.bbox.getCenter();
-            bbCentroid.expand(center);
+        std::vector<aabb> centroidBoxes(rangeNum);
+
+        forEachRange(refNum, rangeNum, [&](int r, uint32_t start, uint32_t end) {
+            for (uint32_t i = start; i < end; i++) {
+                auto id = node.refIds[i];
+                const auto& ref = refs[id];
+                auto center = ref.bbox.getCenter();
+                centroidBoxes[r].expand(center);
+            }
+        });
+
+        for (const auto& box : centroidBoxes) {
+            bbCentroid.expand(box);
         }
 
         cost = AT_MATH_INF;
@@ -465,26 +621,33 @@ namespace aten
             for (uint32_t i = 0; i < m_numBins; i++) {
                 bins[i] = Bin();
             }
+            std::fill(rangeBins.begin(), rangeBins.end(), Bin());
 
             // distribute references in the bins based on the centroids.
-            for (uint32_t i = 0; i < refNum; i++) {
-                // m[hɊ܂܂Op`AABBɂČvZ.
+            forEachRange(refNum, rangeNum, [&](int r, uint32_t start, uint32_t end) {
+                auto localBins = &rangeBins[r * m_numBins];
 
-                auto id = node.refIds[i];
-                const auto& ref = m_refs[id];
+                for (uint32_t i = start; i < end; i++) {
+                    // m[hɊ܂܂Op`AABBɂČvZ.
 
-                auto center = ref.bbox.getCenter();
+                    auto id = node.refIds[i];
+                    const auto& ref = refs[id];
 
-                // (bins)ւ̃CfbNX.
-                // ŏ[_Op`AABB̒Sւ̋̒ŐK邱ƂŌvZ.
-                int binIdx = (int)(m_numBins * ((center[dim] - centroidMin[dim]) * invLen));
+                    auto center = ref.bbox.getCenter();
 
-                binIdx = std::min<int>(binIdx, m_numBins - 1);
-                AT_ASSERT(binIdx >= 0);
+                    // (bins)ւ̃CfbNX.
+                    // ŏ[_Op`AABB̒Sւ̋̒ŐK邱ƂŌvZ.
+                    int binIdx = (int)(m_numBins * ((center[dim] - centroidMin[dim]) * invLen));
 
-                bins[binIdx].start += 1;    // BinɊ܂܂Op`̐𑝂₷.
-                bins[binIdx].bbox.expand(ref.bbox);
-            }
+                    binIdx = std::min<int>(binIdx, m_numBins - 1);
+                    AT_ASSERT(binIdx >= 0);
+
+                    localBins[binIdx].start += 1;    // BinɊ܂܂Op`̐𑝂₷.
+                    localBins[binIdx].bbox.expand(ref.bbox);
+                }
+            });
+
+            mergeBins(bins, rangeBins, rangeNum);
 
             // 납番~ς.
             bins[m_numBins - 1].accum = bins[m_numBins - 1].bbox;
@@ -542,6 +705,8 @@ namespace aten
 
     void sbvh::findSpatialSplit(
         SBVHNode& node,
+        ReferenceList& refs,
+        bool isParallel,
         real& cost,
         int& retLeftCount,
         int& retRightCount,
@@ -558,6 +723,9 @@ namespace aten
 
         uint32_t refNum = (uint32_t)node.refIds.size();
 
+        const auto rangeNum = getRangeNum(isParallel);
+        std::vector<Bin> rangeBins(rangeNum * m_numBins);
+
         const auto& box = node.bbox;
         const auto boxMin = box.minPos();
         const auto boxMax = box.maxPos();
@@ -582,44 +750,52 @@ namespace aten
             }
 
             // Check all triangles which the node has.
-            for (uint32_t i = 0; i < refNum; i++) {
-                const auto id = node.refIds[i];
-                const auto& ref = m_refs[id];
+            std::fill(rangeBins.begin(), rangeBins.end(), Bin());
 
-                const auto triMin = ref.bbox.minPos()[dim];
-                const auto triMax = ref.bbox.maxPos()[dim];
+            forEachRange(refNum, rangeNum, [&](int r, uint32_t start, uint32_t end) {
+                auto localBins = &rangeBins[r * m_numBins];
 
-                // split each triangle into references.
-                // each triangle will be recorded into multiple bins.
-                // Op`镪̃CfbNX͈͂vZ.
-                int binStartIdx = (int)(m_numBins * ((triMin - boxMin[dim]) * invLen));
-                int binEndIdx = (int)(m_numBins * ((triMax - boxMin[dim]) * invLen));
+                for (uint32_t i = start; i < end; i++) {
+                    const auto id = node.refIds[i];
+                    const auto& ref = refs[id];
 
-                binStartIdx = aten::clamp<int>(binStartIdx, 0, m_numBins - 1);
-                binEndIdx = aten::clamp<int>(binEndIdx, 0, m_numBins - 1);
+                    const auto triMin = ref.bbox.minPos()[dim];
+                    const auto triMax = ref.bbox.maxPos()[dim];
 
-                //AT_ASSERT(binStartIdx <= binEndIdx);
+                    // split each triangle into references.
+                    // each triangle will be recorded into multiple bins.
+                    // Op`镪̃CfbNX͈͂vZ.
+                    int binStartIdx = (int)(m_numBins * ((triMin - boxMin[dim]) * invLen));
+                    int binEndIdx = (int)(m_numBins * ((triMax - boxMin[dim]) * invLen));
 
-                for (int n = binStartIdx; n <= binEndIdx; n++) {
-                    const auto binMin = boxMin[dim] + n * lenghthPerBin;
-                    const auto binMax = boxMin[dim] + (n + 1) * lenghthPerBin;
-                    AT_ASSERT(binMin <= binMax);
+                    binStartIdx = aten::clamp<int>(binStartIdx, 0, m_numBins - 1);
+                    binEndIdx = aten::clamp<int>(binEndIdx, 0, m_numBins - 1);
 
-                    bins[n].bbox.expand(ref.bbox);
+                    //AT_ASSERT(binStartIdx <= binEndIdx);
 
-                    if (bins[n].bbox.minPos()[dim] < binMin) {
-                        bins[n].bbox.minPos()[dim] = binMin;
-                    }
+                    for (int n = binStartIdx; n <= binEndIdx; n++) {
+                        const auto binMin = boxMin[dim] + n * lenghthPerBin;
+                        const auto binMax = boxMin[dim] + (n + 1) * lenghthPerBin;
+                        AT_ASSERT(binMin <= binMax);
+
+                        localBins[n].bbox.expand(ref.bbox);
+
+                        if (localBins[n].bbox.minPos()[dim] < binMin) {
+                            localBins[n].bbox.minPos()[dim] = binMin;
+                        }
 
-                    if (bins[n].bbox.maxPos()[dim] > binMax) {
-                        bins[n].bbox.maxPos()[dim] = binMax;
+                        if (localBins[n].bbox.maxPos()[dim] > binMax) {
+                            localBins[n].bbox.maxPos()[dim] = binMax;
+                        }
                     }
+
+                    // 񂪎舵Op`XV.
+                    localBins[binStartIdx].start++;
+                    localBins[binEndIdx].end++;
                 }
+            });
 
-                // 񂪎舵Op`XV.
-                bins[binStartIdx].start++;
-                bins[binEndIdx].end++;
-            }
+            mergeBins(bins, rangeBins, rangeNum);
 
             // augment the bins from right to left.
 
@@ -671,6 +847,7 @@ namespace aten
 
     void sbvh::spatialSort(
         SBVHNode& node,
+        ReferenceList& refs,
         real splitPlane,
         int axis,
         real splitCost,
@@ -691,7 +868,7 @@ namespace aten
         // distribute the refenreces to left, right or both children.
         for (uint32_t i = 0; i < refNum; i++) {
             const auto refIdx = node.refIds[i];
-            const auto& ref = m_refs[refIdx];
+            const auto& ref = refs[refIdx];
 
             const auto refMin = ref.bbox.minPos()[axis];
             const auto refMax = ref.bbox.maxPos()[axis];
@@ -748,25 +925,25 @@ namespace aten
                     // push left and right.
                     // ɕ.
 
-                    Reference leftRef(m_refs[refIdx]);
+                    Reference leftRef(refs[refIdx]);
 
                     // oEfBO{bNXXV.
                     if (leftRef.bbox.maxPos()[axis] > splitPlane) {
                         leftRef.bbox.maxPos()[axis] = splitPlane;
                     }
 
-                    Reference rightRef(m_refs[refIdx]);
+                    Reference rightRef(refs[refIdx]);
 
                     // oEfBO{bNXXV.
                     if (rightRef.bbox.minPos()[axis] < splitPlane) {
                         rightRef.bbox.minPos()[axis] = splitPlane;
                     }
 
-                    m_refs[refIdx] = leftRef;
-                    m_refs.push_back(rightRef);
+                    refs[refIdx] = leftRef;
+                    auto rightRefIdx = refs.add(rightRef);
 
                     leftList.push_back(refIdx);
-                    rightList.push_back((uint32_t)m_refs.size() - 1);
+                    rightList.push_back(rightRefIdx);
                 }
             }
         }
@@ -774,6 +951,7 @@ namespace aten
 
     void sbvh::objectSort(
         SBVHNode& node,
+        ReferenceList& refs,
         int splitBin,
         int axis,
         std::vector<uint32_t>& leftList,
@@ -788,7 +966,7 @@ namespace aten
         // compute the aabb of all centroids.
         for (int i = 0; i < refNum; i++) {
             const auto id = node.refIds[i];
-            const auto& ref = m_refs[id];
+            const auto& ref = refs[id];
             auto centroid = ref.bbox.getCenter();
             bbCentroid.expand(centroid);
         }
@@ -798,7 +976,7 @@ namespace aten
         // distribute to left and right based on the provided split bin
         for (int i = 0; i < refNum; i++) {
             const auto id = node.refIds[i];
-            const auto& ref = m_refs[id];
+            const auto& ref = refs[id];
 
             auto center = ref.bbox.getCenter();
 
@@ -984,6 +1162,26 @@ namespace aten
         real t_min, real t_max,
         bool enableLod,
         Intersection& isect) const
+    {
+        return onHit(ctxt, r, t_min, t_max, enableLod, isect, false);
+    }
+
+    bool sbvh::occluded(
+        const context& ctxt,
+        const ray& r,
+        real t_min, real t_max) const
+    {
+        Intersection isect;
+        return onHit(ctxt, r, t_min, t_max, false, isect, true);
+    }
+
+    bool sbvh::onHit(
+        const context& ctxt,
+        const ray& r,
+        real t_min, real t_max,
+        bool enableLod,
+        Intersection& isect,
+        bool isOcclusion) const
     {
         auto& mtxs = m_bvh.getMatrices();
 
@@ -1020,10 +1218,20 @@ namespace aten
 
                     aten::ray transformedRay;
 
+                    real tmin = t_min;
+                    real tmax = t_max;
+
                     if (mtxid >= 0) {
                         const auto& mtxW2L = mtxs[mtxid * 2 + 1];
 
                         transformedRay = mtxW2L.applyRay(r);
+
+                        if (isOcclusion) {
+                            // The direction is normalized in the local space, so the interval has to be scaled.
+                            auto scale = length(mtxW2L.applyXYZ(r.dir));
+                            tmin *= scale;
+                            tmax *= scale;
+                        }
                     }
                     else {
                         transformedRay = r;
@@ -1039,23 +1247,31 @@ namespace aten
                         ctxt,
                         exid,
                         transformedRay,
-                        t_min, t_max,
+                        tmin, tmax,
                         isectTmp,
-                        enableLod);
+                        enableLod,
+                        isOcclusion);
                 }
                 else if (node->primid >= 0) {
                     // Hit test for a primitive.
-                    auto prim = ctxt.getTriangle((int)node->primid);
-                    isHit = prim->hit(ctxt, r, t_min, t_max, isectTmp);
+                    isHit = face::hit(ctxt, (int)node->primid, r, t_min, t_max, isectTmp);
                     if (isHit) {
                         isectTmp.objid = s->id();
                     }
                 }
+                else if (isOcclusion) {
+                    isHit = s->occluded(ctxt, r, t_min, t_max);
+                }
                 else {
                     // Hit test for a shape.
                     isHit = s->hit(ctxt, r, t_min, t_max, isectTmp);
                 }
 
+                if (isHit && isOcclusion) {
+                    // Any hit is enough.
+                    return true;
+                }
+
                 if (isHit) {
                     if (isectTmp.t < isect.t) {
                         isect = isectTmp;
@@ -1085,7 +1301,8 @@ namespace aten
         const ray& r,
         real t_min, real t_max,
         Intersection& isect,
-        bool enableLod) const
+        bool enableLod,
+        bool isOcclusion) const
     {
         real hitt = AT_MATH_INF;
 
@@ -1108,11 +1325,10 @@ namespace aten
                 Intersection isectTmp;
 
 #if (SBVH_TRIANGLE_NUM == 1)
-                auto prim = ctxt.getTriangle((int)node->triid);
-                isHit = prim->hit(ctxt, r, t_min, t_max, isectTmp);
+                isHit = face::hit(ctxt, (int)node->triid, r, t_min, t_max, isectTmp);
 
                 if (isHit) {
-                    const auto& primParam = prim->getParam();
+                    const auto& primParam = ctxt.getTriangleParam((int)node->triid);
                     isectTmp.meshid = primParam.gemoid;
                 }
 #else
@@ -1135,6 +1351,12 @@ namespace aten
                 }
 #endif
 
+                if (isHit && isOcclusion) {
+                    // Any hit is enough.
+                    isect = isectTmp;
+                    return true;
+                }
+
                 if (isHit) {
                     if (isectTmp.t < isect.t) {
                         isect = isectTmp;
@@ -1408,6 +1630,105 @@ namespace aten
         return true;
     }
 
+    // Sections of the cache.
+    enum SbvhCacheSection : uint32_t {
+        SbvhCacheMeta,
+        SbvhCacheNodes,
+    };
+
+    struct SbvhCacheMetaData {
+        real boxmin[3];
+        real boxmax[3];
+        uint32_t maxDepth;
+        int offsetTriIdx;
+    };
+
+    void sbvh::hashBuildSettings(AccelCacheHasher& hasher) const
+    {
+        hasher.add(m_numBins);
+        hasher.add(m_maxTriangles);
+        hasher.add(m_maxRefRatio);
+        hasher.add((uint32_t)SubtreeThreshold);
+        hasher.add((int)VoxelDepth);
+        hasher.add((uint32_t)sizeof(ThreadedSbvhNode));
+    }
+
+    bool sbvh::exportCache(
+        const context& ctxt,
+        AccelCacheWriter& writer)
+    {
+        AT_VRETURN_FALSE(m_isNested);
+
+        if (m_threadedNodes.empty() || m_threadedNodes[0].empty()) {
+            m_threadedNodes.resize(1);
+
+            // Build voxel.
+            if (!m_treelets.empty() && !m_nodes.empty()) {
+                buildVoxel(ctxt);
+            }
+
+            // NOTE
+            // The threaded nodes are kept, so the top layer copies them as the imported ones.
+            std::vector<int> indices;
+            convert(
+                m_threadedNodes[0],
+                0,
+                indices);
+        }
+
+        const auto& nodes = m_threadedNodes[0];
+        AT_VRETURN_FALSE(!nodes.empty());
+
+        const auto& bbox = getBoundingbox();
+
+        SbvhCacheMetaData meta;
+        for (int i = 0; i < 3; i++) {
+            meta.boxmin[i] = bbox.minPos()[i];
+            meta.boxmax[i] = bbox.maxPos()[i];
+        }
+        meta.maxDepth = m_maxDepth;
+        meta.offsetTriIdx = m_offsetTriIdx;
+
+        writer.addValue(SbvhCacheMeta, meta);
+        writer.addSection(SbvhCacheNodes, &nodes[0], sizeof(ThreadedSbvhNode), (uint32_t)nodes.size());
+
+        return true;
+    }
+
+    bool sbvh::importCache(
+        const context& ctxt,
+        const AccelCacheReader& reader)
+    {
+        AT_ASSERT(m_isNested);
+
+        uint32_t metaNum = 0;
+        auto meta = reader.getSection<SbvhCacheMetaData>(SbvhCacheMeta, metaNum);
+
+        uint32_t nodeNum = 0;
+        auto nodes = reader.getSection<ThreadedSbvhNode>(SbvhCacheNodes, nodeNum);
+
+        if (!meta || metaNum != 1 || !nodes || nodeNum == 0) {
+            return false;
+        }
+
+        // NOTE
+        // The nodes are copied at once from the mapped file, because the top layer tree copies them to its list.
+        // The triangle indices in the nodes are absolute, so they are not offset.
+        m_threadedNodes.resize(1);
+        m_threadedNodes[0].assign(nodes, nodes + nodeNum);
+
+        setBoundingBox(aabb(
+            vec3(meta->boxmin[0], meta->boxmin[1], meta->boxmin[2]),
+            vec3(meta->boxmax[0], meta->boxmax[1], meta->boxmax[2])));
+
+        m_maxDepth = meta->maxDepth;
+        m_offsetTriIdx = meta->offsetTriIdx;
+
+        m_isImported = true;
+
+        return true;
+    }
+
     static inline void _drawAABB(
         const aten::ThreadedSbvhNode* node,
         aten::hitable::FuncDrawAABB func,
@@ -62,6 +62,12 @@ namespace aten
 
     /**
      * @brief Spatial Splits in Bounding Volume Hierarchies.
+     *
+     * The top levels of the tree are built serially, and the references of their nodes are binned in parallel.
+     * The nodes which become small enough are built as the subtrees in parallel, and they are merged in order.
+     * The number of the references duplicated by the spatial splits is bounded by the budget,
+     * and the budget is distributed to the subtrees in proportion to their references.
+     * So the built tree doesn't depend on the number of the threads.
      */
     class sbvh : public accelerator {
     public:
@@ -106,6 +112,17 @@ namespace aten
             bool enableLod,
             Intersection& isect) const override;
 
+        /**
+         * @brief Test if a ray is occluded by any objects.
+         */
+        virtual bool occluded(
+            const context& ctxt,
+            const ray& r,
+            real t_min, real t_max) const override;
+
+        using accelerator::hit;
+        using accelerator::occluded;
+
         /**
          * @brief Export the built structure data.
          */
@@ -162,6 +179,43 @@ namespace aten
             return m_maxDepth;
         }
 
+        /**
+         * @brief Set the max number of the references as the ratio to the number of the triangles.
+         * The spatial splits are not done if the references would exceed it.
+         */
+        void setMaxReferenceRatio(real ratio)
+        {
+            AT_ASSERT(ratio >= real(1));
+            m_maxRefRatio = ratio;
+        }
+
+        real getMaxReferenceRatio() const
+        {
+            return m_maxRefRatio;
+        }
+
+    protected:
+        /**
+         * @brief Only the bottom layer can be cached, because the top layer depends on the transforms.
+         */
+        virtual bool isCacheSupported() const override
+        {
+            return m_isNested;
+        }
+
+        virtual void hashBuildSettings(AccelCacheHasher& hasher) const override;
+
+        /**
+         * @brief Add the threaded nodes, which have the voxels, to the cache.
+         */
+        virtual bool exportCache(
+            const context& ctxt,
+            AccelCacheWriter& writer) override;
+
+        virtual bool importCache(
+            const context& ctxt,
+            const AccelCacheReader& reader) override;
+
     private:
         /**
          * @brief Build the tree for the bottom layer.
@@ -197,13 +251,26 @@ namespace aten
             int offset,
             std::vector<int>& indices) const;
 
+        /**
+         * @brief Traverse the top layer.
+         * @param isOcclusion Flag if the traversal is terminated at the first hit.
+         */
+        bool onHit(
+            const context& ctxt,
+            const ray& r,
+            real t_min, real t_max,
+            bool enableLod,
+            Intersection& isect,
+            bool isOcclusion) const;
+
         bool hit(
             const context& ctxt,
             int exid,
             const ray& r,
             real t_min, real t_max,
             Intersection& isect,
-            bool enableLod) const;
+            bool enableLod,
+            bool isOcclusion) const;
 
         /**
          * @brief Temporary description of sbvh node.
@@ -275,10 +342,68 @@ namespace aten
             aabb bbox;
         };
 
+        /**
+         * @brief References which are accessed while building the tree.
+         *
+         * If the added references are kept locally, they are indexed from the number of the shared references
+         * at the construction, and the shared references are not resized.
+         * So the subtrees can be built in parallel.
+         */
+        struct ReferenceList {
+            ReferenceList(std::vector<Reference>& _shared, bool isLocal)
+                : shared(_shared), base(isLocal ? (uint32_t)_shared.size() : UINT32_MAX)
+            {}
+
+            Reference& operator[](uint32_t id)
+            {
+                return id < base ? shared[id] : added[id - base];
+            }
+
+            /**
+             * @brief Add the reference and return its index.
+             */
+            uint32_t add(const Reference& ref)
+            {
+                if (base == UINT32_MAX) {
+                    shared.push_back(ref);
+                    return (uint32_t)shared.size() - 1;
+                }
+
+                added.push_back(ref);
+                return base + (uint32_t)added.size() - 1;
+            }
+
+            std::vector<Reference>& shared;
+            uint32_t base;
+            std::vector<Reference> added;
+        };
+
+        /**
+         * @brief Build the tree from the root node, which is the first node in the list.
+         * @param [in, out] nodes Nodes of the tree.
+         * @param [in, out] refs References.
+         * @param [in, out] budget Number of the references which can be added by the spatial splits.
+         * @param [in] rootSurfaceArea Surface area of the root of the whole tree.
+         * @param [out] subtreeRoots If it is not null, the nodes which have the fewer references than SubtreeThreshold
+         *                           are not split and they are stored as the roots of the subtrees.
+         * @param [in, out] maxDepth Max depth of the nodes.
+         * @param [in, out] refIndexNum Number of the references in the leaves.
+         */
+        void buildTree(
+            std::vector<SBVHNode>& nodes,
+            ReferenceList& refs,
+            uint32_t& budget,
+            real rootSurfaceArea,
+            std::vector<uint32_t>* subtreeRoots,
+            uint32_t& maxDepth,
+            uint32_t& refIndexNum);
+
         /**
          * @brief Find a potential object split, but it does not split.
          * 蕪eXg.
          * @param [in, out] node The node which we want to split.
+         * @param [in] refs References.
+         * @param [in] isParallel Flag to bin the references in parallel.
          * @param [out] cost Cost to split.
          * @param [out] leftBB AABB of the potential left child nodes.
          * @param [out] rightBB AABB of the potential right child nodes.
@@ -287,6 +412,8 @@ namespace aten
          */
         void findObjectSplit(
             SBVHNode& node,
+            ReferenceList& refs,
+            bool isParallel,
             real& cost,
             aabb& leftBB,
             aabb& rightBB,
@@ -297,6 +424,8 @@ namespace aten
          * @brief Find a potential spatial split, but it does not split.
          * ڍוeXg.
          * @param [in, out] node The node which we want to split.
+         * @param [in] refs References.
+         * @param [in] isParallel Flag to bin the references in parallel.
          * @param [out] leftCount Count of triangles in the left child nodes.
          * @param [out] rightCount Count of triangles in the right child nodes.
          * @param [out] leftBB AABB of the potential left child nodes.
@@ -306,6 +435,8 @@ namespace aten
         */
         void findSpatialSplit(
             SBVHNode& node,
+            ReferenceList& refs,
+            bool isParallel,
             real& cost,
             int& leftCount,
             int& rightCount,
@@ -318,6 +449,7 @@ namespace aten
          * @biref Do the binned sah split actually with the result of findSpatialSplit.
          * ڍוeXgɊÂĎۂɕ.
          * @param [in, out] node The node which we want to split.
+         * @param [in, out] refs References. The split references are added.
          * @param [in] splitPlane Position of the axis along which the split will run.
          * @param [in] axis Axis (xyz) along which the split will run.
          * @param [in] splitCost Cost to split.
@@ -330,6 +462,7 @@ namespace aten
          */
         void spatialSort(
             SBVHNode& node,
+            ReferenceList& refs,
             real splitPlane,
             int axis,
             real splitCost,
@@ -344,6 +477,7 @@ namespace aten
          * @biref Do the binned sah split actually with the result of findObjectSplit.
          * 蕪eXgɊÂĎۂɕ.
          * @param [in, out] node The node which we want to split.
+         * @param [in] refs References.
          * @param [in] Index of the bin to split.
          * @param [in] axis Axis (xyz) along which the split will run.
          * @param [out] leftList Triangle indices list for the left children.
@@ -351,6 +485,7 @@ namespace aten
          */
         void objectSort(
             SBVHNode& node,
+            ReferenceList& refs,
             int splitBin,
             int axis,
             std::vector<uint32_t>& leftList,
@@ -385,6 +520,15 @@ namespace aten
 
         uint32_t m_refIndexNum{ 0 };
 
+        // Max number of the references as the ratio to the number of the triangles.
+        real m_maxRefRatio{ real(2) };
+
+        // Nodes which have the fewer references than it are built as the subtrees in parallel.
+        static const uint32_t SubtreeThreshold = 4096;
+
+        // Nodes which have the more references than it are binned in parallel.
+        static const uint32_t ParallelBinningThreshold = 65536;
+
         int m_offsetTriIdx{ 0 };
 
         std::vector<SBVHNode> m_nodes;
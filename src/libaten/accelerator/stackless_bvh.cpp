@@ -205,7 +205,16 @@ namespace aten {
         real t_min, real t_max,
         Intersection& isect) const
     {
-        return hit(ctxt, 0, m_listStacklessBvhNode, r, t_min, t_max, isect);
+        return hit(ctxt, 0, m_listStacklessBvhNode, r, t_min, t_max, isect, false);
+    }
+
+    bool StacklessBVH::occluded(
+        const context& ctxt,
+        const ray& r,
+        real t_min, real t_max) const
+    {
+        Intersection isect;
+        return hit(ctxt, 0, m_listStacklessBvhNode, r, t_min, t_max, isect, true);
     }
 
     bool StacklessBVH::hit(
@@ -214,7 +223,8 @@ namespace aten {
         const std::vector<std::vector<StacklessBvhNode>>& listStacklessBvhNode,
         const ray& r,
         real t_min, real t_max,
-        Intersection& isect) const
+        Intersection& isect,
+        bool isOcclusion) const
     {
         real hitt = AT_MATH_INF;
 
@@ -247,10 +257,20 @@ namespace aten {
 
                     aten::ray transformedRay;
 
+                    real tmin = t_min;
+                    real tmax = t_max;
+
                     if (mtxid >= 0) {
                         const auto& mtxW2L = m_mtxs[mtxid * 2 + 1];
 
                         transformedRay = mtxW2L.applyRay(r);
+
+                        if (isOcclusion) {
+                            // The direction is normalized in the local space, so the interval has to be scaled.
+                            auto scale = length(mtxW2L.applyXYZ(r.dir));
+                            tmin *= scale;
+                            tmax *= scale;
+                        }
                     }
                     else {
                         transformedRay = r;
@@ -261,22 +281,30 @@ namespace aten {
                         (int)node->exid,
                         listStacklessBvhNode,
                         transformedRay,
-                        t_min, t_max,
-                        isectTmp);
+                        tmin, tmax,
+                        isectTmp,
+                        isOcclusion);
                 }
                 else if (node->primid >= 0) {
                     // Hit test for a primitive.
-                    auto prim = ctxt.getTriangle((int)node->primid);
-                    isHit = prim->hit(ctxt, r, t_min, t_max, isectTmp);
+                    isHit = face::hit(ctxt, (int)node->primid, r, t_min, t_max, isectTmp);
                     if (isHit) {
                         isectTmp.objid = s->id();
                     }
                 }
+                else if (isOcclusion) {
+                    isHit = s->occluded(ctxt, r, t_min, t_max);
+                }
                 else {
                     // Hit test for a shape.
                     isHit = s->hit(ctxt, r, t_min, t_max, isectTmp);
                 }
 
+                if (isHit && isOcclusion) {
+                    // Any hit is enough.
+                    return true;
+                }
+
                 if (isHit) {
                     if (isectTmp.t < isect.t) {
                         isect = isectTmp;
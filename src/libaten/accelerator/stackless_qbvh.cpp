@@ -498,7 +498,16 @@ namespace aten
         real t_min, real t_max,
         Intersection& isect) const
     {
-        return hit(ctxt, 0, m_listQbvhNode, r, t_min, t_max, isect);
+        return hit(ctxt, 0, m_listQbvhNode, r, t_min, t_max, isect, false);
+    }
+
+    bool StacklessQbvh::occluded(
+        const context& ctxt,
+        const ray& r,
+        real t_min, real t_max) const
+    {
+        Intersection isect;
+        return hit(ctxt, 0, m_listQbvhNode, r, t_min, t_max, isect, true);
     }
 
     bool StacklessQbvh::hit(
@@ -507,7 +516,8 @@ namespace aten
         const std::vector<std::vector<StacklessQbvhNode>>& listQbvhNode,
         const ray& r,
         real t_min, real t_max,
-        Intersection& isect) const
+        Intersection& isect,
+        bool isOcclusion) const
     {
         int nodeid = 0;
         uint32_t bitstack = 0;
@@ -542,10 +552,20 @@ namespace aten
 
                     aten::ray transformedRay;
 
+                    real tmin = t_min;
+                    real tmax = t_max;
+
                     if (mtxid >= 0) {
                         const auto& mtxW2L = m_mtxs[mtxid * 2 + 1];
 
                         transformedRay = mtxW2L.applyRay(r);
+
+                        if (isOcclusion) {
+                            // The direction is normalized in the local space, so the interval has to be scaled.
+                            auto scale = length(mtxW2L.applyXYZ(r.dir));
+                            tmin *= scale;
+                            tmax *= scale;
+                        }
                     }
                     else {
                         transformedRay = r;
@@ -556,22 +576,30 @@ namespace aten
                         (int)pnode->exid,
                         listQbvhNode,
                         transformedRay,
-                        t_min, t_max,
-                        isectTmp);
+                        tmin, tmax,
+                        isectTmp,
+                        isOcclusion);
                 }
                 else if (pnode->primid >= 0) {
-                    auto f = ctxt.getTriangle((int)pnode->primid);
-                    isHit = f->hit(ctxt, r, t_min, t_max, isectTmp);
+                    isHit = face::hit(ctxt, (int)pnode->primid, r, t_min, t_max, isectTmp);
 
                     if (isHit) {
                         isectTmp.objid = s->id();
                     }
                 }
+                else if (isOcclusion) {
+                    isHit = s->occluded(ctxt, r, t_min, t_max);
+                }
                 else {
                     // sphere, cube.
                     isHit = s->hit(ctxt, r, t_min, t_max, isectTmp);
                 }
 
+                if (isHit && isOcclusion) {
+                    // Any hit is enough.
+                    return true;
+                }
+
                 if (isHit) {
                     if (isectTmp.t < isect.t) {
                         isect = isectTmp;
@@ -151,6 +151,75 @@ namespace aten
         //dump(m_listThreadedBvhNode[1], "node.txt");
     }
 
+    // Sections of the cache.
+    enum ThreadedBvhCacheSection : uint32_t {
+        ThreadedBvhCacheMeta,
+        ThreadedBvhCacheNodes,
+    };
+
+    struct ThreadedBvhCacheMetaData {
+        real boxmin[3];
+        real boxmax[3];
+    };
+
+    void ThreadedBVH::hashBuildSettings(AccelCacheHasher& hasher) const
+    {
+        hasher.add((uint32_t)bvh::s_buildMode);
+        hasher.add(bvh::s_binNum);
+        hasher.add((uint32_t)sizeof(ThreadedBvhNode));
+    }
+
+    bool ThreadedBVH::exportCache(
+        const context& ctxt,
+        AccelCacheWriter& writer)
+    {
+        AT_VRETURN_FALSE(m_isNested && m_listThreadedBvhNode.size() == 1);
+
+        const auto& nodes = m_listThreadedBvhNode[0];
+        AT_VRETURN_FALSE(!nodes.empty());
+
+        const auto& bbox = getBoundingbox();
+
+        ThreadedBvhCacheMetaData meta;
+        for (int i = 0; i < 3; i++) {
+            meta.boxmin[i] = bbox.minPos()[i];
+            meta.boxmax[i] = bbox.maxPos()[i];
+        }
+
+        writer.addValue(ThreadedBvhCacheMeta, meta);
+        writer.addSection(ThreadedBvhCacheNodes, &nodes[0], sizeof(ThreadedBvhNode), (uint32_t)nodes.size());
+
+        return true;
+    }
+
+    bool ThreadedBVH::importCache(
+        const context& ctxt,
+        const AccelCacheReader& reader)
+    {
+        AT_ASSERT(m_isNested);
+
+        uint32_t metaNum = 0;
+        auto meta = reader.getSection<ThreadedBvhCacheMetaData>(ThreadedBvhCacheMeta, metaNum);
+
+        uint32_t nodeNum = 0;
+        auto nodes = reader.getSection<ThreadedBvhNode>(ThreadedBvhCacheNodes, nodeNum);
+
+        if (!meta || metaNum != 1 || !nodes || nodeNum == 0) {
+            return false;
+        }
+
+        // NOTE
+        // The nodes are copied at once from the mapped file, because the top layer tree copies them to its list.
+        m_listThreadedBvhNode.resize(1);
+        m_listThreadedBvhNode[0].assign(nodes, nodes + nodeNum);
+
+        setBoundingBox(aabb(
+            vec3(meta->boxmin[0], meta->boxmin[1], meta->boxmin[2]),
+            vec3(meta->boxmax[0], meta->boxmax[1], meta->boxmax[2])));
+
+        return true;
+    }
+
     void ThreadedBVH::dump(std::vector<ThreadedBvhNode>& nodes, const char* path)
     {
         FILE* fp = fopen(path, "wt");
@@ -345,7 +414,16 @@ namespace aten
         real t_min, real t_max,
         Intersection& isect) const
     {
-        return hit(ctxt, 0, m_listThreadedBvhNode, r, t_min, t_max, isect);
+        return hit(ctxt, 0, m_listThreadedBvhNode, r, t_min, t_max, isect, false);
+    }
+
+    bool ThreadedBVH::occluded(
+        const context& ctxt,
+        const ray& r,
+        real t_min, real t_max) const
+    {
+        Intersection isect;
+        return hit(ctxt, 0, m_listThreadedBvhNode, r, t_min, t_max, isect, true);
     }
 
     bool ThreadedBVH::hit(
@@ -354,7 +432,8 @@ namespace aten
         const std::vector<std::vector<ThreadedBvhNode>>& listThreadedBvhNode,
         const ray& r,
         real t_min, real t_max,
-        Intersection& isect) const
+        Intersection& isect,
+        bool isOcclusion) const
     {
         real hitt = AT_MATH_INF;
 
@@ -376,53 +455,12 @@ namespace aten
             if (node->isLeaf()) {
                 Intersection isectTmp;
 
-                auto s = node->shapeid >= 0 ? ctxt.getTransformable((int)node->shapeid) : nullptr;
+                isHit = hitLeaf(ctxt, listThreadedBvhNode, *node, r, t_min, t_max, isectTmp, isOcclusion);
 
-                if (node->exid >= 0) {
-                    // Traverse external linear bvh list.
-                    const auto& param = s->getParam();
-
-                    int mtxid = param.mtxid;
-
-                    aten::ray transformedRay;
-
-                    if (mtxid >= 0) {
-                        const auto& mtxW2L = m_mtxs[mtxid * 2 + 1];
-
-                        transformedRay = mtxW2L.applyRay(r);
-                    }
-                    else {
-                        transformedRay = r;
-                    }
-
-                    //int exid = node->mainExid;
-                    int exid = *(int*)(&node->exid);
-                    exid = AT_BVHNODE_MAIN_EXID(exid);
-
-                    isHit = hit(
-                        ctxt,
-                        exid,
-                        listThreadedBvhNode,
-                        transformedRay,
-                        t_min, t_max,
-                        isectTmp);
-
-                    if (isHit) {
-                        isectTmp.objid = s->id();
-                    }
-                }
-                else if (node->primid >= 0) {
-                    // Hit test for a primitive.
-                    auto prim = ctxt.getTriangle((int)node->primid);
-                    isHit = prim->hit(ctxt, r, t_min, t_max, isectTmp);
-                    if (isHit) {
-                        // Set dummy to return if ray hit.
-                        isectTmp.objid = s ? s->id() : 1;
-                    }
-                }
-                else {
-                    // Hit test for a shape.
-                    isHit = s->hit(ctxt, r, t_min, t_max, isectTmp);
+                if (isHit && isOcclusion) {
+                    // Any hit is enough.
+                    isect = isectTmp;
+                    return true;
                 }
 
                 if (isHit) {
@@ -447,6 +485,178 @@ namespace aten
         return (isect.objid >= 0);
     }
 
+    bool ThreadedBVH::hitLeaf(
+        const context& ctxt,
+        const std::vector<std::vector<ThreadedBvhNode>>& listThreadedBvhNode,
+        const ThreadedBvhNode& node,
+        const ray& r,
+        real t_min, real t_max,
+        Intersection& isect,
+        bool isOcclusion) const
+    {
+        bool isHit = false;
+
+        auto s = node.shapeid >= 0 ? ctxt.getTransformable((int)node.shapeid) : nullptr;
+
+        if (node.exid >= 0) {
+            // Traverse external linear bvh list.
+            const auto& param = s->getParam();
+
+            int mtxid = param.mtxid;
+
+            aten::ray transformedRay;
+
+            real tmin = t_min;
+            real tmax = t_max;
+
+            if (mtxid >= 0) {
+                const auto& mtxW2L = m_mtxs[mtxid * 2 + 1];
+
+                transformedRay = mtxW2L.applyRay(r);
+
+                if (isOcclusion) {
+                    // The direction is normalized in the local space, so the interval has to be scaled.
+                    auto scale = length(mtxW2L.applyXYZ(r.dir));
+                    tmin *= scale;
+                    tmax *= scale;
+                }
+            }
+            else {
+                transformedRay = r;
+            }
+
+            //int exid = node.mainExid;
+            int exid = *(int*)(&node.exid);
+            exid = AT_BVHNODE_MAIN_EXID(exid);
+
+            isHit = hit(
+                ctxt,
+                exid,
+                listThreadedBvhNode,
+                transformedRay,
+                tmin, tmax,
+                isect,
+                isOcclusion);
+
+            if (isHit) {
+                isect.objid = s->id();
+            }
+        }
+        else if (node.primid >= 0) {
+            // Hit test for a primitive.
+            isHit = face::hit(ctxt, (int)node.primid, r, t_min, t_max, isect);
+            if (isHit) {
+                // Set dummy to return if ray hit.
+                isect.objid = s ? s->id() : 1;
+            }
+        }
+        else if (isOcclusion) {
+            isHit = s->occluded(ctxt, r, t_min, t_max);
+        }
+        else {
+            // Hit test for a shape.
+            isHit = s->hit(ctxt, r, t_min, t_max, isect);
+        }
+
+        return isHit;
+    }
+
+    uint32_t ThreadedBVH::hit(
+        const context& ctxt,
+        const RayPacket& packet,
+        real t_min, real t_max,
+        Intersection* isects) const
+    {
+        return hit(ctxt, m_listThreadedBvhNode, packet, t_min, t_max, isects, false);
+    }
+
+    uint32_t ThreadedBVH::occluded(
+        const context& ctxt,
+        const RayPacket& packet,
+        real t_min, real t_max) const
+    {
+        Intersection isects[RayPacket::MaxRayNum];
+        return hit(ctxt, m_listThreadedBvhNode, packet, t_min, t_max, isects, true);
+    }
+
+    uint32_t ThreadedBVH::hit(
+        const context& ctxt,
+        const std::vector<std::vector<ThreadedBvhNode>>& listThreadedBvhNode,
+        const RayPacket& packet,
+        real t_min, real t_max,
+        Intersection* isects,
+        bool isOcclusion) const
+    {
+        // NOTE
+        // All rays in the packet follow the same hit/miss links.
+        // The hit link is followed if any ray in the packet hits the node.
+        // Only the top layer is traversed as the packet, the bottom layer is traversed per ray.
+
+        if (listThreadedBvhNode.empty() || listThreadedBvhNode[0].empty()) {
+            return 0;
+        }
+
+        const auto& nodes = listThreadedBvhNode[0];
+
+        const RayPacketTraverseRays rays(packet);
+
+        real tmax[RayPacket::MaxRayNum];
+
+        for (uint32_t i = 0; i < RayPacket::MaxRayNum; i++) {
+            tmax[i] = t_max;
+
+            if (packet.activeMask & (1 << i)) {
+                isects[i] = Intersection();
+            }
+        }
+
+        // Mask of the rays which are still traversed.
+        uint32_t activeMask = packet.activeMask;
+
+        uint32_t hitMask = 0;
+
+        int nodeid = 0;
+
+        while (nodeid >= 0 && activeMask > 0) {
+            const auto& node = nodes[nodeid];
+
+            auto mask = intersectAABB(rays, node.boxmin, node.boxmax, t_min, tmax, activeMask);
+
+            if (node.isLeaf()) {
+                for (uint32_t i = 0; i < packet.num; i++) {
+                    if ((mask & (1 << i)) == 0) {
+                        continue;
+                    }
+
+                    Intersection isectTmp;
+
+                    if (hitLeaf(ctxt, listThreadedBvhNode, node, packet.rays[i], t_min, tmax[i], isectTmp, isOcclusion)) {
+                        if (isOcclusion) {
+                            // Any hit is enough.
+                            hitMask |= (1 << i);
+                            activeMask &= ~(1 << i);
+                        }
+                        else if (isectTmp.t < isects[i].t) {
+                            isects[i] = isectTmp;
+                            tmax[i] = isectTmp.t;
+
+                            hitMask |= (1 << i);
+                        }
+                    }
+                }
+
+                // NOTE
+                // Hit and miss links of the leaf are same.
+                nodeid = (int)node.hit;
+            }
+            else {
+                nodeid = (int)(mask > 0 ? node.hit : node.miss);
+            }
+        }
+
+        return hitMask;
+    }
+
     void ThreadedBVH::update(const context& ctxt)
     {
         m_bvh.update();
@@ -84,6 +84,34 @@ namespace aten
             return hit(ctxt, r, t_min, t_max, isect);
         }
 
+        /**
+         * @brief Test if a ray is occluded by any objects.
+         */
+        virtual bool occluded(
+            const context& ctxt,
+            const ray& r,
+            real t_min, real t_max) const override;
+
+        /**
+         * @brief Test if rays in the packet hit objects.
+         */
+        virtual uint32_t hit(
+            const context& ctxt,
+            const RayPacket& packet,
+            real t_min, real t_max,
+            Intersection* isects) const override;
+
+        /**
+         * @brief Test if rays in the packet are occluded by any objects.
+         */
+        virtual uint32_t occluded(
+            const context& ctxt,
+            const RayPacket& packet,
+            real t_min, real t_max) const override;
+
+        using accelerator::hit;
+        using accelerator::occluded;
+
         /**
          * @brief Draw all node's AABB in the structure tree.
          */
@@ -91,7 +119,10 @@ namespace aten
             aten::hitable::FuncDrawAABB func,
             const aten::mat4& mtxL2W) override final
         {
-            m_bvh.drawAABB(func, mtxL2W);
+            // If the tree is loaded from the cache, there is no bvh to draw.
+            if (m_bvh.getRoot()) {
+                m_bvh.drawAABB(func, mtxL2W);
+            }
         }
 
         /**
@@ -141,6 +172,25 @@ namespace aten
 
         static void dump(std::vector<ThreadedBvhNode>& nodes, const char* path);
 
+    protected:
+        /**
+         * @brief Only the bottom layer can be cached, because the top layer depends on the transforms.
+         */
+        virtual bool isCacheSupported() const override
+        {
+            return m_isNested;
+        }
+
+        virtual void hashBuildSettings(AccelCacheHasher& hasher) const override;
+
+        virtual bool exportCache(
+            const context& ctxt,
+            AccelCacheWriter& writer) override;
+
+        virtual bool importCache(
+            const context& ctxt,
+            const AccelCacheReader& reader) override;
+
     private:
         /**
          * @brief Build the tree for the bottom layer.
@@ -192,6 +242,7 @@ namespace aten
 
         /**
          * @brief Test if a ray hits a object.
+         * @param isOcclusion Flag if the traversal is terminated at the first hit.
          */
         bool hit(
             const context& ctxt,
@@ -199,7 +250,32 @@ namespace aten
             const std::vector<std::vector<ThreadedBvhNode>>& listThreadedBvhNode,
             const ray& r,
             real t_min, real t_max,
-            Intersection& isect) const;
+            Intersection& isect,
+            bool isOcclusion) const;
+
+        /**
+         * @brief Test if a ray hits the item which the leaf has.
+         */
+        bool hitLeaf(
+            const context& ctxt,
+            const std::vector<std::vector<ThreadedBvhNode>>& listThreadedBvhNode,
+            const ThreadedBvhNode& node,
+            const ray& r,
+            real t_min, real t_max,
+            Intersection& isect,
+            bool isOcclusion) const;
+
+        /**
+         * @brief Test if rays in the packet hit objects.
+         * @param isOcclusion Flag if the traversal is terminated at any hit for each ray.
+         */
+        uint32_t hit(
+            const context& ctxt,
+            const std::vector<std::vector<ThreadedBvhNode>>& listThreadedBvhNode,
+            const RayPacket& packet,
+            real t_min, real t_max,
+            Intersection* isects,
+            bool isOcclusion) const;
 
         /**
          * @brief Convert the tree to the linear list.
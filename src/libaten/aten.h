@@ -33,6 +33,7 @@
 #include "material/lambert_refraction.h"
 #include "material/microfacet_refraction.h"
 #include "material/material_factory.h"
+#include "material/material_evaluator.h"
 
 #include "math/math.h"
 #include "math/vec3.h"
@@ -50,6 +51,10 @@
 #include "misc/thread.h"
 #include "misc/key.h"
 #include "misc/timeline.h"
+#include "misc/tilescheduler.h"
+#include "misc/aliastable.h"
+#include "misc/mappedfile.h"
+#include "misc/atomicfile.h"
 
 #include "light/light.h"
 #include "light/pointlight.h"
@@ -57,10 +62,12 @@
 #include "light/spotlight.h"
 #include "light/arealight.h"
 #include "light/ibl.h"
+#include "light/lightsampler.h"
 
 #include "proxy/DataCollector.h"
 
 #include "texture/texture.h"
+#include "texture/texturecache.h"
 
 #include "hdr/hdr.h"
 #include "hdr/tonemap.h"
@@ -77,11 +84,14 @@
 #include "scene/scene.h"
 #include "scene/instance.h"
 
+#include "accelerator/accel_cache.h"
 #include "accelerator/accelerator.h"
 #include "accelerator/bvh.h"
 #include "accelerator/qbvh.h"
+#include "accelerator/bvh8.h"
 #include "accelerator/sbvh.h"
 #include "accelerator/threaded_bvh.h"
+#include "accelerator/lbvh.h"
 #include "accelerator/stackless_bvh.h"
 #include "accelerator/stackless_qbvh.h"
 #include "accelerator/CullingFrusta.h"
@@ -107,10 +117,12 @@
 
 #include "renderer/renderer.h"
 #include "renderer/film.h"
+#include "renderer/splatfilm.h"
 #include "renderer/background.h"
 #include "renderer/envmap.h"
 #include "renderer/raytracing.h"
 #include "renderer/pathtracing.h"
+#include "renderer/sorted_pathtracing.h"
 #include "renderer/erpt.h"
 #include "renderer/pssmlt.h"
 #include "renderer/aov.h"
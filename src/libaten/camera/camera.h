@@ -159,6 +159,16 @@ namespace AT_NAME {
             return real(1);
         }
 
+        /**
+         * @brief Return the spread angle of the ray cone per pixel.
+         * It is used to compute the footprint of the ray on the textures.
+         * If the camera doesn't support it, returns 0 and the footprint is not computed.
+         */
+        virtual real getPixelSpreadAngle() const
+        {
+            return real(0);
+        }
+
         virtual const aten::CameraParameter& param() const
         {
             AT_ASSERT(false);
@@ -60,6 +60,12 @@ namespace aten {
             return m_at;
         }
 
+        virtual real getPixelSpreadAngle() const override final
+        {
+            // Vertical direction covers [0, pi].
+            return AT_MATH_PI / m_height;
+        }
+
         void revertRayToPixelPos(
             const ray& ray,
             int& px, int& py) const override final
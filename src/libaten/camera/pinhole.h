@@ -76,6 +76,12 @@ namespace AT_NAME {
             return m_at;
         }
 
+        virtual real getPixelSpreadAngle() const override final
+        {
+            // Vertical angle of one pixel.
+            return aten::atan(real(2) * aten::tan(Deg2Rad(m_vfov) * real(0.5)) / m_param.height);
+        }
+
         virtual const aten::CameraParameter& param() const override final
         {
             return m_param;
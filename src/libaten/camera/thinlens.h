@@ -94,6 +94,12 @@ namespace aten {
             return m_imagesensor.height;
         }
 
+        virtual real getPixelSpreadAngle() const override final
+        {
+            // Angle of one pixel seen from the lens.
+            return aten::atan(m_pixelHeight / m_imageSensorToLensDistance);
+        }
+
     private:
         // 𑜓x.
         int m_imageWidthPx;
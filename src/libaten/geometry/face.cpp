@@ -9,56 +9,60 @@
 
 namespace AT_NAME
 {
-    void face::resetIdWhenAnyTriangleLeave(AT_NAME::face* tri)
-    {
-        tri->m_id = tri->m_listItem.currentIndex();
-    }
-
-    face::face()
-    {
-        m_listItem.init(this, resetIdWhenAnyTriangleLeave);
-    }
+    face::IntersectType face::s_intersectType = face::IntersectType::Precomputed;
 
-    face::~face()
-    {
-        m_listItem.leave();
-    }
-
-    face* face::create(
+    bool face::hit(
         const context& ctxt,
-        const aten::PrimitiveParamter& param)
+        const aten::ray& r,
+        real t_min, real t_max,
+        aten::Intersection& isect) const
     {
-        face* f = new face();
-
-        f->param = param;
-
-        f->build(ctxt, param.mtrlid, param.gemoid);
-
-        return f;
+        return hit(ctxt, m_id, r, t_min, t_max, isect);
     }
 
     bool face::hit(
         const context& ctxt,
+        int triIdx,
         const aten::ray& r,
         real t_min, real t_max,
-        aten::Intersection& isect) const
+        aten::Intersection& isect)
     {
-        const auto& v0 = ctxt.getVertex(param.idx[0]);
-        const auto& v1 = ctxt.getVertex(param.idx[1]);
-        const auto& v2 = ctxt.getVertex(param.idx[2]);
+        const auto& param = ctxt.getTriangleParam(triIdx);
+
+        bool isHit = false;
 
-        bool isHit = hit(
-            &param, 
-            v0.pos, v1.pos, v2.pos,
-            r, 
-            t_min, t_max, 
-            &isect);
+        if (s_intersectType == IntersectType::Watertight
+            || !ctxt.isEnabledTriangleEdges())
+        {
+            // NOTE
+            // Watertight test needs the original vertex positions.
+            // If they are reconstructed from the edges, the shared edges don't match exactly.
+            const auto& v0 = ctxt.getVertex(param.idx[0]);
+            const auto& v1 = ctxt.getVertex(param.idx[1]);
+            const auto& v2 = ctxt.getVertex(param.idx[2]);
+
+            isHit = hit(
+                &param,
+                v0.pos, v1.pos, v2.pos,
+                r,
+                t_min, t_max,
+                &isect);
+        }
+        else {
+            const auto& edges = ctxt.getTriangleEdges(triIdx);
+
+            isHit = hitWithEdges(
+                edges.v0, edges.e1, edges.e2,
+                r,
+                t_min, t_max,
+                &isect);
+        }
 
         if (isHit) {
             // Temporary, notify triangle id to the parent object.
-            isect.objid = m_id;
+            isect.objid = triIdx;
 
-            isect.primid = m_id;
+            isect.primid = triIdx;
 
             isect.mtrlid = param.mtrlid;
         }
@@ -77,9 +81,39 @@ namespace AT_NAME
     {
         bool isHit = false;
 
-        const auto res = intersectTriangle(r, v0, v1, v2);
+        const auto res = (s_intersectType == IntersectType::Watertight
+            ? intersectTriangleWatertight(r, v0, v1, v2)
+            : intersectTriangle(r, v0, v1, v2));
 
-        if (res.isIntersect) {
+        // NOTE
+        // Hits farther than t_max have to be rejected for the occlusion query.
+        if (res.isIntersect && res.t <= t_max) {
+            if (res.t < isect->t) {
+                isect->t = res.t;
+
+                isect->a = res.a;
+                isect->b = res.b;
+
+                isHit = true;
+            }
+        }
+
+        return isHit;
+    }
+
+    bool face::hitWithEdges(
+        const aten::vec3& v0,
+        const aten::vec3& e1,
+        const aten::vec3& e2,
+        const aten::ray& r,
+        real t_min, real t_max,
+        aten::Intersection* isect)
+    {
+        bool isHit = false;
+
+        const auto res = intersectTriangleWithEdges(r, v0, e1, e2);
+
+        if (res.isIntersect && res.t <= t_max) {
             if (res.t < isect->t) {
                 isect->t = res.t;
 
@@ -99,6 +133,8 @@ namespace AT_NAME
         aten::hitrecord& rec,
         const aten::Intersection& isect) const
     {
+        const auto& param = getParam();
+
         const auto& v0 = ctxt.getVertex(param.idx[0]);
         const auto& v1 = ctxt.getVertex(param.idx[1]);
         const auto& v2 = ctxt.getVertex(param.idx[2]);
@@ -115,6 +151,19 @@ namespace AT_NAME
         }
 
         rec.area = param.area;
+
+        // NOTE
+        // uv.z == -1 means there is no texture coordinate.
+        if (v0.uv.z >= real(0) && param.area > real(0)) {
+            auto duv1 = v1.uv - v0.uv;
+            auto duv2 = v2.uv - v0.uv;
+
+            real uvArea = real(0.5) * aten::abs(duv1.x * duv2.y - duv2.x * duv1.y);
+
+            if (uvArea > real(0)) {
+                rec.texLodBase = real(0.5) * aten::log2(uvArea / param.area);
+            }
+        }
     }
 
     void face::evalHitResult(
@@ -147,6 +196,8 @@ namespace AT_NAME
         int mtrlid, 
         int geomid)
     {
+        auto& param = m_ctxt->getTriangleParam(m_id);
+
         const auto& v0 = ctxt.getVertex(param.idx[0]);
         const auto& v1 = ctxt.getVertex(param.idx[1]);
         const auto& v2 = ctxt.getVertex(param.idx[2]);
@@ -170,6 +221,8 @@ namespace AT_NAME
 
         param.mtrlid = mtrlid;
         param.gemoid = geomid;
+
+        m_ctxt->updateTriangleEdges(m_id);
     }
 
     void face::getSamplePosNormalArea(
@@ -196,6 +249,8 @@ namespace AT_NAME
         real b = aten::sqrt(r0) * r1;
 #endif
 
+        const auto& param = getParam();
+
         const auto& v0 = ctxt.getVertex(param.idx[0]);
         const auto& v1 = ctxt.getVertex(param.idx[1]);
         const auto& v2 = ctxt.getVertex(param.idx[2]);
@@ -225,11 +280,13 @@ namespace AT_NAME
 
     int face::geomid() const
     {
-        return param.gemoid;
+        return getParam().gemoid;
     }
 
     aabb face::computeAABB(const context& ctxt) const
     {
+        const auto& param = getParam();
+
         const auto& v0 = ctxt.getVertex(param.idx[0]);
         const auto& v1 = ctxt.getVertex(param.idx[1]);
         const auto& v2 = ctxt.getVertex(param.idx[2]);
@@ -241,4 +298,34 @@ namespace AT_NAME
 
         return ret;
     }
+
+    aten::vec3 face::getV0() const
+    {
+        if (m_ctxt->isEnabledTriangleEdges()) {
+            return m_ctxt->getTriangleEdges(m_id).v0;
+        }
+
+        const auto& param = getParam();
+        return m_ctxt->getVertex(param.idx[0]).pos;
+    }
+
+    aten::vec3 face::getE1() const
+    {
+        if (m_ctxt->isEnabledTriangleEdges()) {
+            return m_ctxt->getTriangleEdges(m_id).e1;
+        }
+
+        const auto& param = getParam();
+        return m_ctxt->getVertex(param.idx[1]).pos - m_ctxt->getVertex(param.idx[0]).pos;
+    }
+
+    aten::vec3 face::getE2() const
+    {
+        if (m_ctxt->isEnabledTriangleEdges()) {
+            return m_ctxt->getTriangleEdges(m_id).e2;
+        }
+
+        const auto& param = getParam();
+        return m_ctxt->getVertex(param.idx[2]).pos - m_ctxt->getVertex(param.idx[0]).pos;
+    }
 }
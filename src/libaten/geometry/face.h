@@ -12,20 +12,63 @@
 
 namespace AT_NAME
 {
+    /**
+     * @brief View of the triangle which is stored in the context.
+     *
+     * The parameters and the precomputed edges are stored in the flat arrays of the context,
+     * and the face only refers to them by the triangle id.
+     * The faces are created by the context, because they are allocated per block.
+     */
     class face : public aten::hitable {
         friend class context;
 
     private:
-        face();
-        virtual ~face();
+        face() {}
+        virtual ~face() {}
 
     public:
+        /**
+         * @enum IntersectType
+         * @brief Algorithm to test if a ray hits a triangle.
+         */
+        enum class IntersectType {
+            Precomputed,    ///< Moller-Trumbore with the edges which are precomputed at build.
+            Watertight,     ///< Watertight test which has no gaps along the shared edges.
+        };
+
+        /**
+         * @brief Set the algorithm to test if a ray hits a triangle for all triangles.
+         */
+        static void setIntersectType(IntersectType type)
+        {
+            s_intersectType = type;
+        }
+
+        /**
+         * @brief Return the algorithm to test if a ray hits a triangle.
+         */
+        static IntersectType getIntersectType()
+        {
+            return s_intersectType;
+        }
+
         virtual bool hit(
             const aten::context& ctxt,
             const aten::ray& r,
             real t_min, real t_max,
             aten::Intersection& isect) const override;
 
+        /**
+         * @brief Test if a ray hits the triangle which is specified by the triangle id.
+         * The accelerators use it not to go through the view.
+         */
+        static bool hit(
+            const aten::context& ctxt,
+            int triIdx,
+            const aten::ray& r,
+            real t_min, real t_max,
+            aten::Intersection& isect);
+
         static bool hit(
             const aten::PrimitiveParamter* param,
             const aten::vec3& v0,
@@ -35,6 +78,17 @@ namespace AT_NAME
             real t_min, real t_max,
             aten::Intersection* isect);
 
+        /**
+         * @brief Test if a ray hits the triangle with the precomputed first vertex and edges.
+         */
+        static bool hitWithEdges(
+            const aten::vec3& v0,
+            const aten::vec3& e1,
+            const aten::vec3& e2,
+            const aten::ray& r,
+            real t_min, real t_max,
+            aten::Intersection* isect);
+
         virtual void evalHitResult(
             const aten::context& ctxt,
             const aten::ray& r, 
@@ -64,12 +118,7 @@ namespace AT_NAME
 
         const aten::PrimitiveParamter& getParam() const
         {
-            return param;
-        }
-
-        void setParam(const aten::PrimitiveParamter& p)
-        {
-            param = p;
+            return m_ctxt->getTriangleParam(m_id);
         }
 
         int getId() const
@@ -77,23 +126,25 @@ namespace AT_NAME
             return m_id;
         }
 
-    private:
-        static void resetIdWhenAnyTriangleLeave(AT_NAME::face* tri);
+        /**
+         * @brief Return the first vertex position.
+         */
+        aten::vec3 getV0() const;
 
-        static face* create(
-            const context& ctxt,
-            const aten::PrimitiveParamter& param);
+        /**
+         * @brief Return the edge from the first vertex to the second vertex.
+         */
+        aten::vec3 getE1() const;
+
+        /**
+         * @brief Return the edge from the first vertex to the third vertex.
+         */
+        aten::vec3 getE2() const;
 
-        void addToDataList(aten::DataList<AT_NAME::face>& list)
-        {
-            list.add(&m_listItem);
-            m_id = m_listItem.currentIndex();
-        }
-    
     private:
-        aten::PrimitiveParamter param;
+        aten::context* m_ctxt{ nullptr };
         int m_id{ -1 };
 
-        aten::DataList<AT_NAME::face>::ListItem m_listItem;
+        static IntersectType s_intersectType;
     };
 }
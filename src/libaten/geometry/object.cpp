@@ -54,8 +54,10 @@ namespace AT_NAME
 
         m_param.primnum = m_triangles;
 
+        buildTriangleSampler();
+
         m_accel->asNested();
-        m_accel->build(ctxt, (hitable**)&tmp[0], (uint32_t)tmp.size(), &bbox);
+        m_accel->buildWithCache(ctxt, (hitable**)&tmp[0], (uint32_t)tmp.size(), &bbox);
 
         bbox = m_accel->getBoundingbox();
 
@@ -100,6 +102,14 @@ namespace AT_NAME
         return isHit;
     }
 
+    bool object::occluded(
+        const context& ctxt,
+        const aten::ray& r,
+        real t_min, real t_max) const
+    {
+        return m_accel->occluded(ctxt, r, t_min, t_max);
+    }
+
     void object::evalHitResult(
         const context& ctxt,
         const aten::ray& r,
@@ -139,24 +149,63 @@ namespace AT_NAME
         real ratio = scaledLen / orignalLen;
         ratio = ratio * ratio;
 
-        rec.area = m_param.area * ratio;
+        rec.area = getTriangleSampleArea(f, ratio);
+
+        // World area of the triangle is scaled by ratio.
+        if (rec.texLodBase < AT_MATH_INF && ratio > real(0)) {
+            rec.texLodBase -= real(0.5) * aten::log2(ratio);
+        }
 
         rec.mtrlid = isect.mtrlid;
     }
 
+    void object::buildTriangleSampler()
+    {
+        // NOTE
+        // The triangles in the object have the contiguous ids from m_param.primid, as GeomParameter expects.
+        std::vector<real> areas(m_triangles, real(0));
+
+        for (const auto s : shapes) {
+            for (const auto f : s->faces) {
+                auto idx = f->getId() - m_param.primid;
+                AT_ASSERT(0 <= idx && idx < (int)m_triangles);
+
+                areas[idx] = f->getParam().area;
+            }
+        }
+
+        m_triangleSampler.build(areas);
+    }
+
+    real object::getTriangleSampleArea(
+        const face* f,
+        real scale) const
+    {
+        if (m_triangleSampler.size() == 0) {
+            // Not built for sampling. Treat as uniform on the surface.
+            return m_param.area * scale;
+        }
+
+        auto pdf = m_triangleSampler.getPdf(f->getId() - m_param.primid);
+
+        // pdf on the surface = (probability to select the triangle) / (area of the triangle).
+        return pdf > real(0)
+            ? f->getParam().area * scale / pdf
+            : AT_MATH_INF;
+    }
+
     void object::getSamplePosNormalArea(
         const context& ctxt,
         aten::hitable::SamplePosNormalPdfResult* result,
         const aten::mat4& mtxL2W, 
         aten::sampler* sampler) const
     {
+        AT_ASSERT(m_triangleSampler.size() > 0);
+
         auto r = sampler->nextSample();
-        int shapeidx = (int)(r * (shapes.size() - 1));
-        auto objshape = shapes[shapeidx];
+        auto idx = m_triangleSampler.sample(r);
 
-        r = sampler->nextSample();
-        int faceidx = (int)(r * (objshape->faces.size() - 1));
-        auto f = objshape->faces[faceidx];
+        auto f = ctxt.getTriangle(m_param.primid + idx);
 
         const auto& faceParam = f->getParam();
 
@@ -182,11 +231,13 @@ namespace AT_NAME
         real ratio = scaledLen / orignalLen;
         ratio = ratio * ratio;
 
-        auto area = m_param.area * ratio;
-
         f->getSamplePosNormalArea(ctxt, result, sampler);
 
-        result->area = area;
+        // Transform local to world.
+        result->pos = mtxL2W.apply(result->pos);
+        result->nml = normalize(mtxL2W.applyXYZ(result->nml));
+
+        result->area = getTriangleSampleArea(f, ratio);
     }
 
     void object::drawForGBuffer(
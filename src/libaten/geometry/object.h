@@ -8,6 +8,7 @@
 #include "geometry/face.h"
 #include "geometry/objshape.h"
 #include "geometry/transformable.h"
+#include "misc/aliastable.h"
 #include "scene/context.h"
 
 namespace AT_NAME
@@ -30,6 +31,11 @@ namespace AT_NAME
             real t_min, real t_max,
             aten::Intersection& isect) const override final;
 
+        virtual bool occluded(
+            const aten::context& ctxt,
+            const aten::ray& r,
+            real t_min, real t_max) const override final;
+
         virtual void evalHitResult(
             const aten::context& ctxt,
             const aten::ray& r,
@@ -79,6 +85,11 @@ namespace AT_NAME
 
         void build(const aten::context& ctxt);
 
+        /**
+         * @brief Sample a position on the object.
+         * The triangle is selected by its area with the alias table, so the position is uniform on the surface.
+         * result->area is the area which gives the pdf to sample the position as 1 / area.
+         */
         virtual void getSamplePosNormalArea(
             const aten::context& ctxt,
             aten::hitable::SamplePosNormalPdfResult* result,
@@ -101,10 +112,21 @@ namespace AT_NAME
             return shapes[idx];
         }
 
+    private:
+        void buildTriangleSampler();
+
+        // Return the area which gives the pdf to sample the position on the triangle as 1 / area.
+        real getTriangleSampleArea(
+            const face* f,
+            real scale) const;
+
     private:
         std::vector<objshape*> shapes;
 
         aten::accelerator* m_accel{ nullptr };
         uint32_t m_triangles{ 0 };
+
+        // To select the triangle by area. Indexed by the triangle id from m_param.primid.
+        aten::AliasTable m_triangleSampler;
     };
 }
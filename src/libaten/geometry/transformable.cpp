@@ -2,14 +2,9 @@
 
 namespace aten
 {
-    void transformable::resetIdWhenAnyTransformableLeave(aten::transformable* obj)
-    {
-        obj->m_id = obj->m_listItem.currentIndex();
-    }
-
     transformable::transformable()
     {
-        m_listItem.init(this, resetIdWhenAnyTransformableLeave);
+        m_listItem.init(this);
     }
 
     transformable::transformable(GeometryType type)
@@ -67,8 +67,6 @@ namespace aten
         }
 
     private:
-        static void resetIdWhenAnyTransformableLeave(aten::transformable* obj);
-
         void addToDataList(aten::DataList<aten::transformable>& list)
         {
             list.add(&m_listItem);
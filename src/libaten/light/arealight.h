@@ -42,6 +42,10 @@ namespace AT_NAME {
             // TODO
             // AMDProRender(Baikal)ł͂ dist2/ʐ ƂȂĂ邪...
             auto dist2 = aten::squared_length(rec->p - org);
+
+            // NOTE
+            // rec->area is the area which gives the pdf to sample the position as 1 / area.
+            // For the polygon object, it is per triangle, because the triangle is selected by its area.
             result->pdf = 1 / rec->area;
 
             result->dir = rec->p - org;
@@ -1,44 +1,208 @@
+#include <string.h>
+
 #include "light/ibl.h"
+#include "texture/texturecache.h"
+#include "misc/atomicfile.h"
 
 // NOTE
 // http://www.cs.virginia.edu/~gfx/courses/2007/ImageSynthesis/assignments/envsample.pdf
 // http://www.igorsklyar.com/system/documents/papers/4/fiscourse.comp.pdf
 
 namespace AT_NAME {
+    std::string ImageBasedLight::s_cacheDir;
+
+    // FNV-1a.
+    static uint64_t computeHash(const void* data, size_t size, uint64_t hash)
+    {
+        auto p = reinterpret_cast<const uint8_t*>(data);
+
+        for (size_t i = 0; i < size; i++) {
+            hash ^= p[i];
+            hash *= 1099511628211ULL;
+        }
+
+        return hash;
+    }
+
+    static bool computeImageHash(const aten::texture* tex, uint64_t& hash)
+    {
+        static const uint64_t FNVOffsetBasis = 14695981039346656037ULL;
+
+        uint32_t size[4] = { tex->width(), tex->height(), tex->channels(), (uint32_t)tex->getFormat() };
+
+        hash = computeHash(size, sizeof(size), FNVOffsetBasis);
+
+        if (tex->isTiled()) {
+            // The tiled texture doesn't have the texels in the memory.
+            // Hash the texels in the tiled file, not to decode the whole image to the memory.
+            return tex->getTextureCache()->computeHash(tex->getTiledFileId(), hash);
+        }
+
+        const int height = (int)tex->height();
+
+        const auto data = reinterpret_cast<const uint8_t*>(tex->getData());
+        const size_t rowSize = tex->getDataSize() / height;
+
+        // Hash per row in parallel, and then combine them.
+        std::vector<uint64_t> rowHash(height);
+
+#ifdef ENABLE_OMP
+#pragma omp parallel for
+#endif
+        for (int y = 0; y < height; y++) {
+            rowHash[y] = computeHash(&data[y * rowSize], rowSize, FNVOffsetBasis);
+        }
+
+        hash = computeHash(&rowHash[0], sizeof(uint64_t) * rowHash.size(), hash);
+
+        return true;
+    }
+
+    static std::string getCachePath(const std::string& dir, uint64_t hash)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.ibl", (unsigned long long)hash);
+
+        std::string path(dir);
+        if (path.back() != '/' && path.back() != '\\') {
+            path += '/';
+        }
+        path += name;
+
+        return path;
+    }
+
+    struct IBLCacheHeader {
+        uint8_t magic[4];
+        uint8_t version[4];
+        uint64_t hash;
+        uint32_t width;
+        uint32_t height;
+        uint32_t sizeOfReal;
+        real avgIllum;
+    };
+
+    bool ImageBasedLight::loadCache(const std::string& path, uint64_t hash)
+    {
+        FILE* fp = fopen(path.c_str(), "rb");
+        if (!fp) {
+            return false;
+        }
+
+        auto tex = getEnvMap()->getTexture();
+
+        IBLCacheHeader header;
+
+        bool isLoaded = (fread(&header, sizeof(header), 1, fp) == 1)
+            && memcmp(header.magic, "IBLA", 4) == 0
+            && header.version[3] == 1
+            && header.hash == hash
+            && header.width == tex->width()
+            && header.height == tex->height()
+            && header.sizeOfReal == sizeof(real)
+            && m_table.load(fp)
+            && m_table.size() == tex->width() * tex->height();
+
+        fclose(fp);
+
+        if (!isLoaded) {
+            AT_PRINTF("%s is not the cache for the environment map\n", path.c_str());
+            m_table.clear();
+            return false;
+        }
+
+        m_avgIllum = header.avgIllum;
+
+        return true;
+    }
+
+    bool ImageBasedLight::saveCache(const std::string& path, uint64_t hash) const
+    {
+        const auto tmpPath = aten::AtomicFile::getTemporaryPath(path);
+
+        FILE* fp = fopen(tmpPath.c_str(), "wb");
+        if (!fp) {
+            AT_PRINTF("Failed to open %s\n", tmpPath.c_str());
+            return false;
+        }
+
+        auto tex = getEnvMap()->getTexture();
+
+        IBLCacheHeader header;
+        {
+            header.magic[0] = 'I';
+            header.magic[1] = 'B';
+            header.magic[2] = 'L';
+            header.magic[3] = 'A';
+
+            header.version[0] = 0;
+            header.version[1] = 0;
+            header.version[2] = 0;
+            header.version[3] = 1;
+
+            header.hash = hash;
+            header.width = tex->width();
+            header.height = tex->height();
+            header.sizeOfReal = sizeof(real);
+            header.avgIllum = m_avgIllum;
+        }
+
+        bool isSaved = (fwrite(&header, sizeof(header), 1, fp) == 1)
+            && m_table.save(fp);
+
+        isSaved = (fclose(fp) == 0) && isSaved;
+
+        if (!isSaved) {
+            AT_PRINTF("Failed to write %s\n", tmpPath.c_str());
+            remove(tmpPath.c_str());
+            return false;
+        }
+
+        return aten::AtomicFile::replace(tmpPath, path);
+    }
+
     void ImageBasedLight::preCompute()
     {
         auto envmap = getEnvMap();
         AT_ASSERT(envmap);
 
-        auto width = envmap->getTexture()->width();
-        auto height = envmap->getTexture()->height();
+        auto tex = envmap->getTexture();
+
+        const int width = (int)tex->width();
+        const int height = (int)tex->height();
 
         m_avgIllum = 0;
+        m_table.clear();
+
+        uint64_t hash = 0;
+        std::string cachePath;
+
+        if (!s_cacheDir.empty() && computeImageHash(tex, hash)) {
+            cachePath = getCachePath(s_cacheDir, hash);
+
+            if (loadCache(cachePath, hash)) {
+                return;
+            }
+        }
 
         // NOTE
         // }bv́A~i= ܓxox}bvĵ.
 
         // NOTE
-        //    0 1 2 3 4
-        //   +-+-+-+-+-+
-        // 0 |a|b|c|d|e|...
-        //   +-+-+-+-+-+
-        // 1 |h|i|j|k|l|...
-        //   +-+-+-+-+-+
-        //
-        // VicjPDF͂P񕪂̍vlƂȂ.
-        // @pdfV_0 = a + b + c + d + e + ....
-        // @pdfV_1 = h + i + j + k + l + ....
-        //
-        // UijPDF͂PsNZ̒lƂȂ.
-        // @pdfU_00 = a, pdfU_01 = b, ...
-        // @pdfU_10 = h, pdfU_11 = i, ...
+        // Weight of the pixel is its luminance, and all pixels are in one alias table.
+        // So the pixel is sampled in O(1) with one random number, instead of the two binary searches
+        // for the marginal cdf (row) and the conditional cdf (column).
 
-        real totalWeight = 0;
+        std::vector<real> weights(width * height);
 
-        m_cdfU.resize(height);
+        // Sum per row to compute the average illuminance.
+        std::vector<real> rowIllum(height);
+        std::vector<real> rowScale(height);
 
-        for (uint32_t y = 0; y < height; y++) {
+#ifdef ENABLE_OMP
+#pragma omp parallel for
+#endif
+        for (int y = 0; y < height; y++) {
             // NOTE
             // ~́AܓxɂĂ͋ɂقǘcނ̂ŁA̕␳.
             // ܓx [0, pi].
@@ -46,75 +210,37 @@ namespace AT_NAME {
             // sin(0) = 0  scalel[ɂȂ̂邽.
             real scale = aten::sin(AT_MATH_PI * (real)(y + 0.5) / height);
 
-            // vpdf.
-            real pdfV = 0;
+            real sumIllum = 0;
 
-            // updf.
-            std::vector<real>& pdfU = m_cdfU[y];
-
-            for (uint32_t x = 0; x < width; x++) {
+            for (int x = 0; x < width; x++) {
                 real u = (real)(x + 0.5) / width;
                 real v = (real)(y + 0.5) / height;
 
                 auto clr = envmap->sample(u, v);
                 const auto illum = AT_NAME::color::luminance(clr);
 
-                m_avgIllum += illum * scale;
-                totalWeight += scale;
-
-                // P񕪂̍vlvZ.
-                pdfV += illum * scale;
-
-                // ܂pdf𒙂߂.
-                pdfU.push_back(illum * scale);
+                weights[y * width + x] = illum * scale;
+                sumIllum += illum * scale;
             }
 
-            // ܂pdf𒙂߂.
-            m_cdfV.push_back(pdfV);
+            rowIllum[y] = sumIllum;
+            rowScale[y] = scale * width;
         }
 
-        // For vertical.
-        {
-            real sum = 0;
-            for (int i = 0; i < m_cdfV.size(); i++) {
-                sum += m_cdfV[i];
-                if (i > 0) {
-                    m_cdfV[i] += m_cdfV[i - 1];
-                }
-            }
-            if (sum > 0) {
-                real invSum = 1 / sum;
-                for (int i = 0; i < m_cdfV.size(); i++) {
-                    m_cdfV[i] *= invSum;
-                    m_cdfV[i] = aten::clamp<real>(m_cdfV[i], 0, 1);
-                }
-            }
-        }
+        real totalWeight = 0;
 
-        // For horizontal.
-        {
-            for (uint32_t y = 0; y < height; y++) {
-                real sum = 0;
-                std::vector<real>& cdfU = m_cdfU[y];
-
-                for (uint32_t x = 0; x < width; x++) {
-                    sum += cdfU[x];
-                    if (x > 0) {
-                        cdfU[x] += cdfU[x - 1];
-                    }
-                }
-
-                if (sum > 0) {
-                    real invSum = 1 / sum;
-                    for (uint32_t x = 0; x < width; x++) {
-                        cdfU[x] *= invSum;
-                        cdfU[x] = aten::clamp<real>(cdfU[x], 0, 1);
-                    }
-                }
-            }
+        for (int y = 0; y < height; y++) {
+            m_avgIllum += rowIllum[y];
+            totalWeight += rowScale[y];
         }
 
         m_avgIllum /= totalWeight;
+
+        m_table.build(weights);
+
+        if (!cachePath.empty()) {
+            saveCache(cachePath, hash);
+        }
     }
 
     real ImageBasedLight::samplePdf(const aten::ray& r) const
@@ -128,74 +254,6 @@ namespace AT_NAME {
         return pdf;
     }
 
-    static int samplePdfAndCdf(
-        real r, 
-        const std::vector<real>& cdf, 
-        real& outPdf, 
-        real& outCdf)
-    {
-        outPdf = 0;
-        outCdf = 0;
-
-        // NOTE
-        // cdf is normalized to [0, 1].
-
-#if 1
-        int idxTop = 0;
-        int idxTail = (int)cdf.size() - 1;
-
-        for (;;) {
-            int idxMid = (idxTop + idxTail) >> 1;
-            auto midCdf = cdf[idxMid];
-
-            if (r < midCdf) {
-                idxTail = idxMid;
-            }
-            else {
-                idxTop = idxMid;
-            }
-
-            if ((idxTail - idxTop) == 1) {
-                auto topCdf = cdf[idxTop];
-                auto tailCdf = cdf[idxTail];
-
-                int idx = 0;
-
-                if (r <= topCdf) {
-                    outPdf = topCdf;
-                    idx = idxTop;
-                }
-                else {
-                    outPdf = tailCdf - topCdf;
-                    idx = idxTail;
-                }
-
-                return idx;
-            }
-        }
-#else
-        for (int i = 0; i < cdf.size(); i++) {
-            if (r <= cdf[i]) {
-                auto idx = i;
-
-                outCdf = cdf[i];
-
-                if (i > 0) {
-                    outPdf = cdf[i] - cdf[i - 1];
-                }
-                else {
-                    outPdf = cdf[0];
-                }
-
-                return idx;
-            }
-        }
-#endif
-
-        AT_ASSERT(false);
-        return 0;
-    }
-
     aten::LightSampleResult ImageBasedLight::sample(
         const aten::context& ctxt,
         const aten::vec3& org, 
@@ -208,17 +266,16 @@ namespace AT_NAME {
 
 #if 1
         const auto r1 = sampler->nextSample();
-        const auto r2 = sampler->nextSample();
-
-        real pdfU, pdfV;
-        real cdfU, cdfV;
-
-        int y = samplePdfAndCdf(r1, m_cdfV, pdfV, cdfV);
-        int x = samplePdfAndCdf(r2, m_cdfU[y], pdfU, cdfU);
 
         auto width = envmap->getTexture()->width();
         auto height = envmap->getTexture()->height();
 
+        real pdfUV;
+        auto idx = m_table.sample(r1, &pdfUV);
+
+        auto x = idx % width;
+        auto y = idx / width;
+
         real u = (real)(x + 0.5) / width;
         real v = (real)(y + 0.5) / height;
 
@@ -226,7 +283,7 @@ namespace AT_NAME {
         // p(w) = p(u, v) * (w * h) / (2^2 * sin())
         auto pi2 = AT_MATH_PI * AT_MATH_PI;
         auto theta = AT_MATH_PI * v;
-        result.pdf = (pdfU * pdfV) * ((width * height) / (pi2 * aten::sin(theta)));
+        result.pdf = pdfUV * ((width * height) / (pi2 * aten::sin(theta)));
 
         // u, v -> direction.
         result.dir = AT_NAME::envmap::convertUVToDirection(u, v);
@@ -1,9 +1,11 @@
 #pragma once
 
+#include <string>
 #include <vector>
 #include "light/light.h"
 #include "renderer/envmap.h"
 #include "misc/color.h"
+#include "misc/aliastable.h"
 
 namespace AT_NAME {
     class ImageBasedLight : public Light {
@@ -65,6 +67,16 @@ namespace AT_NAME {
             return m_avgIllum;
         }
 
+        /**
+         * @brief Set the directory to cache the table to sample the environment map.
+         * The table is keyed on the hash of the image, so it is reused for the same image.
+         * If the directory is empty, the table is not cached.
+         */
+        static void setCacheDirectory(const char* dir)
+        {
+            s_cacheDir = dir ? dir : "";
+        }
+
         virtual aten::LightSampleResult sample(
             const aten::context& ctxt,
             const aten::vec3& org, 
@@ -83,14 +95,16 @@ namespace AT_NAME {
     private:
         void preCompute();
 
+        bool loadCache(const std::string& path, uint64_t hash);
+        bool saveCache(const std::string& path, uint64_t hash) const;
+
     private:
         real m_avgIllum{ real(0) };
 
-        // vcdf(cumulative distribution function = ݐϕz֐ = sum of pdf).
-        std::vector<real> m_cdfV;
+        // Alias table over all pixels of the environment map.
+        // The weight of the pixel is its luminance and the solid angle which it covers.
+        aten::AliasTable m_table;
 
-        // ucdf(cumulative distribution function = ݐϕz֐ = sum of pdf).
-        // 񂲂Ƃɕێ.
-        std::vector<std::vector<real>> m_cdfU;
+        static std::string s_cacheDir;
     };
 }
\ No newline at end of file
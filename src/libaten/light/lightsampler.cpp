@@ -0,0 +1,527 @@
+#include <algorithm>
+
+#include "light/lightsampler.h"
+#include "geometry/transformable.h"
+#include "misc/color.h"
+#include "scene/context.h"
+
+// NOTE
+// Importance Sampling of Many Lights with Adaptive Tree Splitting, Conty Estevez and Kulla, 2018.
+// http://www.aconty.com/pdf/many-lights-hpg2018.pdf
+
+namespace AT_NAME
+{
+    static inline real safeSqrt(real x)
+    {
+        return aten::sqrt(std::max(x, real(0)));
+    }
+
+    // cos(max(0, a - b)).
+    static inline real cosSubClamped(real sinA, real cosA, real sinB, real cosB)
+    {
+        if (cosA > cosB) {
+            return real(1);
+        }
+        return cosA * cosB + sinA * sinB;
+    }
+
+    // sin(max(0, a - b)).
+    static inline real sinSubClamped(real sinA, real cosA, real sinB, real cosB)
+    {
+        if (cosA > cosB) {
+            return real(0);
+        }
+        return sinA * cosB - cosA * sinB;
+    }
+
+    // Rotate the vector around the axis with Rodrigues' rotation formula.
+    static inline aten::vec3 rotate(const aten::vec3& v, const aten::vec3& axis, real theta)
+    {
+        auto c = aten::cos(theta);
+        auto s = aten::sin(theta);
+        return v * c + cross(axis, v) * s + axis * dot(axis, v) * (real(1) - c);
+    }
+
+    // Merge two normal cones into the cone which bounds both.
+    static void mergeCone(
+        const aten::vec3& axisA, real cosA,
+        const aten::vec3& axisB, real cosB,
+        aten::vec3& axis, real& cosTheta)
+    {
+        auto thetaA = aten::acos(aten::clamp<real>(cosA, -1, 1));
+        auto thetaB = aten::acos(aten::clamp<real>(cosB, -1, 1));
+        auto thetaD = aten::acos(aten::clamp<real>(dot(axisA, axisB), -1, 1));
+
+        if (std::min(thetaD + thetaB, AT_MATH_PI) <= thetaA) {
+            // A contains B.
+            axis = axisA;
+            cosTheta = cosA;
+            return;
+        }
+        if (std::min(thetaD + thetaA, AT_MATH_PI) <= thetaB) {
+            // B contains A.
+            axis = axisB;
+            cosTheta = cosB;
+            return;
+        }
+
+        auto thetaO = (thetaA + thetaD + thetaB) * real(0.5);
+
+        if (thetaO >= AT_MATH_PI) {
+            axis = axisA;
+            cosTheta = real(-1);
+            return;
+        }
+
+        // Rotate A's axis toward B's axis.
+        auto thetaR = thetaO - thetaA;
+        auto wr = cross(axisA, axisB);
+
+        if (squared_length(wr) == real(0)) {
+            axis = axisA;
+            cosTheta = real(-1);
+            return;
+        }
+
+        axis = normalize(rotate(axisA, normalize(wr), thetaR));
+        cosTheta = aten::cos(thetaO);
+    }
+
+    real LightSampler::LightBounds::importance(const aten::vec3& org, const aten::vec3& nml) const
+    {
+        if (power <= real(0)) {
+            return real(0);
+        }
+
+        auto center = bbox.getCenter();
+        auto radius = bbox.getDiagonalLenght() * real(0.5);
+
+        // Clamp the distance not to diverge when the shading point is in the bounds.
+        auto d2 = squared_length(org - center);
+        d2 = std::max(d2, radius * radius);
+
+        auto wi = normalize(org - center);
+
+        // Angle between the cone axis and the direction to the shading point.
+        auto cosThetaW = dot(axis, wi);
+        auto sinThetaW = safeSqrt(real(1) - cosThetaW * cosThetaW);
+
+        // Angle which the bounds subtends from the shading point.
+        real cosThetaB = real(-1);
+        if (squared_length(org - center) > radius * radius) {
+            auto sin2ThetaMax = radius * radius / squared_length(org - center);
+            cosThetaB = safeSqrt(real(1) - sin2ThetaMax);
+        }
+        auto sinThetaB = safeSqrt(real(1) - cosThetaB * cosThetaB);
+
+        // Minimum angle between the emitter normals and the direction to the shading point.
+        auto sinThetaO = safeSqrt(real(1) - cosThetaO * cosThetaO);
+        auto cosThetaX = cosSubClamped(sinThetaW, cosThetaW, sinThetaO, cosThetaO);
+        auto sinThetaX = sinSubClamped(sinThetaW, cosThetaW, sinThetaO, cosThetaO);
+        auto cosThetaP = cosSubClamped(sinThetaX, cosThetaX, sinThetaB, cosThetaB);
+
+        if (cosThetaP <= cosThetaE) {
+            // The shading point is out of the emission.
+            return real(0);
+        }
+
+        real importance = power * cosThetaP / d2;
+
+        // Receiver's cosine.
+        if (squared_length(nml) > real(0)) {
+            auto cosThetaI = aten::abs(dot(wi, nml));
+            auto sinThetaI = safeSqrt(real(1) - cosThetaI * cosThetaI);
+            auto cosThetaPI = cosSubClamped(sinThetaI, cosThetaI, sinThetaB, cosThetaB);
+            importance *= cosThetaPI;
+        }
+
+        return std::max(importance, real(0));
+    }
+
+    LightSampler::LightBounds LightSampler::LightBounds::merge(const LightBounds& a, const LightBounds& b)
+    {
+        if (a.power <= real(0)) {
+            return b;
+        }
+        if (b.power <= real(0)) {
+            return a;
+        }
+
+        LightBounds ret;
+
+        ret.bbox = aten::aabb::merge(a.bbox, b.bbox);
+        ret.power = a.power + b.power;
+        ret.cosThetaE = std::min(a.cosThetaE, b.cosThetaE);
+
+        mergeCone(
+            a.axis, a.cosThetaO,
+            b.axis, b.cosThetaO,
+            ret.axis, ret.cosThetaO);
+
+        return ret;
+    }
+
+    LightSampler::LightBounds LightSampler::computeLightBounds(
+        const aten::context& ctxt,
+        const Light* light) const
+    {
+        LightBounds bounds;
+
+        const auto& param = light->param();
+        auto luminance = color::luminance(light->getLe());
+
+        switch (param.type) {
+        case aten::LightType::Point:
+            bounds.bbox = aten::aabb(light->getPos(), light->getPos());
+            bounds.power = luminance * real(4) * AT_MATH_PI;
+            break;
+        case aten::LightType::Spot:
+            bounds.bbox = aten::aabb(light->getPos(), light->getPos());
+            bounds.axis = light->getDir();
+            bounds.cosThetaO = real(1);
+            bounds.cosThetaE = aten::cos(param.outerAngle * real(0.5));
+            bounds.power = luminance * real(2) * AT_MATH_PI * (real(1) - bounds.cosThetaE);
+            break;
+        case aten::LightType::Area:
+        {
+            auto obj = static_cast<const aten::transformable*>(light->getLightObject());
+            if (!obj) {
+                break;
+            }
+
+            bounds.bbox = obj->getBoundingbox();
+
+            auto area = obj->getParam().area;
+            if (area <= real(0)) {
+                area = bounds.bbox.computeSurfaceArea();
+            }
+
+            // Area light emits only to the front side.
+            bounds.power = luminance * area * AT_MATH_PI;
+            bounds.cosThetaE = real(0);
+
+            // Normal cone from the triangles.
+            // The vertices of the polygon object are in world space. Other objects are treated as omni directional.
+            if (obj->getType() == aten::GeometryType::Polygon) {
+                std::vector<aten::PrimitiveParamter> triangles;
+                obj->collectTriangles(triangles);
+
+                bool isFirst = true;
+
+                for (const auto& tri : triangles) {
+                    aten::vec3 normals[3];
+                    int normalNum = 0;
+
+                    if (tri.needNormal > 0) {
+                        const auto& v0 = ctxt.getVertex(tri.idx[0]);
+                        const auto& v1 = ctxt.getVertex(tri.idx[1]);
+                        const auto& v2 = ctxt.getVertex(tri.idx[2]);
+
+                        auto n = cross(aten::vec3(v1.pos - v0.pos), aten::vec3(v2.pos - v0.pos));
+                        if (squared_length(n) > real(0)) {
+                            normals[normalNum++] = normalize(n);
+                        }
+                    }
+                    else {
+                        for (int i = 0; i < 3; i++) {
+                            const auto& v = ctxt.getVertex(tri.idx[i]);
+                            if (squared_length(v.nml) > real(0)) {
+                                normals[normalNum++] = normalize(v.nml);
+                            }
+                        }
+                    }
+
+                    for (int i = 0; i < normalNum; i++) {
+                        if (isFirst) {
+                            bounds.axis = normals[i];
+                            bounds.cosThetaO = real(1);
+                            isFirst = false;
+                        }
+                        else {
+                            mergeCone(
+                                bounds.axis, bounds.cosThetaO,
+                                normals[i], real(1),
+                                bounds.axis, bounds.cosThetaO);
+                        }
+                    }
+                }
+
+                if (isFirst) {
+                    bounds.cosThetaO = real(-1);
+                }
+            }
+            break;
+        }
+        default:
+            AT_ASSERT(false);
+            break;
+        }
+
+        return bounds;
+    }
+
+    int LightSampler::buildBvh(
+        std::vector<LightBounds>& bounds,
+        std::vector<int>& lightIndices,
+        int start, int end,
+        uint64_t trail, int depth)
+    {
+        AT_ASSERT(start < end);
+        AT_ASSERT(depth < 64);
+
+        int nodeIdx = (int)m_nodes.size();
+        m_nodes.push_back(LightBvhNode());
+
+        if (end - start == 1) {
+            auto lightIdx = lightIndices[start];
+
+            m_nodes[nodeIdx].bounds = bounds[m_finiteIdx[lightIdx]];
+            m_nodes[nodeIdx].lightIdx = lightIdx;
+
+            m_trails[lightIdx] = trail;
+
+            return nodeIdx;
+        }
+
+        // Split at the median along the longest axis of the centroids.
+        aten::aabb centroidBox;
+        for (int i = start; i < end; i++) {
+            auto c = bounds[m_finiteIdx[lightIndices[i]]].bbox.getCenter();
+            centroidBox.expand(c);
+        }
+
+        auto size = centroidBox.size();
+        int axis = 0;
+        if (size.y > size.x) {
+            axis = 1;
+        }
+        if (size.z > size[axis]) {
+            axis = 2;
+        }
+
+        int mid = (start + end) / 2;
+
+        std::nth_element(
+            lightIndices.begin() + start,
+            lightIndices.begin() + mid,
+            lightIndices.begin() + end,
+            [&](int a, int b) {
+            auto ca = bounds[m_finiteIdx[a]].bbox.getCenter();
+            auto cb = bounds[m_finiteIdx[b]].bbox.getCenter();
+            return ca[axis] < cb[axis];
+        });
+
+        int left = buildBvh(bounds, lightIndices, start, mid, trail, depth + 1);
+        int right = buildBvh(bounds, lightIndices, mid, end, trail | (1ull << depth), depth + 1);
+
+        m_nodes[nodeIdx].left = left;
+        m_nodes[nodeIdx].right = right;
+        m_nodes[nodeIdx].bounds = LightBounds::merge(m_nodes[left].bounds, m_nodes[right].bounds);
+
+        return nodeIdx;
+    }
+
+    void LightSampler::build(
+        const aten::context& ctxt,
+        const std::vector<Light*>& lights,
+        Type type)
+    {
+        m_type = type;
+        m_lightNum = (uint32_t)lights.size();
+
+        m_finiteLights.clear();
+        m_infiniteLights.clear();
+        m_finiteIdx.clear();
+        m_finiteIdx.resize(m_lightNum, -1);
+
+        m_powerTable.clear();
+        m_nodes.clear();
+        m_trails.clear();
+        m_trails.resize(m_lightNum, 0);
+
+        m_lightIdxByObjId.clear();
+
+        for (uint32_t i = 0; i < m_lightNum; i++) {
+            const auto light = lights[i];
+
+            if (light->isInfinite()) {
+                m_infiniteLights.push_back(i);
+            }
+            else {
+                m_finiteIdx[i] = (int)m_finiteLights.size();
+                m_finiteLights.push_back(i);
+            }
+
+            const auto& param = light->param();
+            if (param.type == aten::LightType::Area && param.objid >= 0) {
+                m_lightIdxByObjId.insert(std::make_pair(param.objid, (int)i));
+            }
+        }
+
+        if (m_type != Type::Uniform && !m_finiteLights.empty()) {
+            std::vector<LightBounds> bounds(m_finiteLights.size());
+
+            for (size_t i = 0; i < m_finiteLights.size(); i++) {
+                bounds[i] = computeLightBounds(ctxt, lights[m_finiteLights[i]]);
+            }
+
+            if (m_type == Type::Power) {
+                std::vector<real> powers(bounds.size());
+                for (size_t i = 0; i < bounds.size(); i++) {
+                    powers[i] = bounds[i].power;
+                }
+                m_powerTable.build(powers);
+            }
+            else {
+                std::vector<int> lightIndices(m_finiteLights);
+
+                m_nodes.reserve(lightIndices.size() * 2);
+
+                buildBvh(bounds, lightIndices, 0, (int)lightIndices.size(), 0, 0);
+            }
+        }
+
+        m_isBuilt = true;
+    }
+
+    int LightSampler::sample(
+        const aten::vec3& org,
+        const aten::vec3& nml,
+        real u,
+        real& selectPdf) const
+    {
+        AT_ASSERT(m_isBuilt);
+
+        selectPdf = real(0);
+
+        if (m_lightNum == 0) {
+            return -1;
+        }
+
+        if (m_type == Type::Uniform) {
+            auto idx = std::min<uint32_t>((uint32_t)(u * m_lightNum), m_lightNum - 1);
+            selectPdf = real(1) / m_lightNum;
+            return (int)idx;
+        }
+
+        // Choose the infinite lights or the finite lights, and then reuse the random number.
+        auto probInfinite = getInfiniteLightSelectProb();
+
+        if (u < probInfinite) {
+            u = u / probInfinite;
+
+            auto num = (uint32_t)m_infiniteLights.size();
+            auto idx = std::min<uint32_t>((uint32_t)(u * num), num - 1);
+
+            selectPdf = probInfinite / num;
+            return m_infiniteLights[idx];
+        }
+
+        u = (u - probInfinite) / (real(1) - probInfinite);
+        u = std::min(u, real(1) - AT_MATH_EPSILON);
+
+        const auto probFinite = real(1) - probInfinite;
+
+        if (m_type == Type::Power) {
+            real pdf = real(0);
+            auto idx = m_powerTable.sample(u, &pdf);
+
+            selectPdf = probFinite * pdf;
+            return m_finiteLights[idx];
+        }
+
+        // Traverse the BVH.
+        real pdf = probFinite;
+        int nodeIdx = 0;
+
+        while (!m_nodes[nodeIdx].isLeaf()) {
+            const auto& node = m_nodes[nodeIdx];
+
+            auto importanceL = m_nodes[node.left].bounds.importance(org, nml);
+            auto importanceR = m_nodes[node.right].bounds.importance(org, nml);
+
+            if (importanceL <= real(0) && importanceR <= real(0)) {
+                // No light in the node affects the shading point.
+                return -1;
+            }
+
+            auto probL = importanceL / (importanceL + importanceR);
+
+            if (u < probL) {
+                u = std::min(u / probL, real(1) - AT_MATH_EPSILON);
+                pdf *= probL;
+                nodeIdx = node.left;
+            }
+            else {
+                u = std::min((u - probL) / (real(1) - probL), real(1) - AT_MATH_EPSILON);
+                pdf *= real(1) - probL;
+                nodeIdx = node.right;
+            }
+        }
+
+        selectPdf = pdf;
+        return m_nodes[nodeIdx].lightIdx;
+    }
+
+    real LightSampler::getSelectPdf(
+        const aten::vec3& org,
+        const aten::vec3& nml,
+        int lightIdx) const
+    {
+        AT_ASSERT(m_isBuilt);
+
+        if (lightIdx < 0 || (uint32_t)lightIdx >= m_lightNum) {
+            return real(0);
+        }
+
+        if (m_type == Type::Uniform) {
+            return real(1) / m_lightNum;
+        }
+
+        auto probInfinite = getInfiniteLightSelectProb();
+
+        if (m_finiteIdx[lightIdx] < 0) {
+            return probInfinite / m_infiniteLights.size();
+        }
+
+        const auto probFinite = real(1) - probInfinite;
+
+        if (m_type == Type::Power) {
+            return probFinite * m_powerTable.getPdf(m_finiteIdx[lightIdx]);
+        }
+
+        // Follow the trail from the root to the leaf.
+        auto trail = m_trails[lightIdx];
+
+        real pdf = probFinite;
+        int nodeIdx = 0;
+
+        while (!m_nodes[nodeIdx].isLeaf()) {
+            const auto& node = m_nodes[nodeIdx];
+
+            auto importanceL = m_nodes[node.left].bounds.importance(org, nml);
+            auto importanceR = m_nodes[node.right].bounds.importance(org, nml);
+
+            if (importanceL <= real(0) && importanceR <= real(0)) {
+                return real(0);
+            }
+
+            auto probL = importanceL / (importanceL + importanceR);
+
+            if (trail & 1) {
+                pdf *= real(1) - probL;
+                nodeIdx = node.right;
+            }
+            else {
+                pdf *= probL;
+                nodeIdx = node.left;
+            }
+
+            trail >>= 1;
+        }
+
+        AT_ASSERT(m_nodes[nodeIdx].lightIdx == lightIdx);
+
+        return pdf;
+    }
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+
+#include "light/light.h"
+#include "math/aabb.h"
+#include "misc/aliastable.h"
+
+namespace AT_NAME
+{
+    /**
+     * @brief Select one light from many lights for the explicit connection.
+     *
+     * Uniform : Select uniformly.
+     * Power : Select by the power of the lights with the alias table.
+     * BVH : Traverse the BVH over the lights stochastically by the importance of the nodes for the shading point.
+     *       The importance is computed with the power, the bounds and the normal cone bounds of the node.
+     *
+     * Infinite lights (directional light, IBL) can't be bounded, so they are selected separately
+     * with the probability which is proportional to their number.
+     */
+    class LightSampler {
+    public:
+        LightSampler() {}
+        ~LightSampler() {}
+
+    public:
+        enum class Type {
+            Uniform,
+            Power,
+            BVH,
+        };
+
+        /**
+         * @brief Build the structure to select the lights.
+         */
+        void build(
+            const aten::context& ctxt,
+            const std::vector<Light*>& lights,
+            Type type);
+
+        /**
+         * @brief Return whether the structure is built for the specified number of the lights.
+         */
+        bool isBuilt(uint32_t lightNum) const
+        {
+            return m_isBuilt && m_lightNum == lightNum;
+        }
+
+        Type getType() const
+        {
+            return m_type;
+        }
+
+        /**
+         * @brief Select a light.
+         * @param org Shading point.
+         * @param nml Normal at the shading point. If it is zero vector, the receiver's cosine is not considered.
+         * @param u Uniform random number in [0, 1).
+         * @param selectPdf Probability to select the light.
+         * @return Index of the selected light. If no light can affect the shading point, -1 is returned.
+         */
+        int sample(
+            const aten::vec3& org,
+            const aten::vec3& nml,
+            real u,
+            real& selectPdf) const;
+
+        /**
+         * @brief Return the probability to select the light for the shading point.
+         * It is the same as selectPdf which sample returns for the light.
+         */
+        real getSelectPdf(
+            const aten::vec3& org,
+            const aten::vec3& nml,
+            int lightIdx) const;
+
+        /**
+         * @brief Return the index of the area light which has the specified object.
+         * If no light has the object, -1 is returned.
+         */
+        int findLightByObject(int objid) const
+        {
+            auto it = m_lightIdxByObjId.find(objid);
+            return it != m_lightIdxByObjId.end() ? it->second : -1;
+        }
+
+    private:
+        /**
+         * @brief Bounds of the lights which are used to compute the importance.
+         */
+        struct LightBounds {
+            aten::aabb bbox;
+            aten::vec3 axis{ real(0), real(0), real(1) };   ///< Axis of the normal cone.
+            real cosThetaO{ real(-1) };                     ///< Cosine of the spread of the normal cone.
+            real cosThetaE{ real(0) };                      ///< Cosine of the spread of the emission around the normals.
+            real power{ real(0) };
+
+            real importance(const aten::vec3& org, const aten::vec3& nml) const;
+
+            static LightBounds merge(const LightBounds& a, const LightBounds& b);
+        };
+
+        struct LightBvhNode {
+            LightBounds bounds;
+            int left{ -1 };
+            int right{ -1 };
+            int lightIdx{ -1 };    ///< Index of the light if the node is leaf.
+
+            bool isLeaf() const
+            {
+                return lightIdx >= 0;
+            }
+        };
+
+        LightBounds computeLightBounds(
+            const aten::context& ctxt,
+            const Light* light) const;
+
+        int buildBvh(
+            std::vector<LightBounds>& bounds,
+            std::vector<int>& lightIndices,
+            int start, int end,
+            uint64_t trail, int depth);
+
+        real getInfiniteLightSelectProb() const
+        {
+            if (m_finiteLights.empty()) {
+                return real(1);
+            }
+            return (real)m_infiniteLights.size() / m_lightNum;
+        }
+
+    private:
+        Type m_type{ Type::Uniform };
+
+        bool m_isBuilt{ false };
+        uint32_t m_lightNum{ 0 };
+
+        // Indices of the finite lights and the infinite lights.
+        std::vector<int> m_finiteLights;
+        std::vector<int> m_infiniteLights;
+
+        // Index in m_finiteLights per light. For the infinite lights, -1.
+        std::vector<int> m_finiteIdx;
+
+        // For Type::Power. Built over the finite lights.
+        aten::AliasTable m_powerTable;
+
+        // For Type::BVH.
+        std::vector<LightBvhNode> m_nodes;
+
+        // Bit trail from the root to the leaf per light. 0 is left, 1 is right.
+        std::vector<uint64_t> m_trails;
+
+        std::unordered_map<int, int> m_lightIdxByObjId;
+    };
+}
@@ -52,7 +52,7 @@ namespace AT_NAME
         auto lower = name;
         std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
 
-        for each (const char* mtrl_name in g_mtrlTypeNames) {
+        for (const char* mtrl_name : g_mtrlTypeNames) {
             if (lower == mtrl_name) {
                 return true;
             }
@@ -66,17 +66,12 @@ namespace AT_NAME
         return (0 <= type && type < aten::MaterialType::MaterialTypeMax);
     }
 
-    void material::resetIdWhenAnyMaterialLeave(AT_NAME::material* mtrl)
-    {
-        mtrl->m_id = mtrl->m_listItem.currentIndex();
-    }
-
     material::material(
         aten::MaterialType type, 
         const aten::MaterialAttribute& attrib)
         : m_param(type, attrib)
     {
-        m_listItem.init(this, resetIdWhenAnyMaterialLeave);
+        m_listItem.init(this);
     }
 
     material::material(
@@ -88,7 +83,7 @@ namespace AT_NAME
         aten::texture* normalMap/*= nullptr*/)
         : material(type, attrib)
     {
-        m_listItem.init(this, resetIdWhenAnyMaterialLeave);
+        m_listItem.init(this);
 
         m_param.baseColor = clr;
         m_param.ior = ior;
@@ -102,7 +97,7 @@ namespace AT_NAME
         aten::Values& val)
         : material(type, attrib)
     {
-        m_listItem.init(this, resetIdWhenAnyMaterialLeave);
+        m_listItem.init(this);
 
         m_param.baseColor = val.get("baseColor", m_param.baseColor);
         m_param.ior = val.get("ior", m_param.ior);
@@ -442,6 +442,9 @@ namespace AT_NAME
         void setName(const char* name)
         {
             m_name = name;
+
+            // To find the material by the name in the context.
+            m_listItem.setName(m_name);
         }
 
         const char* name() const
@@ -469,8 +472,6 @@ namespace AT_NAME
         static bool isValidMaterialType(aten::MaterialType type);
 
     private:
-        static void resetIdWhenAnyMaterialLeave(AT_NAME::material* mtrl);
-
         void addToDataList(aten::DataList<AT_NAME::material>& list)
         {
             list.add(&m_listItem);
@@ -0,0 +1,199 @@
+#include "material/material_evaluator.h"
+
+namespace AT_NAME
+{
+    void MaterialEvaluator::evalBatch(
+        const aten::MaterialParameter* mtrls,
+        const aten::MaterialParameter* param,
+        const MaterialShadingPoint* points,
+        const aten::vec3* wo,
+        int num,
+        aten::vec3* bsdfs,
+        real* pdfs)
+    {
+        const auto footprint = TextureFootprint::get();
+
+        // NOTE
+        // All points have the same material, so the switch on the type always takes the same case.
+        for (int i = 0; i < num; i++) {
+            const auto& p = points[i];
+
+            TextureFootprint::set(p.footprint);
+
+            bsdfs[i] = bsdf(mtrls, param, p.normal, p.wi, wo[i], p.u, p.v);
+            pdfs[i] = pdf(mtrls, param, p.normal, p.wi, wo[i], p.u, p.v);
+        }
+
+        TextureFootprint::set(footprint);
+    }
+
+    void MaterialEvaluator::sampleBatch(
+        const aten::MaterialParameter* mtrls,
+        const aten::MaterialParameter* param,
+        const MaterialShadingPoint* points,
+        aten::sampler** samplers,
+        int num,
+        MaterialSampling* results)
+    {
+        const auto footprint = TextureFootprint::get();
+
+        for (int i = 0; i < num; i++) {
+            const auto& p = points[i];
+
+            TextureFootprint::set(p.footprint);
+
+            results[i] = MaterialSampling();
+
+            sample(
+                &results[i],
+                mtrls, param,
+                p.normal, p.wi, p.orgnormal,
+                samplers[i],
+                p.u, p.v);
+        }
+
+        TextureFootprint::set(footprint);
+    }
+
+    // NOTE
+    // The layered material is evaluated in the same way as LayeredBSDF.
+
+    void MaterialEvaluator::sampleLayer(
+        MaterialSampling* result,
+        const aten::MaterialParameter* mtrls,
+        const aten::MaterialParameter* param,
+        const aten::vec3& normal,
+        const aten::vec3& wi,
+        const aten::vec3& orgnormal,
+        aten::sampler* sampler,
+        real u, real v)
+    {
+        real weight = 1;
+
+        for (int i = 0; i < AT_COUNTOF(param->layer); i++) {
+            if (param->layer[i] < 0) {
+                break;
+            }
+
+            const auto layer = &mtrls[param->layer[i]];
+
+            aten::vec3 appliedNml = normal;
+
+            // NOTE
+            // The normal map of the top layer is applied by the caller.
+            if (i > 0) {
+                AT_NAME::applyNormalMap(layer->normalMap, normal, appliedNml, u, v);
+            }
+
+            MaterialSampling sampleres;
+            sample(&sampleres, mtrls, layer, appliedNml, wi, orgnormal, sampler, u, v);
+
+            const auto f = aten::clamp<real>(sampleres.fresnel, 0, 1);
+
+            result->pdf += weight * f * sampleres.pdf;
+
+            // bsdf includes fresnel value.
+            result->bsdf += weight * sampleres.bsdf;
+
+            weight = aten::clamp<real>(weight - f, 0, 1);
+            if (weight <= 0) {
+                break;
+            }
+
+            if (i == 0) {
+                result->dir = sampleres.dir;
+            }
+        }
+    }
+
+    real MaterialEvaluator::pdfLayer(
+        const aten::MaterialParameter* mtrls,
+        const aten::MaterialParameter* param,
+        const aten::vec3& normal,
+        const aten::vec3& wi,
+        const aten::vec3& wo,
+        real u, real v)
+    {
+        real ret = 0;
+
+        real weight = 1;
+        real ior = 1;   // Start from the vacuum.
+
+        for (int i = 0; i < AT_COUNTOF(param->layer); i++) {
+            if (param->layer[i] < 0) {
+                break;
+            }
+
+            const auto layer = &mtrls[param->layer[i]];
+
+            aten::vec3 appliedNml = normal;
+
+            if (i > 0) {
+                AT_NAME::applyNormalMap(layer->normalMap, normal, appliedNml, u, v);
+            }
+
+            auto p = pdf(mtrls, layer, appliedNml, wi, wo, u, v);
+            auto f = computeFresnel(layer, appliedNml, wi, wo, ior);
+
+            f = aten::clamp<real>(f, 0, 1);
+
+            ret += weight * p;
+
+            weight = aten::clamp<real>(weight - f, 0, 1);
+            if (weight <= 0) {
+                break;
+            }
+
+            // The ior of the upper layer is used for the lower layer.
+            ior = layer->ior;
+        }
+
+        return ret;
+    }
+
+    aten::vec3 MaterialEvaluator::bsdfLayer(
+        const aten::MaterialParameter* mtrls,
+        const aten::MaterialParameter* param,
+        const aten::vec3& normal,
+        const aten::vec3& wi,
+        const aten::vec3& wo,
+        real u, real v)
+    {
+        aten::vec3 ret;
+
+        real weight = 1;
+        real ior = 1;   // Start from the vacuum.
+
+        for (int i = 0; i < AT_COUNTOF(param->layer); i++) {
+            if (param->layer[i] < 0) {
+                break;
+            }
+
+            const auto layer = &mtrls[param->layer[i]];
+
+            aten::vec3 appliedNml = normal;
+
+            if (i > 0) {
+                AT_NAME::applyNormalMap(layer->normalMap, normal, appliedNml, u, v);
+            }
+
+            auto b = bsdf(mtrls, layer, appliedNml, wi, wo, u, v);
+            auto f = computeFresnel(layer, appliedNml, wi, wo, ior);
+
+            f = aten::clamp<real>(f, 0, 1);
+
+            // bsdf includes fresnel value.
+            ret += weight * b;
+
+            weight = aten::clamp<real>(weight - f, 0, 1);
+            if (weight <= 0) {
+                break;
+            }
+
+            // The ior of the upper layer is used for the lower layer.
+            ior = layer->ior;
+        }
+
+        return ret;
+    }
+}
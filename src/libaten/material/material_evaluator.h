@@ -0,0 +1,389 @@
+#pragma once
+
+#include "material/material.h"
+#include "material/sample_texture.h"
+#include "material/emissive.h"
+#include "material/lambert.h"
+#include "material/oren_nayar.h"
+#include "material/specular.h"
+#include "material/refraction.h"
+#include "material/blinn.h"
+#include "material/ggx.h"
+#include "material/beckman.h"
+#include "material/velvet.h"
+#include "material/lambert_refraction.h"
+#include "material/microfacet_refraction.h"
+#include "material/disney_brdf.h"
+#include "material/carpaint.h"
+
+namespace AT_NAME
+{
+    /**
+     * @brief Shading point for the batched evaluation of the material.
+     */
+    struct MaterialShadingPoint {
+        aten::vec3 normal;      ///< Shading normal which the normal map is applied to.
+        aten::vec3 orgnormal;   ///< Original normal at the hit point.
+        aten::vec3 wi;          ///< Incoming direction.
+        real u{ real(0) };
+        real v{ real(0) };
+        real footprint{ AT_MATH_INF };  ///< Texture footprint. See TextureFootprint.
+    };
+
+    /**
+     * @brief Evaluate the materials with their parameters by switching on the material type.
+     *
+     * This is the CPU counterpart of material_impl.cuh in idaten.
+     * The parameters are read from the contiguous array which context::copyMaterialParameters makes,
+     * so the material objects and their virtual functions are not necessary.
+     * The layers of the layered material are referred by the index in the array.
+     *
+     * The batched functions evaluate many shading points with the same material at once.
+     * The type is resolved once per batch, and the loop per type is the place for the SIMD kernel.
+     *
+     * @note NPR materials (Toon) are not supported, because they need the light object.
+     */
+    class MaterialEvaluator {
+    private:
+        MaterialEvaluator() = delete;
+        ~MaterialEvaluator() = delete;
+
+    public:
+        static inline void sample(
+            MaterialSampling* result,
+            const aten::MaterialParameter* mtrls,
+            const aten::MaterialParameter* param,
+            const aten::vec3& normal,
+            const aten::vec3& wi,
+            const aten::vec3& orgnormal,
+            aten::sampler* sampler,
+            real u, real v)
+        {
+            switch (param->type) {
+            case aten::MaterialType::Emissive:
+                emissive::sample(result, param, normal, wi, orgnormal, sampler, u, v, false);
+                break;
+            case aten::MaterialType::Lambert:
+                lambert::sample(result, param, normal, wi, orgnormal, sampler, u, v, false);
+                break;
+            case aten::MaterialType::OrneNayar:
+                OrenNayar::sample(result, param, normal, wi, orgnormal, sampler, u, v, false);
+                break;
+            case aten::MaterialType::Specular:
+                specular::sample(result, param, normal, wi, orgnormal, sampler, u, v, false);
+                break;
+            case aten::MaterialType::Refraction:
+                refraction::sample(result, param, normal, wi, orgnormal, sampler, u, v, false);
+                break;
+            case aten::MaterialType::Blinn:
+                MicrofacetBlinn::sample(result, param, normal, wi, orgnormal, sampler, u, v, false);
+                break;
+            case aten::MaterialType::GGX:
+                MicrofacetGGX::sample(result, param, normal, wi, orgnormal, sampler, u, v, false);
+                break;
+            case aten::MaterialType::Beckman:
+                MicrofacetBeckman::sample(result, param, normal, wi, orgnormal, sampler, u, v, false);
+                break;
+            case aten::MaterialType::Velvet:
+                MicrofacetVelvet::sample(result, param, normal, wi, orgnormal, sampler, u, v, false);
+                break;
+            case aten::MaterialType::Lambert_Refraction:
+                LambertRefraction::sample(result, param, normal, wi, orgnormal, sampler, u, v, false);
+                break;
+            case aten::MaterialType::Microfacet_Refraction:
+                MicrofacetRefraction::sample(result, param, normal, wi, orgnormal, sampler, u, v, false);
+                break;
+            case aten::MaterialType::Disney:
+                DisneyBRDF::sample(result, param, normal, wi, orgnormal, sampler, u, v, false);
+                break;
+            case aten::MaterialType::CarPaint:
+                CarPaintBRDF::sample(result, param, normal, wi, orgnormal, sampler, u, v, false);
+                break;
+            case aten::MaterialType::Layer:
+                sampleLayer(result, mtrls, param, normal, wi, orgnormal, sampler, u, v);
+                break;
+            default:
+                AT_ASSERT(false);
+                break;
+            }
+        }
+
+        static inline real pdf(
+            const aten::MaterialParameter* mtrls,
+            const aten::MaterialParameter* param,
+            const aten::vec3& normal,
+            const aten::vec3& wi,
+            const aten::vec3& wo,
+            real u, real v)
+        {
+            real ret = real(0);
+
+            switch (param->type) {
+            case aten::MaterialType::Emissive:
+                ret = emissive::pdf(param, normal, wi, wo, u, v);
+                break;
+            case aten::MaterialType::Lambert:
+                ret = lambert::pdf(normal, wo);
+                break;
+            case aten::MaterialType::OrneNayar:
+                ret = OrenNayar::pdf(param, normal, wi, wo, u, v);
+                break;
+            case aten::MaterialType::Specular:
+                ret = specular::pdf(param, normal, wi, wo, u, v);
+                break;
+            case aten::MaterialType::Refraction:
+                ret = refraction::pdf(param, normal, wi, wo, u, v);
+                break;
+            case aten::MaterialType::Blinn:
+                ret = MicrofacetBlinn::pdf(param, normal, wi, wo, u, v);
+                break;
+            case aten::MaterialType::GGX:
+                ret = MicrofacetGGX::pdf(param, normal, wi, wo, u, v);
+                break;
+            case aten::MaterialType::Beckman:
+                ret = MicrofacetBeckman::pdf(param, normal, wi, wo, u, v);
+                break;
+            case aten::MaterialType::Velvet:
+                ret = MicrofacetVelvet::pdf(param, normal, wi, wo, u, v);
+                break;
+            case aten::MaterialType::Lambert_Refraction:
+                ret = LambertRefraction::pdf(normal, wo);
+                break;
+            case aten::MaterialType::Microfacet_Refraction:
+                ret = MicrofacetRefraction::pdf(param, normal, wi, wo, u, v);
+                break;
+            case aten::MaterialType::Disney:
+                ret = DisneyBRDF::pdf(param, normal, wi, wo, u, v);
+                break;
+            case aten::MaterialType::CarPaint:
+                ret = CarPaintBRDF::pdf(param, normal, wi, wo, u, v);
+                break;
+            case aten::MaterialType::Layer:
+                ret = pdfLayer(mtrls, param, normal, wi, wo, u, v);
+                break;
+            default:
+                AT_ASSERT(false);
+                break;
+            }
+
+            return ret;
+        }
+
+        static inline aten::vec3 bsdf(
+            const aten::MaterialParameter* mtrls,
+            const aten::MaterialParameter* param,
+            const aten::vec3& normal,
+            const aten::vec3& wi,
+            const aten::vec3& wo,
+            real u, real v)
+        {
+            aten::vec3 ret;
+
+            switch (param->type) {
+            case aten::MaterialType::Emissive:
+                ret = emissive::bsdf(param, normal, wi, wo, u, v);
+                break;
+            case aten::MaterialType::Lambert:
+                ret = lambert::bsdf(param, u, v);
+                break;
+            case aten::MaterialType::OrneNayar:
+                ret = OrenNayar::bsdf(param, normal, wi, wo, u, v);
+                break;
+            case aten::MaterialType::Specular:
+                ret = specular::bsdf(param, normal, wi, wo, u, v);
+                break;
+            case aten::MaterialType::Refraction:
+                ret = refraction::bsdf(param, normal, wi, wo, u, v);
+                break;
+            case aten::MaterialType::Blinn:
+                ret = MicrofacetBlinn::bsdf(param, normal, wi, wo, u, v);
+                break;
+            case aten::MaterialType::GGX:
+                ret = MicrofacetGGX::bsdf(param, normal, wi, wo, u, v);
+                break;
+            case aten::MaterialType::Beckman:
+                ret = MicrofacetBeckman::bsdf(param, normal, wi, wo, u, v);
+                break;
+            case aten::MaterialType::Velvet:
+                ret = MicrofacetVelvet::bsdf(param, normal, wi, wo, u, v);
+                break;
+            case aten::MaterialType::Lambert_Refraction:
+                ret = LambertRefraction::bsdf(param, u, v);
+                break;
+            case aten::MaterialType::Microfacet_Refraction:
+                ret = MicrofacetRefraction::bsdf(param, normal, wi, wo, u, v);
+                break;
+            case aten::MaterialType::Disney:
+                ret = DisneyBRDF::bsdf(param, normal, wi, wo, u, v);
+                break;
+            case aten::MaterialType::CarPaint:
+                ret = CarPaintBRDF::bsdf(param, normal, wi, wo, u, v);
+                break;
+            case aten::MaterialType::Layer:
+                ret = bsdfLayer(mtrls, param, normal, wi, wo, u, v);
+                break;
+            default:
+                AT_ASSERT(false);
+                break;
+            }
+
+            return ret;
+        }
+
+        static inline aten::vec3 sampleDirection(
+            const aten::MaterialParameter* mtrls,
+            const aten::MaterialParameter* param,
+            const aten::vec3& normal,
+            const aten::vec3& wi,
+            real u, real v,
+            aten::sampler* sampler)
+        {
+            switch (param->type) {
+            case aten::MaterialType::Emissive:
+                return emissive::sampleDirection(param, normal, wi, u, v, sampler);
+            case aten::MaterialType::Lambert:
+                return lambert::sampleDirection(normal, sampler);
+            case aten::MaterialType::OrneNayar:
+                return OrenNayar::sampleDirection(param, normal, wi, u, v, sampler);
+            case aten::MaterialType::Specular:
+                return specular::sampleDirection(param, normal, wi, u, v, sampler);
+            case aten::MaterialType::Refraction:
+                return refraction::sampleDirection(param, normal, wi, u, v, sampler);
+            case aten::MaterialType::Blinn:
+                return MicrofacetBlinn::sampleDirection(param, normal, wi, u, v, sampler);
+            case aten::MaterialType::GGX:
+                return MicrofacetGGX::sampleDirection(param, normal, wi, u, v, sampler);
+            case aten::MaterialType::Beckman:
+                return MicrofacetBeckman::sampleDirection(param, normal, wi, u, v, sampler);
+            case aten::MaterialType::Velvet:
+                return MicrofacetVelvet::sampleDirection(param, normal, wi, u, v, sampler);
+            case aten::MaterialType::Lambert_Refraction:
+                return LambertRefraction::sampleDirection(param, normal, wi, u, v, sampler);
+            case aten::MaterialType::Microfacet_Refraction:
+                return MicrofacetRefraction::sampleDirection(param, normal, wi, u, v, sampler);
+            case aten::MaterialType::Disney:
+                return DisneyBRDF::sampleDirection(param, normal, wi, u, v, sampler);
+            case aten::MaterialType::CarPaint:
+                return CarPaintBRDF::sampleDirection(param, normal, wi, u, v, sampler);
+            case aten::MaterialType::Layer:
+                // The direction is sampled with the top layer.
+                return sampleDirection(mtrls, &mtrls[param->layer[0]], normal, wi, u, v, sampler);
+            default:
+                AT_ASSERT(false);
+                break;
+            }
+
+            return aten::vec3(0, 1, 0);
+        }
+
+        /**
+         * @brief Compute the fresnel which weights the lower layers of the layered material.
+         * It returns the same value as material::computeFresnel of the material object.
+         */
+        static inline real computeFresnel(
+            const aten::MaterialParameter* param,
+            const aten::vec3& normal,
+            const aten::vec3& wi,
+            const aten::vec3& wo,
+            real outsideIor)
+        {
+            switch (param->type) {
+            case aten::MaterialType::Emissive:
+                return emissive::computeFresnel(param, normal, wi, wo, outsideIor);
+            case aten::MaterialType::Lambert:
+                return lambert::computeFresnel(param, normal, wi, wo, outsideIor);
+            case aten::MaterialType::OrneNayar:
+                return OrenNayar::computeFresnel(param, normal, wi, wo, outsideIor);
+            case aten::MaterialType::Specular:
+                return specular::computeFresnel(param, normal, wi, wo, outsideIor);
+            case aten::MaterialType::Refraction:
+                return refraction::computeFresnel(param, normal, wi, wo, outsideIor);
+            case aten::MaterialType::Lambert_Refraction:
+                return LambertRefraction::computeFresnel(param, normal, wi, wo, outsideIor);
+            case aten::MaterialType::Disney:
+                return DisneyBRDF::computeFresnel(param, normal, wi, wo, outsideIor);
+            case aten::MaterialType::Layer:
+            case aten::MaterialType::Toon:
+                return real(1);
+            default:
+                break;
+            }
+
+            return material::computeFresnel(param, normal, wi, wo, outsideIor);
+        }
+
+        /**
+         * @brief Apply the normal map. For the layered material, the normal map of the top layer is applied.
+         */
+        static inline void applyNormalMap(
+            const aten::MaterialParameter* mtrls,
+            const aten::MaterialParameter* param,
+            const aten::vec3& orgNml,
+            aten::vec3& newNml,
+            real u, real v)
+        {
+            if (param->type == aten::MaterialType::Layer) {
+                if (param->layer[0] < 0) {
+                    newNml = orgNml;
+                    return;
+                }
+                param = &mtrls[param->layer[0]];
+            }
+
+            AT_NAME::applyNormalMap(param->normalMap, orgNml, newNml, u, v);
+        }
+
+        /**
+         * @brief Evaluate bsdf and pdf for the shading points which have the same material.
+         * @param points Shading points. The texture footprint is set per point.
+         * @param wo Outgoing directions per shading point.
+         */
+        static void evalBatch(
+            const aten::MaterialParameter* mtrls,
+            const aten::MaterialParameter* param,
+            const MaterialShadingPoint* points,
+            const aten::vec3* wo,
+            int num,
+            aten::vec3* bsdfs,
+            real* pdfs);
+
+        /**
+         * @brief Sample the materials for the shading points which have the same material.
+         * @param samplers Samplers per shading point.
+         */
+        static void sampleBatch(
+            const aten::MaterialParameter* mtrls,
+            const aten::MaterialParameter* param,
+            const MaterialShadingPoint* points,
+            aten::sampler** samplers,
+            int num,
+            MaterialSampling* results);
+
+    private:
+        static void sampleLayer(
+            MaterialSampling* result,
+            const aten::MaterialParameter* mtrls,
+            const aten::MaterialParameter* param,
+            const aten::vec3& normal,
+            const aten::vec3& wi,
+            const aten::vec3& orgnormal,
+            aten::sampler* sampler,
+            real u, real v);
+
+        static real pdfLayer(
+            const aten::MaterialParameter* mtrls,
+            const aten::MaterialParameter* param,
+            const aten::vec3& normal,
+            const aten::vec3& wi,
+            const aten::vec3& wo,
+            real u, real v);
+
+        static aten::vec3 bsdfLayer(
+            const aten::MaterialParameter* mtrls,
+            const aten::MaterialParameter* param,
+            const aten::vec3& normal,
+            const aten::vec3& wi,
+            const aten::vec3& wo,
+            real u, real v);
+    };
+}
@@ -21,7 +21,45 @@ namespace AT_NAME {
 #include "scene/context.h"
 
 namespace AT_NAME {
-    inline AT_DEVICE_MTRL_API aten::vec3 sampleTexture(const int texid, real u, real v, const aten::vec3& defaultValue, int lod = 0)
+    /**
+     * @brief Footprint of the ray cone at the current shading point on this thread.
+     *
+     * The materials sample the textures only with the texture coordinate,
+     * so the renderer sets the footprint before shading instead of passing it through all materials.
+     * The footprint is log2 of (cone width / |cos|) plus hitrecord::texLodBase,
+     * and the level of detail for the texture is the footprint plus 0.5 * log2(width * height) of the texture.
+     */
+    class TextureFootprint {
+    private:
+        TextureFootprint() = delete;
+        ~TextureFootprint() = delete;
+
+    public:
+        static void set(real footprint)
+        {
+            get() = footprint;
+        }
+
+        /**
+         * @brief Disable the footprint. The textures are sampled at the original level.
+         */
+        static void reset()
+        {
+            get() = AT_MATH_INF;
+        }
+
+        static real& get()
+        {
+            static thread_local real footprint = AT_MATH_INF;
+            return footprint;
+        }
+    };
+
+    /**
+     * @brief Sample the texture.
+     * @param lod Level of detail. If it is negative, it is computed from the footprint of the current shading point.
+     */
+    inline AT_DEVICE_MTRL_API aten::vec3 sampleTexture(const int texid, real u, real v, const aten::vec3& defaultValue, real lod = real(-1))
     {
         aten::vec3 ret = defaultValue;
 
@@ -30,7 +68,15 @@ namespace AT_NAME {
             const auto ctxt = aten::context::getPinnedContext();
             auto tex = ctxt->getTexture(texid);
             if (tex) {
-                ret = tex->at(u, v);
+                if (lod < real(0)) {
+                    auto footprint = TextureFootprint::get();
+
+                    lod = footprint < AT_MATH_INF
+                        ? footprint + real(0.5) * aten::log2((real)(tex->width() * tex->height()))
+                        : real(0);
+                }
+
+                ret = tex->at(u, v, lod);
             }
         }
 
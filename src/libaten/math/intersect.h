@@ -21,9 +21,9 @@ namespace aten {
 
     inline AT_DEVICE_API int maxDim(const vec3& v)
     {
-        uint32_t x = (uint32_t)aten::abs(v.x);
-        uint32_t y = (uint32_t)aten::abs(v.y);
-        uint32_t z = (uint32_t)aten::abs(v.z);
+        real x = aten::abs(v.x);
+        real y = aten::abs(v.y);
+        real z = aten::abs(v.z);
 
         if (x > y) {
             if (x > z) {
@@ -41,13 +41,17 @@ namespace aten {
         }
     }
 
-    inline intersectResult intersectTriangle(
+    /**
+     * @brief Test if a ray hits a triangle with the precomputed edges.
+     * @param e1 Edge from v0 to v1 (v1 - v0).
+     * @param e2 Edge from v0 to v2 (v2 - v0).
+     */
+    inline intersectResult intersectTriangleWithEdges(
         const ray& ray,
         const vec3& v0,
-        const vec3& v1,
-        const vec3& v2)
+        const vec3& e1,
+        const vec3& e2)
     {
-#if 1
         // NOTE
         // http://qiita.com/edo_m18/items/2bd885b13bd74803a368
         // http://kanamori.cs.tsukuba.ac.jp/jikken/inner/triangle_intersection.pdf
@@ -57,8 +61,6 @@ namespace aten {
         // Fast    Minimum Storage RayTriangle    Intersection.
         // https://cadxfem.org/inf/Fast%20MinimumStorage%20RayTriangle%20Intersection.pdf
 
-        vec3 e1 = v1 - v0;
-        vec3 e2 = v2 - v0;
         vec3 r = ray.org - v0;
         vec3 d = ray.dir;
 
@@ -84,7 +86,31 @@ namespace aten {
         result.t = t;
 
         return std::move(result);
-#else
+    }
+
+    /**
+     * @brief Test if a ray hits a triangle.
+     */
+    inline intersectResult intersectTriangle(
+        const ray& ray,
+        const vec3& v0,
+        const vec3& v1,
+        const vec3& v2)
+    {
+        return intersectTriangleWithEdges(ray, v0, v1 - v0, v2 - v0);
+    }
+
+    /**
+     * @brief Test if a ray hits a triangle without gaps and double hits along the shared edges.
+     * @note The vertices have to be the original positions (not reconstructed from edges),
+     *       so that the neighbour triangles are tested with exactly the same values.
+     */
+    inline intersectResult intersectTriangleWatertight(
+        const ray& ray,
+        const vec3& v0,
+        const vec3& v1,
+        const vec3& v2)
+    {
         intersectResult result;
 
         // NOTE
@@ -150,20 +176,20 @@ namespace aten {
 
         const real rcpDet = real(1) / det;
 
-        const real beta = U * rcpDet;
-        const real gamma = V * rcpDet;
+        // NOTE
+        // U is the weight of v0, V is v1 and W is v2.
+        // p = (1 - a - b)*v0 + a*v1 + b*v2
+        const real beta = V * rcpDet;
+        const real gamma = W * rcpDet;
         const real t = T * rcpDet;
 
-        result.isIntersect = ((beta >= real(0) && beta <= real(1))
-            && (gamma >= real(0) && gamma <= real(1))
-            && (beta + gamma <= real(1))
-            && t >= real(0));
+        // Edge tests guarantee barycentric coordinates are in [0, 1].
+        result.isIntersect = (t >= real(0));
 
         result.a = beta;
         result.b = gamma;
         result.t = t;
 
         return std::move(result);
-#endif
     }
 }
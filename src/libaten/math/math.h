@@ -96,6 +96,11 @@ namespace aten {
         return AT_MATH_FUNC(::log, f);
     }
 
+    inline AT_DEVICE_API real log2(real f)
+    {
+        return AT_MATH_FUNC(::log2, f);
+    }
+
     inline AT_DEVICE_API real exp(real f)
     {
         return AT_MATH_FUNC(::exp, f);
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "defs.h"
+#include "math/vec3.h"
+
+// NOTE
+// https://fgiesen.wordpress.com/2009/12/13/decoding-morton-codes/
+// http://www.forceflow.be/2013/10/07/morton-encodingdecoding-through-bit-interleaving-implementations/
+
+namespace aten
+{
+    /**
+     * @brief Insert two 0 bits after each of the 10 low bits.
+     */
+    inline uint32_t expandBits(uint32_t value)
+    {
+        // NOTE
+        // value | value << 16 = value * (1 + 1 << 16) = value * 0x00010001u
+        value = (value | value << 16) & 0xFF0000FFu;
+        value = (value | value << 8) & 0x0F00F00Fu;
+        value = (value | value << 4) & 0xC30C30C3u;
+        value = (value | value << 2) & 0x49249249u;
+        return value;
+    }
+
+    /**
+     * @brief Insert two 0 bits after each of the 21 low bits.
+     */
+    inline uint64_t expandBitsBy21(uint32_t value)
+    {
+        uint64_t x = value & 0x1fffff;
+        x = (x | x << 32) & 0x001f00000000ffffull;
+        x = (x | x << 16) & 0x001f0000ff0000ffull;
+        x = (x | x << 8) & 0x100f00f00f00f00full;
+        x = (x | x << 4) & 0x10c30c30c30c30c3ull;
+        x = (x | x << 2) & 0x1249249249249249ull;
+        return x;
+    }
+
+    /**
+     * @brief Compute 30 bit Morton code. The point has to be in the unit cube.
+     */
+    inline void computeMortonCode(const vec3& point, uint32_t& code)
+    {
+        auto x = (uint32_t)aten::clamp<real>(point.x * real(1024), real(0), real(1023));
+        auto y = (uint32_t)aten::clamp<real>(point.y * real(1024), real(0), real(1023));
+        auto z = (uint32_t)aten::clamp<real>(point.z * real(1024), real(0), real(1023));
+
+        code = expandBits(x) << 2 | expandBits(y) << 1 | expandBits(z);
+    }
+
+    /**
+     * @brief Compute 63 bit Morton code. The point has to be in the unit cube.
+     */
+    inline void computeMortonCode(const vec3& point, uint64_t& code)
+    {
+        auto x = (uint32_t)aten::clamp<real>(point.x * real(2097152), real(0), real(2097151));
+        auto y = (uint32_t)aten::clamp<real>(point.y * real(2097152), real(0), real(2097151));
+        auto z = (uint32_t)aten::clamp<real>(point.z * real(2097152), real(0), real(2097151));
+
+        code = expandBitsBy21(x) << 2 | expandBitsBy21(y) << 1 | expandBitsBy21(z);
+    }
+}
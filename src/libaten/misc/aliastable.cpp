@@ -0,0 +1,149 @@
+#include "misc/aliastable.h"
+#include "math/math.h"
+
+namespace aten
+{
+    void AliasTable::build(const real* weights, uint32_t num)
+    {
+        clear();
+
+        if (num == 0) {
+            return;
+        }
+
+        m_bins.resize(num);
+        m_pdf.resize(num);
+
+        for (uint32_t i = 0; i < num; i++) {
+            AT_ASSERT(weights[i] >= real(0));
+            m_totalWeight += weights[i];
+        }
+
+        if (m_totalWeight <= real(0)) {
+            // Uniform.
+            for (uint32_t i = 0; i < num; i++) {
+                m_pdf[i] = real(1) / num;
+                m_bins[i].prob = real(1);
+                m_bins[i].alias = i;
+            }
+            return;
+        }
+
+        // Scaled probabilities. The mean is 1.
+        std::vector<real> scaled(num);
+
+        std::vector<uint32_t> smalls;
+        std::vector<uint32_t> larges;
+        smalls.reserve(num);
+        larges.reserve(num);
+
+        for (uint32_t i = 0; i < num; i++) {
+            m_pdf[i] = weights[i] / m_totalWeight;
+            scaled[i] = m_pdf[i] * num;
+
+            if (scaled[i] < real(1)) {
+                smalls.push_back(i);
+            }
+            else {
+                larges.push_back(i);
+            }
+        }
+
+        while (!smalls.empty() && !larges.empty()) {
+            auto s = smalls.back();
+            smalls.pop_back();
+
+            auto l = larges.back();
+
+            m_bins[s].prob = scaled[s];
+            m_bins[s].alias = l;
+
+            // Move the lacked probability of the small bin from the large one.
+            scaled[l] = (scaled[l] + scaled[s]) - real(1);
+
+            if (scaled[l] < real(1)) {
+                larges.pop_back();
+                smalls.push_back(l);
+            }
+        }
+
+        // Remained ones are 1 except for the numerical error.
+        for (auto i : larges) {
+            m_bins[i].prob = real(1);
+            m_bins[i].alias = i;
+        }
+        for (auto i : smalls) {
+            m_bins[i].prob = real(1);
+            m_bins[i].alias = i;
+        }
+    }
+
+    uint32_t AliasTable::sample(real u, real* pdf/*= nullptr*/) const
+    {
+        AT_ASSERT(!m_bins.empty());
+
+        const uint32_t num = (uint32_t)m_bins.size();
+
+        real scaled = u * num;
+        uint32_t idx = std::min<uint32_t>((uint32_t)scaled, num - 1);
+
+        // Reuse the fractional part as the random number to choose own index or alias.
+        real frac = scaled - idx;
+
+        if (frac >= m_bins[idx].prob) {
+            idx = m_bins[idx].alias;
+        }
+
+        if (pdf) {
+            *pdf = m_pdf[idx];
+        }
+
+        return idx;
+    }
+
+    bool AliasTable::save(FILE* fp) const
+    {
+        uint32_t num = size();
+
+        bool isSaved = (fwrite(&num, sizeof(num), 1, fp) == 1)
+            && (fwrite(&m_totalWeight, sizeof(m_totalWeight), 1, fp) == 1);
+
+        if (isSaved && num > 0) {
+            isSaved = (fwrite(&m_bins[0], sizeof(Bin), num, fp) == num)
+                && (fwrite(&m_pdf[0], sizeof(real), num, fp) == num);
+        }
+
+        return isSaved;
+    }
+
+    bool AliasTable::load(FILE* fp)
+    {
+        clear();
+
+        uint32_t num = 0;
+        real totalWeight = 0;
+
+        if (fread(&num, sizeof(num), 1, fp) != 1
+            || fread(&totalWeight, sizeof(totalWeight), 1, fp) != 1)
+        {
+            return false;
+        }
+
+        std::vector<Bin> bins(num);
+        std::vector<real> pdf(num);
+
+        if (num > 0) {
+            if (fread(&bins[0], sizeof(Bin), num, fp) != num
+                || fread(&pdf[0], sizeof(real), num, fp) != num)
+            {
+                return false;
+            }
+        }
+
+        m_bins.swap(bins);
+        m_pdf.swap(pdf);
+        m_totalWeight = totalWeight;
+
+        return true;
+    }
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdio>
+#include <vector>
+
+#include "defs.h"
+#include "types.h"
+
+namespace aten
+{
+    /**
+     * @brief Alias table to sample a discrete distribution in O(1).
+     *
+     * Built with Vose's method.
+     * Each bin has the probability to keep its own index and the alias index to be taken otherwise,
+     * so one sample needs only one random number and no search.
+     */
+    class AliasTable {
+    public:
+        AliasTable() {}
+        ~AliasTable() {}
+
+    public:
+        /**
+         * @brief Build the table from the weights.
+         * The weights don't need to be normalized. If all weights are zero, the distribution is uniform.
+         */
+        void build(const real* weights, uint32_t num);
+
+        void build(const std::vector<real>& weights)
+        {
+            build(weights.empty() ? nullptr : &weights[0], (uint32_t)weights.size());
+        }
+
+        /**
+         * @brief Sample an index.
+         * @param u Uniform random number in [0, 1).
+         * @param pdf If it is not nullptr, the probability to select the index is returned.
+         * @return Sampled index.
+         */
+        uint32_t sample(real u, real* pdf = nullptr) const;
+
+        /**
+         * @brief Return the probability to select the index.
+         */
+        real getPdf(uint32_t idx) const
+        {
+            AT_ASSERT(idx < m_pdf.size());
+            return m_pdf[idx];
+        }
+
+        /**
+         * @brief Return the number of items.
+         */
+        uint32_t size() const
+        {
+            return (uint32_t)m_bins.size();
+        }
+
+        /**
+         * @brief Return the sum of the weights which the table was built from.
+         */
+        real getTotalWeight() const
+        {
+            return m_totalWeight;
+        }
+
+        /**
+         * @brief Write the table to the opened file as binary.
+         */
+        bool save(FILE* fp) const;
+
+        /**
+         * @brief Read the table which was written by save from the opened file.
+         */
+        bool load(FILE* fp);
+
+        void clear()
+        {
+            m_bins.clear();
+            m_pdf.clear();
+            m_totalWeight = 0;
+        }
+
+    private:
+        struct Bin {
+            real prob{ real(1) };   ///< Probability to take own index in the bin.
+            uint32_t alias{ 0 };    ///< Index to be taken if own index is not taken.
+        };
+
+        std::vector<Bin> m_bins;
+        std::vector<real> m_pdf;
+
+        real m_totalWeight{ real(0) };
+    };
+}
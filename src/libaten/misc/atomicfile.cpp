@@ -0,0 +1,49 @@
+#include <stdio.h>
+#include <atomic>
+#include <random>
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "misc/atomicfile.h"
+
+namespace aten {
+    std::string AtomicFile::getTemporaryPath(const std::string& path)
+    {
+        static std::atomic<uint32_t> counter(0);
+
+#if defined(_WIN32) || defined(_WIN64)
+        const uint32_t pid = (uint32_t)_getpid();
+#else
+        const uint32_t pid = (uint32_t)getpid();
+#endif
+
+        std::random_device seed;
+
+        char suffix[64];
+        snprintf(suffix, sizeof(suffix), ".%u.%08x.%u.tmp", pid, (uint32_t)seed(), counter++);
+
+        return path + suffix;
+    }
+
+    bool AtomicFile::replace(const std::string& tmpPath, const std::string& path)
+    {
+#if defined(_WIN32) || defined(_WIN64)
+        // NOTE
+        // On Windows, rename fails if the destination exists.
+        // On the others, rename replaces the destination atomically, so the destination is not removed.
+        remove(path.c_str());
+#endif
+
+        if (rename(tmpPath.c_str(), path.c_str()) != 0) {
+            AT_PRINTF("Failed to rename %s to %s\n", tmpPath.c_str(), path.c_str());
+            remove(tmpPath.c_str());
+            return false;
+        }
+
+        return true;
+    }
+}
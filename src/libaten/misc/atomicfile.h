@@ -0,0 +1,34 @@
+#pragma once
+
+#include <string>
+
+#include "defs.h"
+#include "types.h"
+
+namespace aten {
+    /**
+     * @brief Utility to replace the file atomically.
+     *
+     * The file is written to the temporary file at first, and the temporary file is renamed to the destination.
+     * So the readers never see the partially written file, and the previous file is kept if writing fails.
+     */
+    class AtomicFile {
+    private:
+        AtomicFile() {}
+        ~AtomicFile() {}
+
+    public:
+        /**
+         * @brief Return the temporary path to write the file.
+         * It is unique over the processes and the threads,
+         * because the directory may be shared by the processes on the different machines.
+         */
+        static std::string getTemporaryPath(const std::string& path);
+
+        /**
+         * @brief Replace the destination with the temporary file.
+         * If it fails, the temporary file is removed.
+         */
+        static bool replace(const std::string& tmpPath, const std::string& path);
+    };
+}
@@ -1,12 +1,19 @@
 #pragma once
 
 #include <vector>
-#include <algorithm>
-#include <iterator>
-#include <functional>
+#include <string>
+#include <unordered_map>
 
 namespace aten
 {
+/**
+ * @brief Registry of the data which are referred by the integer handles.
+ *
+ * The handle of the item is stable while the item is in the list.
+ * When the item leaves, its slot is kept empty and reused by the next added item,
+ * so the handles of the other items are never changed.
+ * Adding, removing, and finding the handle by the data pointer or by the name are constant time.
+ */
 template <class Data>
 class DataList {
 public:
@@ -33,12 +40,9 @@ public:
         const ListItem& operator=(const ListItem& rhs) = delete;
 
     public:
-        using FuncWhenAnyLeave = std::function<void(Data*)>;
-
-        void init(Data* data, FuncWhenAnyLeave func)
+        void init(Data* data)
         {
             m_data = data;
-            m_funcWhenAnyLeave = func;
         }
 
         bool leave()
@@ -62,15 +66,28 @@ public:
             return m_data;
         }
 
+        /**
+         * @brief Return the handle in the list. If the item doesn't belong to any list, -1 is returned.
+         */
         int currentIndex() const
         {
-            int idx = -1;
+            return m_belongedList ? m_handle : -1;
+        }
 
+        /**
+         * @brief Set the name to find the item by the name.
+         */
+        void setName(const std::string& name)
+        {
             if (m_belongedList) {
-                idx = m_belongedList->currentIndex(this);
+                m_belongedList->unregisterName(this);
             }
 
-            return idx;
+            m_name = name;
+
+            if (m_belongedList) {
+                m_belongedList->registerName(this);
+            }
         }
 
         Data* operator->()
@@ -78,18 +95,11 @@ public:
             return m_data;
         }
 
-    private:
-        void doFuncWhenAnyLeave()
-        {
-            if (m_funcWhenAnyLeave) {
-                m_funcWhenAnyLeave(m_data);
-            }
-        }
-
     private:
         Data* m_data{ nullptr };
         DataList<Data>* m_belongedList{ nullptr };
-        FuncWhenAnyLeave m_funcWhenAnyLeave{ nullptr };
+        int m_handle{ -1 };
+        std::string m_name;
     };
 
     void add(ListItem* item)
@@ -97,9 +107,26 @@ public:
         AT_ASSERT(item);
 
         item->leave();
+
+        int handle = -1;
+
+        if (m_freeHandles.empty()) {
+            handle = static_cast<int>(m_list.size());
+            m_list.push_back(item);
+        }
+        else {
+            handle = m_freeHandles.back();
+            m_freeHandles.pop_back();
+            m_list[handle] = item;
+        }
+
         item->m_belongedList = this;
+        item->m_handle = handle;
+
+        m_handleByData.insert(std::make_pair(static_cast<const void*>(item->m_data), handle));
+        registerName(item);
 
-        m_list.push_back(item);
+        m_num++;
     }
 
     bool remove(ListItem* item)
@@ -111,30 +138,24 @@ public:
             return false;
         }
 
-        auto it = std::find(m_list.begin(), m_list.end(), item);
+        int handle = item->m_handle;
+        AT_ASSERT(m_list[handle] == item);
 
-        if (it != m_list.end()) {
-            m_list.erase(it);
+        unregisterName(item);
+        m_handleByData.erase(item->m_data);
 
-            // NOTE
-            // Disable in cuda to avoid nvcc error.
-            // If below code is enabled, nvcc occurs an error, but I don't know why.
-#ifndef __AT_CUDA__
-            for each (auto& item in m_list)
-            {
-                item->doFuncWhenAnyLeave();
-            }
+        m_list[handle] = nullptr;
+        m_freeHandles.push_back(handle);
 
-            item->m_belongedList = nullptr;
-#endif
+        item->m_belongedList = nullptr;
+        item->m_handle = -1;
 
-            return true;
-        }
+        m_num--;
 
-        return false;
+        return true;
     }
 
-    int currentIndex(const ListItem* item)
+    int currentIndex(const ListItem* item) const
     {
         AT_ASSERT(item);
 
@@ -143,55 +164,124 @@ public:
             return -1;
         }
 
-        auto it = std::find(m_list.begin(), m_list.end(), item);
+        return item->m_handle;
+    }
+
+    /**
+     * @brief Find the handle of the data. If the data isn't in the list, -1 is returned.
+     */
+    int findIndex(const void* data) const
+    {
+        auto it = m_handleByData.find(data);
+        return it != m_handleByData.end() ? it->second : -1;
+    }
+
+    /**
+     * @brief Find the handle of the item which has the name.
+     * If some items have the same name, the smallest handle is returned.
+     * If no item has the name, -1 is returned.
+     */
+    int findIndexByName(const std::string& name) const
+    {
+        int ret = -1;
+
+        auto range = m_handleByName.equal_range(name);
 
-        if (it != m_list.end()) {
-            auto ret = std::distance(m_list.begin(), it);
-            return static_cast<int>(ret);
+        for (auto it = range.first; it != range.second; it++) {
+            if (ret < 0 || it->second < ret) {
+                ret = it->second;
+            }
         }
 
-        return -1;
+        return ret;
     }
 
     void deleteAllDataAndClear()
     {
-        auto it = m_list.begin();
-
-        while (it != m_list.end()) {
-            auto* item = *it;
-
-            it = m_list.erase(it);
+        // Take the list not to modify it while the data are deleted.
+        std::vector<ListItem*> items;
+        items.swap(m_list);
 
-            item->m_belongedList = nullptr;
+        for (auto item : items) {
+            if (item) {
+                item->m_belongedList = nullptr;
+                item->m_handle = -1;
 
-            auto data = item->getData();
-            delete data;
+                auto data = item->getData();
+                delete data;
+            }
         }
 
-        m_list.clear();
+        m_freeHandles.clear();
+        m_handleByData.clear();
+        m_handleByName.clear();
+        m_num = 0;
     }
 
+    /**
+     * @brief Return the number of the slots. The handles are less than it.
+     * The slots of the removed items are empty, and operator[] returns nullptr for them.
+     */
     uint32_t size() const
     {
         return static_cast<uint32_t>(m_list.size());
     }
 
+    /**
+     * @brief Return the number of the items in the list.
+     */
+    uint32_t count() const
+    {
+        return m_num;
+    }
+
     Data* operator[](int idx)
     {
-        return m_list[idx]->m_data;
+        auto item = m_list[idx];
+        return item ? item->m_data : nullptr;
     }
 
     const Data* operator[](int idx) const
     {
-        return m_list[idx]->m_data;
+        auto item = m_list[idx];
+        return item ? item->m_data : nullptr;
     }
 
+    /**
+     * @brief Return the items by the handle. The slots of the removed items are nullptr.
+     */
     const std::vector<ListItem*>& getList() const
     {
         return m_list;
     }
 
+private:
+    void registerName(const ListItem* item)
+    {
+        if (!item->m_name.empty()) {
+            m_handleByName.insert(std::make_pair(item->m_name, item->m_handle));
+        }
+    }
+
+    void unregisterName(const ListItem* item)
+    {
+        auto range = m_handleByName.equal_range(item->m_name);
+
+        for (auto it = range.first; it != range.second; it++) {
+            if (it->second == item->m_handle) {
+                m_handleByName.erase(it);
+                break;
+            }
+        }
+    }
+
 private:
     std::vector<ListItem*> m_list;
+    std::vector<int> m_freeHandles;
+
+    std::unordered_map<const void*, int> m_handleByData;
+    std::unordered_multimap<std::string, int> m_handleByName;
+
+    uint32_t m_num{ 0 };
 };
 }
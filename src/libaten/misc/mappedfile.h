@@ -0,0 +1,58 @@
+#pragma once
+
+#include <string>
+
+#include "defs.h"
+#include "types.h"
+
+namespace aten {
+    /**
+     * @brief Read only file which is mapped to the memory.
+     */
+    class MappedFile {
+    public:
+        MappedFile() {}
+        ~MappedFile()
+        {
+            close();
+        }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+    public:
+        /**
+         * @brief Map the whole file to the memory.
+         * @return If the file is mapped, return true.
+         */
+        bool open(const std::string& path);
+
+        /**
+         * @brief Unmap the file.
+         */
+        void close();
+
+        bool isOpened() const
+        {
+            return m_data != nullptr;
+        }
+
+        const uint8_t* data() const
+        {
+            return m_data;
+        }
+
+        size_t size() const
+        {
+            return m_size;
+        }
+
+    private:
+        const uint8_t* m_data{ nullptr };
+        size_t m_size{ 0 };
+
+        // Handles which depend on the platform.
+        void* m_file{ nullptr };
+        void* m_mapping{ nullptr };
+    };
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "defs.h"
+#include "types.h"
+#include "math/math.h"
+#include "misc/omputil.h"
+
+namespace aten
+{
+    /**
+     * @brief LSD radix sort for the keys with the values.
+     *
+     * Each thread counts digits and scatters the items in its own contiguous range.
+     * The order of the items which have the same key is kept, so the result doesn't depend on the number of threads.
+     */
+    template <typename T>
+    class RadixSort {
+    public:
+        RadixSort() {}
+        ~RadixSort() {}
+
+    public:
+        /**
+         * @brief Sort the keys in ascending order, and reorder the values along them.
+         * @param keyBits Number of low bits which are used in the keys. Upper bits are not sorted.
+         */
+        void sort(
+            std::vector<T>& keys,
+            std::vector<uint32_t>& values,
+            uint32_t keyBits)
+        {
+            AT_ASSERT(keys.size() == values.size());
+
+            auto num = (int)keys.size();
+
+            if (num <= 1) {
+                return;
+            }
+
+            int chunkNum = (num + MinItemNumPerThread - 1) / MinItemNumPerThread;
+            chunkNum = aten::clamp<int>(chunkNum, 1, (int)OMPUtil::getThreadNum());
+
+            int chunkSize = (num + chunkNum - 1) / chunkNum;
+
+            m_histograms.resize(chunkNum * RadixNum);
+
+            m_tmpKeys.resize(num);
+            m_tmpValues.resize(num);
+
+            const uint32_t passNum = (keyBits + RadixBits - 1) / RadixBits;
+
+            for (uint32_t pass = 0; pass < passNum; pass++) {
+                const uint32_t shift = pass * RadixBits;
+
+#ifdef ENABLE_OMP
+#pragma omp parallel for
+#endif
+                for (int c = 0; c < chunkNum; c++) {
+                    auto* histogram = &m_histograms[c * RadixNum];
+                    std::fill(histogram, histogram + RadixNum, 0);
+
+                    int start = c * chunkSize;
+                    int end = std::min(start + chunkSize, num);
+
+                    for (int i = start; i < end; i++) {
+                        auto digit = (uint32_t)(keys[i] >> shift) & (RadixNum - 1);
+                        histogram[digit]++;
+                    }
+                }
+
+                // Convert counts to offsets.
+                // If all items have the same digit, this pass can be skipped.
+                bool isSkipped = false;
+                uint32_t offset = 0;
+
+                for (uint32_t d = 0; d < RadixNum; d++) {
+                    uint32_t count = 0;
+
+                    for (int c = 0; c < chunkNum; c++) {
+                        auto& h = m_histograms[c * RadixNum + d];
+                        auto n = h;
+                        h = offset + count;
+                        count += n;
+                    }
+
+                    if (count == (uint32_t)num) {
+                        isSkipped = true;
+                        break;
+                    }
+
+                    offset += count;
+                }
+
+                if (isSkipped) {
+                    continue;
+                }
+
+#ifdef ENABLE_OMP
+#pragma omp parallel for
+#endif
+                for (int c = 0; c < chunkNum; c++) {
+                    auto* histogram = &m_histograms[c * RadixNum];
+
+                    int start = c * chunkSize;
+                    int end = std::min(start + chunkSize, num);
+
+                    for (int i = start; i < end; i++) {
+                        auto digit = (uint32_t)(keys[i] >> shift) & (RadixNum - 1);
+                        auto pos = histogram[digit]++;
+
+                        m_tmpKeys[pos] = keys[i];
+                        m_tmpValues[pos] = values[i];
+                    }
+                }
+
+                keys.swap(m_tmpKeys);
+                values.swap(m_tmpValues);
+            }
+        }
+
+    private:
+        // Number of bits which are sorted in one pass.
+        static const uint32_t RadixBits = 8;
+        static const uint32_t RadixNum = 1 << RadixBits;
+
+        // Minimum number of items which one thread sorts.
+        static const int MinItemNumPerThread = 1 << 14;
+
+        std::vector<uint32_t> m_histograms;
+
+        std::vector<T> m_tmpKeys;
+        std::vector<uint32_t> m_tmpValues;
+    };
+}
@@ -0,0 +1,100 @@
+#include <algorithm>
+
+#include "misc/streamcompaction.h"
+#include "misc/omputil.h"
+#include "math/math.h"
+
+namespace aten
+{
+    // Minimum number of items which one thread compacts.
+    static const int MinItemNumPerThread = 1 << 12;
+
+    int StreamCompaction::compact(
+        uint32_t* dst,
+        const uint8_t* flags,
+        int num)
+    {
+        return onCompact(
+            dst, flags, num,
+            [](int i) { return (uint32_t)i; });
+    }
+
+    int StreamCompaction::compact(
+        uint32_t* dst,
+        const uint32_t* ids,
+        const uint8_t* flags,
+        int num)
+    {
+        AT_ASSERT(dst != ids);
+
+        return onCompact(
+            dst, flags, num,
+            [ids](int i) { return ids[i]; });
+    }
+
+    template <typename FuncGetId>
+    int StreamCompaction::onCompact(
+        uint32_t* dst,
+        const uint8_t* flags,
+        int num,
+        FuncGetId funcGetId)
+    {
+        if (num <= 0) {
+            return 0;
+        }
+
+        int chunkNum = (num + MinItemNumPerThread - 1) / MinItemNumPerThread;
+        chunkNum = aten::clamp<int>(chunkNum, 1, (int)OMPUtil::getThreadNum());
+
+        int chunkSize = (num + chunkNum - 1) / chunkNum;
+
+        m_counts.resize(chunkNum);
+
+        // Count flagged items per chunk.
+#ifdef ENABLE_OMP
+#pragma omp parallel for
+#endif
+        for (int c = 0; c < chunkNum; c++) {
+            int start = c * chunkSize;
+            int end = std::min(start + chunkSize, num);
+
+            int count = 0;
+
+            for (int i = start; i < end; i++) {
+                count += (flags[funcGetId(i)] ? 1 : 0);
+            }
+
+            m_counts[c] = count;
+        }
+
+        // Exclusive scan to get the offsets of the chunks.
+        int total = 0;
+
+        for (int c = 0; c < chunkNum; c++) {
+            auto count = m_counts[c];
+            m_counts[c] = total;
+            total += count;
+        }
+
+        // Scatter.
+#ifdef ENABLE_OMP
+#pragma omp parallel for
+#endif
+        for (int c = 0; c < chunkNum; c++) {
+            int start = c * chunkSize;
+            int end = std::min(start + chunkSize, num);
+
+            int pos = m_counts[c];
+
+            for (int i = start; i < end; i++) {
+                auto id = funcGetId(i);
+
+                if (flags[id]) {
+                    dst[pos++] = id;
+                }
+            }
+        }
+
+        return total;
+    }
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <vector>
+
+#include "defs.h"
+#include "types.h"
+
+namespace aten
+{
+    /**
+     * @brief Parallel stream compaction on CPU.
+     *
+     * Same as idaten's StreamCompaction.
+     * The items are split into chunks per thread, the flags are counted per chunk,
+     * the counts are scanned to the offsets, and then the flagged items are scattered.
+     * The order of the items is kept.
+     */
+    class StreamCompaction {
+    public:
+        StreamCompaction() {}
+        ~StreamCompaction() {}
+
+    public:
+        /**
+         * @brief Gather the indices of the flagged items.
+         * @param dst Destination of the gathered indices.
+         * @param flags Flag per item. If it is not zero, the item is gathered.
+         * @param num Number of the items.
+         * @return Number of the gathered indices.
+         */
+        int compact(
+            uint32_t* dst,
+            const uint8_t* flags,
+            int num);
+
+        /**
+         * @brief Gather the ids whose flags are set.
+         * @param dst Destination of the gathered ids. It must not be the same as ids.
+         * @param ids Ids to be compacted.
+         * @param flags Flag per id, which is indexed by the id (not the position in ids).
+         * @param num Number of the ids.
+         * @return Number of the gathered ids.
+         */
+        int compact(
+            uint32_t* dst,
+            const uint32_t* ids,
+            const uint8_t* flags,
+            int num);
+
+    private:
+        template <typename FuncGetId>
+        int onCompact(
+            uint32_t* dst,
+            const uint8_t* flags,
+            int num,
+            FuncGetId funcGetId);
+
+    private:
+        // Number of the flagged items per chunk, and then offsets of the chunks.
+        std::vector<int> m_counts;
+    };
+}
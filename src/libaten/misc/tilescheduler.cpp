@@ -0,0 +1,206 @@
+#include <algorithm>
+
+#include "misc/tilescheduler.h"
+#include "misc/omputil.h"
+#include "math/math.h"
+
+namespace aten
+{
+    // Convert the position in 2^order x 2^order grid to the distance along the Hilbert curve.
+    static uint32_t computeHilbertIndex(uint32_t order, uint32_t x, uint32_t y)
+    {
+        uint32_t d = 0;
+
+        for (uint32_t s = (1 << order) >> 1; s > 0; s >>= 1) {
+            uint32_t rx = (x & s) > 0 ? 1 : 0;
+            uint32_t ry = (y & s) > 0 ? 1 : 0;
+
+            d += s * s * ((3 * rx) ^ ry);
+
+            // Rotate.
+            if (ry == 0) {
+                if (rx == 1) {
+                    x = s - 1 - x;
+                    y = s - 1 - y;
+                }
+                std::swap(x, y);
+            }
+        }
+
+        return d;
+    }
+
+    void TileScheduler::makeTiles(int width, int height)
+    {
+        const int tileXNum = (width + m_tileWidth - 1) / m_tileWidth;
+        const int tileYNum = (height + m_tileHeight - 1) / m_tileHeight;
+
+        m_tiles.clear();
+        m_tiles.reserve(tileXNum * tileYNum);
+
+        for (int ty = 0; ty < tileYNum; ty++) {
+            for (int tx = 0; tx < tileXNum; tx++) {
+                Tile tile;
+                tile.x = tx * m_tileWidth;
+                tile.y = ty * m_tileHeight;
+                tile.width = std::min(m_tileWidth, width - tile.x);
+                tile.height = std::min(m_tileHeight, height - tile.y);
+
+                m_tiles.push_back(tile);
+            }
+        }
+
+        // Sort key per tile.
+        std::vector<real> keys(m_tiles.size());
+
+        if (m_order == Order::Hilbert) {
+            uint32_t order = 0;
+            while ((1 << order) < std::max(tileXNum, tileYNum)) {
+                order++;
+            }
+
+            for (size_t i = 0; i < m_tiles.size(); i++) {
+                uint32_t tx = m_tiles[i].x / m_tileWidth;
+                uint32_t ty = m_tiles[i].y / m_tileHeight;
+                keys[i] = (real)computeHilbertIndex(order, tx, ty);
+            }
+        }
+        else if (m_order == Order::Spiral) {
+            const real cx = real(0.5) * (tileXNum - 1);
+            const real cy = real(0.5) * (tileYNum - 1);
+
+            for (size_t i = 0; i < m_tiles.size(); i++) {
+                real dx = m_tiles[i].x / m_tileWidth - cx;
+                real dy = m_tiles[i].y / m_tileHeight - cy;
+
+                // Ring index around the center, and then angle in the ring.
+                real ring = aten::floor(std::max(aten::abs(dx), aten::abs(dy)));
+                real angle = aten::atan2(dy, dx) + AT_MATH_PI;
+
+                keys[i] = ring * real(8) + angle;
+            }
+        }
+        else {
+            for (size_t i = 0; i < m_tiles.size(); i++) {
+                keys[i] = (real)i;
+            }
+        }
+
+        std::vector<uint32_t> indices(m_tiles.size());
+        for (uint32_t i = 0; i < (uint32_t)indices.size(); i++) {
+            indices[i] = i;
+        }
+
+        std::stable_sort(
+            indices.begin(), indices.end(),
+            [&](uint32_t a, uint32_t b) { return keys[a] < keys[b]; });
+
+        std::vector<Tile> sorted(m_tiles.size());
+        for (uint32_t i = 0; i < (uint32_t)indices.size(); i++) {
+            sorted[i] = m_tiles[indices[i]];
+            sorted[i].idx = i;
+        }
+
+        m_tiles.swap(sorted);
+    }
+
+    bool TileScheduler::popTile(int threadIdx, Tile& tile)
+    {
+        const int queueNum = (int)m_queues.size();
+
+        // Own deque.
+        {
+            auto& queue = m_queues[threadIdx];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+
+            if (!queue.tiles.empty()) {
+                tile = queue.tiles.front();
+                queue.tiles.pop_front();
+                return true;
+            }
+        }
+
+        // Steal from the other threads' deques.
+        // Stealing from the back keeps the locality of the victim, which renders from the front.
+        for (int i = 1; i < queueNum; i++) {
+            auto& queue = m_queues[(threadIdx + i) % queueNum];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+
+            if (!queue.tiles.empty()) {
+                tile = queue.tiles.back();
+                queue.tiles.pop_back();
+                return true;
+            }
+        }
+
+        // All tiles are rendered or being rendered.
+        return false;
+    }
+
+    bool TileScheduler::run(
+        int width, int height,
+        FuncRenderTile func)
+    {
+        m_finishedTileNum = 0;
+
+        makeTiles(width, height);
+
+        const uint32_t tileNum = (uint32_t)m_tiles.size();
+
+#if defined(ENABLE_OMP) && !defined(RELEASE_DEBUG)
+        const int threadNum = (int)OMPUtil::getThreadNum();
+#else
+        const int threadNum = 1;
+#endif
+
+        if ((int)m_queues.size() != threadNum) {
+            std::vector<TileQueue> queues(threadNum);
+            m_queues.swap(queues);
+        }
+
+        // Distribute the tiles to the threads as the contiguous ranges.
+        for (int i = 0; i < threadNum; i++) {
+            uint32_t start = tileNum * i / threadNum;
+            uint32_t end = tileNum * (i + 1) / threadNum;
+
+            m_queues[i].tiles.assign(m_tiles.begin() + start, m_tiles.begin() + end);
+        }
+
+#if defined(ENABLE_OMP) && !defined(RELEASE_DEBUG)
+#pragma omp parallel num_threads(threadNum)
+#endif
+        {
+#if defined(ENABLE_OMP) && !defined(RELEASE_DEBUG)
+            auto idx = OMPUtil::getThreadIdx();
+#else
+            int idx = 0;
+#endif
+
+            Tile tile;
+
+            while (!m_isCancelled && popTile(idx, tile)) {
+                func(tile, idx);
+
+                auto finished = ++m_finishedTileNum;
+
+                if (m_funcProgress) {
+                    std::lock_guard<std::mutex> lock(m_progressMutex);
+
+                    if (!m_funcProgress(finished, tileNum)) {
+                        m_isCancelled = true;
+                    }
+                }
+            }
+        }
+
+        // Drop the tiles which are not rendered by the cancellation.
+        for (auto& queue : m_queues) {
+            queue.tiles.clear();
+        }
+
+        // Clear the request here, so the request before running is not lost.
+        m_wasCancelled = m_isCancelled.exchange(false);
+
+        return !m_wasCancelled;
+    }
+}
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "defs.h"
+#include "types.h"
+
+namespace aten
+{
+    /**
+     * @brief Scheduler to render the image tile by tile in parallel.
+     *
+     * The tiles are sorted in the specified order and they are distributed to the per-thread deques
+     * as contiguous ranges, so each thread renders the neighbour tiles.
+     * A thread pops the tiles from the front of its own deque.
+     * When its deque gets empty, it steals the tiles from the back of the other threads' deques.
+     * So the threads don't have to wait for a few threads which got the expensive tiles.
+     */
+    class TileScheduler {
+    public:
+        TileScheduler() {}
+        ~TileScheduler() {}
+
+    public:
+        /**
+         * @brief Tile in the image.
+         */
+        struct Tile {
+            int x{ 0 };        ///< Left of the tile.
+            int y{ 0 };        ///< Top of the tile.
+            int width{ 0 };    ///< Width of the tile.
+            int height{ 0 };   ///< Height of the tile.
+            uint32_t idx{ 0 }; ///< Index of the tile in the order.
+        };
+
+        /**
+         * @brief Order to render tiles.
+         */
+        enum class Order {
+            Scanline,   ///< Row by row from the top left.
+            Hilbert,    ///< Along the Hilbert curve. The neighbour tiles are rendered in succession.
+            Spiral,     ///< From the center to the outside. The center of the image is finished first.
+        };
+
+        /**
+         * @brief Function to render one tile.
+         * @param tile Tile to be rendered.
+         * @param threadIdx Index of the thread which renders the tile.
+         */
+        using FuncRenderTile = std::function<void(const Tile& tile, int threadIdx)>;
+
+        /**
+         * @brief Function to be notified the progress.
+         * It is called whenever a tile is finished. The calls are serialized.
+         * @param finishedTileNum Number of the finished tiles.
+         * @param totalTileNum Number of all tiles.
+         * @return If false is returned, rendering is cancelled.
+         */
+        using FuncProgress = std::function<bool(uint32_t finishedTileNum, uint32_t totalTileNum)>;
+
+        /**
+         * @brief Set the size of the tile.
+         */
+        void setTileSize(int width, int height)
+        {
+            AT_ASSERT(width > 0 && height > 0);
+            m_tileWidth = width;
+            m_tileHeight = height;
+        }
+
+        int getTileWidth() const
+        {
+            return m_tileWidth;
+        }
+
+        int getTileHeight() const
+        {
+            return m_tileHeight;
+        }
+
+        /**
+         * @brief Set the order to render tiles.
+         */
+        void setOrder(Order order)
+        {
+            m_order = order;
+        }
+
+        Order getOrder() const
+        {
+            return m_order;
+        }
+
+        /**
+         * @brief Set the function to be notified the progress.
+         */
+        void setProgressCallback(FuncProgress func)
+        {
+            m_funcProgress = func;
+        }
+
+        /**
+         * @brief Render all tiles in parallel.
+         * @param width Width of the image.
+         * @param height Height of the image.
+         * @param func Function to render one tile.
+         * @return If rendering is cancelled, returns false.
+         */
+        bool run(
+            int width, int height,
+            FuncRenderTile func);
+
+        /**
+         * @brief Cancel the running rendering.
+         * The tiles which are being rendered are finished, and the remaining tiles are not rendered.
+         * If it is called when rendering is not running, the next rendering is cancelled.
+         * It can be called from any thread.
+         */
+        void cancel()
+        {
+            m_isCancelled = true;
+        }
+
+        /**
+         * @brief Return whether the latest rendering was cancelled.
+         */
+        bool isCancelled() const
+        {
+            return m_wasCancelled;
+        }
+
+    private:
+        void makeTiles(int width, int height);
+
+        bool popTile(int threadIdx, Tile& tile);
+
+    private:
+        struct TileQueue {
+            std::deque<Tile> tiles;
+            std::mutex mutex;
+        };
+
+        int m_tileWidth{ 32 };
+        int m_tileHeight{ 32 };
+
+        Order m_order{ Order::Hilbert };
+
+        FuncProgress m_funcProgress;
+        std::mutex m_progressMutex;
+
+        std::vector<Tile> m_tiles;
+        std::vector<TileQueue> m_queues;
+
+        std::atomic<uint32_t> m_finishedTileNum{ 0 };
+
+        // Requested to cancel. It is cleared when the rendering is completed.
+        std::atomic<bool> m_isCancelled{ false };
+
+        // Whether the latest rendering was cancelled.
+        bool m_wasCancelled{ false };
+    };
+}
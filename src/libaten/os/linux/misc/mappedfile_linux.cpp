@@ -0,0 +1,47 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "misc/mappedfile.h"
+
+namespace aten {
+    bool MappedFile::open(const std::string& path)
+    {
+        close();
+
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || st.st_size <= 0) {
+            ::close(fd);
+            return false;
+        }
+
+        auto p = ::mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        // The mapping is kept after the file is closed.
+        ::close(fd);
+
+        if (p == MAP_FAILED) {
+            return false;
+        }
+
+        m_data = (const uint8_t*)p;
+        m_size = (size_t)st.st_size;
+
+        return true;
+    }
+
+    void MappedFile::close()
+    {
+        if (m_data) {
+            ::munmap((void*)m_data, m_size);
+        }
+
+        m_data = nullptr;
+        m_size = 0;
+    }
+}
@@ -0,0 +1,67 @@
+#include "defs.h"
+#include "misc/mappedfile.h"
+
+namespace aten {
+    bool MappedFile::open(const std::string& path)
+    {
+        close();
+
+        auto file = ::CreateFileA(
+            path.c_str(),
+            GENERIC_READ,
+            FILE_SHARE_READ,
+            nullptr,
+            OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL,
+            nullptr);
+
+        if (file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+
+        LARGE_INTEGER size;
+        if (!::GetFileSizeEx(file, &size) || size.QuadPart <= 0) {
+            ::CloseHandle(file);
+            return false;
+        }
+
+        auto mapping = ::CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping) {
+            ::CloseHandle(file);
+            return false;
+        }
+
+        auto p = ::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (!p) {
+            ::CloseHandle(mapping);
+            ::CloseHandle(file);
+            return false;
+        }
+
+        m_file = file;
+        m_mapping = mapping;
+
+        m_data = (const uint8_t*)p;
+        m_size = (size_t)size.QuadPart;
+
+        return true;
+    }
+
+    void MappedFile::close()
+    {
+        if (m_data) {
+            ::UnmapViewOfFile(m_data);
+        }
+        if (m_mapping) {
+            ::CloseHandle((HANDLE)m_mapping);
+        }
+        if (m_file) {
+            ::CloseHandle((HANDLE)m_file);
+        }
+
+        m_data = nullptr;
+        m_size = 0;
+        m_file = nullptr;
+        m_mapping = nullptr;
+    }
+}
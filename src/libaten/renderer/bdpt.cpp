@@ -1,4 +1,5 @@
 #include "renderer/bdpt.h"
+#include "renderer/splatfilm.h"
 #include "misc/omputil.h"
 #include "misc/timer.h"
 #include "material/lambert.h"
@@ -177,6 +178,12 @@ namespace aten
                     mtrl,
                     rec.u, rec.v));
 
+                // Probability to select this light and sample the point on it, for the MIS weight.
+                const auto lightNum = scene->lightNum();
+                vs.back().areaPdfOnLight = lightNum > 0
+                    ? real(1) / (lightNum * rec.area)
+                    : real(0);
+
                 vec3 emit = mtrl->color();
                 vec3 contrib = throughput * emit / totalAreaPdf;
 
@@ -231,6 +238,7 @@ namespace aten
         const context& ctxt,
         std::vector<Vertex>& vs,
         aten::Light* light,
+        real lightSelectPdf,
         sampler* sampler,
         scene* scene,
         camera* camera) const
@@ -243,7 +251,8 @@ namespace aten
         light->getSamplePosNormalArea(ctxt, &res, sampler);
         auto posOnLight = res.pos;
         auto nmlOnLight = res.nml;
-        auto pdfOnLight = real(1) / res.area;
+        // Im܂߂.
+        auto pdfOnLight = lightSelectPdf / res.area;
 
         // mx̐ςێiʐϑxɊւmxj.
         auto totalAreaPdf = pdfOnLight;
@@ -580,24 +589,32 @@ namespace aten
     real BDPT::computeMISWeight(
         camera* camera,
         real totalAreaPdf,
-        const std::vector<Vertex>& eye_vs,
         int numEyeVtx,
-        const std::vector<Vertex>& light_vs,
-        int numLightVtx) const
+        int numLightVtx,
+        Workspace& ws) const
     {
+        const auto& eye_vs = ws.eyevs;
+        const auto& light_vs = ws.lightvs;
+
         // NOTE
         // https://www.slideshare.net/h013/edubpt-v100
         // p157 - p167
 
         // ̃TvOm.
-        const auto& beginLight = light_vs[0];
-        const real areaPdf_y0 = beginLight.totalAreaPdf;
+        // If the eye subpath hits the light (no light vertex), y0 is the hit point on that light,
+        // not the start of the traced light subpath. So the pdf is computed from the hit light.
+        const real areaPdf_y0 = numLightVtx == 0
+            ? eye_vs[numEyeVtx - 1].areaPdfOnLight
+            : light_vs[0].totalAreaPdf;
 
         // J̃TvOm.
         const auto& beginEye = eye_vs[0];
         const real areaPdf_x0 = beginEye.totalAreaPdf;
 
-        std::vector<const Vertex*> vs(numEyeVtx + numLightVtx);
+        // NOTE
+        // The scratch is reused not to allocate per connection.
+        auto& vs = ws.misVs;
+        vs.resize(numEyeVtx + numLightVtx);
 
         // _ɕׂB
         // vs[0] = y0, vs[1] = y1, ... vs[k-1] = x1, vs[k] = x0
@@ -616,7 +633,8 @@ namespace aten
         const int k = numLightVtx + numEyeVtx - 1;
 
         // pi1/pi vZ.
-        std::vector<real> pi1_pi(numLightVtx + numEyeVtx);
+        auto& pi1_pi = ws.pi1_pi;
+        pi1_pi.resize(numLightVtx + numEyeVtx);
         {
             {
                 const auto* vtx = vs[0];
@@ -642,7 +660,8 @@ namespace aten
         }
 
         // p߂
-        std::vector<real> p(numEyeVtx + numLightVtx + 1);
+        auto& p = ws.p;
+        p.resize(numEyeVtx + numLightVtx + 1);
         {
             // ^񒆂totalAreaPdfZbg.
             p[numLightVtx] = totalAreaPdf;
@@ -688,12 +707,14 @@ namespace aten
         const context& ctxt,
         int x, 
         int y,
-        std::vector<Result>& result,
-        const std::vector<Vertex>& eye_vs,
-        const std::vector<Vertex>& light_vs,
+        Workspace& ws,
         scene* scene,
         camera* camera) const
     {
+        auto& result = ws.result;
+        const auto& eye_vs = ws.eyevs;
+        const auto& light_vs = ws.lightvs;
+
         const int eyeNum = (int)eye_vs.size();
         const int lightNum = (int)light_vs.size();
 
@@ -841,8 +862,9 @@ namespace aten
                 const real misWeight = computeMISWeight(
                     camera,
                     totalAreaPdf,
-                    eye_vs, numEyeVtx,
-                    light_vs, numLightVtx);
+                    numEyeVtx,
+                    numLightVtx,
+                    ws);
 
                 if (misWeight <= real(0)) {
                     continue;
@@ -888,25 +910,34 @@ namespace aten
 
         auto threadnum = OMPUtil::getThreadNum();
 
-        std::vector<std::vector<vec4>> image(threadnum);
-
-        for (int i = 0; i < threadnum; i++) {
-            image[i].resize(m_width * m_height);
+        if (m_workspaces.size() != threadnum) {
+            m_workspaces.resize(threadnum);
         }
 
-#if defined(ENABLE_OMP) && !defined(BDPT_DEBUG)
-#pragma omp parallel
-#endif
-        {
-            auto idx = OMPUtil::getThreadIdx();
+        // NOTE
+        // The contributions to the own pixel are accumulated to the film directly,
+        // because a tile is rendered by only one thread.
+        // The contributions to the other pixels go to the splat film.
+        std::vector<vec4> image(m_width * m_height);
 
-            auto time = timer::getSystemTime();
+        SplatFilm splatFilm;
+        splatFilm.init(m_width, m_height, threadnum);
 
-#if defined(ENABLE_OMP) && !defined(BDPT_DEBUG)
-#pragma omp for
-#endif
-            for (int y = 0; y < m_height; y++) {
-                for (int x = 0; x < m_width; x++) {
+        const auto lightNum = scene->lightNum();
+
+        auto time = timer::getSystemTime();
+
+        m_scheduler.run(
+            m_width, m_height,
+            [&](const TileScheduler::Tile& tile, int idx) {
+            if (lightNum == 0) {
+                return;
+            }
+
+            auto& ws = m_workspaces[idx];
+
+            for (int y = tile.y; y < tile.y + tile.height; y++) {
+                for (int x = tile.x; x < tile.x + tile.width; x++) {
                     int pos = y * m_width + x;
 
                     for (uint32_t i = 0; i < samples; i++) {
@@ -919,110 +950,82 @@ namespace aten
                         CMJ rnd;
                         rnd.init(time.milliSeconds, i, scramble);
 
-                        std::vector<Result> result;
+                        ws.result.clear();
+                        ws.eyevs.clear();
+                        ws.lightvs.clear();
 
-                        std::vector<Vertex> eyevs;
-                        std::vector<Vertex> lightvs;
+                        auto eyeRes = genEyePath(ctxt, ws.eyevs, x, y, &rnd, scene, camera);
+
+                        // Select one light, not to trace the light subpath per light.
+                        uint32_t lightIdx = 0;
+                        if (lightNum > 1) {
+                            lightIdx = std::min<uint32_t>((uint32_t)(rnd.nextSample() * lightNum), lightNum - 1);
+                        }
+                        const real lightSelectPdf = real(1) / lightNum;
+
+                        auto light = scene->getLight(lightIdx);
+                        auto lightRes = genLightPath(ctxt, ws.lightvs, light, lightSelectPdf, &rnd, scene, camera);
 
-                        auto eyeRes = genEyePath(ctxt, eyevs, x, y, &rnd, scene, camera);
-                        
-#if 0
                         if (eyeRes.isTerminate) {
-                            int pos = eyeRes.y * m_width + eyeRes.x;
-                            image[idx][pos] += vec4(eyeRes.contrib, 1);
+                            const real misWeight = computeMISWeight(
+                                camera,
+                                ws.eyevs[ws.eyevs.size() - 1].totalAreaPdf,
+                                (const int)ws.eyevs.size(),   // num_eye_vertex
+                                0,                            // num_light_vertex
+                                ws);
+
+                            const vec3 contrib = misWeight * eyeRes.contrib;
+                            ws.result.push_back(Result(contrib, eyeRes.x, eyeRes.y, true));
                         }
-#else
-                        auto lightNum = scene->lightNum();
-                        for (uint32_t n = 0; n < lightNum; n++) {
-                            auto light = scene->getLight(n);
-                            auto lightRes = genLightPath(ctxt, lightvs, light, &rnd, scene, camera);
-
-                            if (eyeRes.isTerminate) {
-                                const real misWeight = computeMISWeight(
-                                    camera,
-                                    eyevs[eyevs.size() - 1].totalAreaPdf,
-                                    eyevs,
-                                    (const int)eyevs.size(),   // num_eye_vertex
-                                    lightvs,
-                                    0);                         // num_light_vertex
-
-                                const vec3 contrib = misWeight * eyeRes.contrib;
-                                result.push_back(Result(contrib, eyeRes.x, eyeRes.y, true));
-                            }
 
-                            if (lightRes.isTerminate) {
-                                const real misWeight = computeMISWeight(
-                                    camera,
-                                    lightvs[lightvs.size() - 1].totalAreaPdf,
-                                    eyevs,
-                                    0,                            // num_eye_vertex
-                                    lightvs,
-                                    (const int)lightvs.size());    // num_light_vertex
-
-                                const vec3 contrib = misWeight * lightRes.contrib;
-                                result.push_back(Result(contrib, lightRes.x, lightRes.y, false));
-                            }
+                        if (lightRes.isTerminate) {
+                            const real misWeight = computeMISWeight(
+                                camera,
+                                ws.lightvs[ws.lightvs.size() - 1].totalAreaPdf,
+                                0,                              // num_eye_vertex
+                                (const int)ws.lightvs.size(),   // num_light_vertex
+                                ws);
+
+                            const vec3 contrib = misWeight * lightRes.contrib;
+                            ws.result.push_back(Result(contrib, lightRes.x, lightRes.y, false));
+                        }
 
-                            combine(
-                                ctxt, 
-                                x, y,
-                                result, 
-                                eyevs,
-                                lightvs,
-                                scene,
-                                camera);
-
-#if 1
-                            for (int i = 0; i < (int)result.size(); i++) {
-                                const auto& res = result[i];
-
-                                // TODO
-                                // FIXME
-                                // I have to research why contribute value is invalid.
-                                if (isInvalidColor(res.contrib)) {
-                                    //AT_PRINTF("Invalid(%d/%d[%d])\n", x, y, i);
-                                    continue;
-                                }
-
-                                const int pos = res.y * m_width + res.x;
-
-                                if (res.isStartFromPixel) {
-                                    image[idx][pos] += vec4(res.contrib, 1);
-                                }
-                                else {
-                                    // ꂽTvɂāATv݂̉fix,y)甭˂ꂽeyeTupX܂ނ̂ꍇ
-                                    // Ixy ̃eJlsamples[i].valuê̂Ȃ̂ŁÂ܂ܑB̌Ả摜o͎ɔ˂ꂽ񐔂̑viiteration_per_thread * num_threads)Ŋ.
-                                    //
-                                    // ꂽTvɂāẢ݂f甭˂ꂽeyeTupX܂ނ̂ł͂ȂꍇilightTupXʂ̉f(x',y')ɓBꍇj
-                                    // Ix'y' ̃eJlV킯ȀꍇA摜Ŝɑ΂ČTv𐶐A܂x'y'Ƀqbgƍl邽
-                                    // ̂悤ȃTvɂĂ͍ŏIIɌ甭˂񐔂̑vŊāAfւ̊^ƂKv.
-                                    image[idx][pos] += vec4(res.contrib * divPixelProb, 1);
-                                }
+                        combine(
+                            ctxt,
+                            x, y,
+                            ws,
+                            scene,
+                            camera);
+
+                        for (const auto& res : ws.result) {
+                            // TODO
+                            // FIXME
+                            // I have to research why contribute value is invalid.
+                            if (isInvalidColor(res.contrib)) {
+                                continue;
                             }
-#endif
 
+                            if (res.isStartFromPixel) {
+                                // The eye subpath starts from the own pixel.
+                                image[pos] += vec4(res.contrib, 1);
+                            }
+                            else {
+                                // ꂽTvɂāATv݂̉fix,y)甭˂ꂽeyeTupX܂ނ̂ꍇ
+                                // Ixy ̃eJlsamples[i].valuê̂Ȃ̂ŁÂ܂ܑB̌Ả摜o͎ɔ˂ꂽ񐔂̑viiteration_per_thread * num_threads)Ŋ.
+                                //
+                                // ꂽTvɂāẢ݂f甭˂ꂽeyeTupX܂ނ̂ł͂ȂꍇilightTupXʂ̉f(x',y')ɓBꍇj
+                                // Ix'y' ̃eJlV킯ȀꍇA摜Ŝɑ΂ČTv𐶐A܂x'y'Ƀqbgƍl邽
+                                // ̂悤ȃTvɂĂ͍ŏIIɌ甭˂񐔂̑vŊāAfւ̊^ƂKv.
+                                const int splatPos = res.y * m_width + res.x;
+                                splatFilm.splat(idx, splatPos, res.contrib * divPixelProb);
+                            }
                         }
-#endif
                     }
                 }
             }
-        }
-
-        std::vector<vec4> tmp(m_width * m_height);
-
-        for (int i = 0; i < threadnum; i++) {
-            auto& img = image[i];
-            for (int y = 0; y < m_height; y++) {
-                for (int x = 0; x < m_width; x++) {
-                    int pos = y * m_width + x;
 
-                    auto clr = img[pos] / samples;
-                    clr.w = 1;
-
-                    tmp[pos] += clr;
-                }
-            }
-        }
+            splatFilm.flush(idx);
+        });
 
 #if defined(ENABLE_OMP) && !defined(BDPT_DEBUG)
 #pragma omp parallel for
@@ -1031,7 +1034,7 @@ namespace aten
             for (int x = 0; x < m_width; x++) {
                 int pos = y * m_width + x;
 
-                auto clr = tmp[pos];
+                auto clr = (image[pos] + vec4(splatFilm.at(pos), 0)) / samples;
                 clr.w = 1;
 
                 dst.buffer->put(x, y, clr);
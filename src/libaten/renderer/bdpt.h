@@ -1,5 +1,7 @@
 #pragma once
 
+#include <vector>
+
 #include "renderer/renderer.h"
 #include "scene/scene.h"
 #include "camera/camera.h"
@@ -7,6 +9,15 @@
 
 namespace aten
 {
+    /**
+     * @brief Bidirectional path tracer.
+     *
+     * One light is selected per sample and one light subpath is traced for it.
+     * The vertices and the scratch for MIS weights are kept per thread and reused over the samples,
+     * so nothing is allocated per sample once the buffers have grown.
+     * All threads share one film. The contributions to the pixels out of the rendered tile
+     * go to the shared splat film.
+     */
     class BDPT : public Renderer {
     public:
         BDPT() {}
@@ -46,6 +57,10 @@ namespace aten
 
             aten::Light* light{ nullptr };
 
+            // Area pdf to generate this vertex as the start of the light subpath.
+            // It is only for the light which the eye subpath hits.
+            real areaPdfOnLight{ real(0) };
+
             Vertex(
                 const vec3& p,
                 const vec3& _nml,
@@ -90,6 +105,20 @@ namespace aten
             {}
         };
 
+        /**
+         * @brief Buffers per thread which are reused over the samples.
+         */
+        struct Workspace {
+            std::vector<Vertex> eyevs;
+            std::vector<Vertex> lightvs;
+            std::vector<Result> result;
+
+            // Scratch to compute the MIS weight.
+            std::vector<const Vertex*> misVs;
+            std::vector<real> pi1_pi;
+            std::vector<real> p;
+        };
+
         Result genEyePath(
             const context& ctxt,
             std::vector<Vertex>& vs,
@@ -102,6 +131,7 @@ namespace aten
             const context& ctxt,
             std::vector<Vertex>& vs,
             aten::Light* light,
+            real lightSelectPdf,
             sampler* sampler,
             scene* scene,
             camera* camera) const;
@@ -116,18 +146,15 @@ namespace aten
         real computeMISWeight(
             camera* camera,
             real totalAreaPdf,
-            const std::vector<Vertex>& eye_vs,
             int numEyeVtx,
-            const std::vector<Vertex>& light_vs,
-            int numLightVtx) const;
+            int numLightVtx,
+            Workspace& ws) const;
 
         void combine(
             const context& ctxt,
             int x, 
             int y,
-            std::vector<Result>& result,
-            const std::vector<Vertex>& eye_vs,
-            const std::vector<Vertex>& light_vs,
+            Workspace& ws,
             scene* scene,
             camera* camera) const;
 
@@ -138,5 +165,7 @@ namespace aten
 
         int m_width;
         int m_height;
+
+        std::vector<Workspace> m_workspaces;
     };
 }
@@ -161,9 +161,7 @@ namespace aten
                 auto bsdf = mtrl->bsdf(orienting_normal, path.ray.dir, dirToLight, path.rec.u, path.rec.v);
                 auto pdfb = mtrl->pdf(orienting_normal, path.ray.dir, dirToLight, path.rec.u, path.rec.v);
 
-                hitrecord tmpRec;
-
-                if (scene->hitLight(ctxt, light, posLight, shadowRay, AT_MATH_EPSILON, AT_MATH_INF, tmpRec)) {
+                if (scene->isLightVisible(ctxt, light, posLight, shadowRay, AT_MATH_EPSILON)) {
                     // Shadow ray hits the light.
                     auto cosShadow = dot(orienting_normal, dirToLight);
 
@@ -210,6 +208,7 @@ namespace aten
 
                         ray nextRay = aten::ray(path.rec.p, nextDir);
 
+                        hitrecord tmpRec;
                         aten::Intersection tmpIsect;
 
                         if (scene->hit(ctxt, nextRay, AT_MATH_EPSILON, AT_MATH_INF, tmpRec, tmpIsect)) {
@@ -293,20 +292,13 @@ namespace aten
             m_rrDepth = m_maxDepth - 1;
         }
 
+        auto time = timer::getSystemTime();
 
-#if defined(ENABLE_OMP) && !defined(RELEASE_DEBUG)
-#pragma omp parallel
-#endif
-        {
-            auto idx = OMPUtil::getThreadIdx();
-
-            auto time = timer::getSystemTime();
-
-#if defined(ENABLE_OMP) && !defined(RELEASE_DEBUG)
-#pragma omp for
-#endif
-            for (int y = 0; y < height; y++) {
-                for (int x = 0; x < width; x++) {
+        m_scheduler.run(
+            width, height,
+            [&](const TileScheduler::Tile& tile, int idx) {
+            for (int y = tile.y; y < tile.y + tile.height; y++) {
+                for (int x = tile.x; x < tile.x + tile.width; x++) {
                     int pos = y * width + x;
 
                     vec3 col = vec3(0);
@@ -370,6 +362,6 @@ namespace aten
                     }
                 }
             }
-        }
+        });
     }
 }
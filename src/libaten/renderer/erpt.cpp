@@ -1,4 +1,5 @@
 #include "renderer/erpt.h"
+#include "renderer/splatfilm.h"
 #include "misc/omputil.h"
 #include "sampler/xorshift.h"
 #include "sampler/halton.h"
@@ -13,10 +14,16 @@ namespace aten
 
     class ERPTSampler : public sampler {
     public:
-        ERPTSampler(sampler* rnd);
+        ERPTSampler() {}
         virtual ~ERPTSampler() {}
 
     public:
+        /**
+         * @brief Initialize the primary samples with the random sequence.
+         * The allocated primary samples are reused.
+         */
+        void init(sampler* rnd);
+
         virtual real nextSample() override final;
 
         void reset()
@@ -37,9 +44,11 @@ namespace aten
         std::vector<real> m_primarySamples;
     };
 
-    ERPTSampler::ERPTSampler(sampler* rnd)
-        : m_rnd(rnd)
+    void ERPTSampler::init(sampler* rnd)
     {
+        m_rnd = rnd;
+        m_usedRandCoords = 0;
+
         static const int initsize = 32;
         m_primarySamples.resize(initsize);
 
@@ -187,23 +196,28 @@ namespace aten
         // edvZ.
         std::vector<vec3> tmpSumI(threadNum);
 
-#ifdef ENABLE_OMP
-#pragma omp parallel for
-#endif
-        for (int y = 0; y < height; y++) {
-            auto idx = OMPUtil::getThreadIdx();
+        m_scheduler.run(
+            width, height,
+            [&](const TileScheduler::Tile& tile, int idx) {
+            ERPTSampler X;
 
-            for (int x = 0; x < width; x++) {
-                int pos = y * width + x;
+            for (int y = tile.y; y < tile.y + tile.height; y++) {
+                for (int x = tile.x; x < tile.x + tile.width; x++) {
+                    int pos = y * width + x;
 
-                auto scramble = aten::getRandom(pos) * 0x1fe3434f;
-                XorShift rnd(scramble + time.milliSeconds);
-                ERPTSampler X(&rnd);
+                    auto scramble = aten::getRandom(pos) * 0x1fe3434f;
+                    XorShift rnd(scramble + time.milliSeconds);
+                    X.init(&rnd);
 
-                auto path = genPath(ctxt, scene, &X, x, y, width, height, camera, false);
+                    auto path = genPath(ctxt, scene, &X, x, y, width, height, camera, false);
 
-                tmpSumI[idx] += path.contrib;
+                    tmpSumI[idx] += path.contrib;
+                }
             }
+        });
+
+        if (m_scheduler.isCancelled()) {
+            return;
         }
 
         for (uint32_t i = 0; i < threadNum; i++) {
@@ -212,130 +226,147 @@ namespace aten
 
         const real ed = color::luminance(sumI / (real)(width * height)) / (real)mutation;
 
-        std::vector<std::vector<vec3>> acuumImage(threadNum);
+        // NOTE
+        // The chains splat to the pixels around the start pixel, which may be out of the tile.
+        // So all contributions go to the shared film through the per-thread buffer.
+        SplatFilm film;
+        film.init(width, height, threadNum);
 
-#ifdef ENABLE_OMP
-#pragma omp parallel for
-#endif
-        for (int y = 0; y < height; y++) {
-            AT_PRINTF("Rendering (%f)%%\n", 100.0 * y / (height - 1));
+        std::vector<ChainStatistics> stats(threadNum);
 
-            auto idx = OMPUtil::getThreadIdx();
+        m_scheduler.run(
+            width, height,
+            [&](const TileScheduler::Tile& tile, int idx) {
+            // The primary samples are reused in the tile.
+            ERPTSampler X;
+            ERPTSampler Y;
+            ERPTSampler Z;
 
-            auto& image = acuumImage[idx];
-            if (image.empty()) {
-                image.resize(width * height);
-                memset(&image[0], 0, sizeof(vec3) * width * height);
-            }
+            auto& stat = stats[idx];
 
-            for (int x = 0; x < width; x++) {
-                auto pos = y * width + x;
-                auto scramble = aten::getRandom(pos) * 0x1fe3434f;
+            for (int y = tile.y; y < tile.y + tile.height; y++) {
+                for (int x = tile.x; x < tile.x + tile.width; x++) {
+                    auto pos = y * width + x;
+                    auto scramble = aten::getRandom(pos) * 0x1fe3434f;
 
-                for (uint32_t i = 0; i < samples; i++) {
+                    for (uint32_t i = 0; i < samples; i++) {
                     
 
-                    // TODO
-                    // sobol  halton sequence ̓XebvăI[o[t[Ă܂...
-                    //XorShift rnd((y * height * 4 + x * 4) * samples + i + 1 + time.milliSeconds);
-                    CMJ rnd;
-                    rnd.init(time.milliSeconds, i, scramble);
-                    ERPTSampler X(&rnd);
-
-                    // ݂̃XN[̂_̃pXɂˋPx߂.
-                    auto newSample = genPath(ctxt, scene, &X, x, y, width, height, camera, false);
-
-                    // pXɒڃqbgĂꍇAGlM[zȂŁÂ܂܉摜ɑ.
-                    if (newSample.isTerminate) {
-                        int pos = newSample.y * width + newSample.x;
-                        image[pos] += newSample.contrib / (real)samples;
-                        continue;
-                    }
+                        // TODO
+                        // sobol  halton sequence ̓XebvăI[o[t[Ă܂...
+                        //XorShift rnd((y * height * 4 + x * 4) * samples + i + 1 + time.milliSeconds);
+                        CMJ rnd;
+                        rnd.init(time.milliSeconds, i, scramble);
+                        X.init(&rnd);
+
+                        // ݂̃XN[̂_̃pXɂˋPx߂.
+                        auto newSample = genPath(ctxt, scene, &X, x, y, width, height, camera, false);
+
+                        // pXɒڃqbgĂꍇAGlM[zȂŁÂ܂܉摜ɑ.
+                        if (newSample.isTerminate) {
+                            int pos = newSample.y * width + newSample.x;
+                            film.splat(idx, pos, newSample.contrib / (real)samples);
+                            continue;
+                        }
 
-                    const vec3 e = newSample.contrib;
-                    auto l = color::luminance(e);
+                        const vec3 e = newSample.contrib;
+                        auto l = color::luminance(e);
 
-                    if (l > 0) {
-                        auto r = rnd.nextSample();
-                        auto illum = color::luminance(e);
-                        const int numChains = (int)std::floor(r + illum / (mutation * ed));;
+                        if (l > 0) {
+                            auto r = rnd.nextSample();
+                            auto illum = color::luminance(e);
+                            const int numChains = (int)std::floor(r + illum / (mutation * ed));;
 
-                        // ͂ɕzGlM[.
-                        const vec3 depositValue = (e / illum * ed) / (real)samples;
+                            // ͂ɕzGlM[.
+                            const vec3 depositValue = (e / illum * ed) / (real)samples;
 
-                        for (int nc = 0; nc < numChains; nc++) {
-                            ERPTSampler Y = X;
-                            Path Ypath = newSample;
+                            stat.chainNum += numChains;
 
-                            // Consecutive sample filtering.
-                            // _ɋɒ[ɃGlM[zƁAX|bgmCYɂȂĂ܂.
-                            // Unbiasedɂɂ͂dȂAIɂ͌ꂵ̂ł_ɑ΂镪z񐔂𐧌邱Ƃł̂悤ȃmCY}.
-                            // BiasedɂȂ邪Aڂ͗ǂȂ.
-                            static const int MaxStack = 10;
-                            int stack_num = 0;
-                            int now_x = x;
-                            int now_y = y;
+                            for (int nc = 0; nc < numChains; nc++) {
+                                Y = X;
+                                Path Ypath = newSample;
 
-                            for (uint32_t m = 0; m < mutation; m++) {
-                                ERPTSampler Z = Y;
-                                Z.mutate();
+                                // Consecutive sample filtering.
+                                // _ɋɒ[ɃGlM[zƁAX|bgmCYɂȂĂ܂.
+                                // Unbiasedɂɂ͂dȂAIɂ͌ꂵ̂ł_ɑ΂镪z񐔂𐧌邱Ƃł̂悤ȃmCY}.
+                                // BiasedɂȂ邪Aڂ͗ǂȂ.
+                                static const int MaxStack = 10;
+                                int stack_num = 0;
+                                int now_x = x;
+                                int now_y = y;
 
-                                Path Zpath = genPath(ctxt, scene, &Z, x, y, width, height, camera, true);
+                                for (uint32_t m = 0; m < mutation; m++) {
+                                    Z = Y;
+                                    Z.mutate();
 
-                                // H
-                                //Z.reset();
+                                    Path Zpath = genPath(ctxt, scene, &Z, x, y, width, height, camera, true);
 
-                                auto lfz = color::luminance(Zpath.contrib);
-                                auto lfy = color::luminance(Ypath.contrib);
+                                    // H
+                                    //Z.reset();
 
-                                auto q = lfz / lfy;
+                                    auto lfz = color::luminance(Zpath.contrib);
+                                    auto lfy = color::luminance(Ypath.contrib);
 
-                                auto r = rnd.nextSample();
+                                    auto q = lfz / lfy;
 
-                                if (q > r) {
-                                    // accept mutation.
-                                    Y = Z;
-                                    Ypath = Zpath;
-                                }
+                                    auto r = rnd.nextSample();
 
-                                // Consecutive sample filtering
-                                if (now_x == Ypath.x && now_y == Ypath.y) {
-                                    // mutationrejectꂽ񐔂JEg.
-                                    stack_num++;
-                                }
-                                else {
-                                    // mutationacceptꂽ̂reject񐔂Zbg.
-                                    now_x = Ypath.x;
-                                    now_y = Ypath.y;
-                                    stack_num = 0;
-                                }
+                                    if (q > r) {
+                                        // accept mutation.
+                                        Y = Z;
+                                        Ypath = Zpath;
+                                        stat.accept++;
+                                    }
+                                    else {
+                                        stat.reject++;
+                                    }
 
-                                // GlM[Redistribution.
-                                // ɕzꑱȂ悤ɏ𐧌.
-                                if (stack_num < MaxStack) {
-#if 1
-                                    if (!Ypath.isTerminate) {
-                                        // _Ƃ͈قȂ邪AɒڃqbgƂ͕zȂł݂.
-                                        int pos = Ypath.y * width + Ypath.x;
-                                        image[pos] += depositValue;
+                                    // Consecutive sample filtering
+                                    if (now_x == Ypath.x && now_y == Ypath.y) {
+                                        // mutationrejectꂽ񐔂JEg.
+                                        stack_num++;
                                     }
+                                    else {
+                                        // mutationacceptꂽ̂reject񐔂Zbg.
+                                        now_x = Ypath.x;
+                                        now_y = Ypath.y;
+                                        stack_num = 0;
+                                    }
+
+                                    // GlM[Redistribution.
+                                    // ɕzꑱȂ悤ɏ𐧌.
+                                    if (stack_num < MaxStack) {
+#if 1
+                                        if (!Ypath.isTerminate) {
+                                            // _Ƃ͈قȂ邪AɒڃqbgƂ͕zȂł݂.
+                                            int pos = Ypath.y * width + Ypath.x;
+                                            film.splat(idx, pos, depositValue);
+                                        }
 #else
-                                    int pos = Ypath.y * width + Ypath.x;
-                                    image[pos] += depositValue;
+                                        int pos = Ypath.y * width + Ypath.x;
+                                        film.splat(idx, pos, depositValue);
 #endif
+                                    }
                                 }
                             }
                         }
                     }
                 }
             }
+
+            film.flush(idx);
+        });
+
+        m_chainStats = ChainStatistics();
+
+        for (const auto& s : stats) {
+            m_chainStats.chainNum += s.chainNum;
+            m_chainStats.accept += s.accept;
+            m_chainStats.reject += s.reject;
         }
 
-        for (uint32_t n = 0; n < threadNum; n++) {
-            auto& image = acuumImage[n];
-            for (int i = 0; i < width * height; i++) {
-                dst.buffer->add(i, vec4(image[i], 1));
-            }
+        for (int i = 0; i < width * height; i++) {
+            dst.buffer->add(i, vec4(film.at(i), 1));
         }
     }
 }
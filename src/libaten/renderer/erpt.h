@@ -7,6 +7,12 @@
 
 namespace aten
 {
+    /**
+     * @brief Energy redistribution path tracing.
+     *
+     * The energy of the path is redistributed to the neighbour pixels by the Markov chains.
+     * The chains splat to one film which is shared by all threads.
+     */
     class ERPT : public PathTracing {
     public:
         ERPT() {}
@@ -18,6 +24,29 @@ namespace aten
             scene* scene,
             camera* camera) override final;
 
+        /**
+         * @brief Statistics of the Markov chains.
+         */
+        struct ChainStatistics {
+            uint64_t chainNum{ 0 };     ///< Number of the chains.
+            uint64_t accept{ 0 };       ///< Number of the accepted mutations.
+            uint64_t reject{ 0 };       ///< Number of the rejected mutations.
+
+            real acceptanceRate() const
+            {
+                auto num = accept + reject;
+                return num > 0 ? accept / (real)num : real(0);
+            }
+        };
+
+        /**
+         * @brief Return the statistics of all chains at the latest rendering.
+         */
+        const ChainStatistics& getChainStatistics() const
+        {
+            return m_chainStats;
+        }
+
     private:
         struct Path {
             int x{ 0 };
@@ -34,5 +63,8 @@ namespace aten
             int width, int height,
             camera* camera,
             bool willImagePlaneMutation);
+
+    private:
+        ChainStatistics m_chainStats;
     };
 }
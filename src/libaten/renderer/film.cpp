@@ -1,5 +1,8 @@
+#include <stdio.h>
 #include <string.h>
+#include <string>
 #include "renderer/film.h"
+#include "misc/atomicfile.h"
 
 namespace aten
 {
@@ -71,4 +74,181 @@ namespace aten
 
         curValue.w = n + 1;
     }
+
+    void FilmProgressive::beginPass()
+    {
+        if (m_sampleNum.size() != m_image.size()) {
+            m_sum.resize(m_image.size());
+            m_sum2.resize(m_image.size());
+            m_sampleNum.resize(m_image.size());
+        }
+    }
+
+    void FilmProgressive::reset()
+    {
+        for (auto& v : m_image) {
+            v = vec4();
+        }
+
+        m_sum.clear();
+        m_sum2.clear();
+        m_sampleNum.clear();
+
+        m_passNum = 0;
+    }
+
+    void FilmProgressive::accumulate(int i, const vec3& sum, const vec3& sum2, uint32_t sampleNum)
+    {
+        // NOTE
+        // The buffers are allocated in beginPass, because this is called in the parallel region.
+        AT_ASSERT(m_sampleNum.size() == m_image.size());
+
+        if (sampleNum == 0) {
+            return;
+        }
+
+        m_sum[i] += sum;
+        m_sum2[i] += sum2;
+        m_sampleNum[i] += sampleNum;
+
+        auto mean = m_sum[i] / (real)m_sampleNum[i];
+        m_image[i] = vec4(mean, 1);
+    }
+
+    vec3 FilmProgressive::getVariance(int i) const
+    {
+        if (m_sampleNum.empty() || m_sampleNum[i] == 0) {
+            return vec3(0);
+        }
+
+        auto n = (real)m_sampleNum[i];
+        auto mean = m_sum[i] / n;
+        auto var = m_sum2[i] / n - mean * mean;
+
+        var.x = std::max<real>(var.x, 0);
+        var.y = std::max<real>(var.y, 0);
+        var.z = std::max<real>(var.z, 0);
+
+        return var;
+    }
+
+    struct FilmCheckpointHeader {
+        uint8_t magic[4];
+        uint8_t version[4];
+        uint32_t width;
+        uint32_t height;
+        uint32_t passNum;
+        uint32_t sizeOfReal;
+    };
+
+    bool FilmProgressive::saveCheckpoint(const char* path) const
+    {
+        const auto tmpPath = AtomicFile::getTemporaryPath(path);
+
+        FILE* fp = fopen(tmpPath.c_str(), "wb");
+        if (!fp) {
+            AT_PRINTF("Failed to open %s\n", tmpPath.c_str());
+            return false;
+        }
+
+        FilmCheckpointHeader header;
+        {
+            header.magic[0] = 'F';
+            header.magic[1] = 'L';
+            header.magic[2] = 'C';
+            header.magic[3] = 'P';
+
+            header.version[0] = 0;
+            header.version[1] = 0;
+            header.version[2] = 0;
+            header.version[3] = 1;
+
+            header.width = m_width;
+            header.height = m_height;
+            header.passNum = m_passNum;
+            header.sizeOfReal = sizeof(real);
+        }
+
+        bool isSaved = (fwrite(&header, sizeof(header), 1, fp) == 1);
+
+        // If nothing is accumulated yet, only the header is written.
+        auto num = m_sampleNum.size();
+
+        if (isSaved && num > 0) {
+            isSaved = (fwrite(&m_sum[0], sizeof(vec3), num, fp) == num)
+                && (fwrite(&m_sum2[0], sizeof(vec3), num, fp) == num)
+                && (fwrite(&m_sampleNum[0], sizeof(uint32_t), num, fp) == num);
+        }
+
+        isSaved = (fclose(fp) == 0) && isSaved;
+
+        if (!isSaved) {
+            AT_PRINTF("Failed to write %s\n", tmpPath.c_str());
+            remove(tmpPath.c_str());
+            return false;
+        }
+
+        // The previous checkpoint is kept until it is replaced.
+        return AtomicFile::replace(tmpPath, path);
+    }
+
+    bool FilmProgressive::loadCheckpoint(const char* path)
+    {
+        FILE* fp = fopen(path, "rb");
+        if (!fp) {
+            return false;
+        }
+
+        FilmCheckpointHeader header;
+
+        if (fread(&header, sizeof(header), 1, fp) != 1
+            || memcmp(header.magic, "FLCP", 4) != 0
+            || header.version[3] != 1
+            || header.width != (uint32_t)m_width
+            || header.height != (uint32_t)m_height
+            || header.sizeOfReal != sizeof(real))
+        {
+            AT_PRINTF("%s is not the checkpoint for this film\n", path);
+            fclose(fp);
+            return false;
+        }
+
+        auto num = m_image.size();
+
+        std::vector<vec3> sum(num);
+        std::vector<vec3> sum2(num);
+        std::vector<uint32_t> sampleNum(num);
+
+        bool isLoaded = (fread(&sum[0], sizeof(vec3), num, fp) == num)
+            && (fread(&sum2[0], sizeof(vec3), num, fp) == num)
+            && (fread(&sampleNum[0], sizeof(uint32_t), num, fp) == num);
+
+        // Only the header is written, if nothing was accumulated.
+        bool isEmpty = !isLoaded && ftell(fp) == (long)sizeof(header);
+
+        fclose(fp);
+
+        if (!isLoaded && !isEmpty) {
+            AT_PRINTF("Failed to read %s\n", path);
+            return false;
+        }
+
+        reset();
+
+        if (isLoaded) {
+            m_sum.swap(sum);
+            m_sum2.swap(sum2);
+            m_sampleNum.swap(sampleNum);
+
+            for (size_t i = 0; i < num; i++) {
+                if (m_sampleNum[i] > 0) {
+                    m_image[i] = vec4(m_sum[i] / (real)m_sampleNum[i], 1);
+                }
+            }
+        }
+
+        m_passNum = header.passNum;
+
+        return true;
+    }
 }
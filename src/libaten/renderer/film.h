@@ -79,5 +79,79 @@ namespace aten
         {
             put(i, v);
         }
+
+        /**
+         * @brief Clear the image and the accumulated samples to restart the progressive rendering.
+         */
+        void reset();
+
+        /**
+         * @brief Accumulate the samples into the pixel, and update the pixel with the mean of all accumulated samples.
+         * @param i Index of the pixel.
+         * @param sum Sum of the samples.
+         * @param sum2 Sum of the squared samples.
+         * @param sampleNum Number of the samples.
+         */
+        void accumulate(int i, const vec3& sum, const vec3& sum2, uint32_t sampleNum);
+
+        /**
+         * @brief Return the number of the accumulated samples in the pixel.
+         */
+        uint32_t getSampleNum(int i) const
+        {
+            return m_sampleNum.empty() ? 0 : m_sampleNum[i];
+        }
+
+        /**
+         * @brief Return the variance of the accumulated samples in the pixel.
+         */
+        vec3 getVariance(int i) const;
+
+        /**
+         * @brief Return the number of the passes which have been accumulated.
+         * It is used as the sampler state, so the resumed rendering continues the sample sequence.
+         */
+        uint32_t getPassNum() const
+        {
+            return m_passNum;
+        }
+
+        /**
+         * @brief Prepare to accumulate the samples of one pass. It has to be called out of the parallel region.
+         */
+        void beginPass();
+
+        /**
+         * @brief Count up the number of the passes. It has to be called when one pass is finished.
+         */
+        void endPass()
+        {
+            m_passNum++;
+        }
+
+        /**
+         * @brief Save the accumulated samples and the number of the passes to the file.
+         * The file is written to the temporary file at first and then it is renamed,
+         * so the previous checkpoint is not broken even if the process is killed while saving.
+         */
+        bool saveCheckpoint(const char* path) const;
+
+        /**
+         * @brief Load the accumulated samples and the number of the passes from the file to resume rendering.
+         * If the file doesn't match this film, nothing is loaded and returns false.
+         */
+        bool loadCheckpoint(const char* path);
+
+    private:
+        // Sum of the samples per pixel.
+        std::vector<vec3> m_sum;
+
+        // Sum of the squared samples per pixel.
+        std::vector<vec3> m_sum2;
+
+        // Number of the samples per pixel.
+        std::vector<uint32_t> m_sampleNum;
+
+        uint32_t m_passNum{ 0 };
     };
 }
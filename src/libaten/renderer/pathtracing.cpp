@@ -1,4 +1,7 @@
+#include <atomic>
+
 #include "renderer/pathtracing.h"
+#include "misc/color.h"
 #include "misc/omputil.h"
 #include "misc/timer.h"
 #include "renderer/nonphotoreal.h"
@@ -9,6 +12,7 @@
 #include "sampler/cmj.h"
 
 #include "material/lambert.h"
+#include "material/sample_texture.h"
 
 //#define Deterministic_Path_Termination
 
@@ -32,13 +36,15 @@ namespace aten
         const ray& inRay,
         camera* cam,
         CameraSampleResult& camsample,
-        scene* scene)
+        scene* scene,
+        const PrimaryHit* primaryHit/*= nullptr*/)
     {
         uint32_t depth = 0;
         uint32_t rrDepth = m_rrDepth;
 
         Path path;
         path.ray = inRay;
+        path.coneSpread = cam ? cam->getPixelSpreadAngle() : real(0);
 
         while (depth < maxDepth) {
             path.rec = hitrecord();
@@ -47,7 +53,23 @@ namespace aten
             bool willContinue = true;
             Intersection isect;
 
-            if (scene->hit(ctxt, path.ray, AT_MATH_EPSILON, AT_MATH_INF, path.rec, isect)) {
+            bool isHit = false;
+
+            if (depth == 0 && primaryHit) {
+                // Camera ray has been already traced.
+                isHit = primaryHit->isHit;
+                if (isHit) {
+                    path.rec = primaryHit->rec;
+                }
+            }
+            else {
+                isHit = scene->hit(ctxt, path.ray, AT_MATH_EPSILON, AT_MATH_INF, path.rec, isect);
+                path.objid = isect.objid;
+            }
+
+            if (isHit) {
+                updateTextureFootprint(path.rec, path.ray, path.coneSpread, path.coneWidth);
+
                 willContinue = shade(ctxt, sampler, scene, cam, camsample, depth, path);
             }
             else {
@@ -78,9 +100,34 @@ namespace aten
             depth++;
         }
 
+        TextureFootprint::reset();
+
         return std::move(path);
     }
 
+    void PathTracing::updateTextureFootprint(
+        const hitrecord& rec,
+        const ray& r,
+        real coneSpread,
+        real& coneWidth)
+    {
+        // Grow the ray cone to the hit point.
+        // The spread angle is kept at the bounces, as if the surfaces were flat and specular.
+        coneWidth += coneSpread * length(rec.p - r.org);
+
+        auto cosTheta = aten::abs(dot(rec.normal, r.dir));
+
+        if (coneWidth > real(0)
+            && cosTheta > real(0)
+            && rec.texLodBase < AT_MATH_INF)
+        {
+            TextureFootprint::set(rec.texLodBase + aten::log2(coneWidth / cosTheta));
+        }
+        else {
+            TextureFootprint::reset();
+        }
+    }
+
     bool PathTracing::shade(
         const context& ctxt,
         sampler* sampler,
@@ -156,6 +203,9 @@ namespace aten
                         // p31 - p35
                         pdfLight = pdfLight * dist2 / cosLight;
 
+                        // Probability to select this light at the previous hit point.
+                        pdfLight *= scene->getLightSelectPdf(path.objid, path.ray.org, path.prevNormal);
+
                         weight = path.pdfb / (pdfLight + path.pdfb);
                     }
                 }
@@ -235,9 +285,7 @@ namespace aten
                 auto shadowRayDir = normalize(tmp);
                 aten::ray shadowRay(shadowRayOrg, shadowRayDir);
 
-                hitrecord tmpRec;
-
-                if (scene->hitLight(ctxt, light, posLight, shadowRay, AT_MATH_EPSILON, AT_MATH_INF, tmpRec)) {
+                if (scene->isLightVisible(ctxt, light, posLight, shadowRay, AT_MATH_EPSILON)) {
                     // Shadow ray hits the light.
                     auto cosShadow = dot(orienting_normal, dirToLight);
 
@@ -273,7 +321,7 @@ namespace aten
                                 // p31 - p35
                                 pdfb = pdfb * cosLight / dist2;
 
-                                auto misW = pdfLight / (pdfb + pdfLight);
+                                auto misW = (pdfLight * lightSelectPdf) / (pdfb + pdfLight * lightSelectPdf);
 
                                 path.contrib += (misW * (bsdf * emit * G) / pdfLight) / lightSelectPdf;
                             }
@@ -296,9 +344,7 @@ namespace aten
                 vec3 dirToLight = normalize(sampleres.dir);
                 aten::ray shadowRay(path.rec.p, dirToLight);
 
-                hitrecord tmpRec;
-
-                if (scene->hitLight(ctxt, m_virtualLight, posLight, shadowRay, AT_MATH_EPSILON, AT_MATH_INF, tmpRec)) {
+                if (scene->isLightVisible(ctxt, m_virtualLight, posLight, shadowRay, AT_MATH_EPSILON)) {
                     auto cosShadow = dot(orienting_normal, dirToLight);
                     auto dist2 = squared_length(sampleres.dir);
                     auto dist = aten::sqrt(dist2);
@@ -376,6 +422,7 @@ namespace aten
         }
 
         path.prevMtrl = mtrl;
+        path.prevNormal = orienting_normal;
 
         path.pdfb = pdfb;
 
@@ -410,7 +457,40 @@ namespace aten
         }
     }
 
-    static uint32_t frame = 0;
+    // Compute the relative error of the accumulated samples in the tile.
+    static real computeTileRelativeError(
+        const FilmProgressive* film,
+        const TileScheduler::Tile& tile,
+        int width)
+    {
+        // To avoid that the dark pixels are never converged.
+        static const real MinMean = real(0.001);
+
+        real error = 0;
+
+        for (int y = tile.y; y < tile.y + tile.height; y++) {
+            for (int x = tile.x; x < tile.x + tile.width; x++) {
+                int pos = y * width + x;
+
+                auto n = film->getSampleNum(pos);
+                if (n == 0) {
+                    return AT_MATH_INF;
+                }
+
+                auto mean = color::luminance(vec3(film->at(x, y)));
+                auto var = color::luminance(film->getVariance(pos));
+
+                // Standard error of the mean.
+                auto stdErr = aten::sqrt(var / n);
+
+                error += stdErr / std::max(mean, MinMean);
+            }
+        }
+
+        error /= (real)(tile.width * tile.height);
+
+        return error;
+    }
 
     void PathTracing::onRender(
         const context& ctxt,
@@ -418,7 +498,7 @@ namespace aten
         scene* scene,
         camera* camera)
     {
-        frame++;
+        m_frame++;
 
         int width = dst.width;
         int height = dst.height;
@@ -444,101 +524,226 @@ namespace aten
 
         auto time = timer::getSystemTime();
 
-#if defined(ENABLE_OMP) && !defined(RELEASE_DEBUG)
-#pragma omp parallel
-#endif
-        {
-            auto idx = OMPUtil::getThreadIdx();
+        auto film = m_progressiveFilm;
 
-            auto t = timer::getSystemTime();
+        // In the progressive rendering, the sample sequence continues from the accumulated passes.
+        uint32_t frame = m_frame;
 
-#if defined(ENABLE_OMP) && !defined(RELEASE_DEBUG)
-#pragma omp for
-#endif
-            for (int y = 0; y < height; y++) {
-                for (int x = 0; x < width; x++) {
-                    int pos = y * width + x;
+        if (film) {
+            AT_ASSERT(film->width() == (uint32_t)width && film->height() == (uint32_t)height);
+            film->beginPass();
+            frame = film->getPassNum();
+        }
 
-                    vec3 col = vec3(0);
-                    vec3 col2 = vec3(0);
-                    uint32_t cnt = 0;
+        // The adaptive sampling needs the accumulated samples.
+        const bool isAdaptive = m_enableAdaptiveSampling && film;
 
-#ifdef RELEASE_DEBUG
-                    if (x == BREAK_X && y == BREAK_Y) {
-                        DEBUG_BREAK();
+        if (isAdaptive) {
+            if (m_isAdaptiveSamplingFinished) {
+                return;
+            }
+
+            if (!m_isAdaptiveTimerStarted) {
+                m_adaptiveTimer.begin();
+                m_isAdaptiveTimerStarted = true;
+            }
+        }
+
+        const bool isBasePass = !film || film->getPassNum() < m_adaptiveParam.basePassNum;
+
+        std::atomic<uint32_t> renderedTileNum(0);
+        std::atomic<bool> isTimeOver(false);
+
+        m_scheduler.run(
+            width, height,
+            [&](const TileScheduler::Tile& tile, int idx) {
+            if (isAdaptive) {
+                if (m_adaptiveParam.timeBudget > 0
+                    && m_adaptiveTimer.end() > m_adaptiveParam.timeBudget)
+                {
+                    isTimeOver = true;
+                    m_scheduler.cancel();
+                    return;
+                }
+
+                if (!isBasePass
+                    && computeTileRelativeError(film, tile, width) < m_adaptiveParam.threshold)
+                {
+                    // Converged. Only output the accumulated result.
+                    if (dst.buffer && dst.buffer != film) {
+                        for (int y = tile.y; y < tile.y + tile.height; y++) {
+                            for (int x = tile.x; x < tile.x + tile.width; x++) {
+                                dst.buffer->put(x, y, film->at(x, y));
+                            }
+                        }
                     }
+                    return;
+                }
+
+                renderedTileNum++;
+            }
+
+            for (int y = tile.y; y < tile.y + tile.height; y++) {
+                // NOTE
+                // Camera rays for the neighbor pixels in the row of the tile are traced together as the packet.
+                for (int bx = tile.x; bx < tile.x + tile.width; bx += RayPacket::MaxRayNum) {
+                    const int laneNum = std::min<int>(RayPacket::MaxRayNum, tile.x + tile.width - bx);
+
+                    vec3 col[RayPacket::MaxRayNum];
+                    vec3 col2[RayPacket::MaxRayNum];
+                    uint32_t cnt[RayPacket::MaxRayNum];
+                    bool isTerminated[RayPacket::MaxRayNum];
+
+                    for (int n = 0; n < laneNum; n++) {
+                        col[n] = vec3(0);
+                        col2[n] = vec3(0);
+                        cnt[n] = 0;
+                        isTerminated[n] = false;
+
+#ifdef RELEASE_DEBUG
+                        if (bx + n == BREAK_X && y == BREAK_Y) {
+                            DEBUG_BREAK();
+                        }
 #endif
+                    }
+
+                    //XorShift rnd(scramble + t.milliSeconds);
+                    //Halton rnd(scramble + t.milliSeconds);
+                    //Sobol rnd;
+                    CMJ rnd[RayPacket::MaxRayNum];
+                    //WangHash rnd(scramble + t.milliSeconds);
+
+                    CameraSampleResult camsample[RayPacket::MaxRayNum];
+
+                    RayPacket packet;
+                    hitrecord recs[RayPacket::MaxRayNum];
+                    Intersection isects[RayPacket::MaxRayNum];
 
                     for (uint32_t i = 0; i < samples; i++) {
-                        auto scramble = aten::getRandom(pos) * 0x1fe3434f;
+                        packet.clear();
+
+                        for (int n = 0; n < laneNum; n++) {
+                            if (isTerminated[n]) {
+                                // Keep the lane, but not trace.
+                                packet.add(ray(), false);
+                                continue;
+                            }
+
+                            int x = bx + n;
+                            int pos = y * width + x;
+
+                            auto scramble = aten::getRandom(pos) * 0x1fe3434f;
+
+                            rnd[n].init(frame, i, scramble);
 
-                        //XorShift rnd(scramble + t.milliSeconds);
-                        //Halton rnd(scramble + t.milliSeconds);
-                        //Sobol rnd;
-                        CMJ rnd;
-                        rnd.init(frame, i, scramble);
-                        //WangHash rnd(scramble + t.milliSeconds);
+                            real u = real(x + rnd[n].nextSample()) / real(width);
+                            real v = real(y + rnd[n].nextSample()) / real(height);
+
+                            camsample[n] = camera->sample(u, v, &rnd[n]);
+
+                            packet.add(camsample[n].r);
+                        }
+
+                        if (packet.activeMask == 0) {
+                            break;
+                        }
 
-                        real u = real(x + rnd.nextSample()) / real(width);
-                        real v = real(y + rnd.nextSample()) / real(height);
+                        auto hitMask = scene->hit(ctxt, packet, AT_MATH_EPSILON, AT_MATH_INF, recs, isects);
 
-                        auto camsample = camera->sample(u, v, &rnd);
+                        for (int n = 0; n < laneNum; n++) {
+                            if ((packet.activeMask & (1 << n)) == 0) {
+                                continue;
+                            }
 
-                        auto ray = camsample.r;
+                            PrimaryHit primaryHit;
+                            primaryHit.isHit = ((hitMask & (1 << n)) > 0);
+                            primaryHit.rec = recs[n];
 
 #ifdef Deterministic_Path_Termination
-                        auto maxDepth = depths[i];
-                        auto path = radiance(
-                            &sampler,
-                            maxDepth,
-                            ray,
-                            camera,
-                            camsample,
-                            scene);
+                            auto maxDepth = depths[i];
 #else
-
-                        auto path = radiance(
-                            ctxt,
-                            &rnd,
-                            ray, 
-                            camera,
-                            camsample,
-                            scene);
+                            auto maxDepth = m_maxDepth;
 #endif
 
-                        if (isInvalidColor(path.contrib)) {
-                            AT_PRINTF("Invalid(%d/%d[%d])\n", x, y, i);
-                            continue;
-                        }
+                            auto path = radiance(
+                                ctxt,
+                                &rnd[n],
+                                maxDepth,
+                                packet.rays[n],
+                                camera,
+                                camsample[n],
+                                scene,
+                                &primaryHit);
+
+                            if (isInvalidColor(path.contrib)) {
+                                AT_PRINTF("Invalid(%d/%d[%d])\n", bx + n, y, i);
+                                continue;
+                            }
 
-                        auto pdfOnImageSensor = camsample.pdfOnImageSensor;
-                        auto pdfOnLens = camsample.pdfOnLens;
+                            auto pdfOnImageSensor = camsample[n].pdfOnImageSensor;
+                            auto pdfOnLens = camsample[n].pdfOnLens;
 
-                        auto s = camera->getSensitivity(
-                            camsample.posOnImageSensor,
-                            camsample.posOnLens);
+                            auto s = camera->getSensitivity(
+                                camsample[n].posOnImageSensor,
+                                camsample[n].posOnLens);
 
-                        auto c = path.contrib * s / (pdfOnImageSensor * pdfOnLens);
+                            auto c = path.contrib * s / (pdfOnImageSensor * pdfOnLens);
 
-                        col += c;
-                        col2 += c * c;
-                        cnt++;
+                            col[n] += c;
+                            col2[n] += c * c;
+                            cnt[n]++;
 
-                        if (path.isTerminate) {
-                            break;
+                            if (path.isTerminate) {
+                                isTerminated[n] = true;
+                            }
                         }
                     }
 
-                    col /= (real)cnt;
+                    for (int n = 0; n < laneNum; n++) {
+                        int x = bx + n;
+
+                        if (film) {
+                            int pos = y * width + x;
+
+                            film->accumulate(pos, col[n], col2[n], cnt[n]);
+
+                            if (dst.buffer && dst.buffer != film) {
+                                dst.buffer->put(x, y, film->at(x, y));
+                            }
+
+                            if (dst.variance) {
+                                dst.variance->put(x, y, vec4(film->getVariance(pos), real(1)));
+                            }
+
+                            continue;
+                        }
+
+                        col[n] /= (real)cnt[n];
 
-                    dst.buffer->put(x, y, vec4(col, 1));
+                        dst.buffer->put(x, y, vec4(col[n], 1));
 
-                    if (dst.variance) {
-                        col2 /= (real)cnt;
-                        dst.variance->put(x, y, vec4(col2 - col * col, real(1)));
+                        if (dst.variance) {
+                            col2[n] /= (real)cnt[n];
+                            dst.variance->put(x, y, vec4(col2[n] - col[n] * col[n], real(1)));
+                        }
                     }
                 }
             }
+        });
+
+        if (isAdaptive && (renderedTileNum == 0 || isTimeOver)) {
+            m_isAdaptiveSamplingFinished = true;
+        }
+
+        if (film) {
+            film->endPass();
+
+            if (m_checkpointInterval > 0
+                && !m_checkpointPath.empty()
+                && (film->getPassNum() % m_checkpointInterval) == 0)
+            {
+                film->saveCheckpoint(m_checkpointPath.c_str());
+            }
         }
     }
 }
@@ -1,9 +1,12 @@
 #pragma once
 
+#include <string>
+
 #include "renderer/renderer.h"
 #include "scene/scene.h"
 #include "camera/camera.h"
 #include "light/pointlight.h"
+#include "misc/timer.h"
 
 namespace aten
 {
@@ -30,6 +33,65 @@ namespace aten
             m_lightDir = dir;
         }
 
+        /**
+         * @brief Enable the progressive rendering.
+         * At every rendering, Destination::sample samples per pixel are accumulated into the specified film
+         * with the number of samples per pixel, and dst.buffer receives the mean of all accumulated samples.
+         * The film's pass number is used as the sampler state, so the film restored from the checkpoint continues the sample sequence.
+         * @param film Film to accumulate. If nullptr is specified, the progressive rendering is disabled.
+         */
+        void setProgressiveFilm(FilmProgressive* film)
+        {
+            m_progressiveFilm = film;
+        }
+
+        /**
+         * @brief Save the progressive film as the checkpoint periodically.
+         * @param path Path to the checkpoint file. It can be loaded with FilmProgressive::loadCheckpoint to resume rendering.
+         * @param intervalPass The checkpoint is saved whenever this number of passes is finished. If 0 is specified, it is not saved.
+         */
+        void setCheckpoint(const char* path, uint32_t intervalPass)
+        {
+            m_checkpointPath = path ? path : "";
+            m_checkpointInterval = intervalPass;
+        }
+
+        /**
+         * @brief Parameters for the adaptive sampling.
+         */
+        struct AdaptiveSamplingParameter {
+            real threshold{ real(0.01) };   ///< Tiles whose relative error is less than this are treated as converged.
+            uint32_t basePassNum{ 4 };      ///< Number of the passes which are rendered for all tiles before the adaptive sampling starts.
+            real timeBudget{ 0 };           ///< Time budget [ms] from the first adaptive rendering. If 0, there is no limit.
+        };
+
+        /**
+         * @brief Enable the adaptive sampling. It works only with the progressive rendering.
+         * After the base passes, only the tiles whose relative error is above the threshold are rendered.
+         * The relative error is the standard error of the pixel mean divided by the mean, and it is averaged in the tile.
+         */
+        void enableAdaptiveSampling(const AdaptiveSamplingParameter& param)
+        {
+            m_enableAdaptiveSampling = true;
+            m_adaptiveParam = param;
+            m_isAdaptiveTimerStarted = false;
+            m_isAdaptiveSamplingFinished = false;
+        }
+
+        void disableAdaptiveSampling()
+        {
+            m_enableAdaptiveSampling = false;
+        }
+
+        /**
+         * @brief Return whether all tiles are converged or the time budget runs out.
+         * Once it is finished, rendering does nothing until the adaptive sampling is enabled again.
+         */
+        bool isAdaptiveSamplingFinished() const
+        {
+            return m_isAdaptiveSamplingFinished;
+        }
+
     protected:
         struct Path {
             vec3 contrib;
@@ -39,6 +101,15 @@ namespace aten
             hitrecord rec;
             const material* prevMtrl{ nullptr };
 
+            // Normal at the previous hit point, and object which the ray hits.
+            // They are used to compute the probability to select the hit light.
+            vec3 prevNormal;
+            int objid{ -1 };
+
+            // Ray cone to compute the footprint on the textures.
+            real coneWidth{ 0 };
+            real coneSpread{ 0 };
+
             aten::ray ray;
 
             bool isTerminate{ false };
@@ -61,6 +132,14 @@ namespace aten
             return std::move(radiance(ctxt, sampler, m_maxDepth, inRay, cam, camsample, scene));
         }
 
+        /**
+         * @brief Result of the hit test for the camera ray which is traced as the packet.
+         */
+        struct PrimaryHit {
+            bool isHit{ false };
+            hitrecord rec;
+        };
+
         Path radiance(
             const context& ctxt,
             sampler* sampler,
@@ -68,7 +147,8 @@ namespace aten
             const ray& inRay,
             camera* cam,
             CameraSampleResult& camsample,
-            scene* scene);
+            scene* scene,
+            const PrimaryHit* primaryHit = nullptr);
 
         bool shade(
             const context& ctxt,
@@ -84,6 +164,15 @@ namespace aten
             int depth,
             Path& path);
 
+        /**
+         * @brief Grow the ray cone to the hit point, and set the footprint on the textures for shading.
+         */
+        static void updateTextureFootprint(
+            const hitrecord& rec,
+            const ray& r,
+            real coneSpread,
+            real& coneWidth);
+
     protected:
         uint32_t m_maxDepth{ 1 };
 
@@ -94,5 +183,19 @@ namespace aten
 
         PointLight* m_virtualLight{ nullptr };
         vec3 m_lightDir;
+
+        uint32_t m_frame{ 0 };
+
+        FilmProgressive* m_progressiveFilm{ nullptr };
+
+        std::string m_checkpointPath;
+        uint32_t m_checkpointInterval{ 0 };
+
+        bool m_enableAdaptiveSampling{ false };
+        AdaptiveSamplingParameter m_adaptiveParam;
+
+        timer m_adaptiveTimer;
+        bool m_isAdaptiveTimerStarted{ false };
+        bool m_isAdaptiveSamplingFinished{ false };
     };
 }
@@ -1,6 +1,8 @@
+#include <algorithm>
 #include <vector>
 #include <stack>
 #include "renderer/pssmlt.h"
+#include "renderer/splatfilm.h"
 #include "sampler/xorshift.h"
 #include "sampler/cmj.h"
 #include "misc/color.h"
@@ -15,13 +17,10 @@ namespace aten
     // ̈̃Tṽf[^\.
     struct PrimarySample {
         int modify_time{ 0 };
-        real value;
 
-        PrimarySample()
-        {
-            // TODO
-            value = aten::drand48();
-        }
+        // NOTE
+        // The value is always sampled before it is used, because modify_time is older than the time of the sampler.
+        real value{ real(0) };
     };
 
     // Kelemen MLTɂāApXɎge헐primary spaceĂ.
@@ -31,9 +30,8 @@ namespace aten
     // ԂɂψفiMutate()ǰʂgčĂѓ悤ɃpXgŃpX𐶐Ƃ̃pX͎Rɕψٌ̃pXɂȂĂ.
     class MLTSampler : public sampler {
     public:
-        MLTSampler(sampler* rnd)
+        MLTSampler()
         {
-            m_rnd = rnd;
             u.resize(128);
         }
         ~MLTSampler() {}
@@ -44,6 +42,25 @@ namespace aten
             usedRandCoords = 0;
         }
 
+        /**
+         * @brief Reset the state to start the new chain. The allocated primary samples are reused.
+         */
+        void reset(sampler* rnd)
+        {
+            m_rnd = rnd;
+
+            for (auto& s : u) {
+                s.modify_time = 0;
+            }
+
+            clearStack();
+
+            globalTime = 0;
+            largeStep = 0;
+            largeStepTime = 0;
+            usedRandCoords = 0;
+        }
+
         virtual real nextSample() override final;
 
         void clearStack();
@@ -55,7 +72,7 @@ namespace aten
         sampler* m_rnd{ nullptr };
 
         std::vector<PrimarySample> u;
-        std::stack<PrimarySample> stack;
+        std::stack<PrimarySample, std::vector<PrimarySample>> stack;
 
         // accept ꂽ mutation ̉.
         int globalTime{ 0 };
@@ -216,85 +233,112 @@ namespace aten
 
         auto threadNum = OMPUtil::getThreadNum();
 
-        std::vector<std::vector<vec3>> acuumImage(threadNum);
+        // The primary samples are reused per thread.
+        std::vector<MLTSampler> mltSamplers(threadNum);
+
+        SplatFilm film;
+        film.init(width, height, threadNum);
 
         auto time = timer::getSystemTime();
 
+        // Generate the seed path with the random sequence which is determined by the index of the seed path.
+        // So the primary samples of the seed path can be regenerated later without keeping them.
+        auto genSeedPath = [&](MLTSampler& mlt, XorShift& rnd, int seedIdx) {
+            rnd.init(aten::getRandom(seedIdx) + time.milliSeconds);
+
+            // All coordinates are sampled newly as the large step.
+            mlt.reset(&rnd);
+            mlt.largeStep = 1;
+            mlt.globalTime = 1;
+            mlt.init();
+
+            auto path = genPath(ctxt, scene, &mlt, -1, -1, width, height, camera);
+
+            // ݂̂Ȃ̂ŃX^bNɂ.
+            mlt.clearStack();
+
+            return path;
+        };
+
+        // pX𐶐.
+        // ̃pXMLTŎgŏ̃pX𓾂B(Markov Chain Monte Carlołj.
+        // The seed paths are shared by all chains.
+
+        // Kɑ߂̐.
+        int seedPathMax = width * height;
+        if (seedPathMax <= 0) {
+            seedPathMax = 1;
+        }
+
+        // CDF of the luminance of the seed paths.
+        std::vector<real> seedCdf(seedPathMax);
+
 #ifdef ENABLE_OMP
 #pragma omp parallel for
 #endif
-        for (int mi = 0; mi < mltNum; mi++) {
+        for (int i = 0; i < seedPathMax; i++) {
             auto idx = OMPUtil::getThreadIdx();
 
-            auto& image = acuumImage[idx];
-            if (image.empty()) {
-                image.resize(width * height);
-                memset(&image[0], 0, sizeof(vec3) * width * height);
-            }
-
-            // TODO
-            // sobol  halton sequence ̓XebvăI[o[t[Ă܂...
-            //XorShift rnd(4 * mltNum + mi + 1 + time.milliSeconds);
-            CMJ rnd;
-            rnd.init(time.milliSeconds, mi, 4 * mltNum + mi + 1);
-            MLTSampler mlt(&rnd);
+            XorShift rnd;
+            auto path = genSeedPath(mltSamplers[idx], rnd, i);
 
-            // pX𐶐.
-            // ̃pXMLTŎgŏ̃pX𓾂B(Markov Chain Monte Carlołj.
+            seedCdf[i] = color::luminance(path.contrib);
+        }
 
-            // Kɑ߂̐.
-            int seedPathMax = width * height;
-            if (seedPathMax <= 0) {
-                seedPathMax = 1;
-            }
+        for (int i = 1; i < seedPathMax; i++) {
+            seedCdf[i] += seedCdf[i - 1];
+        }
 
-            std::vector<Path> seedPaths(seedPathMax);
+        const real sumI = seedCdf[seedPathMax - 1];
 
-            real sumI = 0.0;
-            mlt.largeStep = 1;
+        m_chainStats.assign(mltNum, ChainStatistics());
 
-            for (int i = 0; i < seedPathMax; i++) {
-                mlt.init();
+        if (sumI <= real(0)) {
+            // Nothing contributes to the image.
+            return;
+        }
 
-                // gen path.
-                seedPaths[i] = genPath(ctxt, scene, &mlt, -1, -1, width, height, camera);
-                const auto& sample = seedPaths[i];
+        const real b = sumI / seedPathMax;
+        const real p_large = 0.5;
+        const int M = mutation;
 
-                // ܂͐邾Ȃ̂ŁAׂaccept.
-                mlt.globalTime++;
+#ifdef ENABLE_OMP
+#pragma omp parallel for
+#endif
+        for (int mi = 0; mi < mltNum; mi++) {
+            auto idx = OMPUtil::getThreadIdx();
 
-                // ݂̂Ȃ̂ŃX^bNɂ?
-                mlt.clearStack();
+            auto& mlt = mltSamplers[idx];
+            auto& stats = m_chainStats[mi];
 
-                // sum I.
-                sumI += color::luminance(sample.contrib);
-            }
+            // TODO
+            // sobol  halton sequence ̓XebvăI[o[t[Ă܂...
+            //XorShift rnd(4 * mltNum + mi + 1 + time.milliSeconds);
+            CMJ rnd;
+            rnd.init(time.milliSeconds, mi, 4 * mltNum + mi + 1);
 
             // ŏ̃pX߂.
             // PxlɊÂd_TvOɂđIł.
             int selecetdPath = 0;
             {
                 auto cost = rnd.nextSample() * sumI;
-                real accumlatedImportance = 0;
 
-                for (int i = 0; i < seedPathMax; i++) {
-                    const auto& path = seedPaths[i];
-                    accumlatedImportance += color::luminance(path.contrib);
-
-                    if (accumlatedImportance >= cost) {
-                        selecetdPath = i;
-                        break;
-                    }
-                }
+                auto it = std::lower_bound(seedCdf.begin(), seedCdf.end(), cost);
+                selecetdPath = std::min((int)(it - seedCdf.begin()), seedPathMax - 1);
             }
 
-            const real b = sumI / seedPathMax;
-            const real p_large = 0.5;
-            const int M = mutation;
-            int accept = 0;
-            int reject = 0;
+            stats.seedPathIdx = selecetdPath;
+
+            // Regenerate the primary samples of the selected seed path.
+            XorShift seedRnd;
+            Path oldPath = genSeedPath(mlt, seedRnd, selecetdPath);
 
-            Path oldPath = seedPaths[selecetdPath];
+            // The seed path is accepted as the large step.
+            mlt.largeStepTime = mlt.globalTime;
+            mlt.globalTime++;
+
+            // The chain is mutated with its own random sequence.
+            mlt.m_rnd = &rnd;
 
             for (int i = 0; i < M; i++) {
                 mlt.largeStep = rnd.nextSample() < p_large ? 1 : 0;
@@ -314,17 +358,17 @@ namespace aten
 
                 int newPos = newPath.y * width + newPath.x;
                 vec3 newV = newPath_W * newPath.contrib * newPath.weight;
-                image[newPos] += newV;
+                film.splat(idx, newPos, newV);
 
                 int oldPos = oldPath.y * width + oldPath.x;
                 vec3 oldV = oldPath_W * oldPath.contrib * oldPath.weight;
-                image[oldPos] += oldV;
+                film.splat(idx, oldPos, oldV);
 
                 auto r = rnd.nextSample();
 
                 if (r < a) {
                     // accept.
-                    accept++;
+                    stats.accept++;
 
                     // ψق.
                     oldPath = newPath;
@@ -339,7 +383,7 @@ namespace aten
                 }
                 else {
                     // reject.
-                    reject++;
+                    stats.reject++;
 
                     // restore state.
                     int idx = mlt.usedRandCoords - 1;
@@ -351,11 +395,10 @@ namespace aten
             }
         }
 
-        for (uint32_t n = 0; n < threadNum; n++) {
-            auto& image = acuumImage[n];
-            for (int i = 0; i < width * height; i++) {
-                dst.buffer->add(i, vec4(image[i] / real(mltNum), real(1)));
-            }
+        film.flushAll();
+
+        for (int i = 0; i < width * height; i++) {
+            dst.buffer->add(i, vec4(film.at(i) / real(mltNum), real(1)));
         }
     }
 }
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <vector>
+
 #include "renderer/pathtracing.h"
 #include "scene/scene.h"
 #include "camera/camera.h"
@@ -7,6 +9,14 @@
 
 namespace aten
 {
+    /**
+     * @brief Primary sample space MLT (Kelemen style).
+     *
+     * The seed paths are generated once in parallel and shared by all Markov chains.
+     * Only the luminance of each seed path is kept, and each chain picks its start path from the CDF of them.
+     * The primary samples of the picked path are regenerated from the random sequence of the seed path.
+     * The splats of all chains go to one shared film.
+     */
     class PSSMLT : public PathTracing {
     public:
         PSSMLT() {}
@@ -18,6 +28,29 @@ namespace aten
             scene* scene,
             camera* camera) override final;
 
+        /**
+         * @brief Statistics of the Markov chain.
+         */
+        struct ChainStatistics {
+            uint32_t seedPathIdx{ 0 };  ///< Index of the seed path which the chain starts from.
+            uint32_t accept{ 0 };       ///< Number of the accepted mutations.
+            uint32_t reject{ 0 };       ///< Number of the rejected mutations.
+
+            real acceptanceRate() const
+            {
+                auto num = accept + reject;
+                return num > 0 ? accept / (real)num : real(0);
+            }
+        };
+
+        /**
+         * @brief Return the statistics per chain at the latest rendering.
+         */
+        const std::vector<ChainStatistics>& getChainStatistics() const
+        {
+            return m_chainStats;
+        }
+
     private:
         struct Path {
             int x{ 0 };
@@ -34,5 +67,8 @@ namespace aten
             int x, int y,
             int width, int height,
             camera* camera);
+
+    private:
+        std::vector<ChainStatistics> m_chainStats;
     };
 }
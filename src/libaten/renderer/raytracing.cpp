@@ -131,15 +131,11 @@ namespace aten
 
         uint32_t sample = 1;
 
-#ifdef ENABLE_OMP
-#pragma omp parallel
-#endif
-        {
-#ifdef ENABLE_OMP
-#pragma omp for
-#endif
-            for (int y = 0; y < height; y++) {
-                for (int x = 0; x < width; x++) {
+        m_scheduler.run(
+            width, height,
+            [&](const TileScheduler::Tile& tile, int idx) {
+            for (int y = tile.y; y < tile.y + tile.height; y++) {
+                for (int x = tile.x; x < tile.x + tile.width; x++) {
                     //if (x == 419 && y == 107) {
                     //if (x == 408 && y == 112) {
                     if (x == 378 && y == 480 - 355) {
@@ -157,6 +153,6 @@ namespace aten
                     dst.buffer->put(x, y, vec4(col, 1));
                 }
             }
-        }
+        });
     }
 }
@@ -8,6 +8,7 @@
 #include "scene/context.h"
 #include "scene/scene.h"
 #include "camera/camera.h"
+#include "misc/tilescheduler.h"
 
 namespace aten
 {
@@ -54,6 +55,23 @@ namespace aten
             m_bg = bg;
         }
 
+        /**
+         * @brief Return the scheduler to render the image tile by tile.
+         * Tile size, order and progress callback can be configured with it.
+         */
+        TileScheduler& getTileScheduler()
+        {
+            return m_scheduler;
+        }
+
+        /**
+         * @brief Cancel the running rendering.
+         */
+        void cancel()
+        {
+            m_scheduler.cancel();
+        }
+
     protected:
         virtual void onRender(
             const context& ctxt,
@@ -91,6 +109,9 @@ namespace aten
             return b;
         }
 
+    protected:
+        TileScheduler m_scheduler;
+
     private:
         background* m_bg{ nullptr };
     };
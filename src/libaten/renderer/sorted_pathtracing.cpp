@@ -1,503 +1,813 @@
 #include "renderer/sorted_pathtracing.h"
+#include "renderer/nonphotoreal.h"
+#include "material/sample_texture.h"
+#include "accelerator/ray_packet.h"
+#include "math/morton.h"
 #include "misc/omputil.h"
 #include "misc/timer.h"
-#include "sampler/xorshift.h"
-#include "sampler/halton.h"
-#include "sampler/sobolproxy.h"
 
 namespace aten
 {
+    void SortedPathTracing::Paths::resize(uint32_t num)
+    {
+        contrib.resize(num);
+        throughput.resize(num);
+        pdfb.resize(num);
+        prevMtrl.resize(num);
+        prevNormal.resize(num);
+        objid.resize(num);
+        coneWidth.resize(num);
+
+        rays.resize(num);
+        recs.resize(num);
+
+        samplers.resize(num);
+
+        camWeight.resize(num);
+
+        isHit.resize(num);
+        isAlive.resize(num);
+        isTerminate.resize(num);
+        isTraced.resize(num);
+
+        shadowRays.resize(num);
+        lightcontrib.resize(num);
+        lightPos.resize(num);
+        targetLight.resize(num);
+        hasShadowRay.resize(num);
+    }
+
     void SortedPathTracing::makePaths(
         int width, int height,
-        int sample,
-        Path* paths,
-        ray* rays,
+        uint32_t sample,
         camera* camera)
     {
-
-        auto time = timer::getSystemTime();
+        m_coneSpread = camera->getPixelSpreadAngle();
 
 #ifdef ENABLE_OMP
 #pragma omp parallel for
 #endif
         for (int y = 0; y < height; y++) {
             for (int x = 0; x < width; x++) {
-                uint32_t idx = y * width + x;
+                int idx = y * width + x;
+
+                // If the path is terminated at the previous samples, the pixel is not traced anymore.
+                m_paths.isTraced[idx] = !m_paths.isTerminate[idx];
+                m_paths.isAlive[idx] = m_paths.isTraced[idx];
 
-                auto& path = paths[idx];
+                if (!m_paths.isAlive[idx]) {
+                    continue;
+                }
 
-                if (!path.isTerminate) {
-                    auto scramble = aten::getRandom(idx) * 0x1fe3434f;
+                auto& sampler = m_paths.samplers[idx];
 
-                    if (path.sampler) {
-                        path.sampler->init(scramble + time.milliSeconds);
-                        //path.sampler->init(scramble + time.milliSeconds);
-                    }
-                    else {
-                        path.sampler = new Sobol(scramble + time.milliSeconds);
-                        //path.sampler = new XorShift(scramble + time.milliSeconds);
-                    }
+                auto scramble = aten::getRandom(idx) * 0x1fe3434f;
+                sampler.init(m_frame, sample, scramble);
 
-                    sampler* sampler = path.sampler;
+                real u = real(x + sampler.nextSample()) / real(width);
+                real v = real(y + sampler.nextSample()) / real(height);
 
-                    real u = real(x + sampler->nextSample()) / real(width);
-                    real v = real(y + sampler->nextSample()) / real(height);
+                auto camsample = camera->sample(u, v, &sampler);
 
-                    path.camsample = camera->sample(u, v, sampler);
-                    path.camSensitivity = camera->getSensitivity(
-                        path.camsample.posOnImageSensor,
-                        path.camsample.posOnLens);
+                auto s = camera->getSensitivity(
+                    camsample.posOnImageSensor,
+                    camsample.posOnLens);
 
-                    rays[idx] = path.camsample.r;
+                m_paths.camWeight[idx] = s / (camsample.pdfOnImageSensor * camsample.pdfOnLens);
 
-                    path.x = x;
-                    path.y = y;
+                m_paths.rays[idx] = camsample.r;
 
-                    path.isAlive = true;
-                    path.needWrite = true;
+                m_paths.contrib[idx] = vec3(0);
+                m_paths.throughput[idx] = vec3(1);
+                m_paths.pdfb[idx] = real(1);
+                m_paths.prevMtrl[idx] = nullptr;
+                m_paths.coneWidth[idx] = real(0);
 
-                    path.contrib = vec3(0);
-                    path.throughput = vec3(1);
-                }
+                m_paths.isHit[idx] = false;
+                m_paths.hasShadowRay[idx] = false;
             }
         }
     }
 
-    void SortedPathTracing::hitPaths(
-        Path* paths,
-        const ray* rays,
-        int numPath,
-        scene* scene)
+    void SortedPathTracing::sortRays(int numAlive)
     {
+        // Bounds of the ray origins to normalize them for Morton code.
+        auto threadNum = OMPUtil::getThreadNum();
+        std::vector<aabb> orgBoxes(threadNum);
+
+        for (auto& box : orgBoxes) {
+            box.empty();
+        }
+
 #ifdef ENABLE_OMP
 #pragma omp parallel for
 #endif
-        for (int i = 0; i < numPath; i++) {
-            auto& path = paths[i];
-            const auto& ray = rays[i];
+        for (int i = 0; i < numAlive; i++) {
+            auto idx = OMPUtil::getThreadIdx();
+            orgBoxes[idx].expand(m_paths.rays[m_aliveIds[i]].org);
+        }
 
-            path.isHit = false;
+        aabb orgBox = orgBoxes[0];
+        for (uint32_t i = 1; i < threadNum; i++) {
+            orgBox.expand(orgBoxes[i]);
+        }
 
-            if (path.isAlive) {
-                // .
-                path.rec = hitrecord();
-                path.ray = ray;
+        const auto& minPos = orgBox.minPos();
+        auto size = orgBox.size();
 
-                Intersection isect;
-                path.isHit = scene->hit(ray, AT_MATH_EPSILON, AT_MATH_INF, path.rec, isect);
-            }
+        vec3 invSize(
+            size.x > real(0) ? real(1) / size.x : real(0),
+            size.y > real(0) ? real(1) / size.y : real(0),
+            size.z > real(0) ? real(1) / size.z : real(0));
+
+        m_aliveIds.resize(numAlive);
+        m_sortKeys.resize(numAlive);
+
+        // NOTE
+        // Key = [octant of direction : 3 bit][origin : 30 bit][direction : 30 bit]
+        // The rays which go to the same octant from the near origins are grouped.
+
+#ifdef ENABLE_OMP
+#pragma omp parallel for
+#endif
+        for (int i = 0; i < numAlive; i++) {
+            const auto& r = m_paths.rays[m_aliveIds[i]];
+
+            uint64_t octant = (r.dir.x < real(0) ? 1 : 0)
+                | (r.dir.y < real(0) ? 2 : 0)
+                | (r.dir.z < real(0) ? 4 : 0);
+
+            uint32_t orgCode = 0;
+            computeMortonCode((r.org - minPos) * invSize, orgCode);
+
+            uint32_t dirCode = 0;
+            computeMortonCode((r.dir + vec3(1)) * real(0.5), dirCode);
+
+            m_sortKeys[i] = (octant << 60) | ((uint64_t)orgCode << 30) | (uint64_t)dirCode;
         }
+
+        m_radixSort.sort(m_sortKeys, m_aliveIds, 63);
     }
 
-    int SortedPathTracing::compactionPaths(
-        Path* paths,
-        int numPath,
-        uint32_t* hitIds)
+    void SortedPathTracing::hitPaths(
+        const context& ctxt,
+        scene* scene,
+        int numAlive)
     {
-        int cnt = 0;
+        // NOTE
+        // The neighbours in the sorted order are traced together as the packet.
+        int packetNum = (numAlive + RayPacket::MaxRayNum - 1) / RayPacket::MaxRayNum;
 
-        for (int i = 0; i < numPath; i++) {
-            const auto& path = paths[i];
-            if (path.isAlive && path.isHit) {
-                hitIds[cnt++] = i;
+#ifdef ENABLE_OMP
+#pragma omp parallel for
+#endif
+        for (int p = 0; p < packetNum; p++) {
+            int start = p * RayPacket::MaxRayNum;
+            int num = std::min<int>(RayPacket::MaxRayNum, numAlive - start);
+
+            RayPacket packet;
+            hitrecord recs[RayPacket::MaxRayNum];
+            Intersection isects[RayPacket::MaxRayNum];
+
+            for (int n = 0; n < num; n++) {
+                auto idx = m_aliveIds[start + n];
+                packet.add(m_paths.rays[idx]);
             }
-        }
 
-        return cnt;
+            auto hitMask = scene->hit(ctxt, packet, AT_MATH_EPSILON, AT_MATH_INF, recs, isects);
+
+            for (int n = 0; n < num; n++) {
+                auto idx = m_aliveIds[start + n];
+
+                m_paths.isHit[idx] = ((hitMask & (1 << n)) > 0);
+
+                if (m_paths.isHit[idx]) {
+                    m_paths.recs[idx] = recs[n];
+                    m_paths.objid[idx] = isects[n].objid;
+                }
+            }
+        }
     }
 
     void SortedPathTracing::shadeMiss(
         scene* scene,
-        int depth,
-        Path* paths,
-        int numPath,
-        vec4* dst)
+        uint32_t depth,
+        int numAlive)
     {
+        auto ibl = scene->getIBL();
+
 #ifdef ENABLE_OMP
 #pragma omp parallel for
 #endif
-        for (int i = 0; i < numPath; i++) {
-            auto& path = paths[i];
+        for (int i = 0; i < numAlive; i++) {
+            auto idx = m_aliveIds[i];
 
-            if (path.isAlive && !path.isHit) {
-                PathTracing::shadeMiss(scene, depth, path);
+            if (m_paths.isHit[idx]) {
+                continue;
+            }
 
-                auto idx = path.y * m_width + path.x;
-                dst[idx] += path.camSensitivity * vec4(path.contrib, 1);
+            const auto& r = m_paths.rays[idx];
+            const auto& throughput = m_paths.throughput[idx];
+            auto& contrib = m_paths.contrib[idx];
 
-                path.isAlive = false;
-                path.needWrite = false;
+            if (ibl) {
+                if (depth == 0) {
+                    auto bg = ibl->getEnvMap()->sample(r);
+                    contrib += throughput * bg;
+                    m_paths.isTerminate[idx] = true;
+                }
+                else {
+                    auto pdfb = m_paths.pdfb[idx];
+                    auto pdfLight = ibl->samplePdf(r);
+                    auto misW = pdfb / (pdfLight + pdfb);
+                    auto emit = ibl->getEnvMap()->sample(r);
+                    contrib += throughput * misW * emit;
+                }
+            }
+            else {
+                auto bg = sampleBG(r);
+                contrib += throughput * bg;
+            }
+
+            if (depth < m_startDepth && !m_paths.isTerminate[idx]) {
+                contrib = vec3(0);
             }
+
+            m_paths.isAlive[idx] = false;
         }
     }
 
-    void SortedPathTracing::shade(
-        uint32_t sample,
-        uint32_t depth,
-        Path* paths,
-        ray* rays,
-        ShadowRay* shadowRays,
-        uint32_t* hitIds,
-        int numHit,
-        camera* cam,
-        scene* scene)
+    void SortedPathTracing::sortHits(int numHit)
     {
-        uint32_t rrDepth = m_rrDepth;
+        m_hitIds.resize(numHit);
+        m_sortKeys.resize(numHit);
 
 #ifdef ENABLE_OMP
 #pragma omp parallel for
 #endif
         for (int i = 0; i < numHit; i++) {
-            auto idx = hitIds[i];
+            const auto& rec = m_paths.recs[m_hitIds[i]];
+
+            // NOTE
+            // Invalid material id (-1) comes first.
+            m_sortKeys[i] = (uint64_t)(rec.mtrlid + 1);
+        }
 
-            shadowRays[idx].isActive = false;
+        m_radixSort.sort(m_sortKeys, m_hitIds, 32);
+    }
 
-            auto& path = paths[idx];
+    void SortedPathTracing::makeShadeBatches(int numHit)
+    {
+        // NOTE
+        // The hits are sorted by material, so the consecutive hits which have the same material are grouped.
+        // Even if the hits are not sorted, the batches are valid, but they become small.
+        m_shadeBatches.clear();
 
-            if (!path.isAlive) {
-                continue;
+        for (int i = 0; i < numHit; i++) {
+            auto mtrlid = m_paths.recs[m_hitIds[i]].mtrlid;
+
+            if (m_shadeBatches.empty()
+                || m_shadeBatches.back().mtrlid != mtrlid
+                || m_shadeBatches.back().num == ShadeBatchSize)
+            {
+                ShadeBatch batch;
+                batch.start = i;
+                batch.num = 0;
+                batch.mtrlid = mtrlid;
+
+                m_shadeBatches.push_back(batch);
             }
 
-            auto sampler = path.sampler;
-            bool willContinue = true;
+            m_shadeBatches.back().num++;
+        }
+    }
 
-            uint32_t rrDepth = m_rrDepth;
+    void SortedPathTracing::shade(
+        const context& ctxt,
+        scene* scene,
+        uint32_t depth,
+        int numHit)
+    {
+        makeShadeBatches(numHit);
 
-            // ʒu̖@.
-            // ̂̃C̓ol.
-            vec3 orienting_normal = dot(path.rec.normal, path.ray.dir) < 0.0 ? path.rec.normal : -path.rec.normal;
+        const int numBatch = (int)m_shadeBatches.size();
 
-            auto mtrl = material::getMaterial(path.rec.mtrlid);
+#ifdef ENABLE_OMP
+#pragma omp parallel for schedule(dynamic, 1)
+#endif
+        for (int i = 0; i < numBatch; i++) {
+            shadeBatch(ctxt, scene, depth, m_shadeBatches[i]);
+        }
+    }
 
-            // Apply normal map.
-            mtrl->applyNormalMap(orienting_normal, orienting_normal, path.rec.u, path.rec.v);
+    void SortedPathTracing::shadeBatch(
+        const context& ctxt,
+        scene* scene,
+        uint32_t depth,
+        const ShadeBatch& batch)
+    {
+        const uint32_t rrDepth = m_rrDepth;
+
+        if (batch.mtrlid < 0) {
+            // Nothing can be shaded without material.
+            for (uint32_t n = 0; n < batch.num; n++) {
+                auto idx = m_hitIds[batch.start + n];
+                m_paths.hasShadowRay[idx] = false;
+                m_paths.isAlive[idx] = false;
+            }
+            return;
+        }
 
-            // Implicit conection to light.
-            if (mtrl->isEmissive()) {
-                if (depth == 0) {
-                    // Ray hits the light directly.
-                    path.contrib = mtrl->color();
-                    path.isTerminate = true;
-                    willContinue = false;
-                }
-                else if (path.prevMtrl && path.prevMtrl->isSingular()) {
-                    auto emit = mtrl->color();
-                    path.contrib += path.throughput * emit;
-                    willContinue = false;
-                }
-                else {
-                    auto cosLight = dot(orienting_normal, -path.ray.dir);
-                    auto dist2 = squared_length(path.rec.p - path.ray.org);
+        // NOTE
+        // All hits in the batch have the same material.
+        // The material is evaluated by the switch on its type instead of the virtual functions,
+        // and the same case is taken for all hits in the batch.
+        const auto mtrls = &m_mtrlParams[0];
+        const auto param = &m_mtrlParams[batch.mtrlid];
+        const auto mtrl = ctxt.getMaterial(batch.mtrlid);
 
-                    if (cosLight >= 0) {
-                        auto pdfLight = 1 / path.rec.area;
+        const bool isSingularOrTranslucent = param->attrib.isSingular || param->attrib.isTranslucent;
 
-                        // Convert pdf area to sradian.
-                        // http://www.slideshare.net/h013/edubpt-v100
-                        // p31 - p35
-                        pdfLight = pdfLight * dist2 / cosLight;
+        // Shading points in the batch.
+        MaterialShadingPoint points[ShadeBatchSize];
+        bool willContinue[ShadeBatchSize];
+        real russianProb[ShadeBatchSize];
+
+        // Inputs to connect to the light. They are indexed by the order of the light samples.
+        uint32_t lightIds[ShadeBatchSize];
+        MaterialShadingPoint lightPoints[ShadeBatchSize];
+        vec3 dirToLights[ShadeBatchSize];
+        LightSampleResult lightSamples[ShadeBatchSize];
+        const Light* lights[ShadeBatchSize];
+        real lightSelectPdfs[ShadeBatchSize];
+        vec3 lightBsdfs[ShadeBatchSize];
+        real lightPdfs[ShadeBatchSize];
+        uint32_t numLight = 0;
+
+        // Inputs to sample the next direction. They are indexed by the order of the samples.
+        uint32_t sampleIds[ShadeBatchSize];
+        MaterialShadingPoint samplePoints[ShadeBatchSize];
+        sampler* samplers[ShadeBatchSize];
+        MaterialSampling samplings[ShadeBatchSize];
+        uint32_t numSample = 0;
+
+        for (uint32_t n = 0; n < batch.num; n++) {
+            auto idx = m_hitIds[batch.start + n];
+
+            auto& rec = m_paths.recs[idx];
+            auto& r = m_paths.rays[idx];
+            auto& contrib = m_paths.contrib[idx];
+            auto& throughput = m_paths.throughput[idx];
+            auto& sampler = m_paths.samplers[idx];
+
+            const auto prevMtrl = m_paths.prevMtrl[idx];
 
-                        auto misW = path.pdfb / (pdfLight + path.pdfb);
+            m_paths.hasShadowRay[idx] = false;
 
-                        auto emit = mtrl->color();
+            updateTextureFootprint(rec, r, m_coneSpread, m_paths.coneWidth[idx]);
 
-                        path.contrib += path.throughput * misW * emit;
+            willContinue[n] = true;
 
-                        // When ray hit the light, tracing will finish.
-                        willContinue = false;
+            bool isBackfacing = dot(rec.normal, -r.dir) < real(0);
+
+            vec3 orienting_normal = rec.normal;
+
+            // Implicit conection to light.
+            if (param->attrib.isEmissive) {
+                if (!isBackfacing) {
+                    real weight = real(1);
+
+                    if (depth > 0 && !(prevMtrl && prevMtrl->isSingularOrTranslucent())) {
+                        auto cosLight = dot(orienting_normal, -r.dir);
+                        auto dist2 = aten::squared_length(rec.p - r.org);
+
+                        if (cosLight >= 0) {
+                            auto pdfLight = 1 / rec.area;
+
+                            // Convert pdf area to sradian.
+                            // http://www.slideshare.net/h013/edubpt-v100
+                            // p31 - p35
+                            pdfLight = pdfLight * dist2 / cosLight;
+
+                            // Probability to select this light at the previous hit point.
+                            pdfLight *= scene->getLightSelectPdf(m_paths.objid[idx], r.org, m_paths.prevNormal[idx]);
+
+                            weight = m_paths.pdfb[idx] / (pdfLight + m_paths.pdfb[idx]);
+                        }
                     }
+
+                    contrib += throughput * weight * param->baseColor;
+                }
+
+                if (depth == 0) {
+                    // Ray hits the light directly, so the pixel doesn't need to be traced anymore.
+                    m_paths.isTerminate[idx] = true;
                 }
+                willContinue[n] = false;
             }
+            else {
+                if (!param->attrib.isTranslucent && isBackfacing) {
+                    orienting_normal = -orienting_normal;
+                }
 
-            if (!willContinue) {
-                path.isAlive = false;
-                continue;
+                // Apply normal map.
+                MaterialEvaluator::applyNormalMap(mtrls, param, orienting_normal, orienting_normal, rec.u, rec.v);
+
+                // Non-Photo-Real.
+                if (param->attrib.isNPR) {
+                    contrib = shadeNPR(ctxt, mtrl, rec.p, orienting_normal, rec.u, rec.v, scene, &sampler);
+                    if (depth == 0) {
+                        m_paths.isTerminate[idx] = true;
+                    }
+                    willContinue[n] = false;
+                }
             }
 
+            auto& point = points[n];
+            point.normal = orienting_normal;
+            point.orgnormal = rec.normal;
+            point.wi = r.dir;
+            point.u = rec.u;
+            point.v = rec.v;
+            point.footprint = TextureFootprint::get();
+
             // Explicit conection to light.
-            if (!mtrl->isSingular())
+            // The light is sampled here, and the material is evaluated for all light samples at once.
+            if (willContinue[n] && !isSingularOrTranslucent)
             {
                 real lightSelectPdf = 1;
                 LightSampleResult sampleres;
 
                 auto light = scene->sampleLight(
-                    path.rec.p,
+                    ctxt,
+                    rec.p,
                     orienting_normal,
-                    sampler,
+                    &sampler,
                     lightSelectPdf, sampleres);
 
                 if (light) {
-                    const vec3& posLight = sampleres.pos;
-                    const vec3& nmlLight = sampleres.nml;
-                    real pdfLight = sampleres.pdf;
+                    lightIds[numLight] = n;
+                    lightPoints[numLight] = point;
+                    dirToLights[numLight] = normalize(sampleres.dir);
+                    lightSamples[numLight] = sampleres;
+                    lights[numLight] = light;
+                    lightSelectPdfs[numLight] = lightSelectPdf;
+                    numLight++;
+                }
+            }
 
-                    auto lightobj = sampleres.obj;
+            TextureFootprint::reset();
+        }
 
-                    vec3 dirToLight = normalize(sampleres.dir);
-                    shadowRays[idx] = ShadowRay(path.rec.p, dirToLight);
+        MaterialEvaluator::evalBatch(
+            mtrls, param,
+            lightPoints, dirToLights,
+            numLight,
+            lightBsdfs, lightPdfs);
 
-                    auto cosShadow = dot(orienting_normal, dirToLight);
+        // The shadow ray is tested at the next stage.
+        for (uint32_t l = 0; l < numLight; l++) {
+            auto n = lightIds[l];
+            auto idx = m_hitIds[batch.start + n];
 
-                    auto bsdf = mtrl->bsdf(orienting_normal, path.ray.dir, dirToLight, path.rec.u, path.rec.v);
-                    auto pdfb = mtrl->pdf(orienting_normal, path.ray.dir, dirToLight, path.rec.u, path.rec.v);
+            const auto& rec = m_paths.recs[idx];
+            const auto& orienting_normal = points[n].normal;
 
-                    bsdf *= path.throughput;
+            const auto& sampleres = lightSamples[l];
+            const auto light = lights[l];
+            const auto lightSelectPdf = lightSelectPdfs[l];
 
-                    // Get light color.
-                    auto emit = sampleres.finalColor;
+            const vec3& posLight = sampleres.pos;
+            const vec3& nmlLight = sampleres.nml;
+            real pdfLight = sampleres.pdf;
 
-                    path.lightPos = posLight;
-                    path.targetLight = light;
-                    path.lightcontrib = vec3(0);
+            const vec3& dirToLight = dirToLights[l];
 
-                    if (light->isSingular() || light->isInfinite()) {
-                        if (pdfLight > real(0)) {
-                            // TODO
-                            // WIg^[̈ɂ.
-                            // singular light ̏ꍇ́AfinalColor ɋ̏Z܂܂Ă.
-                            // inifinite light ̏ꍇ́AɂȂApdfLightɊ܂܂鋗ƑłH.
-                            // ił̂ŁApdfLightɂ͋͊܂łȂj.
-                            auto misW = pdfLight / (pdfb + pdfLight);
-                            path.lightcontrib  = (misW * bsdf * emit * cosShadow / pdfLight) / lightSelectPdf;
-                        }
-                    }
-                    else {
-                        auto cosLight = dot(nmlLight, -dirToLight);
+            auto shadowRayOrg = rec.p + AT_MATH_EPSILON * orienting_normal;
+            auto tmp = rec.p + dirToLight - shadowRayOrg;
+            auto shadowRayDir = normalize(tmp);
 
-                        if (cosShadow >= 0 && cosLight >= 0) {
-                            auto dist2 = squared_length(sampleres.dir);
-                            auto G = cosShadow * cosLight / dist2;
+            auto cosShadow = dot(orienting_normal, dirToLight);
 
-                            if (pdfb > real(0) && pdfLight > real(0)) {
-                                // Convert pdf from steradian to area.
-                                // http://www.slideshare.net/h013/edubpt-v100
-                                // p31 - p35
-                                pdfb = pdfb * cosLight / dist2;
+            auto bsdf = lightBsdfs[l];
+            auto pdfb = lightPdfs[l];
 
-                                auto misW = pdfLight / (pdfb + pdfLight);
+            bsdf *= m_paths.throughput[idx];
 
-                                path.lightcontrib = (misW * (bsdf * emit * G) / pdfLight) / lightSelectPdf;
-                            }
-                        }
+            // Get light color.
+            auto emit = sampleres.finalColor;
+
+            vec3 lightcontrib(0);
+            bool hasContrib = false;
+
+            if (light->isSingular() || light->isInfinite()) {
+                if (pdfLight > real(0) && cosShadow >= 0) {
+                    auto misW = pdfLight / (pdfb + pdfLight);
+                    lightcontrib = (misW * bsdf * emit * cosShadow / pdfLight) / lightSelectPdf;
+                    hasContrib = true;
+                }
+            }
+            else {
+                auto cosLight = dot(nmlLight, -dirToLight);
+
+                if (cosShadow >= 0 && cosLight >= 0) {
+                    auto dist2 = squared_length(sampleres.dir);
+                    auto G = cosShadow * cosLight / dist2;
+
+                    if (pdfb > real(0) && pdfLight > real(0)) {
+                        // Convert pdf from steradian to area.
+                        // http://www.slideshare.net/h013/edubpt-v100
+                        // p31 - p35
+                        pdfb = pdfb * cosLight / dist2;
+
+                        auto misW = (pdfLight * lightSelectPdf) / (pdfb + pdfLight * lightSelectPdf);
+
+                        lightcontrib = (misW * (bsdf * emit * G) / pdfLight) / lightSelectPdf;
+                        hasContrib = true;
                     }
                 }
             }
 
-            real russianProb = real(1);
+            if (hasContrib) {
+                m_paths.shadowRays[idx] = ray(shadowRayOrg, shadowRayDir);
+                m_paths.lightcontrib[idx] = lightcontrib;
+                m_paths.lightPos[idx] = posLight;
+                m_paths.targetLight[idx] = light;
+                m_paths.hasShadowRay[idx] = true;
+            }
+        }
+
+        // Russian roulette.
+        for (uint32_t n = 0; n < batch.num; n++) {
+            if (!willContinue[n]) {
+                continue;
+            }
+
+            auto idx = m_hitIds[batch.start + n];
+
+            russianProb[n] = real(1);
 
             if (depth > rrDepth) {
-                auto t = normalize(path.throughput);
+                auto t = normalize(m_paths.throughput[idx]);
                 auto p = std::max(t.r, std::max(t.g, t.b));
 
-                russianProb = sampler->nextSample();
+                russianProb[n] = m_paths.samplers[idx].nextSample();
 
-                if (russianProb >= p) {
-                    path.contrib = vec3();
-                    willContinue = false;
+                if (russianProb[n] >= p) {
+                    // Same as PathTracing, the contribution of the path is discarded.
+                    m_paths.contrib[idx] = vec3();
+                    m_paths.hasShadowRay[idx] = false;
+                    willContinue[n] = false;
+                    continue;
                 }
                 else {
-                    russianProb = p;
+                    russianProb[n] = p;
                 }
             }
 
-            auto sampling = mtrl->sample(path.ray, orienting_normal, path.rec.normal, sampler, path.rec.u, path.rec.v);
+            sampleIds[numSample] = n;
+            samplePoints[numSample] = points[n];
+            samplers[numSample] = &m_paths.samplers[idx];
+            numSample++;
+        }
+
+        // NOTE
+        // Each path has its own sampler, so the order of the samples per path is the same as the per path shading.
+        MaterialEvaluator::sampleBatch(
+            mtrls, param,
+            samplePoints, samplers,
+            numSample,
+            samplings);
+
+        for (uint32_t s = 0; s < numSample; s++) {
+            auto n = sampleIds[s];
+            auto idx = m_hitIds[batch.start + n];
+
+            const auto& rec = m_paths.recs[idx];
+            const auto& orienting_normal = points[n].normal;
+            const auto& sampling = samplings[s];
 
             auto nextDir = normalize(sampling.dir);
             auto pdfb = sampling.pdf;
             auto bsdf = sampling.bsdf;
 
             real c = 1;
-            if (!mtrl->isSingular()) {
-                // TODO
-                // AMD̂absĂ邪....
-                //c = aten::abs(dot(orienting_normal, nextDir));
-                c = dot(orienting_normal, nextDir);
+            if (!param->attrib.isSingular) {
+                c = aten::abs(dot(orienting_normal, nextDir));
             }
 
             if (pdfb > 0 && c > 0) {
-                path.throughput *= bsdf * c / pdfb;
-                path.throughput /= russianProb;
-            }
-            else {
-                willContinue = false;
-            }
-
-            path.prevMtrl = mtrl;
+                auto& throughput = m_paths.throughput[idx];
 
-            path.pdfb = pdfb;
+                throughput *= bsdf * c / pdfb;
+                throughput /= russianProb[n];
 
-            // Make next ray.
-            rays[idx] = aten::ray(path.rec.p, nextDir);
+                m_paths.prevMtrl[idx] = mtrl;
+                m_paths.prevNormal[idx] = orienting_normal;
+                m_paths.pdfb[idx] = pdfb;
 
-            if (!willContinue) {
-                path.isAlive = false;
+                // Make next ray.
+                m_paths.rays[idx] = aten::ray(rec.p, nextDir);
+            }
+            else {
+                willContinue[n] = false;
             }
         }
-    }
 
-    void SortedPathTracing::hitShadowRays(
-        const Path* paths,
-        ShadowRay* shadowrays,
-        int numRay,
-        scene* scene)
-    {
-#ifdef ENABLE_OMP
-#pragma omp parallel for
-#endif
-        for (int i = 0; i < numRay; i++) {
-            auto& shadowRay = shadowrays[i];
-
-            if (shadowRay.isActive) {
-                const auto& path = paths[i];
-
-                hitrecord rec;
-                shadowRay.isActive = scene->hitLight(
-                    path.targetLight,
-                    path.lightPos,
-                    shadowRay,
-                    AT_MATH_EPSILON, AT_MATH_INF, rec);
+        for (uint32_t n = 0; n < batch.num; n++) {
+            auto idx = m_hitIds[batch.start + n];
+
+            if (depth < m_startDepth && !m_paths.isTerminate[idx]) {
+                m_paths.contrib[idx] = vec3(0);
+                m_paths.hasShadowRay[idx] = false;
             }
+
+            m_paths.isAlive[idx] = willContinue[n];
         }
     }
 
-    void SortedPathTracing::evalExplicitLight(
-        Path* paths,
-        const ShadowRay* shadowRays,
-        uint32_t* hitIds,
+    void SortedPathTracing::hitShadowRays(
+        const context& ctxt,
+        scene* scene,
         int numHit)
     {
 #ifdef ENABLE_OMP
 #pragma omp parallel for
 #endif
         for (int i = 0; i < numHit; i++) {
-            auto idx = hitIds[i];
+            auto idx = m_hitIds[i];
 
-            auto& path = paths[idx];
+            if (!m_paths.hasShadowRay[idx]) {
+                continue;
+            }
 
-            const auto& shadowRay = shadowRays[idx];
+            bool isVisible = scene->isLightVisible(
+                ctxt,
+                m_paths.targetLight[idx],
+                m_paths.lightPos[idx],
+                m_paths.shadowRays[idx],
+                AT_MATH_EPSILON);
 
-            if (shadowRay.isActive) {
-                path.contrib += path.lightcontrib;
+            if (isVisible) {
+                m_paths.contrib[idx] += m_paths.lightcontrib[idx];
             }
+
+            m_paths.hasShadowRay[idx] = false;
         }
     }
 
-    void SortedPathTracing::gather(
-        Path* paths,
-        int numPath,
-        vec4* dst)
+    void SortedPathTracing::gather(int width, int height)
     {
 #ifdef ENABLE_OMP
 #pragma omp parallel for
 #endif
-        for (int i = 0; i < numPath; i++) {
-            auto& path = paths[i];
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                int idx = y * width + x;
+
+                if (!m_paths.isTraced[idx]) {
+                    continue;
+                }
 
-            if (path.needWrite) {
-                dst[i] += path.camSensitivity * vec4(path.contrib, 1);
+                const auto& contrib = m_paths.contrib[idx];
 
-                path.needWrite = false;
+                if (isInvalidColor(contrib)) {
+                    AT_PRINTF("Invalid(%d/%d)\n", x, y);
+                    continue;
+                }
+
+                auto c = contrib * m_paths.camWeight[idx];
+
+                m_color[idx] += c;
+                m_color2[idx] += c * c;
+                m_count[idx]++;
             }
         }
     }
 
-    void SortedPathTracing::render(
+    void SortedPathTracing::onRender(
+        const context& ctxt,
         Destination& dst,
         scene* scene,
         camera* camera)
     {
-        m_width = dst.width;
-        m_height = dst.height;
+        m_frame++;
 
-        if (m_tmpbuffer.size() == 0) {
-            m_tmpbuffer.resize(m_width * m_height);
-        }
-        
-        vec4* color = &m_tmpbuffer[0];
-        memset(color, 0, m_tmpbuffer.size() * sizeof(vec4));
+        int width = dst.width;
+        int height = dst.height;
+        uint32_t samples = dst.sample;
 
-        m_samples = dst.sample;
         m_maxDepth = dst.maxDepth;
         m_rrDepth = dst.russianRouletteDepth;
+        m_startDepth = dst.startDepth;
 
         if (m_rrDepth > m_maxDepth) {
             m_rrDepth = m_maxDepth - 1;
         }
 
-        std::vector<Path> paths(m_width * m_height);
-        std::vector<ray> rays(m_width * m_height);
-        std::vector<ShadowRay> shadowRays(m_width * m_height);
-        std::vector<uint32_t> hitIds(m_width * m_height);
+        const int numPath = width * height;
+
+        m_paths.resize(numPath);
+
+        // Material parameters to evaluate the materials without the virtual functions.
+        m_mtrlParams.clear();
+        ctxt.copyMaterialParameters(m_mtrlParams);
+
+        m_aliveIds.resize(numPath);
+        m_hitIds.resize(numPath);
+
+        m_color.assign(numPath, vec3(0));
+        m_color2.assign(numPath, vec3(0));
+        m_count.assign(numPath, 0);
+
+        std::fill(m_paths.isTerminate.begin(), m_paths.isTerminate.end(), 0);
+
+        m_elapsed = ElapsedTime();
+
+        timer timer;
+
+        for (uint32_t i = 0; i < samples; i++) {
+            timer.begin();
+            makePaths(width, height, i, camera);
+            m_elapsed.makePaths += timer.end();
 
-        for (uint32_t i = 0; i < m_samples; i++) {
-            makePaths(
-                m_width, m_height, i,
-                &paths[0],
-                &rays[0],
-                camera);
+            // NOTE
+            // The alive ids are shrinked at the previous sample.
+            m_aliveIds.resize(numPath);
+
+            timer.begin();
+            int numAlive = m_compaction.compact(&m_aliveIds[0], &m_paths.isAlive[0], numPath);
+            m_elapsed.compaction += timer.end();
 
             uint32_t depth = 0;
 
-            while (depth < m_maxDepth) {
-                hitPaths(
-                    &paths[0],
-                    &rays[0],
-                    (int)paths.size(),
-                    scene);
+            while (depth < m_maxDepth && numAlive > 0) {
+                if (m_enableRaySort) {
+                    timer.begin();
+                    sortRays(numAlive);
+                    m_elapsed.sortRays += timer.end();
+                }
+
+                timer.begin();
+                hitPaths(ctxt, scene, numAlive);
+                m_elapsed.hitPaths += timer.end();
 
-                auto numHit = compactionPaths(
-                    &paths[0],
-                    (int)paths.size(),
-                    &hitIds[0]);
+                timer.begin();
+                shadeMiss(scene, depth, numAlive);
+                m_elapsed.shadeMiss += timer.end();
 
-                shadeMiss(
-                    scene, depth,
-                    &paths[0], (int)paths.size(), color);
+                timer.begin();
+                m_hitIds.resize(numAlive);
+                int numHit = m_compaction.compact(&m_hitIds[0], &m_aliveIds[0], &m_paths.isHit[0], numAlive);
+                m_elapsed.compaction += timer.end();
 
                 if (numHit == 0) {
                     break;
                 }
 
-                shade(
-                    i,
-                    depth,
-                    &paths[0],
-                    &rays[0],
-                    &shadowRays[0],
-                    &hitIds[0],
-                    numHit,
-                    camera,
-                    scene);
-
-                hitShadowRays(&paths[0], &shadowRays[0], shadowRays.size(), scene);
-
-                evalExplicitLight(
-                    &paths[0],
-                    &shadowRays[0],
-                    &hitIds[0],
-                    numHit);
+                if (m_enableMaterialSort) {
+                    timer.begin();
+                    sortHits(numHit);
+                    m_elapsed.sortHits += timer.end();
+                }
+
+                timer.begin();
+                shade(ctxt, scene, depth, numHit);
+                m_elapsed.shade += timer.end();
+
+                timer.begin();
+                hitShadowRays(ctxt, scene, numHit);
+                m_elapsed.hitShadowRays += timer.end();
+
+                timer.begin();
+                numAlive = m_compaction.compact(&m_aliveIds[0], &m_hitIds[0], &m_paths.isAlive[0], numHit);
+                m_elapsed.compaction += timer.end();
 
                 depth++;
             }
 
-            gather(&paths[0], (int)paths.size(), color);
+            timer.begin();
+            gather(width, height);
+            m_elapsed.gather += timer.end();
         }
 
 #ifdef ENABLE_OMP
 #pragma omp parallel for
 #endif
-        for (int y = 0; y < m_height; y++) {
-            for (int x = 0; x < m_width; x++) {
-                auto pos = y * m_width + x;
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                int idx = y * width + x;
 
-                auto& clr = color[pos];
+                auto cnt = (real)std::max<uint32_t>(m_count[idx], 1);
 
-                clr.r /= clr.w;
-                clr.g /= clr.w;
-                clr.b /= clr.w;
-                clr.w = 1;
+                auto col = m_color[idx] / cnt;
 
-                dst.buffer->put(x, y, clr);
+                dst.buffer->put(x, y, vec4(col, 1));
+
+                if (dst.variance) {
+                    auto col2 = m_color2[idx] / cnt;
+                    dst.variance->put(x, y, vec4(col2 - col * col, real(1)));
+                }
             }
         }
     }
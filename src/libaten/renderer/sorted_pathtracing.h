@@ -1,124 +1,203 @@
 #pragma once
 
+#include <vector>
+
 #include "renderer/pathtracing.h"
 #include "math/vec4.h"
+#include "material/material_evaluator.h"
+#include "misc/radixsort.h"
+#include "misc/streamcompaction.h"
+#include "sampler/cmj.h"
 
 namespace aten
 {
+    /**
+     * @brief Wavefront path tracer.
+     *
+     * All paths in the image are advanced bounce by bounce with the separated stages
+     * (hit test, miss shading, shading, shadow ray test) like idaten.
+     * Before the hit test, rays are sorted by Morton code of the origin and the direction,
+     * and they are traced as the packets of the neighbours in the sorted order.
+     * Before shading, hits are sorted by material.
+     * The sorted hits are shaded as the batches which have the same material,
+     * and the material is evaluated by the switch on its type over the parameter array.
+     * The alive paths are gathered with stream compaction after each stage.
+     *
+     * @note Virtual light is not supported.
+     */
     class SortedPathTracing : public PathTracing {
     public:
         SortedPathTracing() {}
         ~SortedPathTracing() {}
 
-        virtual void render(
+        virtual void onRender(
+            const context& ctxt,
             Destination& dst,
             scene* scene,
             camera* camera) override final;
 
-    private:
-        struct Path : public PathTracing::Path {
-            CameraSampleResult camsample;
-            real camSensitivity;
-
-            uint32_t x, y;
-            aten::sampler* sampler{ nullptr };
-
-            vec3 lightcontrib;
-            vec3 lightPos;
-            Light* targetLight;
-            
-            struct {
-                uint32_t isHit        : 1;
-                uint32_t isAlive    : 1;
-                uint32_t needWrite    : 1;
-            };
-
-            Path()
-            {
-                isHit = false;
-                isAlive = true;
-                needWrite = true;
-            }
+        /**
+         * @brief Enable to sort rays before the hit test.
+         */
+        void enableRaySort(bool enable)
+        {
+            m_enableRaySort = enable;
+        }
+
+        /**
+         * @brief Enable to sort hits by material before shading.
+         */
+        void enableMaterialSort(bool enable)
+        {
+            m_enableMaterialSort = enable;
+        }
+
+        /**
+         * @brief Elapsed time per stage at the latest rendering [ms].
+         */
+        struct ElapsedTime {
+            real makePaths{ 0 };
+            real sortRays{ 0 };
+            real hitPaths{ 0 };
+            real shadeMiss{ 0 };
+            real sortHits{ 0 };
+            real shade{ 0 };
+            real hitShadowRays{ 0 };
+            real compaction{ 0 };
+            real gather{ 0 };
         };
 
-        struct ShadowRay : aten::ray {
-            ShadowRay() : ray()
-            {
-                isActive = true;
-            }
-            ShadowRay(const vec3& o, const vec3& d) : ray(o, d)
-            {
-                isActive = true;
-            }
-
-            struct {
-                uint32_t isActive : 1;
-            };
+        /**
+         * @brief Return elapsed time per stage at the latest rendering.
+         */
+        const ElapsedTime& getElapsedTime() const
+        {
+            return m_elapsed;
+        }
+
+    private:
+        /**
+         * @brief Path states as SoA, which are indexed by the path id (= pixel index).
+         */
+        struct Paths {
+            std::vector<vec3> contrib;
+            std::vector<vec3> throughput;
+            std::vector<real> pdfb;
+            std::vector<const material*> prevMtrl;
+
+            // Normal at the previous hit point, and object which the ray hits.
+            // They are used to compute the probability to select the hit light.
+            std::vector<vec3> prevNormal;
+            std::vector<int> objid;
+
+            // Width of the ray cone to compute the footprint on the textures.
+            std::vector<real> coneWidth;
+
+            std::vector<ray> rays;
+            std::vector<hitrecord> recs;
+
+            std::vector<CMJ> samplers;
+
+            // Camera sensitivity divided by pdf of the camera sample.
+            std::vector<real> camWeight;
+
+            std::vector<uint8_t> isHit;
+            std::vector<uint8_t> isAlive;
+            std::vector<uint8_t> isTerminate;
+            std::vector<uint8_t> isTraced;  ///< Flag if the path is traced at the current sample.
+
+            // Shadow ray for explicit connection to light.
+            std::vector<ray> shadowRays;
+            std::vector<vec3> lightcontrib;
+            std::vector<vec3> lightPos;
+            std::vector<const Light*> targetLight;
+            std::vector<uint8_t> hasShadowRay;
+
+            void resize(uint32_t num);
         };
 
         void makePaths(
             int width, int height,
-            int sample,
-            Path* paths,
-            ray* rays,
+            uint32_t sample,
             camera* camera);
 
-        void hitPaths(
-            Path* paths,
-            const ray* rays,
-            int numPath,
-            scene* scene);
+        void sortRays(int numAlive);
 
-        int compactionPaths(
-            Path* paths,
-            int numPath,
-            uint32_t* hitIds);
+        void hitPaths(
+            const context& ctxt,
+            scene* scene,
+            int numAlive);
 
         void shadeMiss(
             scene* scene,
-            int depth,
-            Path* paths,
-            int numPath,
-            vec4* dst);
+            uint32_t depth,
+            int numAlive);
+
+        void sortHits(int numHit);
+
+        /**
+         * @brief Consecutive hits in the hit ids which have the same material.
+         */
+        struct ShadeBatch {
+            uint32_t start;
+            uint32_t num;
+            int mtrlid;
+        };
+
+        static const uint32_t ShadeBatchSize = 64;
+
+        void makeShadeBatches(int numHit);
 
         void shade(
-            uint32_t sample,
+            const context& ctxt,
+            scene* scene,
             uint32_t depth,
-            Path* paths,
-            ray* rays,
-            ShadowRay* shadowRays,
-            uint32_t* hitIds,
-            int numHit,
-            camera* cam,
-            scene* scene);
+            int numHit);
+
+        void shadeBatch(
+            const context& ctxt,
+            scene* scene,
+            uint32_t depth,
+            const ShadeBatch& batch);
 
         void hitShadowRays(
-            const Path* paths,
-            ShadowRay* shadowrays,
-            int numRay,
-            scene* scene);
-
-        void evalExplicitLight(
-            Path* paths,
-            const ShadowRay* shadowRays,
-            uint32_t* hitIds,
+            const context& ctxt,
+            scene* scene,
             int numHit);
 
-        void gather(
-            Path* paths,
-            int numPath,
-            vec4* dst);
+        void gather(int width, int height);
 
     private:
-        uint32_t m_maxDepth{ 1 };
+        Paths m_paths;
+
+        // Ids of the alive paths.
+        std::vector<uint32_t> m_aliveIds;
+
+        // Ids of the paths which hit something.
+        std::vector<uint32_t> m_hitIds;
+
+        // Keys to sort rays and hits.
+        std::vector<uint64_t> m_sortKeys;
+
+        std::vector<ShadeBatch> m_shadeBatches;
+
+        // Copy of the material parameters in the context.
+        std::vector<MaterialParameter> m_mtrlParams;
+
+        RadixSort<uint64_t> m_radixSort;
+        StreamCompaction m_compaction;
+
+        // Accumulated color per pixel.
+        std::vector<vec3> m_color;
+        std::vector<vec3> m_color2;
+        std::vector<uint32_t> m_count;
 
-        // Depth to compute russinan roulette.
-        uint32_t m_rrDepth{ 1 };
+        bool m_enableRaySort{ true };
+        bool m_enableMaterialSort{ true };
 
-        uint32_t m_samples{ 1 };
+        // Spread angle of the ray cone. It is constant for all paths.
+        real m_coneSpread{ 0 };
 
-        std::vector<vec4> m_tmpbuffer;
-        int m_width{ 0 };
-        int m_height{ 0 };
+        ElapsedTime m_elapsed;
     };
 }
@@ -0,0 +1,68 @@
+#include <algorithm>
+
+#include "renderer/splatfilm.h"
+
+namespace aten
+{
+    const uint32_t SplatFilm::BufferSize;
+    const int SplatFilm::BlockHeight;
+
+    void SplatFilm::init(int width, int height, uint32_t threadNum)
+    {
+        m_width = width;
+        m_height = height;
+
+        m_image.assign(width * height, vec3(0));
+
+        m_buffers.resize(threadNum);
+        for (auto& buffer : m_buffers) {
+            buffer.clear();
+            buffer.reserve(BufferSize);
+        }
+
+        int blockNum = (height + BlockHeight - 1) / BlockHeight;
+        blockNum = std::max(blockNum, 1);
+
+        if (blockNum != m_blockNum) {
+            m_locks.reset(new std::mutex[blockNum]);
+            m_blockNum = blockNum;
+        }
+    }
+
+    void SplatFilm::flush(int threadIdx)
+    {
+        auto& buffer = m_buffers[threadIdx];
+
+        if (buffer.empty()) {
+            return;
+        }
+
+        // Sort by the pixel, so the splats in the same block are flushed with one lock.
+        std::sort(
+            buffer.begin(), buffer.end(),
+            [](const Splat& a, const Splat& b) { return a.pos < b.pos; });
+
+        const int blockPixels = m_width * BlockHeight;
+
+        size_t i = 0;
+
+        while (i < buffer.size()) {
+            const int block = buffer[i].pos / blockPixels;
+
+            std::lock_guard<std::mutex> lock(m_locks[block]);
+
+            for (; i < buffer.size() && buffer[i].pos / blockPixels == block; i++) {
+                m_image[buffer[i].pos] += buffer[i].v;
+            }
+        }
+
+        buffer.clear();
+    }
+
+    void SplatFilm::flushAll()
+    {
+        for (int i = 0; i < (int)m_buffers.size(); i++) {
+            flush(i);
+        }
+    }
+}
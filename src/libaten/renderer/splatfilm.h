@@ -0,0 +1,100 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "defs.h"
+#include "types.h"
+#include "math/vec3.h"
+
+namespace aten
+{
+    /**
+     * @brief Film which is shared by the threads to splat the contributions to any pixel.
+     *
+     * The splats are buffered per thread, and they are flushed to the film when the buffer is full.
+     * The film is divided into the blocks of BlockHeight rows, and each block has its own lock.
+     * The buffered splats are sorted by the pixel and flushed block by block,
+     * so the threads which splat to the different regions don't wait for each other.
+     */
+    class SplatFilm {
+    public:
+        SplatFilm() {}
+        ~SplatFilm() {}
+
+        SplatFilm(const SplatFilm&) = delete;
+        SplatFilm& operator=(const SplatFilm&) = delete;
+
+    public:
+        /**
+         * @brief Initialize the film and clear it.
+         * @param threadNum Number of the threads which splat to the film.
+         */
+        void init(int width, int height, uint32_t threadNum);
+
+        /**
+         * @brief Splat the value to the pixel.
+         * @param threadIdx Index of the thread which splats.
+         * @param pos Index of the pixel (y * width + x).
+         */
+        void splat(int threadIdx, int pos, const vec3& v)
+        {
+            AT_ASSERT(0 <= pos && pos < (int)m_image.size());
+
+            auto& buffer = m_buffers[threadIdx];
+
+            buffer.push_back(Splat(pos, v));
+
+            if (buffer.size() >= BufferSize) {
+                flush(threadIdx);
+            }
+        }
+
+        /**
+         * @brief Flush the buffered splats of the thread to the film.
+         */
+        void flush(int threadIdx);
+
+        /**
+         * @brief Flush the buffered splats of all threads.
+         * @note It must not be called while the threads splat.
+         */
+        void flushAll();
+
+        const vec3& at(int pos) const
+        {
+            return m_image[pos];
+        }
+
+        int width() const
+        {
+            return m_width;
+        }
+
+        int height() const
+        {
+            return m_height;
+        }
+
+    private:
+        static const uint32_t BufferSize = 4096;
+        static const int BlockHeight = 16;
+
+        struct Splat {
+            int pos;
+            vec3 v;
+
+            Splat(int _pos, const vec3& _v) : pos(_pos), v(_v) {}
+        };
+
+        std::vector<vec3> m_image;
+        int m_width{ 0 };
+        int m_height{ 0 };
+
+        std::vector<std::vector<Splat>> m_buffers;
+
+        std::unique_ptr<std::mutex[]> m_locks;
+        int m_blockNum{ 0 };
+    };
+}
@@ -7,6 +7,13 @@ namespace aten
 {
     const context* context::s_pinnedCtxt = nullptr;
 
+    context::~context()
+    {
+        for (auto block : m_triBlocks) {
+            delete[] block;
+        }
+    }
+
     void context::build()
     {
         if (!m_vertices.empty()
@@ -84,31 +91,21 @@ namespace aten
         auto& materials = m_materials.getList();
 
         for (const auto item : materials) {
-            auto mtrl = item->getData();
-            dst.push_back(mtrl->param());
+            // Keep the empty handle of the removed material not to change the indices of the others.
+            if (item) {
+                auto mtrl = item->getData();
+                dst.push_back(mtrl->param());
+            }
+            else {
+                dst.push_back(MaterialParameter(aten::MaterialType::Lambert, MaterialAttributeLambert));
+            }
         }
     }
 
     const material* context::findMaterialByName(const char* name) const
     {
-        std::string strname(name);
-
-        auto& materials = m_materials.getList();
-
-        auto found = std::find_if(
-            materials.begin(), materials.end(),
-            [&](const aten::DataList<aten::material>::ListItem* item) {
-            auto mtrl = item->getData();
-            return mtrl->nameString() == strname;
-        });
-
-        if (found != materials.end()) {
-            auto* item = *found;
-            auto mtrl = item->getData();
-            return mtrl;
-        }
-
-        return nullptr;
+        int idx = m_materials.findIndexByName(name);
+        return idx >= 0 ? m_materials[idx] : nullptr;
     }
 
     int context::findMaterialIdxByName(const char* name) const
@@ -122,61 +119,103 @@ namespace aten
 
     AT_NAME::face* context::createTriangle(const aten::PrimitiveParamter& param)
     {
-        auto f = AT_NAME::face::create(*this, param);
-        AT_ASSERT(f);
-        
-        if (f) {
-            addTriangle(f);
+        const int idx = getTriangleNum();
+
+        m_triParams.push_back(param);
+
+        if (m_enableTriEdges) {
+            m_triEdges.push_back(TriangleEdges());
+        }
+
+        if (idx % TriangleBlockSize == 0) {
+            auto block = new AT_NAME::face[TriangleBlockSize];
+            AT_ASSERT(block);
+
+            m_triBlockIdx.insert(std::make_pair(block, (int)m_triBlocks.size()));
+            m_triBlocks.push_back(block);
         }
 
+        auto f = &m_triBlocks[idx / TriangleBlockSize][idx % TriangleBlockSize];
+
+        f->m_ctxt = this;
+        f->m_id = idx;
+
+        f->build(*this, param.mtrlid, param.gemoid);
+
         return f;
     }
 
-    void context::addTriangle(AT_NAME::face* tri)
+    const AT_NAME::face* context::getTriangle(int idx) const
     {
-        tri->addToDataList(m_triangles);
+        AT_ASSERT(0 <= idx && idx < getTriangleNum());
+        return &m_triBlocks[idx / TriangleBlockSize][idx % TriangleBlockSize];
     }
 
-    int context::getTriangleNum() const
+    void context::enableTriangleEdges(bool enable)
     {
-        return m_triangles.size();
+        if (m_enableTriEdges == enable) {
+            return;
+        }
+
+        m_enableTriEdges = enable;
+
+        if (enable) {
+            m_triEdges.resize(m_triParams.size());
+
+            for (int i = 0; i < getTriangleNum(); i++) {
+                updateTriangleEdges(i);
+            }
+        }
+        else {
+            std::vector<TriangleEdges>().swap(m_triEdges);
+        }
     }
 
-    const AT_NAME::face* context::getTriangle(int idx) const
+    void context::updateTriangleEdges(int idx)
     {
-        AT_ASSERT(0 <= idx && idx < getTriangleNum());
-        return m_triangles[idx];
+        if (!m_enableTriEdges) {
+            return;
+        }
+
+        const auto& param = getTriangleParam(idx);
+
+        const auto& v0 = getVertex(param.idx[0]);
+        const auto& v1 = getVertex(param.idx[1]);
+        const auto& v2 = getVertex(param.idx[2]);
+
+        auto& edges = m_triEdges[idx];
+
+        edges.v0 = v0.pos;
+        edges.e1 = v1.pos - v0.pos;
+        edges.e2 = v2.pos - v0.pos;
     }
 
     void context::copyPrimitiveParameters(std::vector<aten::PrimitiveParamter>& dst) const
     {
-        auto& triangles = m_triangles.getList();
-
-        for (const auto item : triangles) {
-            const auto tri = item->getData();
-            dst.push_back(tri->getParam());
-        }
+        dst.insert(dst.end(), m_triParams.begin(), m_triParams.end());
     }
 
     int context::findTriIdxFromPointer(const void* p) const
     {
-        auto& triangles = m_triangles.getList();
+        const auto f = reinterpret_cast<const AT_NAME::face*>(p);
 
-        auto found = std::find_if(
-            triangles.begin(), triangles.end(),
-            [&](const aten::DataList<aten::face>::ListItem* item) {
-            const auto tri = item->getData();
-            return tri == p;
-        });
+        // Find the block which has the largest address not greater than the pointer.
+        auto it = m_triBlockIdx.upper_bound(f);
+        if (it == m_triBlockIdx.begin()) {
+            return -1;
+        }
+
+        --it;
 
-        int id = -1;
+        const auto block = it->first;
 
-        if (found != triangles.end()) {
-            const auto tri = (*found)->getData();
-            id = tri->getId();
+        if (f >= block + TriangleBlockSize) {
+            return -1;
         }
 
-        return id;
+        int id = it->second * TriangleBlockSize + (int)(f - block);
+
+        return id < getTriangleNum() ? id : -1;
     }
 
     void context::addTransformable(aten::transformable* t)
@@ -200,6 +239,10 @@ namespace aten
         auto& shapes = m_transformables.getList();
 
         for (auto s : shapes) {
+            if (!s) {
+                continue;
+            }
+
             auto t = s->getData();
 
             auto type = t->getType();
@@ -228,23 +271,7 @@ namespace aten
 
     int context::findTransformableIdxFromPointer(const void* p) const
     {
-        auto& shapes = m_transformables.getList();
-
-        auto found = std::find_if(
-            shapes.begin(), shapes.end(),
-            [&](const aten::DataList<aten::transformable>::ListItem* item) {
-            const auto t = item->getData();
-            return t == p;
-        });
-
-        int id = -1;
-
-        if (found != shapes.end()) {
-            const auto t = (*found)->getData();
-            id = t->id();
-        }
-
-        return id;
+        return m_transformables.findIndex(p);
     }
 
     int context::findPolygonalTransformableOrderFromPointer(const void* p) const
@@ -254,6 +281,10 @@ namespace aten
         int order = -1;
 
         for (const auto item : shapes) {
+            if (!item) {
+                continue;
+            }
+
             const auto t = item->getData();
 
             auto type = t->getType();
@@ -271,9 +302,12 @@ namespace aten
         return order;
     }
     
-    texture* context::createTexture(uint32_t width, uint32_t height, uint32_t channels, const char* name)
+    texture* context::createTexture(
+        uint32_t width, uint32_t height, uint32_t channels,
+        const char* name,
+        texture::Format format/*= texture::Format::RGBA32F*/)
     {
-        auto ret = texture::create(width, height, channels, name);
+        auto ret = texture::create(width, height, channels, name, format);
         AT_ASSERT(ret);
 
         addTexture(ret);
@@ -311,7 +345,9 @@ namespace aten
 
         for (int i = 0; i < num; i++) {
             auto tex = m_textures[i];
-            tex->initAsGLTexture();
+            if (tex) {
+                tex->initAsGLTexture();
+            }
         }
     }
 }
@@ -3,6 +3,8 @@
 #include <vector>
 #include <algorithm>
 #include <iterator>
+#include <functional>
+#include <map>
 
 #include "geometry/vertex.h"
 #include "visualizer/GeomDataBuffer.h"
@@ -19,10 +21,19 @@ namespace aten
 {
     class transformable;
 
+    /**
+     * @brief First vertex position and edges of the triangle which are precomputed for the hit test.
+     */
+    struct TriangleEdges {
+        aten::vec3 v0;
+        aten::vec3 e1;  ///< Edge from the first vertex to the second vertex.
+        aten::vec3 e2;  ///< Edge from the first vertex to the third vertex.
+    };
+
     class context {
     public:
         context() {}
-        virtual ~context() {}
+        virtual ~context();
 
     public:
         void addVertex(const aten::vertex& vtx)
@@ -30,6 +41,14 @@ namespace aten
             m_vertices.push_back(vtx);
         }
 
+        /**
+         * @brief Add the vertices at once.
+         */
+        void addVertices(const aten::vertex* vtxs, uint32_t num)
+        {
+            m_vertices.insert(m_vertices.end(), vtxs, vtxs + num);
+        }
+
         const aten::vertex& getVertex(int idx) const
         {
             return m_vertices[idx];
@@ -86,6 +105,10 @@ namespace aten
 
         void addMaterial(AT_NAME::material* mtrl);
 
+        /**
+         * @brief Return the number of the material handles.
+         * The handles of the removed materials are kept empty, and getMaterial returns nullptr for them.
+         */
         int getMaterialNum() const
         {
             return static_cast<int>(m_materials.size());
@@ -111,20 +134,70 @@ namespace aten
 
         int findMaterialIdxByName(const char* name) const;
 
+        /**
+         * @brief Create a triangle.
+         * The parameter is stored in the flat array, and the returned face is the view to it.
+         */
         AT_NAME::face* createTriangle(const aten::PrimitiveParamter& param);
 
-        void addTriangle(AT_NAME::face* tri);
-
-        int getTriangleNum() const;
+        int getTriangleNum() const
+        {
+            return (int)m_triParams.size();
+        }
 
         const AT_NAME::face* getTriangle(int idx) const;
 
+        const aten::PrimitiveParamter& getTriangleParam(int idx) const
+        {
+            AT_ASSERT(0 <= idx && idx < getTriangleNum());
+            return m_triParams[idx];
+        }
+
+        aten::PrimitiveParamter& getTriangleParam(int idx)
+        {
+            AT_ASSERT(0 <= idx && idx < getTriangleNum());
+            return m_triParams[idx];
+        }
+
+        const std::vector<aten::PrimitiveParamter>& getTriangleParams() const
+        {
+            return m_triParams;
+        }
+
+        /**
+         * @brief Enable to store the first vertex and the edges per triangle.
+         * They are used by the hit test not to gather the vertices and compute the edges per test,
+         * but they take 48 bytes per triangle. If disabled, they are computed from the vertices per test.
+         */
+        void enableTriangleEdges(bool enable);
+
+        bool isEnabledTriangleEdges() const
+        {
+            return m_enableTriEdges;
+        }
+
+        const aten::TriangleEdges& getTriangleEdges(int idx) const
+        {
+            AT_ASSERT(m_enableTriEdges);
+            AT_ASSERT(0 <= idx && idx < getTriangleNum());
+            return m_triEdges[idx];
+        }
+
+        /**
+         * @brief Compute the stored first vertex and edges of the triangle from the vertices.
+         */
+        void updateTriangleEdges(int idx);
+
         void copyPrimitiveParameters(std::vector<aten::PrimitiveParamter>& dst) const;
 
         int findTriIdxFromPointer(const void* p) const;
 
         void addTransformable(aten::transformable* t);
 
+        /**
+         * @brief Return the number of the transformable handles.
+         * getTransformable returns nullptr for the handles of the removed transformables.
+         */
         int getTransformableNum() const;
 
         const aten::transformable* getTransformable(int idx) const;
@@ -137,8 +210,15 @@ namespace aten
 
         int findPolygonalTransformableOrderFromPointer(const void* p) const;
 
-        texture* createTexture(uint32_t width, uint32_t height, uint32_t channels, const char* name);
+        texture* createTexture(
+            uint32_t width, uint32_t height, uint32_t channels,
+            const char* name,
+            texture::Format format = texture::Format::RGBA32F);
 
+        /**
+         * @brief Return the number of the texture handles.
+         * getTexture returns nullptr for the handles of the removed textures.
+         */
         int getTextureNum() const;
 
         const texture* getTexture(int idx) const;
@@ -172,7 +252,19 @@ namespace aten
         aten::GeomVertexBuffer m_vb;
 
         DataList<AT_NAME::material> m_materials;
-        DataList<AT_NAME::face> m_triangles;
+
+        // Triangles as SoA, which are indexed by the triangle id.
+        std::vector<aten::PrimitiveParamter> m_triParams;
+        std::vector<aten::TriangleEdges> m_triEdges;
+        bool m_enableTriEdges{ true };
+
+        // Views of the triangles, which are allocated per block not to allocate them one by one.
+        static const int TriangleBlockSize = 1024;
+        std::vector<AT_NAME::face*> m_triBlocks;
+
+        // Block index by the address of the block to find the triangle id from the view.
+        std::map<const AT_NAME::face*, int> m_triBlockIdx;
+
         DataList<aten::transformable> m_transformables;
         DataList<aten::texture> m_textures;
     };
@@ -33,6 +33,11 @@ namespace aten {
 
         real area{ real(1) };
 
+        // 0.5 * log2(texture coordinate area / world area) of the hit triangle.
+        // It is used to compute the level of detail of the textures with the ray cone.
+        // If it can't be computed, it is INF.
+        real texLodBase{ AT_MATH_INF };
+
         int mtrlid{ -1 };
 
         bool isVoxel{ false };
@@ -90,6 +95,19 @@ namespace aten {
             real t_min, real t_max,
             Intersection& isect) const = 0;
 
+        /**
+         * @brief Test if a ray is occluded by the object.
+         * @note Any hit in [t_min, t_max] is enough, so the traversal can stop at the first hit.
+         */
+        virtual bool occluded(
+            const context& ctxt,
+            const ray& r,
+            real t_min, real t_max) const
+        {
+            Intersection isect;
+            return hit(ctxt, r, t_min, t_max, isect);
+        }
+
         virtual const aabb& getBoundingbox() const
         {
             return m_aabb;
@@ -81,6 +81,23 @@ namespace aten
             return isHit;
         }
 
+        virtual bool occluded(
+            const context& ctxt,
+            const ray& r,
+            real t_min, real t_max) const override final
+        {
+            // Transform world to local.
+            vec3 org = m_mtxW2L.apply(r.org);
+            vec3 dir = m_mtxW2L.applyXYZ(r.dir);
+
+            // The direction is normalized in the ray, so the interval has to be scaled to the local space.
+            auto scale = length(dir);
+
+            ray transformdRay(org, dir);
+
+            return m_obj->occluded(ctxt, transformdRay, t_min * scale, t_max * scale);
+        }
+
         virtual void evalHitResult(
             const context& ctxt,
             const ray& r,
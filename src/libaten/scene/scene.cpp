@@ -34,6 +34,24 @@ namespace aten {
         return isHit;
     }
 
+    bool scene::isLightVisible(
+        const context& ctxt,
+        const Light* light,
+        const vec3& lightPos,
+        const ray& r,
+        real t_min) const
+    {
+        real t_max = AT_MATH_INF;
+
+        if (!light->isInfinite()) {
+            // Stop just before the light, so that the light object itself is not treated as the occluder.
+            real distToLight = length(lightPos - r.org);
+            t_max = distToLight - AT_MATH_EPSILON;
+        }
+
+        return !this->occluded(ctxt, r, t_min, t_max);
+    }
+
     Light* scene::sampleLight(
         const context& ctxt,
         const vec3& org,
@@ -42,11 +60,25 @@ namespace aten {
         real& selectPdf,
         LightSampleResult& sampleRes)
     {
-#if 1
         Light* light = nullptr;
 
         auto num = m_lights.size();
-        if (num > 0) {
+
+        if (m_lightSampler.isBuilt((uint32_t)num)) {
+            auto r = sampler->nextSample();
+
+            auto idx = m_lightSampler.sample(org, nml, r, selectPdf);
+
+            if (idx >= 0) {
+                light = m_lights[idx];
+                sampleRes = light->sample(ctxt, org, nml, sampler);
+            }
+            else {
+                // No light affects the shading point.
+                selectPdf = 1;
+            }
+        }
+        else if (num > 0) {
             auto r = sampler->nextSample();
             uint32_t idx = (uint32_t)aten::clamp<real>(r * num, 0, num - 1);
             light = m_lights[idx];
@@ -59,65 +91,21 @@ namespace aten {
         }
 
         return light;
-#else
-        // Resampled Importance Sampling.
-        // For reducing variance...maybe...
-
-        std::vector<LightSampleResult> samples(m_lights.size());
-        std::vector<real> costs(m_lights.size());
-
-        real sumCost = 0;
-
-        for (int i = 0; i < m_lights.size(); i++) {
-            const auto light = m_lights[i];
-
-            samples[i] = light->sample(org, nml, sampler);
-
-            const auto& lightsample = samples[i];
-
-            vec3 posLight = lightsample.pos;
-            vec3 nmlLight = lightsample.nml;
-            real pdfLight = lightsample.pdf;
-            vec3 dirToLight = normalize(lightsample.dir);
-
-            auto cosShadow = dot(nml, dirToLight);
-            auto dist2 = squared_length(lightsample.dir);
-            auto dist = aten::sqrt(dist2);
-
-            auto illum = color::luminance(lightsample.finalColor);
-
-            if (cosShadow > 0) {
-                if (light->isSingular() || light->isInfinite()) {
-                    costs[i] = illum * cosShadow / pdfLight;
-                }
-                else {
-                    costs[i] = illum * cosShadow / dist2 / pdfLight;
-                }
-                sumCost += costs[i];
-            }
-            else {
-                costs[i] = 0;
-            }
-        }
-
-        auto r = sampler->nextSample() * sumCost;
-        
-        real sum = 0;
+    }
 
-        for (int i = 0; i < costs.size(); i++) {
-            const auto c = costs[i];
-            sum += c;
+    real scene::getLightSelectPdf(
+        int objid,
+        const vec3& org,
+        const vec3& nml) const
+    {
+        auto num = m_lights.size();
 
-            if (r <= sum && c > 0) {
-                auto light = m_lights[i];
-                sampleRes = samples[i];
-                selectPdf = c / sumCost;
-                return light;
-            }
+        if (m_lightSampler.isBuilt((uint32_t)num)) {
+            auto idx = m_lightSampler.findLightByObject(objid);
+            return m_lightSampler.getSelectPdf(org, nml, idx);
         }
 
-        return nullptr;
-#endif
+        return num > 0 ? real(1) / num : real(0);
     }
 
     void scene::drawForGBuffer(
@@ -8,6 +8,7 @@
 #include "accelerator/bvh.h"
 #include "light/light.h"
 #include "light/ibl.h"
+#include "light/lightsampler.h"
 #include "scene/context.h"
 
 namespace AT_NAME {
@@ -43,6 +44,43 @@ namespace AT_NAME {
             return hit(ctxt, r, t_min, t_max, false, rec, isect);
         }
 
+        /**
+         * @brief Test if a ray is occluded by any objects.
+         * @note The closest hit is not computed, and the hit result is not evaluated.
+         */
+        virtual bool occluded(
+            const aten::context& ctxt,
+            const aten::ray& r,
+            real t_min, real t_max) const = 0;
+
+        /**
+         * @brief Test if rays in the packet hit objects.
+         * @return Bit mask of the rays which hit objects.
+         */
+        virtual uint32_t hit(
+            const aten::context& ctxt,
+            const aten::RayPacket& packet,
+            real t_min, real t_max,
+            aten::hitrecord* recs,
+            aten::Intersection* isects) const
+        {
+            uint32_t ret = 0;
+
+            for (uint32_t i = 0; i < packet.num; i++) {
+                if ((packet.activeMask & (1 << i)) == 0) {
+                    continue;
+                }
+
+                isects[i] = aten::Intersection();
+
+                if (hit(ctxt, packet.rays[i], t_min, t_max, false, recs[i], isects[i])) {
+                    ret |= (1 << i);
+                }
+            }
+
+            return ret;
+        }
+
         void addLight(Light* l)
         {
             m_lights.push_back(l);
@@ -88,6 +126,17 @@ namespace AT_NAME {
             real t_min, real t_max,
             aten::hitrecord& rec);
 
+        /**
+         * @brief Test if the shadow ray reaches the light without any occluders.
+         * @note Unlike hitLight, the traversal stops at the first occluder.
+         */
+        bool isLightVisible(
+            const aten::context& ctxt,
+            const Light* light,
+            const aten::vec3& lightPos,
+            const aten::ray& r,
+            real t_min) const;
+
         static inline AT_DEVICE_API bool hitLight(
             bool isHit,
             aten::LightAttribute attrib,
@@ -168,6 +217,40 @@ namespace AT_NAME {
             real& selectPdf,
             aten::LightSampleResult& sampleRes);
 
+        /**
+         * @brief Return the probability that sampleLight selects the area light which has the specified object.
+         * It is used to compute MIS weight when the path hits the emissive object.
+         * If the object is not the light, 0 is returned because it is never selected.
+         */
+        real getLightSelectPdf(
+            int objid,
+            const aten::vec3& org,
+            const aten::vec3& nml) const;
+
+        /**
+         * @brief Set how sampleLight selects the light.
+         * The structure to select the light is built in build or buildLightSampler.
+         */
+        void setLightSamplerType(LightSampler::Type type)
+        {
+            m_lightSamplerType = type;
+        }
+
+        LightSampler::Type getLightSamplerType() const
+        {
+            return m_lightSamplerType;
+        }
+
+        /**
+         * @brief Build the structure to select the light.
+         * It has to be called again if the lights are added after building the scene.
+         * Until it is built for the current lights, the light is selected uniformly.
+         */
+        void buildLightSampler(const aten::context& ctxt)
+        {
+            m_lightSampler.build(ctxt, m_lights, m_lightSamplerType);
+        }
+
         void drawForGBuffer(
             aten::hitable::FuncPreDraw func,
             std::function<bool(aten::hitable*)> funcIfDraw,
@@ -178,6 +261,9 @@ namespace AT_NAME {
 
         std::vector<Light*> m_lights;
         ImageBasedLight* m_ibl{ nullptr };
+
+        LightSampler::Type m_lightSamplerType{ LightSampler::Type::Uniform };
+        LightSampler m_lightSampler;
     };
 
     template <typename ACCEL>
@@ -212,6 +298,8 @@ namespace AT_NAME {
 
                 m_accel.build(ctxt, &m_tmp[0], (uint32_t)m_tmp.size(), &bbox);
             }
+
+            buildLightSampler(ctxt);
         }
 
         virtual bool hit(
@@ -235,6 +323,37 @@ namespace AT_NAME {
             return isHit;
         }
 
+        virtual bool occluded(
+            const aten::context& ctxt,
+            const aten::ray& r,
+            real t_min, real t_max) const override final
+        {
+            return m_accel.occluded(ctxt, r, t_min, t_max);
+        }
+
+        virtual uint32_t hit(
+            const aten::context& ctxt,
+            const aten::RayPacket& packet,
+            real t_min, real t_max,
+            aten::hitrecord* recs,
+            aten::Intersection* isects) const override final
+        {
+            const aten::accelerator& accel = m_accel;
+            auto hitMask = accel.hit(ctxt, packet, t_min, t_max, isects);
+
+            // TODO
+#ifndef __AT_CUDA__
+            for (uint32_t i = 0; i < packet.num; i++) {
+                if (hitMask & (1 << i)) {
+                    auto obj = ctxt.getTransformable(isects[i].objid);
+                    aten::hitable::evalHitResult(ctxt, obj, packet.rays[i], recs[i], isects[i]);
+                }
+            }
+#endif
+
+            return hitMask;
+        }
+
         ACCEL* getAccel()
         {
             return &m_accel;
@@ -1,28 +1,25 @@
 #include <string>
+#include <string.h>
 
 #include "stb_image_write.h"
 
 #include "texture/texture.h"
+#include "texture/texturecache.h"
 #include "visualizer/atengl.h"
 #include "visualizer/shader.h"
 #include "misc/color.h"
 
 namespace aten
 {
-    void texture::resetIdWhenAnyTextureLeave(aten::texture* tex)
-    {
-        tex->m_id = tex->m_listItem.currentIndex();
-    }
-
     texture::texture()
     {
-        m_listItem.init(this, resetIdWhenAnyTextureLeave);
+        m_listItem.init(this);
     }
 
-    texture::texture(uint32_t width, uint32_t height, uint32_t channels, const char* name/*= nullptr*/)
+    texture::texture(uint32_t width, uint32_t height, uint32_t channels, const char* name/*= nullptr*/, Format format/*= Format::RGBA32F*/)
         : texture()
     {
-        init(width, height, channels);
+        init(width, height, channels, format);
         if (name) {
             m_name = name;
         }
@@ -35,24 +32,569 @@ namespace aten
         releaseAsGLTexture();
     }
 
-    texture* texture::create(uint32_t width, uint32_t height, uint32_t channels, const char* name)
+    texture* texture::create(uint32_t width, uint32_t height, uint32_t channels, const char* name, Format format)
     {
-        texture* ret = new texture(width, height, channels, name);
+        texture* ret = new texture(width, height, channels, name, format);
         AT_ASSERT(ret);
 
         return ret;
     }
 
-    void texture::init(uint32_t width, uint32_t height, uint32_t channels)
+    void texture::init(uint32_t width, uint32_t height, uint32_t channels, Format format/*= Format::RGBA32F*/)
     {
-        if (m_colors.empty()) {
+        if (m_colors.empty() && m_data.empty()) {
             m_width = width;
             m_height = height;
             m_channels = channels;
 
             m_size = height * width;
 
-            m_colors.resize(width * height);
+            m_format = format;
+
+            if (m_format == Format::RGBA32F) {
+                m_colors.resize(width * height);
+            }
+            else {
+                m_data.resize(width * height * getTexelSize(m_format));
+            }
+        }
+    }
+
+    uint32_t texture::getTexelSize(Format format)
+    {
+        switch (format) {
+        case Format::RGBA32F:
+            return sizeof(vec4);
+        case Format::RGBA8:
+        case Format::SRGBA8:
+        case Format::RGBE:
+            return 4;
+        case Format::RG8:
+        case Format::NormalRG8:
+            return 2;
+        case Format::R8:
+            return 1;
+        }
+
+        AT_ASSERT(false);
+        return 0;
+    }
+
+    static inline uint8_t encodeUnorm8(real v)
+    {
+        return (uint8_t)(aten::clamp(v, real(0), real(1)) * real(255) + real(0.5));
+    }
+
+    static inline real decodeUnorm8(uint8_t v)
+    {
+        return v * (real(1) / real(255));
+    }
+
+    static const real* getSRGBToLinearTable()
+    {
+        struct Table {
+            real values[256];
+
+            Table()
+            {
+                for (int i = 0; i < 256; i++) {
+                    real c = i / real(255);
+                    values[i] = c <= real(0.04045)
+                        ? c / real(12.92)
+                        : aten::pow((c + real(0.055)) / real(1.055), real(2.4));
+                }
+            }
+        };
+
+        static const Table table;
+        return table.values;
+    }
+
+    static inline uint8_t encodeSRGB8(real v)
+    {
+        v = aten::clamp(v, real(0), real(1));
+        v = v <= real(0.0031308)
+            ? v * real(12.92)
+            : real(1.055) * aten::pow(v, real(1) / real(2.4)) - real(0.055);
+        return encodeUnorm8(v);
+    }
+
+    vec4 texture::decode(const uint8_t* src) const
+    {
+        switch (m_format) {
+        case Format::RGBA8:
+            return vec4(decodeUnorm8(src[0]), decodeUnorm8(src[1]), decodeUnorm8(src[2]), decodeUnorm8(src[3]));
+        case Format::SRGBA8:
+        {
+            const auto table = getSRGBToLinearTable();
+            return vec4(table[src[0]], table[src[1]], table[src[2]], decodeUnorm8(src[3]));
+        }
+        case Format::RG8:
+            return vec4(decodeUnorm8(src[0]), decodeUnorm8(src[1]), real(0), real(1));
+        case Format::R8:
+            return vec4(decodeUnorm8(src[0]), real(0), real(0), real(1));
+        case Format::NormalRG8:
+        {
+            // [0, 1] -> [-1, 1]
+            real x = decodeUnorm8(src[0]) * real(2) - real(1);
+            real y = decodeUnorm8(src[1]) * real(2) - real(1);
+            real z = aten::sqrt(std::max(real(1) - x * x - y * y, real(0)));
+
+            // Return as [0, 1] like the other normal maps.
+            return vec4(
+                decodeUnorm8(src[0]), decodeUnorm8(src[1]),
+                z * real(0.5) + real(0.5),
+                real(1));
+        }
+        case Format::RGBE:
+        {
+            if (src[3] == 0) {
+                return vec4(real(0), real(0), real(0), real(1));
+            }
+            real f = (real)ldexp(1.0, (int)src[3] - (128 + 8));
+            return vec4(src[0] * f, src[1] * f, src[2] * f, real(1));
+        }
+        default:
+            AT_ASSERT(false);
+            break;
+        }
+
+        return vec4();
+    }
+
+    void texture::encode(uint8_t* dst, const vec4& clr) const
+    {
+        switch (m_format) {
+        case Format::RGBA8:
+            dst[0] = encodeUnorm8(clr.x);
+            dst[1] = encodeUnorm8(clr.y);
+            dst[2] = encodeUnorm8(clr.z);
+            dst[3] = encodeUnorm8(clr.w);
+            break;
+        case Format::SRGBA8:
+            dst[0] = encodeSRGB8(clr.x);
+            dst[1] = encodeSRGB8(clr.y);
+            dst[2] = encodeSRGB8(clr.z);
+            dst[3] = encodeUnorm8(clr.w);
+            break;
+        case Format::RG8:
+        case Format::NormalRG8:
+            dst[0] = encodeUnorm8(clr.x);
+            dst[1] = encodeUnorm8(clr.y);
+            break;
+        case Format::R8:
+            dst[0] = encodeUnorm8(clr.x);
+            break;
+        case Format::RGBE:
+        {
+            real v = std::max(clr.x, std::max(clr.y, clr.z));
+
+            if (v < real(1e-32)) {
+                dst[0] = dst[1] = dst[2] = dst[3] = 0;
+            }
+            else {
+                int e = 0;
+                real m = (real)frexp(v, &e) * real(256) / v;
+
+                dst[0] = (uint8_t)std::max(clr.x * m, real(0));
+                dst[1] = (uint8_t)std::max(clr.y * m, real(0));
+                dst[2] = (uint8_t)std::max(clr.z * m, real(0));
+                dst[3] = (uint8_t)(e + 128);
+            }
+            break;
+        }
+        default:
+            AT_ASSERT(false);
+            break;
+        }
+    }
+
+    void texture::setTexel(uint32_t x, uint32_t y, const vec4& clr)
+    {
+        AT_ASSERT(!isTiled());
+
+        x = std::min(x, m_width - 1);
+        y = std::min(y, m_height - 1);
+
+        uint32_t pos = ((m_height - 1) - y) * m_width + x;
+
+        if (m_format == Format::RGBA32F) {
+            m_colors[pos] = clr;
+        }
+        else {
+            encode(&m_data[pos * getTexelSize(m_format)], clr);
+        }
+    }
+
+    const vec4* texture::colors() const
+    {
+        if (m_format == Format::RGBA32F && !isTiled()) {
+            return &m_colors[0];
+        }
+
+        if (m_decoded.empty()) {
+            m_decoded.resize(m_width * m_height);
+
+            for (uint32_t i = 0; i < m_size; i++) {
+                m_decoded[i] = fetch(0, i % m_width, i / m_width);
+            }
+        }
+
+        return &m_decoded[0];
+    }
+
+    void texture::convertFormat(Format format)
+    {
+        AT_ASSERT(!isTiled());
+
+        if (m_format == format || isTiled()) {
+            return;
+        }
+
+        bool hasMipmap = !m_mips.empty();
+
+        // Decode all texels once.
+        std::vector<vec4> colors(m_size);
+
+        for (uint32_t i = 0; i < m_size; i++) {
+            colors[i] = fetch(0, i % m_width, i / m_width);
+        }
+
+        m_format = format;
+        m_decoded.clear();
+        m_mips.clear();
+
+        if (m_format == Format::RGBA32F) {
+            m_colors.swap(colors);
+            m_data.clear();
+            m_data.shrink_to_fit();
+        }
+        else {
+            m_colors.clear();
+            m_colors.shrink_to_fit();
+
+            const auto texelSize = getTexelSize(m_format);
+            m_data.resize(m_size * texelSize);
+
+            for (uint32_t i = 0; i < m_size; i++) {
+                encode(&m_data[i * texelSize], colors[i]);
+            }
+        }
+
+        if (hasMipmap) {
+            buildMipmap();
+        }
+    }
+
+    vec3 texture::at(real u, real v, real lod) const
+    {
+        const real maxLevel = (real)(getMipLevelNum() - 1);
+        lod = aten::clamp(lod, real(0), maxLevel);
+
+        vec4 clr;
+
+        switch (m_filter) {
+        case Filter::Point:
+            clr = samplePoint((uint32_t)(lod + real(0.5)), u, v);
+            break;
+        case Filter::Bilinear:
+            clr = sampleBilinear((uint32_t)(lod + real(0.5)), u, v);
+            break;
+        case Filter::Trilinear:
+        {
+            uint32_t level0 = (uint32_t)lod;
+            uint32_t level1 = std::min(level0 + 1, (uint32_t)maxLevel);
+            real t = lod - level0;
+
+            clr = sampleBilinear(level0, u, v);
+
+            if (level1 != level0 && t > real(0)) {
+                clr = clr * (real(1) - t) + sampleBilinear(level1, u, v) * t;
+            }
+            break;
+        }
+        }
+
+        return toVec3(clr);
+    }
+
+    uint32_t texture::getMipLevelNum() const
+    {
+        if (isTiled()) {
+            return m_cache->getFileInfo(m_cacheFileId).levelNum;
+        }
+
+        return (uint32_t)m_mips.size() + 1;
+    }
+
+    void texture::getLevelSize(uint32_t level, uint32_t& width, uint32_t& height) const
+    {
+        if (isTiled()) {
+            m_cache->getLevelSize(m_cacheFileId, level, width, height);
+        }
+        else if (level == 0) {
+            width = m_width;
+            height = m_height;
+        }
+        else {
+            width = m_mips[level - 1].width;
+            height = m_mips[level - 1].height;
+        }
+    }
+
+    const void* texture::getLevelData(uint32_t level) const
+    {
+        if (isTiled()) {
+            return nullptr;
+        }
+        else if (level == 0) {
+            return getData();
+        }
+
+        const auto& mip = m_mips[level - 1];
+
+        return m_format == Format::RGBA32F
+            ? (const void*)mip.colors.data()
+            : (const void*)mip.data.data();
+    }
+
+    void texture::attachTiledFile(TextureCache* cache, int fileId)
+    {
+        AT_ASSERT(cache);
+
+        const auto& info = cache->getFileInfo(fileId);
+
+        m_cache = cache;
+        m_cacheFileId = fileId;
+
+        m_width = info.width;
+        m_height = info.height;
+        m_channels = info.channels;
+        m_format = info.format;
+
+        m_size = m_width * m_height;
+
+        // Release the texels in the memory.
+        std::vector<vec4>().swap(m_colors);
+        std::vector<uint8_t>().swap(m_data);
+        std::vector<vec4>().swap(m_decoded);
+        m_mips.clear();
+    }
+
+    vec4 texture::fetch(uint32_t level, int x, int y) const
+    {
+        if (isTiled()) {
+            uint8_t texel[sizeof(vec4)];
+
+            if (!m_cache->fetchTexel(m_cacheFileId, level, x, y, texel)) {
+                return vec4();
+            }
+
+            if (m_format == Format::RGBA32F) {
+                vec4 clr;
+                memcpy(&clr, texel, sizeof(vec4));
+                return clr;
+            }
+
+            return decode(texel);
+        }
+
+        if (level == 0) {
+            auto pos = y * m_width + x;
+
+            return m_format == Format::RGBA32F
+                ? m_colors[pos]
+                : decode(&m_data[pos * getTexelSize(m_format)]);
+        }
+
+        const auto& mip = m_mips[level - 1];
+        auto pos = y * mip.width + x;
+
+        return m_format == Format::RGBA32F
+            ? mip.colors[pos]
+            : decode(&mip.data[pos * getTexelSize(m_format)]);
+    }
+
+    void texture::fetchQuad(
+        uint32_t level,
+        int x0, int y0, int x1, int y1,
+        vec4* dst) const
+    {
+        if (!isTiled()) {
+            dst[0] = fetch(level, x0, y0);
+            dst[1] = fetch(level, x1, y0);
+            dst[2] = fetch(level, x0, y1);
+            dst[3] = fetch(level, x1, y1);
+            return;
+        }
+
+        // The texels are fetched at once, so the tiles are looked up once for the footprint.
+        const uint32_t xs[4] = { (uint32_t)x0, (uint32_t)x1, (uint32_t)x0, (uint32_t)x1 };
+        const uint32_t ys[4] = { (uint32_t)y0, (uint32_t)y0, (uint32_t)y1, (uint32_t)y1 };
+
+        uint8_t texels[sizeof(vec4) * 4];
+
+        if (!m_cache->fetchTexels(m_cacheFileId, level, xs, ys, 4, texels)) {
+            for (int i = 0; i < 4; i++) {
+                dst[i] = vec4();
+            }
+            return;
+        }
+
+        const auto texelSize = getTexelSize(m_format);
+
+        for (int i = 0; i < 4; i++) {
+            const auto texel = &texels[i * texelSize];
+
+            if (m_format == Format::RGBA32F) {
+                memcpy(&dst[i], texel, sizeof(vec4));
+            }
+            else {
+                dst[i] = decode(texel);
+            }
+        }
+    }
+
+    vec4 texture::samplePoint(uint32_t level, real u, real v) const
+    {
+        uint32_t width, height;
+        getLevelSize(level, width, height);
+
+        u -= floor(u);
+        v -= floor(v);
+
+        uint32_t x = (uint32_t)(aten::cmpMin(u, real(1)) * (width - 1));
+        uint32_t y = (uint32_t)(aten::cmpMin(v, real(1)) * (height - 1));
+
+        return fetch(level, x, y);
+    }
+
+    vec4 texture::sampleBilinear(uint32_t level, real u, real v) const
+    {
+        uint32_t levelWidth, levelHeight;
+        getLevelSize(level, levelWidth, levelHeight);
+
+        const int width = (int)levelWidth;
+        const int height = (int)levelHeight;
+
+        u -= floor(u);
+        v -= floor(v);
+
+        // Texel centers are at (i + 0.5) / size.
+        real fx = u * width - real(0.5);
+        real fy = v * height - real(0.5);
+
+        real x0f = aten::floor(fx);
+        real y0f = aten::floor(fy);
+
+        real tx = fx - x0f;
+        real ty = fy - y0f;
+
+        // Repeat.
+        int x0 = ((int)x0f + width) % width;
+        int y0 = ((int)y0f + height) % height;
+        int x1 = (x0 + 1) % width;
+        int y1 = (y0 + 1) % height;
+
+        vec4 c[4];
+        fetchQuad(level, x0, y0, x1, y1, c);
+
+        const auto& c00 = c[0];
+        const auto& c10 = c[1];
+        const auto& c01 = c[2];
+        const auto& c11 = c[3];
+
+        vec4 c0 = c00 * (real(1) - tx) + c10 * tx;
+        vec4 c1 = c01 * (real(1) - tx) + c11 * tx;
+
+        return c0 * (real(1) - ty) + c1 * ty;
+    }
+
+    vec3 texture::toVec3(const vec4& clr) const
+    {
+        // TODO
+        // Note use alpha channel...
+        uint32_t ch = std::min<uint32_t>(m_channels, 3);
+
+        vec3 ret;
+
+        switch (ch) {
+        case 3:
+            ret[2] = clr[2];
+        case 2:
+            ret[1] = clr[1];
+        case 1:
+            ret[0] = clr[0];
+            break;
+        }
+
+        return ret;
+    }
+
+    void texture::buildMipmap()
+    {
+        if (isTiled()) {
+            // The tiled file has all mip levels.
+            return;
+        }
+
+        m_mips.clear();
+
+        if (m_size == 0) {
+            return;
+        }
+
+        const auto texelSize = getTexelSize(m_format);
+
+        uint32_t level = 0;
+        uint32_t width = m_width;
+        uint32_t height = m_height;
+
+        while (width > 1 || height > 1) {
+            MipLevel mip;
+            mip.width = std::max<uint32_t>(width >> 1, 1);
+            mip.height = std::max<uint32_t>(height >> 1, 1);
+
+            if (m_format == Format::RGBA32F) {
+                mip.colors.resize(mip.width * mip.height);
+            }
+            else {
+                mip.data.resize(mip.width * mip.height * texelSize);
+            }
+
+            // 2x2 box filter.
+            // The compact formats are decoded, filtered and encoded again.
+#ifdef ENABLE_OMP
+#pragma omp parallel for
+#endif
+            for (int y = 0; y < (int)mip.height; y++) {
+                uint32_t y0 = std::min<uint32_t>(y * 2, height - 1);
+                uint32_t y1 = std::min<uint32_t>(y * 2 + 1, height - 1);
+
+                for (uint32_t x = 0; x < mip.width; x++) {
+                    uint32_t x0 = std::min<uint32_t>(x * 2, width - 1);
+                    uint32_t x1 = std::min<uint32_t>(x * 2 + 1, width - 1);
+
+                    auto clr = fetch(level, x0, y0) + fetch(level, x1, y0)
+                        + fetch(level, x0, y1) + fetch(level, x1, y1);
+                    clr *= real(0.25);
+
+                    auto pos = y * mip.width + x;
+
+                    if (m_format == Format::RGBA32F) {
+                        mip.colors[pos] = clr;
+                    }
+                    else {
+                        encode(&mip.data[pos * texelSize], clr);
+                    }
+                }
+            }
+
+            width = mip.width;
+            height = mip.height;
+
+            m_mips.push_back(std::move(mip));
+            level++;
         }
     }
 
@@ -61,22 +603,61 @@ namespace aten
         if (m_gltex == 0) {
             AT_VRETURN(m_width > 0, false);
             AT_VRETURN(m_height > 0, false);
-            AT_VRETURN(m_colors.size() > 0, false);
+            AT_VRETURN(m_size > 0, false);
 
             CALL_GL_API(::glGenTextures(1, &m_gltex));
             AT_VRETURN(m_gltex > 0, false);
 
             CALL_GL_API(glBindTexture(GL_TEXTURE_2D, m_gltex));
 
+            // 8 bit formats are uploaded as they are.
+            // The others are uploaded as float.
+            GLint internalFormat = GL_RGBA32F;
+            GLenum format = GL_RGBA;
+            GLenum type = GL_FLOAT;
+            const void* data = nullptr;
+
+            // The tiled texture is uploaded as float.
+            switch (isTiled() ? Format::RGBA32F : m_format) {
+            case Format::RGBA8:
+                internalFormat = GL_RGBA8;
+                break;
+            case Format::SRGBA8:
+                internalFormat = GL_SRGB8_ALPHA8;
+                break;
+            case Format::RG8:
+                internalFormat = GL_RG8;
+                format = GL_RG;
+                break;
+            case Format::R8:
+                internalFormat = GL_R8;
+                format = GL_RED;
+                break;
+            default:
+                data = colors();
+                break;
+            }
+
+            if (!data) {
+                type = GL_UNSIGNED_BYTE;
+                data = &m_data[0];
+            }
+
+            // NOTE
+            // Rows of 1 or 2 channel 8 bit formats are not aligned to 4 bytes.
+            CALL_GL_API(::glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
+
             CALL_GL_API(glTexImage2D(
                 GL_TEXTURE_2D,
                 0,
-                GL_RGBA32F,
+                internalFormat,
                 m_width, m_height,
                 0,
-                GL_RGBA,
-                GL_FLOAT,
-                &m_colors[0]));
+                format,
+                type,
+                data));
+
+            CALL_GL_API(::glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
 
             CALL_GL_API(::glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
             CALL_GL_API(::glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
@@ -214,6 +795,10 @@ namespace aten
         AT_VRETURN(m_height == rhs.m_height, false);
         AT_VRETURN(m_colors.size() == rhs.m_colors.size(), false);
 
+        // Only for float textures in the memory.
+        AT_VRETURN(m_format == Format::RGBA32F && !isTiled(), false);
+        AT_VRETURN(rhs.m_format == Format::RGBA32F && !rhs.isTiled(), false);
+
 #ifdef ENABLE_OMP
 #pragma omp parallel for
 #endif
@@ -244,9 +829,11 @@ namespace aten
             for (int x = 0; x < m_width; x++) {
                 int yy = m_height - 1 - y;
 
-                dst[yy * m_width + x].r() = (uint8_t)aten::clamp(m_colors[y * m_width + x].x * real(255), real(0), real(255));
-                dst[yy * m_width + x].g() = (uint8_t)aten::clamp(m_colors[y * m_width + x].y * real(255), real(0), real(255));
-                dst[yy * m_width + x].b() = (uint8_t)aten::clamp(m_colors[y * m_width + x].z * real(255), real(0), real(255));
+                const auto clr = fetch(0, x, y);
+
+                dst[yy * m_width + x].r() = (uint8_t)aten::clamp(clr.x * real(255), real(0), real(255));
+                dst[yy * m_width + x].g() = (uint8_t)aten::clamp(clr.y * real(255), real(0), real(255));
+                dst[yy * m_width + x].b() = (uint8_t)aten::clamp(clr.z * real(255), real(0), real(255));
             }
         }
 
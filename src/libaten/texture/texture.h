@@ -10,55 +10,126 @@
 
 namespace aten
 {
+    class TextureCache;
+
     class texture {
         friend class context;
 
+    public:
+        /**
+         * @brief Format to store the texels.
+         */
+        enum class Format {
+            RGBA32F,    ///< 32 bit float per channel.
+            RGBA8,      ///< 8 bit unorm per channel.
+            SRGBA8,     ///< 8 bit per channel. RGB is encoded with sRGB transfer function.
+            RG8,        ///< 8 bit unorm, 2 channels.
+            R8,         ///< 8 bit unorm, 1 channel. e.g. roughness map.
+            NormalRG8,  ///< X and Y of the normal map as 8 bit unorm. Z is reconstructed at decoding.
+            RGBE,       ///< 8 bit RGB with the shared 8 bit exponent. For HDR.
+        };
+
+        /**
+         * @brief Return the size of one texel in the format.
+         */
+        static uint32_t getTexelSize(Format format);
+
     private:
         texture();
-        texture(uint32_t width, uint32_t height, uint32_t channels, const char* name);
+        texture(uint32_t width, uint32_t height, uint32_t channels, const char* name, Format format = Format::RGBA32F);
 
     public:
         ~texture();
         
     private:
-        static texture* create(uint32_t width, uint32_t height, uint32_t channels, const char* name);
+        static texture* create(uint32_t width, uint32_t height, uint32_t channels, const char* name, Format format);
 
     public:
-        void init(uint32_t width, uint32_t height, uint32_t channels);
+        void init(uint32_t width, uint32_t height, uint32_t channels, Format format = Format::RGBA32F);
+
+        /**
+         * @brief Filter to sample the texture.
+         */
+        enum class Filter {
+            Point,      ///< Nearest texel in the level.
+            Bilinear,   ///< Bilinear in the nearest level.
+            Trilinear,  ///< Bilinear in the two levels around the LOD, and blend them.
+        };
 
         vec3 at(real u, real v) const
         {
-            u -= floor(u);
-            v -= floor(v);
-
-            uint32_t x = (uint32_t)(aten::cmpMin(u, real(1)) * (m_width - 1));
-            uint32_t y = (uint32_t)(aten::cmpMin(v, real(1)) * (m_height - 1));
-
-            uint32_t pos = y * m_width + x;
+            return at(u, v, real(0));
+        }
 
-            const auto clr = m_colors[pos];
+        /**
+         * @brief Sample the texture.
+         * @param lod Level of detail. 0 is the original image. The fractional part is used for Trilinear.
+         */
+        vec3 at(real u, real v, real lod) const;
 
-            // TODO
-            // Note use alpha channel...
-            uint32_t ch = std::min<uint32_t>(m_channels, 3);
+        void setFilter(Filter filter)
+        {
+            m_filter = filter;
+        }
 
-            vec3 ret;
+        Filter getFilter() const
+        {
+            return m_filter;
+        }
 
-            switch (ch) {
-            case 3:
-                ret[2] = clr[2];
-            case 2:
-                ret[1] = clr[1];
-            case 1:
-                ret[0] = clr[0];
-                break;
-            }
+        /**
+         * @brief Build the mip pyramid from the current image.
+         * It has to be called again after the texels are modified.
+         */
+        void buildMipmap();
+
+        /**
+         * @brief Return the number of the mip levels including the original image.
+         */
+        uint32_t getMipLevelNum() const;
+
+        /**
+         * @brief Return the size of the mip level.
+         */
+        void getLevelSize(uint32_t level, uint32_t& width, uint32_t& height) const;
+
+        /**
+         * @brief Return the texels of the mip level in the format.
+         * If the texture is tiled, nullptr is returned.
+         */
+        const void* getLevelData(uint32_t level) const;
+
+        /**
+         * @brief Read the texels from the tiled file in the cache instead of the memory.
+         * The texels in the memory are released.
+         */
+        void attachTiledFile(TextureCache* cache, int fileId);
+
+        bool isTiled() const
+        {
+            return m_cache != nullptr;
+        }
 
-            return ret;
+        /**
+         * @brief Return the cache and the id of the tiled file, if the texture is tiled.
+         */
+        TextureCache* getTextureCache() const
+        {
+            return m_cache;
+        }
+        int getTiledFileId() const
+        {
+            return m_cacheFileId;
         }
 
+        /**
+         * @brief Access the channel of the texel. Only for Format::RGBA32F in the memory.
+         * y is from the top of the image.
+         */
         real& operator()(uint32_t x, uint32_t y, uint32_t c)
         {
+            AT_ASSERT(m_format == Format::RGBA32F && !isTiled());
+
             x = std::min(x, m_width - 1);
             y = std::min(y, m_height - 1);
             c = std::min(c, m_channels - 1);
@@ -68,9 +139,51 @@ namespace aten
             return m_colors[pos][c];
         }
 
-        const vec4* colors() const
+        /**
+         * @brief Set the texel. It is encoded to the format of the texture.
+         * y is from the top of the image, the same as operator().
+         */
+        void setTexel(uint32_t x, uint32_t y, const vec4& clr);
+
+        /**
+         * @brief Return the texels as vec4.
+         * For the compact formats, the texels are decoded to the internal buffer at the first call.
+         * It is for uploading to the other devices, and not thread safe.
+         */
+        const vec4* colors() const;
+
+        Format getFormat() const
         {
-            return &m_colors[0];
+            return m_format;
+        }
+
+        /**
+         * @brief Change the format of the texels.
+         * Mipmap is built again if it has been built.
+         */
+        void convertFormat(Format format);
+
+        /**
+         * @brief Return the texels of the original level in the format.
+         * If the texture is tiled, nullptr is returned.
+         */
+        const void* getData() const
+        {
+            if (isTiled()) {
+                return nullptr;
+            }
+
+            return m_format == Format::RGBA32F
+                ? (const void*)m_colors.data()
+                : (const void*)m_data.data();
+        }
+
+        /**
+         * @brief Return the size in bytes of the texels of the original level.
+         */
+        size_t getDataSize() const
+        {
+            return (size_t)m_width * m_height * getTexelSize(m_format);
         }
 
         uint32_t width() const
@@ -124,7 +237,31 @@ namespace aten
         bool exportAsPNG(const std::string& filename);
 
     private:
-        static void resetIdWhenAnyTextureLeave(aten::texture* tex);
+        struct MipLevel {
+            uint32_t width{ 0 };
+            uint32_t height{ 0 };
+            std::vector<vec4> colors;   ///< For Format::RGBA32F.
+            std::vector<uint8_t> data;  ///< For the other formats.
+        };
+
+        vec4 fetch(uint32_t level, int x, int y) const;
+
+        /**
+         * @brief Fetch the 2x2 texels for the bilinear filter.
+         * The order is (x0, y0), (x1, y0), (x0, y1), (x1, y1).
+         */
+        void fetchQuad(
+            uint32_t level,
+            int x0, int y0, int x1, int y1,
+            vec4* dst) const;
+
+        vec4 decode(const uint8_t* src) const;
+        void encode(uint8_t* dst, const vec4& clr) const;
+
+        vec4 samplePoint(uint32_t level, real u, real v) const;
+        vec4 sampleBilinear(uint32_t level, real u, real v) const;
+
+        vec3 toVec3(const vec4& clr) const;
 
         void addToDataList(aten::DataList<aten::texture>& list)
         {
@@ -141,8 +278,26 @@ namespace aten
 
         uint32_t m_size{ 0 };
 
+        Format m_format{ Format::RGBA32F };
+
+        // Texels for Format::RGBA32F.
         std::vector<vec4> m_colors;
 
+        // Texels for the other formats.
+        std::vector<uint8_t> m_data;
+
+        // Decoded texels of the compact formats for colors().
+        mutable std::vector<vec4> m_decoded;
+
+        // If the texture is tiled, the texels are read from the cache.
+        TextureCache* m_cache{ nullptr };
+        int m_cacheFileId{ -1 };
+
+        // Mip levels except the original image. m_mips[0] is the level 1.
+        std::vector<MipLevel> m_mips;
+
+        Filter m_filter{ Filter::Point };
+
         uint32_t m_gltex{ 0 };
 
         std::string m_name;
@@ -0,0 +1,458 @@
+#include <algorithm>
+#include <string.h>
+
+#include "texture/texturecache.h"
+#include "misc/atomicfile.h"
+
+namespace aten
+{
+    const uint32_t TextureCache::TileSize;
+    const uint32_t TextureCache::MaxFetchTexelNum;
+
+    struct TiledFileHeader {
+        uint8_t magic[4];
+        uint8_t version[4];
+        uint32_t width;
+        uint32_t height;
+        uint32_t channels;
+        uint32_t format;
+        uint32_t tileSize;
+        uint32_t levelNum;
+        uint64_t sourceKey;
+    };
+
+    struct TiledLevelHeader {
+        uint32_t width;
+        uint32_t height;
+        uint32_t tilesX;
+        uint32_t tilesY;
+        uint64_t offset;
+    };
+
+    static bool seekFile(FILE* fp, uint64_t offset)
+    {
+#if defined(_WIN32) || defined(_WIN64)
+        return _fseeki64(fp, (__int64)offset, SEEK_SET) == 0;
+#else
+        return fseeko(fp, (off_t)offset, SEEK_SET) == 0;
+#endif
+    }
+
+    TextureCache::~TextureCache()
+    {
+        clear();
+
+        for (auto& file : m_files) {
+            if (file->fp) {
+                fclose(file->fp);
+            }
+        }
+    }
+
+    bool TextureCache::writeTiledFile(const char* path, const texture& tex, uint64_t sourceKey)
+    {
+        AT_VRETURN(!tex.isTiled(), false);
+
+        const uint32_t texelSize = texture::getTexelSize(tex.getFormat());
+        const uint32_t tileBytes = TileSize * TileSize * texelSize;
+        const uint32_t levelNum = tex.getMipLevelNum();
+
+        TiledFileHeader header;
+        {
+            header.magic[0] = 'A';
+            header.magic[1] = 'T';
+            header.magic[2] = 'T';
+            header.magic[3] = 'C';
+
+            header.version[0] = 0;
+            header.version[1] = 0;
+            header.version[2] = 0;
+            header.version[3] = 2;
+
+            header.width = tex.width();
+            header.height = tex.height();
+            header.channels = tex.channels();
+            header.format = (uint32_t)tex.getFormat();
+            header.tileSize = TileSize;
+            header.levelNum = levelNum;
+            header.sourceKey = sourceKey;
+        }
+
+        std::vector<TiledLevelHeader> levels(levelNum);
+
+        uint64_t offset = sizeof(TiledFileHeader) + sizeof(TiledLevelHeader) * levelNum;
+
+        for (uint32_t i = 0; i < levelNum; i++) {
+            auto& level = levels[i];
+
+            tex.getLevelSize(i, level.width, level.height);
+
+            level.tilesX = (level.width + TileSize - 1) / TileSize;
+            level.tilesY = (level.height + TileSize - 1) / TileSize;
+            level.offset = offset;
+
+            offset += (uint64_t)level.tilesX * level.tilesY * tileBytes;
+        }
+
+        const auto tmpPath = AtomicFile::getTemporaryPath(path);
+
+        FILE* fp = fopen(tmpPath.c_str(), "wb");
+        if (!fp) {
+            AT_PRINTF("Failed to open %s\n", tmpPath.c_str());
+            return false;
+        }
+
+        bool isSaved = (fwrite(&header, sizeof(header), 1, fp) == 1)
+            && (fwrite(&levels[0], sizeof(TiledLevelHeader), levelNum, fp) == levelNum);
+
+        std::vector<uint8_t> tile(tileBytes);
+
+        for (uint32_t i = 0; isSaved && i < levelNum; i++) {
+            const auto& level = levels[i];
+            const auto src = reinterpret_cast<const uint8_t*>(tex.getLevelData(i));
+
+            for (uint32_t ty = 0; isSaved && ty < level.tilesY; ty++) {
+                for (uint32_t tx = 0; isSaved && tx < level.tilesX; tx++) {
+                    // Texels out of the image are filled with zero.
+                    memset(&tile[0], 0, tileBytes);
+
+                    uint32_t x = tx * TileSize;
+                    uint32_t w = std::min(TileSize, level.width - x);
+
+                    for (uint32_t y = 0; y < TileSize; y++) {
+                        uint32_t yy = ty * TileSize + y;
+                        if (yy >= level.height) {
+                            break;
+                        }
+
+                        memcpy(
+                            &tile[y * TileSize * texelSize],
+                            &src[((size_t)yy * level.width + x) * texelSize],
+                            w * texelSize);
+                    }
+
+                    isSaved = (fwrite(&tile[0], 1, tileBytes, fp) == tileBytes);
+                }
+            }
+        }
+
+        isSaved = (fclose(fp) == 0) && isSaved;
+
+        if (!isSaved) {
+            AT_PRINTF("Failed to write %s\n", tmpPath.c_str());
+            remove(tmpPath.c_str());
+            return false;
+        }
+
+        return AtomicFile::replace(tmpPath, path);
+    }
+
+    int TextureCache::open(const char* path, uint64_t sourceKey)
+    {
+        FILE* fp = fopen(path, "rb");
+        if (!fp) {
+            return -1;
+        }
+
+        TiledFileHeader header;
+
+        if (fread(&header, sizeof(header), 1, fp) != 1
+            || memcmp(header.magic, "ATTC", 4) != 0
+            || header.version[3] != 2
+            || header.tileSize != TileSize
+            || header.levelNum == 0)
+        {
+            AT_PRINTF("%s is not the tiled texture\n", path);
+            fclose(fp);
+            return -1;
+        }
+
+        if (header.sourceKey != sourceKey) {
+            // The source image has been updated since the file was written.
+            AT_PRINTF("%s is stale\n", path);
+            fclose(fp);
+            return -1;
+        }
+
+        std::unique_ptr<File> file(new File());
+
+        file->info.width = header.width;
+        file->info.height = header.height;
+        file->info.channels = header.channels;
+        file->info.format = (texture::Format)header.format;
+        file->info.levelNum = header.levelNum;
+
+        file->texelSize = texture::getTexelSize(file->info.format);
+        file->tileBytes = TileSize * TileSize * file->texelSize;
+
+        std::vector<TiledLevelHeader> levels(header.levelNum);
+
+        if (fread(&levels[0], sizeof(TiledLevelHeader), header.levelNum, fp) != header.levelNum) {
+            AT_PRINTF("Failed to read %s\n", path);
+            fclose(fp);
+            return -1;
+        }
+
+        for (const auto& l : levels) {
+            LevelInfo level;
+            level.width = l.width;
+            level.height = l.height;
+            level.tilesX = l.tilesX;
+            level.tilesY = l.tilesY;
+            level.offset = l.offset;
+
+            file->levels.push_back(level);
+        }
+
+        file->fp = fp;
+
+        m_files.push_back(std::move(file));
+
+        return (int)m_files.size() - 1;
+    }
+
+    void TextureCache::getLevelSize(
+        int fileId, uint32_t level,
+        uint32_t& width, uint32_t& height) const
+    {
+        AT_ASSERT(0 <= fileId && fileId < (int)m_files.size());
+
+        const auto& file = *m_files[fileId];
+        AT_ASSERT(level < file.levels.size());
+
+        width = file.levels[level].width;
+        height = file.levels[level].height;
+    }
+
+    bool TextureCache::computeHash(int fileId, uint64_t& hash)
+    {
+        AT_ASSERT(0 <= fileId && fileId < (int)m_files.size());
+
+        auto& file = *m_files[fileId];
+        const auto& level = file.levels[0];
+
+        const uint32_t tileNum = level.tilesX * level.tilesY;
+
+        std::vector<uint8_t> tile(file.tileBytes);
+
+        std::lock_guard<std::mutex> lock(file.mutex);
+
+        if (!seekFile(file.fp, level.offset)) {
+            return false;
+        }
+
+        for (uint32_t i = 0; i < tileNum; i++) {
+            if (fread(&tile[0], 1, file.tileBytes, file.fp) != file.tileBytes) {
+                AT_PRINTF("Failed to read the tile %d to hash\n", i);
+                return false;
+            }
+
+            for (uint32_t n = 0; n < file.tileBytes; n++) {
+                hash ^= tile[n];
+                hash *= 1099511628211ULL;
+            }
+        }
+
+        return true;
+    }
+
+    bool TextureCache::fetchTexel(
+        int fileId, uint32_t level,
+        uint32_t x, uint32_t y,
+        uint8_t* dst)
+    {
+        const auto& file = *m_files[fileId];
+        const auto& info = file.levels[level];
+
+        AT_ASSERT(x < info.width && y < info.height);
+
+        uint32_t tileIdx = (y / TileSize) * info.tilesX + (x / TileSize);
+
+        auto tile = getTile(fileId, level, tileIdx);
+        if (!tile) {
+            return false;
+        }
+
+        uint32_t pos = (y % TileSize) * TileSize + (x % TileSize);
+
+        memcpy(dst, &(*tile)[pos * file.texelSize], file.texelSize);
+
+        return true;
+    }
+
+    bool TextureCache::fetchTexels(
+        int fileId, uint32_t level,
+        const uint32_t* xs, const uint32_t* ys,
+        uint32_t num,
+        uint8_t* dst)
+    {
+        AT_ASSERT(num <= MaxFetchTexelNum);
+
+        const auto& file = *m_files[fileId];
+        const auto& info = file.levels[level];
+
+        uint32_t tileIdxs[MaxFetchTexelNum];
+        std::shared_ptr<Tile> tiles[MaxFetchTexelNum];
+
+        for (uint32_t i = 0; i < num; i++) {
+            const uint32_t x = xs[i];
+            const uint32_t y = ys[i];
+
+            AT_ASSERT(x < info.width && y < info.height);
+
+            tileIdxs[i] = (y / TileSize) * info.tilesX + (x / TileSize);
+
+            // Reuse the tile if the previous texel is in the same tile.
+            for (uint32_t n = 0; n < i; n++) {
+                if (tileIdxs[n] == tileIdxs[i]) {
+                    tiles[i] = tiles[n];
+                    break;
+                }
+            }
+
+            if (!tiles[i]) {
+                tiles[i] = getTile(fileId, level, tileIdxs[i]);
+                if (!tiles[i]) {
+                    return false;
+                }
+            }
+
+            uint32_t pos = (y % TileSize) * TileSize + (x % TileSize);
+
+            memcpy(&dst[i * file.texelSize], &(*tiles[i])[pos * file.texelSize], file.texelSize);
+        }
+
+        return true;
+    }
+
+    std::shared_ptr<TextureCache::Tile> TextureCache::getTile(int fileId, uint32_t level, uint32_t tileIdx)
+    {
+        // File : 24 bits, Level : 8 bits, Tile : 32 bits.
+        const uint64_t key = ((uint64_t)fileId << 40) | ((uint64_t)level << 32) | tileIdx;
+
+        // Mix the bits, not to put the neighbour tiles into the same shard.
+        const uint32_t shardIdx = (uint32_t)((key * 0x9e3779b97f4a7c15ULL) >> 60) % ShardNum;
+
+        auto& shard = m_shards[shardIdx];
+
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+
+            auto it = shard.tiles.find(key);
+            if (it != shard.tiles.end()) {
+                // Move to the front as the most recently used.
+                shard.lru.splice(shard.lru.begin(), shard.lru, it->second.it);
+
+                m_hit++;
+                return it->second.tile;
+            }
+        }
+
+        m_miss++;
+
+        // Read without the shard lock, not to block the other threads which access the resident tiles.
+        auto tile = readTile(*m_files[fileId], level, tileIdx);
+        if (!tile) {
+            return nullptr;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+
+            auto it = shard.tiles.find(key);
+            if (it != shard.tiles.end()) {
+                // The other thread has already read the same tile.
+                return it->second.tile;
+            }
+
+            shard.lru.push_front(key);
+
+            Shard::Entry entry;
+            entry.tile = tile;
+            entry.it = shard.lru.begin();
+
+            shard.tiles.insert(std::make_pair(key, entry));
+
+            m_residentBytes += tile->size();
+        }
+
+        evictIfNeeded(shardIdx);
+
+        return tile;
+    }
+
+    std::shared_ptr<TextureCache::Tile> TextureCache::readTile(File& file, uint32_t level, uint32_t tileIdx)
+    {
+        std::shared_ptr<Tile> tile = std::make_shared<Tile>(file.tileBytes);
+
+        const uint64_t offset = file.levels[level].offset + (uint64_t)tileIdx * file.tileBytes;
+
+        std::lock_guard<std::mutex> lock(file.mutex);
+
+        if (!seekFile(file.fp, offset)
+            || fread(&(*tile)[0], 1, file.tileBytes, file.fp) != file.tileBytes)
+        {
+            AT_PRINTF("Failed to read the tile %d of the level %d\n", tileIdx, level);
+            return nullptr;
+        }
+
+        return tile;
+    }
+
+    void TextureCache::evictIfNeeded(uint32_t startShard)
+    {
+        // Evict from the shard which has just got the tile at first, and then from the other shards.
+        // The evicted tiles which are still being read are alive until they are released by the readers.
+        for (uint32_t i = 0; i < ShardNum && m_residentBytes > m_budget; i++) {
+            auto& shard = m_shards[(startShard + i) % ShardNum];
+
+            std::lock_guard<std::mutex> lock(shard.mutex);
+
+            while (m_residentBytes > m_budget && !shard.lru.empty()) {
+                auto key = shard.lru.back();
+                shard.lru.pop_back();
+
+                auto it = shard.tiles.find(key);
+                AT_ASSERT(it != shard.tiles.end());
+
+                m_residentBytes -= it->second.tile->size();
+                shard.tiles.erase(it);
+
+                m_eviction++;
+            }
+        }
+    }
+
+    TextureCache::Statistics TextureCache::getStatistics() const
+    {
+        Statistics ret;
+
+        ret.hit = m_hit;
+        ret.miss = m_miss;
+        ret.eviction = m_eviction;
+        ret.residentBytes = m_residentBytes;
+
+        return ret;
+    }
+
+    void TextureCache::resetStatistics()
+    {
+        m_hit = 0;
+        m_miss = 0;
+        m_eviction = 0;
+    }
+
+    void TextureCache::clear()
+    {
+        for (auto& shard : m_shards) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+
+            for (const auto& it : shard.tiles) {
+                m_residentBytes -= it.second.tile->size();
+            }
+
+            shard.tiles.clear();
+            shard.lru.clear();
+        }
+    }
+}
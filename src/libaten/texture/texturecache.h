@@ -0,0 +1,197 @@
+#pragma once
+
+#include <atomic>
+#include <cstdio>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "defs.h"
+#include "types.h"
+#include "texture/texture.h"
+
+namespace aten
+{
+    /**
+     * @brief Cache of the texture tiles which are loaded lazily from the tiled files.
+     *
+     * The texture is converted once to the tiled file, which has all mip levels split into TileSize x TileSize tiles.
+     * The tile is read from the file when one of its texels is accessed first,
+     * and the resident tiles are bounded by the memory budget.
+     * When the budget is exceeded, the least recently used tiles are evicted.
+     *
+     * To reduce the lock contention, the tiles are distributed to the shards by their keys,
+     * and each shard has its own lock and LRU list.
+     *
+     * @note The files have to be opened before rendering. Opening a file while fetching texels is not thread safe.
+     */
+    class TextureCache {
+    public:
+        TextureCache() {}
+        ~TextureCache();
+
+        TextureCache(const TextureCache&) = delete;
+        TextureCache& operator=(const TextureCache&) = delete;
+
+    public:
+        static const uint32_t TileSize = 64;
+
+        /**
+         * @brief Description of the tiled file.
+         */
+        struct FileInfo {
+            uint32_t width{ 0 };
+            uint32_t height{ 0 };
+            uint32_t channels{ 0 };
+            texture::Format format{ texture::Format::RGBA32F };
+            uint32_t levelNum{ 0 };
+        };
+
+        /**
+         * @brief Statistics of the cache.
+         */
+        struct Statistics {
+            uint64_t hit{ 0 };          ///< Number of the accesses to the resident tiles.
+            uint64_t miss{ 0 };         ///< Number of the accesses which read the tile from the file.
+            uint64_t eviction{ 0 };     ///< Number of the evicted tiles.
+            size_t residentBytes{ 0 };  ///< Size of the resident tiles.
+        };
+
+        /**
+         * @brief Write the texture as the tiled file.
+         * All mip levels of the texture are written in its format.
+         * @param sourceKey Key to identify the source image, e.g. from its size and modified time.
+         */
+        static bool writeTiledFile(const char* path, const texture& tex, uint64_t sourceKey = 0);
+
+        /**
+         * @brief Open the tiled file.
+         * @param sourceKey Key of the current source image. If it is different from the key in the file, the file is stale.
+         * @return Id of the file. If the file can't be opened or it is stale, -1 is returned.
+         */
+        int open(const char* path, uint64_t sourceKey = 0);
+
+        const FileInfo& getFileInfo(int fileId) const
+        {
+            AT_ASSERT(0 <= fileId && fileId < (int)m_files.size());
+            return m_files[fileId]->info;
+        }
+
+        void getLevelSize(
+            int fileId, uint32_t level,
+            uint32_t& width, uint32_t& height) const;
+
+        /**
+         * @brief Hash the texels of the original level in the tiled file with FNV-1a.
+         * The tiles are read directly from the file, and they are not resident in the cache.
+         * @param hash Hash value to be continued, and the result.
+         * @return If the file can't be read, returns false.
+         */
+        bool computeHash(int fileId, uint64_t& hash);
+
+        /**
+         * @brief Copy the texel in the format of the file.
+         * @param dst Destination. It has to have the size of one texel.
+         * @return If the tile can't be read, returns false.
+         */
+        bool fetchTexel(
+            int fileId, uint32_t level,
+            uint32_t x, uint32_t y,
+            uint8_t* dst);
+
+        static const uint32_t MaxFetchTexelNum = 4;
+
+        /**
+         * @brief Copy the texels in the format of the file.
+         * The tile is looked up once for the texels in it, so the lock is taken per tile, not per texel.
+         * It is for the footprint of the filter.
+         * @param xs, ys Coordinates of the texels. The number of the texels has to be MaxFetchTexelNum or less.
+         * @param dst Destination. It has to have the size of num texels.
+         * @return If the tile can't be read, returns false.
+         */
+        bool fetchTexels(
+            int fileId, uint32_t level,
+            const uint32_t* xs, const uint32_t* ys,
+            uint32_t num,
+            uint8_t* dst);
+
+        /**
+         * @brief Set the memory budget for the resident tiles in bytes.
+         */
+        void setMemoryBudget(size_t bytes)
+        {
+            m_budget = bytes;
+        }
+
+        size_t getMemoryBudget() const
+        {
+            return m_budget;
+        }
+
+        Statistics getStatistics() const;
+
+        void resetStatistics();
+
+        /**
+         * @brief Evict all resident tiles.
+         */
+        void clear();
+
+    private:
+        using Tile = std::vector<uint8_t>;
+
+        struct LevelInfo {
+            uint32_t width;
+            uint32_t height;
+            uint32_t tilesX;
+            uint32_t tilesY;
+            uint64_t offset;    ///< Offset of the first tile in the file.
+        };
+
+        struct File {
+            FileInfo info;
+            std::vector<LevelInfo> levels;
+            uint32_t texelSize{ 0 };
+            uint32_t tileBytes{ 0 };
+
+            FILE* fp{ nullptr };
+            std::mutex mutex;
+        };
+
+        struct Shard {
+            struct Entry {
+                std::shared_ptr<Tile> tile;
+                std::list<uint64_t>::iterator it;
+            };
+
+            std::mutex mutex;
+
+            // Front is the most recently used.
+            std::list<uint64_t> lru;
+            std::unordered_map<uint64_t, Entry> tiles;
+        };
+
+        static const uint32_t ShardNum = 16;
+
+        std::shared_ptr<Tile> getTile(int fileId, uint32_t level, uint32_t tileIdx);
+
+        std::shared_ptr<Tile> readTile(File& file, uint32_t level, uint32_t tileIdx);
+
+        void evictIfNeeded(uint32_t startShard);
+
+    private:
+        std::vector<std::unique_ptr<File>> m_files;
+
+        Shard m_shards[ShardNum];
+
+        size_t m_budget{ size_t(1) << 30 };
+        std::atomic<size_t> m_residentBytes{ 0 };
+
+        std::atomic<uint64_t> m_hit{ 0 };
+        std::atomic<uint64_t> m_miss{ 0 };
+        std::atomic<uint64_t> m_eviction{ 0 };
+    };
+}
@@ -1,4 +1,6 @@
 #include <map>
+#include <sys/types.h>
+#include <sys/stat.h>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
@@ -9,12 +11,71 @@
 
 namespace aten {
     static std::string g_base;
+    static bool g_useCompactFormat = true;
+
+    static TextureCache* g_texCache = nullptr;
+    static std::string g_texCacheDir;
 
     void ImageLoader::setBasePath(const std::string& base)
     {
         g_base = removeTailPathSeparator(base);
     }
 
+    void ImageLoader::setUseCompactFormat(bool use)
+    {
+        g_useCompactFormat = use;
+    }
+
+    void ImageLoader::setTextureCache(TextureCache* cache, const std::string& dir)
+    {
+        g_texCache = cache;
+        g_texCacheDir = removeTailPathSeparator(dir);
+    }
+
+    static std::string getTiledFilePath(
+        const std::string& fullpath,
+        const std::string& texname)
+    {
+        // FNV-1a of the full path, to distinguish the same name images in the different directories.
+        uint64_t hash = 14695981039346656037ULL;
+        for (auto c : fullpath) {
+            hash ^= (uint8_t)c;
+            hash *= 1099511628211ULL;
+        }
+
+        char buf[32];
+        snprintf(buf, sizeof(buf), ".%016llx.attc", (unsigned long long)hash);
+
+        std::string path = texname + buf;
+        if (!g_texCacheDir.empty()) {
+            path = g_texCacheDir + "/" + path;
+        }
+
+        return path;
+    }
+
+    static uint64_t getSourceKey(const std::string& fullpath)
+    {
+        // The tiled file is rebuilt if the size or the modified time of the source image is changed.
+        struct stat st;
+        if (stat(fullpath.c_str(), &st) != 0) {
+            return 0;
+        }
+
+        const uint64_t values[2] = { (uint64_t)st.st_size, (uint64_t)st.st_mtime };
+
+        // FNV-1a.
+        uint64_t hash = 14695981039346656037ULL;
+        auto p = reinterpret_cast<const uint8_t*>(values);
+
+        for (size_t i = 0; i < sizeof(values); i++) {
+            hash ^= p[i];
+            hash *= 1099511628211ULL;
+        }
+
+        return hash;
+    }
+
     texture* ImageLoader::load(
         const std::string& path,
         context& ctxt)
@@ -51,17 +112,22 @@ namespace aten {
                 int idx = y * width + x;
                 idx *= skipChannel;
 
+                vec4 clr(real(0), real(0), real(0), real(1));
+
                 switch (channel) {
                 case 4:
-                    (*tex)(x, y, 3) = src[idx + 3] * norm;
+                    clr.w = src[idx + 3] * norm;
                 case 3:
-                    (*tex)(x, y, 2) = src[idx + 2] * norm;
+                    clr.z = src[idx + 2] * norm;
                 case 2:
-                    (*tex)(x, y, 1) = src[idx + 1] * norm;
+                    clr.y = src[idx + 1] * norm;
                 case 1:
-                    (*tex)(x, y, 0) = src[idx + 0] * norm;
+                    clr.x = src[idx + 0] * norm;
                     break;
                 }
+
+                // Encoded to the format of the texture.
+                tex->setTexel(x, y, clr);
             }
         }
     }
@@ -95,6 +161,27 @@ namespace aten {
             return tex;
         }
 
+        std::string tiledPath;
+        uint64_t sourceKey = 0;
+
+        if (g_texCache) {
+            tiledPath = getTiledFilePath(fullpath, texname);
+            sourceKey = getSourceKey(fullpath);
+
+            int fileId = g_texCache->open(tiledPath.c_str(), sourceKey);
+
+            if (fileId >= 0) {
+                // The texels are read from the tiled file.
+                tex = ctxt.createTexture(0, 0, 0, texname.c_str());
+                tex->attachTiledFile(g_texCache, fileId);
+                tex->setFilter(texture::Filter::Trilinear);
+
+                AssetManager::registerTex(tag, tex);
+
+                return tex;
+            }
+        }
+
         real* dst = nullptr;
         int width = 0;
         int height = 0;
@@ -103,7 +190,11 @@ namespace aten {
         if (stbi_is_hdr(fullpath.c_str())) {
             auto src = stbi_loadf(fullpath.c_str(), &width, &height, &channels, 0);
             if (src) {
-                tex = ctxt.createTexture(width, height, channels, texname.c_str());
+                auto format = g_useCompactFormat
+                    ? texture::Format::RGBE
+                    : texture::Format::RGBA32F;
+
+                tex = ctxt.createTexture(width, height, channels, texname.c_str(), format);
                 real norm = real(1);
                 read<float>(src, tex, width, height, channels, norm);
 
@@ -113,7 +204,15 @@ namespace aten {
         else {
             auto src = stbi_load(fullpath.c_str(), &width, &height, &channels, 0);
             if (src) {
-                tex = ctxt.createTexture(width, height, channels, texname.c_str());
+                auto format = texture::Format::RGBA32F;
+
+                if (g_useCompactFormat) {
+                    format = (channels == 1
+                        ? texture::Format::R8
+                        : channels == 2 ? texture::Format::RG8 : texture::Format::RGBA8);
+                }
+
+                tex = ctxt.createTexture(width, height, channels, texname.c_str(), format);
                 real norm = real(1) / real(255);
 
                 read<stbi_uc>(src, tex, width, height, channels, norm);
@@ -123,6 +222,22 @@ namespace aten {
         }
 
         if (tex) {
+            tex->buildMipmap();
+            tex->setFilter(texture::Filter::Trilinear);
+
+            if (g_texCache) {
+                // Convert to the tiled file, and release the texels in the memory.
+                int fileId = -1;
+
+                if (TextureCache::writeTiledFile(tiledPath.c_str(), *tex, sourceKey)) {
+                    fileId = g_texCache->open(tiledPath.c_str(), sourceKey);
+                }
+
+                if (fileId >= 0) {
+                    tex->attachTiledFile(g_texCache, fileId);
+                }
+            }
+
             AssetManager::registerTex(tag, tex);
         }
         else {
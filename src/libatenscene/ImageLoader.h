@@ -2,6 +2,7 @@
 
 #include <string>
 #include "texture/texture.h"
+#include "texture/texturecache.h"
 #include "scene/context.h"
 
 namespace aten {
@@ -13,6 +14,21 @@ namespace aten {
     public:
         static void setBasePath(const std::string& base);
 
+        /**
+         * @brief Set whether the images are stored in the compact formats.
+         * If true (default), 8 bit images are stored as 8 bit per channel, and HDR images are stored as RGBE.
+         * If false, all images are stored as float.
+         */
+        static void setUseCompactFormat(bool use);
+
+        /**
+         * @brief Set the cache to load the textures out of core.
+         * The image is converted once to the tiled file in the directory, and its tiles are loaded lazily by the cache.
+         * If the tiled file exists, the image is not decoded.
+         * If the cache is nullptr, the images are loaded into the memory.
+         */
+        static void setTextureCache(TextureCache* cache, const std::string& dir);
+
         static texture* load(
             const std::string& path,
             context& ctxt);
@@ -120,7 +120,10 @@ namespace aten
         std::vector<MtrlExportInfo> mtrlInfos;
 
         for (const auto mtrl : mtrls) {
-            mtrlInfos.push_back(MtrlExportInfo(mtrl->name(), mtrl->param()));
+            // Skip the empty slot of the removed material.
+            if (mtrl) {
+                mtrlInfos.push_back(MtrlExportInfo(mtrl->name(), mtrl->param()));
+            }
         }
 
         return exportMaterial(lpszOutFile, mtrlInfos);
@@ -0,0 +1,306 @@
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <string.h>
+
+#include "ObjCache.h"
+#include "utility.h"
+
+namespace aten
+{
+    // Type in the header of the cache file, to distinguish it from the cache of the structure tree.
+    static const uint32_t ObjCacheType = 0x4a424f; // 'OBJ'
+
+    // Sections of the cache.
+    enum ObjCacheSection : uint32_t {
+        ObjCacheShapes,
+        ObjCacheVertices,
+        ObjCacheIndices,
+        ObjCacheFaceMaterials,
+        ObjCacheMaterials,
+        ObjCacheStrings,
+    };
+
+    bool ObjCache::makeKey(
+        const std::string& objPath,
+        bool needComputeNormalOntime,
+        uint64_t& key)
+    {
+        struct stat st;
+        if (stat(objPath.c_str(), &st) != 0) {
+            return false;
+        }
+
+        AccelCacheHasher hasher;
+
+        hasher.add(objPath.c_str(), objPath.length());
+
+        hasher.add((uint64_t)st.st_size);
+        hasher.add((uint64_t)st.st_mtime);
+
+        hasher.add((uint32_t)needComputeNormalOntime);
+
+        // If the layout is changed, the cache is not valid.
+        hasher.add((uint32_t)sizeof(vertex));
+        hasher.add((uint32_t)sizeof(Shape));
+
+        key = hasher.value();
+
+        return true;
+    }
+
+    std::string ObjCache::getPath(
+        const std::string& dir,
+        const std::string& objPath)
+    {
+        std::string pathname;
+        std::string extname;
+        std::string filename;
+
+        getStringsFromPath(objPath, pathname, extname, filename);
+
+        // Same name may be in the different directories.
+        AccelCacheHasher hasher;
+        hasher.add(objPath.c_str(), objPath.length());
+
+        char name[32];
+        snprintf(name, sizeof(name), "_%016llx.objcache", (unsigned long long)hasher.value());
+
+        std::string path(dir);
+        if (!path.empty() && path.back() != '/' && path.back() != '\\') {
+            path += "/";
+        }
+        path += filename;
+        path += name;
+
+        return path;
+    }
+
+    bool ObjCache::open(const std::string& path, uint64_t key)
+    {
+        if (!m_reader.open(path, ObjCacheType, key)) {
+            return false;
+        }
+
+        m_shapes = m_reader.getSection<Shape>(ObjCacheShapes, m_shapeNum);
+        m_vertices = m_reader.getSection<vertex>(ObjCacheVertices, m_vtxNum);
+        m_indices = m_reader.getSection<uint32_t>(ObjCacheIndices, m_idxNum);
+        m_mtrls = m_reader.getSection<Material>(ObjCacheMaterials, m_mtrlNum);
+        m_strings = m_reader.getSection<char>(ObjCacheStrings, m_strNum);
+
+        uint32_t faceNum = 0;
+        m_faceMtrls = m_reader.getSection<int32_t>(ObjCacheFaceMaterials, faceNum);
+
+        // The string table has the empty string at least.
+        bool isValid = m_shapes && m_vertices && m_indices && m_faceMtrls && m_mtrls && m_strings
+            && m_strNum > 0 && m_strings[m_strNum - 1] == 0
+            && faceNum * 3 == m_idxNum;
+
+        for (uint32_t i = 0; isValid && i < m_shapeNum; i++) {
+            const auto& s = m_shapes[i];
+            isValid = (uint64_t)s.vtxOffset + s.vtxNum <= m_vtxNum
+                && (uint64_t)s.idxOffset + s.idxNum <= m_idxNum
+                && (s.idxOffset % 3) == 0
+                && (s.idxNum % 3) == 0;
+
+            // Indices are relative to the vertices of the shape.
+            for (uint32_t n = 0; isValid && n < s.idxNum; n++) {
+                isValid = m_indices[s.idxOffset + n] < s.vtxNum;
+            }
+        }
+
+        // The face which doesn't have the material has -1.
+        for (uint32_t i = 0; isValid && i < faceNum; i++) {
+            isValid = m_faceMtrls[i] >= -1
+                && m_faceMtrls[i] < (int64_t)m_mtrlNum;
+        }
+
+        for (uint32_t i = 0; isValid && i < m_mtrlNum; i++) {
+            const auto& m = m_mtrls[i];
+            isValid = m.name < m_strNum
+                && m.diffuseTex < m_strNum
+                && m.bumpTex < m_strNum;
+        }
+
+        if (!isValid) {
+            AT_PRINTF("%s is broken\n", path.c_str());
+            m_reader.close();
+
+            m_shapes = nullptr;
+            m_vertices = nullptr;
+            m_indices = nullptr;
+            m_faceMtrls = nullptr;
+            m_mtrls = nullptr;
+            m_strings = nullptr;
+
+            m_shapeNum = m_vtxNum = m_idxNum = m_mtrlNum = m_strNum = 0;
+        }
+
+        return isValid;
+    }
+
+    uint32_t ObjCache::addString(const std::string& str)
+    {
+        if (str.empty()) {
+            // Top of the table is the empty string.
+            return 0;
+        }
+
+        auto offset = (uint32_t)m_strList.size();
+        m_strList.insert(m_strList.end(), str.begin(), str.end());
+        m_strList.push_back(0);
+
+        return offset;
+    }
+
+    void ObjCache::build(
+        const std::vector<tinyobj::shape_t>& shapes,
+        const std::vector<tinyobj::material_t>& mtrls,
+        bool needComputeNormalOntime)
+    {
+        m_shapeList.clear();
+        m_vtxList.clear();
+        m_idxList.clear();
+        m_faceMtrlList.clear();
+        m_mtrlList.clear();
+        m_strList.clear();
+
+        m_strList.push_back(0);
+
+        size_t vtxNum = 0;
+        size_t idxNum = 0;
+        for (const auto& shape : shapes) {
+            vtxNum += shape.mesh.positions.size() / 3;
+            idxNum += shape.mesh.indices.size();
+        }
+
+        m_vtxList.reserve(vtxNum);
+        m_idxList.reserve(idxNum);
+        m_faceMtrlList.reserve(idxNum / 3);
+
+        for (const auto& shape : shapes) {
+            const auto& mesh = shape.mesh;
+
+            Shape dst;
+            memset(&dst, 0, sizeof(dst));
+
+            dst.vtxOffset = (uint32_t)m_vtxList.size();
+            dst.vtxNum = (uint32_t)(mesh.positions.size() / 3);
+            dst.idxOffset = (uint32_t)m_idxList.size();
+            dst.idxNum = (uint32_t)(mesh.indices.size() / 3 * 3);
+
+            // Flag not to specify normal.
+            dst.needNormal = (mesh.normals.empty() || needComputeNormalOntime) ? 1 : 0;
+
+            vec3 pmin = vec3(AT_MATH_INF);
+            vec3 pmax = vec3(-AT_MATH_INF);
+
+            // NOTE
+            // tinyobjloader only pushes the texture coordinates of the vertices which have them,
+            // so they may be fewer than the vertices.
+            const uint32_t texcoordNum = (uint32_t)(mesh.texcoords.size() / 2);
+
+            for (uint32_t i = 0; i < dst.vtxNum; i++) {
+                vertex vtx;
+
+                vtx.pos.x = mesh.positions[i * 3 + 0];
+                vtx.pos.y = mesh.positions[i * 3 + 1];
+                vtx.pos.z = mesh.positions[i * 3 + 2];
+                vtx.pos.w = real(0);
+
+                if (!mesh.normals.empty()) {
+                    vtx.nml.x = mesh.normals[i * 3 + 0];
+                    vtx.nml.y = mesh.normals[i * 3 + 1];
+                    vtx.nml.z = mesh.normals[i * 3 + 2];
+                }
+
+                if (std::isnan(vtx.nml.x) || std::isnan(vtx.nml.y) || std::isnan(vtx.nml.z))
+                {
+                    // TODO
+                    // work around...
+                    vtx.nml = aten::vec4(real(0), real(1), real(0), 1);
+                }
+
+                if (texcoordNum > 0) {
+                    if (i < texcoordNum) {
+                        vtx.uv.x = mesh.texcoords[i * 2 + 0];
+                        vtx.uv.y = mesh.texcoords[i * 2 + 1];
+                    }
+                    vtx.uv.z = dst.needNormal ? real(1) : real(0);
+                }
+                else {
+                    // Specify not have texture coordinates.
+                    vtx.uv.z = real(-1);
+                }
+
+                m_vtxList.push_back(vtx);
+
+                pmin = vec3(
+                    std::min(pmin.x, vtx.pos.x),
+                    std::min(pmin.y, vtx.pos.y),
+                    std::min(pmin.z, vtx.pos.z));
+                pmax = vec3(
+                    std::max(pmax.x, vtx.pos.x),
+                    std::max(pmax.y, vtx.pos.y),
+                    std::max(pmax.z, vtx.pos.z));
+            }
+
+            dst.boxmin[0] = pmin.x;
+            dst.boxmin[1] = pmin.y;
+            dst.boxmin[2] = pmin.z;
+            dst.boxmax[0] = pmax.x;
+            dst.boxmax[1] = pmax.y;
+            dst.boxmax[2] = pmax.z;
+
+            m_idxList.insert(m_idxList.end(), mesh.indices.begin(), mesh.indices.begin() + dst.idxNum);
+
+            for (uint32_t i = 0; i < dst.idxNum / 3; i++) {
+                m_faceMtrlList.push_back(mesh.material_ids[i]);
+            }
+
+            m_shapeList.push_back(dst);
+        }
+
+        for (const auto& mtrl : mtrls) {
+            Material dst;
+
+            dst.diffuse[0] = mtrl.diffuse[0];
+            dst.diffuse[1] = mtrl.diffuse[1];
+            dst.diffuse[2] = mtrl.diffuse[2];
+
+            dst.name = addString(mtrl.name);
+            dst.diffuseTex = addString(mtrl.diffuse_texname);
+            dst.bumpTex = addString(mtrl.bump_texname);
+
+            m_mtrlList.push_back(dst);
+        }
+
+        m_shapes = m_shapeList.data();
+        m_vertices = m_vtxList.data();
+        m_indices = m_idxList.data();
+        m_faceMtrls = m_faceMtrlList.data();
+        m_mtrls = m_mtrlList.data();
+        m_strings = m_strList.data();
+
+        m_shapeNum = (uint32_t)m_shapeList.size();
+        m_vtxNum = (uint32_t)m_vtxList.size();
+        m_idxNum = (uint32_t)m_idxList.size();
+        m_mtrlNum = (uint32_t)m_mtrlList.size();
+        m_strNum = (uint32_t)m_strList.size();
+    }
+
+    bool ObjCache::write(const std::string& path, uint64_t key) const
+    {
+        AT_VRETURN_FALSE(m_strings);
+
+        AccelCacheWriter writer(ObjCacheType, key);
+
+        writer.addSection(ObjCacheShapes, m_shapes, sizeof(Shape), m_shapeNum);
+        writer.addSection(ObjCacheVertices, m_vertices, sizeof(vertex), m_vtxNum);
+        writer.addSection(ObjCacheIndices, m_indices, sizeof(uint32_t), m_idxNum);
+        writer.addSection(ObjCacheFaceMaterials, m_faceMtrls, sizeof(int32_t), m_idxNum / 3);
+        writer.addSection(ObjCacheMaterials, m_mtrls, sizeof(Material), m_mtrlNum);
+        writer.addSection(ObjCacheStrings, m_strings, sizeof(char), m_strNum);
+
+        return writer.write(path);
+    }
+}
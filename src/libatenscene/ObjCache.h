@@ -0,0 +1,158 @@
+#pragma once
+
+#include <vector>
+#include "tiny_obj_loader.h"
+#include "aten.h"
+
+namespace aten
+{
+    /**
+     * @brief Binary image of the parsed obj file.
+     *
+     * The image has the vertices which are baked as same as ObjLoader adds them to the context,
+     * so they can be copied to the context at once.
+     * The image is stored as the cache file which is mapped to the memory,
+     * so the obj file doesn't need to be parsed again if the cache is valid.
+     */
+    class ObjCache {
+    public:
+        ObjCache() {}
+        ~ObjCache() {}
+
+        ObjCache(const ObjCache&) = delete;
+        ObjCache& operator=(const ObjCache&) = delete;
+
+    public:
+        struct Shape {
+            // Range in the vertices.
+            uint32_t vtxOffset;
+            uint32_t vtxNum;
+
+            // Range in the indices. Each index is relative to vtxOffset.
+            uint32_t idxOffset;
+            uint32_t idxNum;
+
+            // Whether the faces need to compute the normal in real-time.
+            uint32_t needNormal;
+            uint32_t padding[3];
+
+            real boxmin[3];
+            real boxmax[3];
+        };
+
+        struct Material {
+            float diffuse[3];
+
+            // Offsets in the string table.
+            uint32_t name;
+            uint32_t diffuseTex;
+            uint32_t bumpTex;
+        };
+
+        /**
+         * @brief Make the key of the cache from the obj file.
+         * The key changes if the obj file is updated.
+         * @return If the obj file is not found, return false.
+         */
+        static bool makeKey(
+            const std::string& objPath,
+            bool needComputeNormalOntime,
+            uint64_t& key);
+
+        /**
+         * @brief Return the path of the cache file for the obj file.
+         */
+        static std::string getPath(
+            const std::string& dir,
+            const std::string& objPath);
+
+        /**
+         * @brief Open the cache file, and validate it with the key.
+         */
+        bool open(const std::string& path, uint64_t key);
+
+        /**
+         * @brief Build the image from the parsed obj file.
+         */
+        void build(
+            const std::vector<tinyobj::shape_t>& shapes,
+            const std::vector<tinyobj::material_t>& mtrls,
+            bool needComputeNormalOntime);
+
+        /**
+         * @brief Write the image to the cache file.
+         */
+        bool write(const std::string& path, uint64_t key) const;
+
+        uint32_t getShapeNum() const
+        {
+            return m_shapeNum;
+        }
+        const Shape& getShape(uint32_t idx) const
+        {
+            AT_ASSERT(idx < m_shapeNum);
+            return m_shapes[idx];
+        }
+
+        const vertex* getVertices(const Shape& shape) const
+        {
+            return m_vertices + shape.vtxOffset;
+        }
+        const uint32_t* getIndices(const Shape& shape) const
+        {
+            return m_indices + shape.idxOffset;
+        }
+
+        /**
+         * @brief Return the material indices of the faces in the shape.
+         */
+        const int32_t* getFaceMaterials(const Shape& shape) const
+        {
+            return m_faceMtrls + shape.idxOffset / 3;
+        }
+
+        uint32_t getMaterialNum() const
+        {
+            return m_mtrlNum;
+        }
+        const Material& getMaterial(uint32_t idx) const
+        {
+            AT_ASSERT(idx < m_mtrlNum);
+            return m_mtrls[idx];
+        }
+
+        const char* getString(uint32_t offset) const
+        {
+            AT_ASSERT(offset < m_strNum);
+            return m_strings + offset;
+        }
+
+    private:
+        uint32_t addString(const std::string& str);
+
+    private:
+        AccelCacheReader m_reader;
+
+        // Storage if the image is built from the obj file.
+        std::vector<Shape> m_shapeList;
+        std::vector<vertex> m_vtxList;
+        std::vector<uint32_t> m_idxList;
+        std::vector<int32_t> m_faceMtrlList;
+        std::vector<Material> m_mtrlList;
+        std::vector<char> m_strList;
+
+        // Point to the storage or the mapped file.
+        const Shape* m_shapes{ nullptr };
+        const vertex* m_vertices{ nullptr };
+        const uint32_t* m_indices{ nullptr };
+        const int32_t* m_faceMtrls{ nullptr };
+        const Material* m_mtrls{ nullptr };
+        const char* m_strings{ nullptr };
+
+        uint32_t m_shapeNum{ 0 };
+        uint32_t m_vtxNum{ 0 };
+        uint32_t m_idxNum{ 0 };
+        uint32_t m_mtrlNum{ 0 };
+        uint32_t m_strNum{ 0 };
+    };
+}
@@ -4,18 +4,74 @@
 #include "AssetManager.h"
 #include "utility.h"
 #include "ImageLoader.h"
+#include "ObjCache.h"
 
 //#pragma optimize( "", off)
 
 namespace aten
 {
     static std::string g_base;
+    static std::string g_cacheDir;
 
     void ObjLoader::setBasePath(const std::string& base)
     {
         g_base = removeTailPathSeparator(base);
     }
 
+    void ObjLoader::setCacheDirectory(const std::string& dir)
+    {
+        g_cacheDir = removeTailPathSeparator(dir);
+    }
+
+    static bool readObj(
+        ObjCache& cache,
+        const std::string& path,
+        const std::string& mtrlBasePath,
+        bool needComputeNormalOntime)
+    {
+        uint64_t key = 0;
+        std::string cachePath;
+
+        if (!g_cacheDir.empty()
+            && ObjCache::makeKey(path, needComputeNormalOntime, key))
+        {
+            cachePath = ObjCache::getPath(g_cacheDir, path);
+
+            if (cache.open(cachePath, key)) {
+                return true;
+            }
+        }
+
+        std::vector<tinyobj::shape_t> shapes;
+        std::vector<tinyobj::material_t> mtrls;
+        std::string err;
+
+        // TODO
+        // mtl_basepath
+
+        //auto flags = tinyobj::triangulation | tinyobj::calculate_normals;
+        auto flags = tinyobj::triangulation;
+
+        auto result = tinyobj::LoadObj(
+            shapes, mtrls,
+            err,
+            path.c_str(), mtrlBasePath.c_str(),
+            flags);
+
+        if (!result) {
+            return false;
+        }
+
+        cache.build(shapes, mtrls, needComputeNormalOntime);
+
+        if (!cachePath.empty()) {
+            // Even if it fails, the obj file is only parsed again next time.
+            cache.write(cachePath, key);
+        }
+
+        return true;
+    }
+
     object* ObjLoader::load(
         const std::string& path,
         context& ctxt,
@@ -89,21 +145,9 @@ namespace aten
 
         std::string mtrlBasePath = pathname + "/";
 
-        std::vector<tinyobj::shape_t> shapes;
-        std::vector<tinyobj::material_t> mtrls;
-        std::string err;
+        ObjCache cache;
 
-        // TODO
-        // mtl_basepath
-
-        //auto flags = tinyobj::triangulation | tinyobj::calculate_normals;
-        auto flags = tinyobj::triangulation;
-
-        auto result = tinyobj::LoadObj(
-            shapes, mtrls,
-            err,
-            path.c_str(), mtrlBasePath.c_str(),
-            flags);
+        auto result = readObj(cache, path, mtrlBasePath, needComputeNormalOntime);
 
         //AT_VRETURN(result, );
         if (!result) {
@@ -118,57 +162,18 @@ namespace aten
 
         uint32_t numPolygons = 0;
 
-        for (int p = 0; p < shapes.size(); p++) {
-            const auto& shape = shapes[p];
-
-            //AT_ASSERT(shape.mesh.positions.size() == shape.mesh.normals.size());
-            //AT_ASSERT(shape.mesh.positions.size() / 3 == shape.mesh.texcoords.size() / 2);
+        const auto shapeNum = cache.getShapeNum();
 
-            auto vtxnum = shape.mesh.positions.size();
+        for (uint32_t p = 0; p < shapeNum; p++) {
+            const auto& shape = cache.getShape(p);
 
             auto curVtxPos = ctxt.getVertexNum();
 
-            vec3 pmin = vec3(AT_MATH_INF);
-            vec3 pmax = vec3(-AT_MATH_INF);
-
-            // positions and normals.
-            for (uint32_t i = 0; i < vtxnum; i += 3) {
-                vertex vtx;
-
-                vtx.pos.x = shape.mesh.positions[i + 0];
-                vtx.pos.y = shape.mesh.positions[i + 1];
-                vtx.pos.z = shape.mesh.positions[i + 2];
-                vtx.pos.w = real(0);
-
-                if (shape.mesh.normals.empty()) {
-                    // Flag not to specify normal.
-                    vtx.uv.z = real(1);
-                }
-                else {
-                    vtx.nml.x = shape.mesh.normals[i + 0];
-                    vtx.nml.y = shape.mesh.normals[i + 1];
-                    vtx.nml.z = shape.mesh.normals[i + 2];
-                    vtx.uv.z = needComputeNormalOntime ? real(1) : real(0);
-                }
-
-                if (std::isnan(vtx.nml.x) || std::isnan(vtx.nml.y) || std::isnan(vtx.nml.z))
-                {
-                    // TODO
-                    // work around...
-                    vtx.nml = aten::vec4(real(0), real(1), real(0), 1);
-                }
+            // The vertices are baked in the cache, so copy them at once.
+            ctxt.addVertices(cache.getVertices(shape), shape.vtxNum);
 
-                ctxt.addVertex(vtx);
-
-                pmin = vec3(
-                    std::min(pmin.x, vtx.pos.x),
-                    std::min(pmin.y, vtx.pos.y),
-                    std::min(pmin.z, vtx.pos.z));
-                pmax = vec3(
-                    std::max(pmax.x, vtx.pos.x),
-                    std::max(pmax.y, vtx.pos.y),
-                    std::max(pmax.z, vtx.pos.z));
-            }
+            vec3 pmin = vec3(shape.boxmin[0], shape.boxmin[1], shape.boxmin[2]);
+            vec3 pmax = vec3(shape.boxmax[0], shape.boxmax[1], shape.boxmax[2]);
 
             shapemin = vec3(
                 std::min(shapemin.x, pmin.x),
@@ -182,12 +187,15 @@ namespace aten
             aten::objshape* dstshape = nullptr; 
             int mtrlidx = -1;
 
-            auto idxnum = shape.mesh.indices.size();
+            const auto indices = cache.getIndices(shape);
+            const auto faceMtrls = cache.getFaceMaterials(shape);
+
+            auto idxnum = shape.idxNum;
 
             for (uint32_t i = 0; i < idxnum; i += 3) {
                 int mtrlpos = i / 3;
 
-                int m = shape.mesh.material_ids[mtrlpos];
+                int m = faceMtrls[mtrlpos];
 
                 if (mtrlidx != m) {
                     if (dstshape) {
@@ -216,37 +224,40 @@ namespace aten
                     mtrlidx = m;
 
                     if (mtrlidx >= 0) {
-                        const auto mtrl = mtrls[mtrlidx];
-                        dstshape->setMaterial(AssetManager::getMtrl(mtrl.name));
+                        const auto& mtrl = cache.getMaterial(mtrlidx);
+                        dstshape->setMaterial(AssetManager::getMtrl(cache.getString(mtrl.name)));
                     }
 
                     if (!dstshape->getMaterial()) {
                         // No material, set dummy material....
 
                         // Only lambertian.
-                        const auto& objmtrl = mtrls[m];
+                        const auto& objmtrl = cache.getMaterial(m);
 
                         aten::vec3 diffuse(objmtrl.diffuse[0], objmtrl.diffuse[1], objmtrl.diffuse[2]);
 
+                        std::string diffuseTexname = cache.getString(objmtrl.diffuseTex);
+                        std::string bumpTexname = cache.getString(objmtrl.bumpTex);
+
                         aten::texture* albedoMap = nullptr;
                         aten::texture* normalMap = nullptr;
 
                         // Albedo map.
-                        if (!objmtrl.diffuse_texname.empty()) {
-                            albedoMap = AssetManager::getTex(objmtrl.diffuse_texname.c_str());
+                        if (!diffuseTexname.empty()) {
+                            albedoMap = AssetManager::getTex(diffuseTexname);
 
                             if (!albedoMap) {
-                                std::string texname = pathname + "/" + objmtrl.diffuse_texname;
+                                std::string texname = pathname + "/" + diffuseTexname;
                                 albedoMap = aten::ImageLoader::load(texname, ctxt);
                             }
                         }
 
                         // Normal map.
-                        if (!objmtrl.bump_texname.empty()) {
-                            normalMap = AssetManager::getTex(objmtrl.bump_texname.c_str());
+                        if (!bumpTexname.empty()) {
+                            normalMap = AssetManager::getTex(bumpTexname);
 
                             if (!normalMap) {
-                                std::string texname = pathname + "/" + objmtrl.bump_texname;
+                                std::string texname = pathname + "/" + bumpTexname;
                                 normalMap = aten::ImageLoader::load(texname, ctxt);
                             }
                         }
@@ -261,7 +272,7 @@ namespace aten
                             normalMap,
                             nullptr);
 
-                        mtrl->setName(objmtrl.name.c_str());
+                        mtrl->setName(cache.getString(objmtrl.name));
 
                         dstshape->setMaterial(mtrl);
 
@@ -271,18 +282,11 @@ namespace aten
 
                 aten::PrimitiveParamter faceParam;
 
-                faceParam.idx[0] = shape.mesh.indices[i + 0] + curVtxPos;
-                faceParam.idx[1] = shape.mesh.indices[i + 1] + curVtxPos;
-                faceParam.idx[2] = shape.mesh.indices[i + 2] + curVtxPos;
-
-                auto& v0 = ctxt.getVertex(faceParam.idx[0]);
-                auto& v1 = ctxt.getVertex(faceParam.idx[1]);
-                auto& v2 = ctxt.getVertex(faceParam.idx[2]);
+                faceParam.idx[0] = indices[i + 0] + curVtxPos;
+                faceParam.idx[1] = indices[i + 1] + curVtxPos;
+                faceParam.idx[2] = indices[i + 2] + curVtxPos;
 
-                if (v0.uv.z == real(1)
-                    || v1.uv.z == real(1)
-                    || v2.uv.z == real(1))
-                {
+                if (shape.needNormal) {
                     faceParam.needNormal = 1;
                 }
 
@@ -305,7 +309,7 @@ namespace aten
                     obj->setBoundingBox(aten::aabb(pmin, pmax));
                     objs.push_back(obj);
 
-                    if (p + 1 < shapes.size()) {
+                    if (p + 1 < shapeNum) {
                         obj = aten::TransformableFactory::createObject(ctxt);
                     }
                     else {
@@ -322,34 +326,6 @@ namespace aten
                     obj->appendShape(dstshape);
                 }
             }
-
-            // texture cooridnates.
-            vtxnum = shape.mesh.texcoords.size();
-
-            if (vtxnum > 0) {
-                for (uint32_t i = 0; i < vtxnum; i += 2) {
-                    uint32_t vpos = i / 2 + curVtxPos;
-
-                    auto& vtx = ctxt.getVertex(vpos);
-
-                    vtx.uv.x = shape.mesh.texcoords[i + 0];
-                    vtx.uv.y = shape.mesh.texcoords[i + 1];
-                }
-            }
-            else {
-                // NOTE
-                // positions ɂ x,y,z ΂΂ɓĂ̂ŁA3 Ŋ邱ƂłP_ɂȂ.
-                vtxnum = shape.mesh.positions.size() / 3;
-
-                for (uint32_t i = 0; i < vtxnum; i++) {
-                    uint32_t vpos = i + curVtxPos;
-
-                    auto& vtx = ctxt.getVertex(vpos);
-
-                    // Specify not have texture coordinates.
-                    vtx.uv.z = real(-1);
-                }
-            }
         }
 
         if (!willSeparate) {
@@ -12,6 +12,12 @@ namespace aten
     public:
         static void setBasePath(const std::string& base);
 
+        /**
+         * @brief Set the directory to cache the parsed obj files.
+         * If the directory is empty, the obj files are not cached.
+         */
+        static void setCacheDirectory(const std::string& dir);
+
         static object* load(
             const std::string& path,
             context& ctxt,
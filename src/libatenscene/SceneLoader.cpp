@@ -17,7 +17,7 @@ namespace aten
     }
 
     // NOTE
-    // <scene width=<uint> height=<uint>>
+    // <scene width=<uint> height=<uint> accelcache=<string> objcache=<string>>
     //        <camera 
     //            type=<string>
     //            org=<vec3>
@@ -534,6 +534,17 @@ namespace aten
         info.dst.mltNum = val.get("mlt", int(100));
     }
 
+    static std::string getCacheDirectory(const std::string& value)
+    {
+        // Relative path is from the base path.
+        std::string dir = value;
+        bool isAbsolute = !dir.empty() && (dir[0] == '/' || dir.find(':') != std::string::npos);
+        if (!g_base.empty() && !isAbsolute) {
+            dir = g_base + "/" + dir;
+        }
+        return dir;
+    }
+
     SceneLoader::SceneInfo SceneLoader::load(
         const std::string& path,
         context& ctxt)
@@ -578,6 +589,16 @@ namespace aten
                     auto v = getValue<int>(attr);
                     ret.dst.height = v.getAs<int>();
                 }
+                else if (attrName == "accelcache") {
+                    // Directory to cache the structure trees of the objects.
+                    auto dir = getCacheDirectory(attr->Value());
+                    aten::accelerator::setCacheDirectory(dir);
+                }
+                else if (attrName == "objcache") {
+                    // Directory to cache the parsed obj files.
+                    auto dir = getCacheDirectory(attr->Value());
+                    ObjLoader::setCacheDirectory(dir);
+                }
             }
 
             if (ret.dst.width == 0 || ret.dst.height == 0) {
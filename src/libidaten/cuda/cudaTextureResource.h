@@ -1,6 +1,7 @@
 #pragma once
 
 #include "math/vec4.h"
+#include "texture/texture.h"
 #include "cuda/cudadefs.h"
 #include "cuda/cudautil.h"
 
@@ -48,6 +49,21 @@ namespace idaten
         TextureResource(const aten::vec4* p, int w, int h)
             : ptr(p), width(w), height(h)
         {}
+
+        /**
+         * @brief Return the resource of the texture in the context.
+         * The slot of the removed texture is empty, so the 1x1 black texture is uploaded to it
+         * not to change the indices of the others.
+         */
+        static TextureResource create(const aten::texture* tex)
+        {
+            if (tex) {
+                return TextureResource(tex->colors(), tex->width(), tex->height());
+            }
+
+            static const aten::vec4 placeholder(0);
+            return TextureResource(&placeholder, 1, 1);
+        }
     };
 
     class CudaTexture : public CudaTextureResource {
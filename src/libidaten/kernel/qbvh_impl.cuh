@@ -34,14 +34,21 @@ AT_CUDA_INLINE __device__ bool intersectQBVHTriangles(
         float4 bminz = tex1Dfetch<float4>(nodes, aten::GPUBvhNodeSize * nodeid + 6);
         float4 bmaxz = tex1Dfetch<float4>(nodes, aten::GPUBvhNodeSize * nodeid + 7);
 
-        int leftChildrenIdx = (int)node.x;
-        int isLeaf = (int)node.y;
-        int numChildren = (int)node.z;
+        // NOTE
+        // Indices are stored as integer bits.
+        int leftChildrenIdx = __float_as_int(node.x);
+        int isLeaf = __float_as_int(node.y);
+        int numChildren = __float_as_int(node.z);
+
+        int shapeid = __float_as_int(attrib.x);
+        int primid = __float_as_int(attrib.y);
+        int exid = __float_as_int(attrib.z);
+        int meshid = __float_as_int(attrib.w);
 
         bool isHit = false;
 
         if (isLeaf) {
-            int primidx = (int)attrib.y;
+            int primidx = primid;
             aten::PrimitiveParamter prim;
             prim.v0 = ((aten::vec4*)ctxt->prims)[primidx * aten::PrimitiveParamter_float4_size + 0];
             prim.v1 = ((aten::vec4*)ctxt->prims)[primidx * aten::PrimitiveParamter_float4_size + 1];
@@ -55,11 +62,11 @@ AT_CUDA_INLINE __device__ bool intersectQBVHTriangles(
 
             if (isIntersect) {
                 *isect = isectTmp;
-                isect->objid = (int)attrib.x;
-                isect->primid = (int)attrib.y;
+                isect->objid = shapeid;
+                isect->primid = primid;
                 isect->mtrlid = prim.mtrlid;
 
-                //isect->meshid = (int)attrib.w;
+                //isect->meshid = meshid;
                 isect->meshid = prim.gemoid;
 
                 t_max = isect->t;
@@ -133,17 +140,24 @@ AT_CUDA_INLINE __device__ bool intersectQBVH(
         float4 bminz = tex1Dfetch<float4>(nodes, aten::GPUBvhNodeSize * nodeid + 6);
         float4 bmaxz = tex1Dfetch<float4>(nodes, aten::GPUBvhNodeSize * nodeid + 7);
 
-        int leftChildrenIdx = (int)node.x;
-        int isLeaf = (int)node.y;
-        int numChildren = (int)node.z;
+        // NOTE
+        // Indices are stored as integer bits.
+        int leftChildrenIdx = __float_as_int(node.x);
+        int isLeaf = __float_as_int(node.y);
+        int numChildren = __float_as_int(node.z);
+
+        int shapeid = __float_as_int(attrib.x);
+        int primid = __float_as_int(attrib.y);
+        int exid = __float_as_int(attrib.z);
+        int meshid = __float_as_int(attrib.w);
 
         bool isHit = false;
 
         if (isLeaf) {
             // Leaf.
-            const auto* s = &ctxt->shapes[(int)attrib.x];
+            const auto* s = &ctxt->shapes[shapeid];
 
-            if (attrib.z >= 0) {
+            if (exid >= 0) {
                 aten::ray transformedRay;
 
                 if (s->mtxid >= 0) {
@@ -158,7 +172,7 @@ AT_CUDA_INLINE __device__ bool intersectQBVH(
 
                 isHit = intersectQBVHTriangles<Type>(
                     stack, stackpos,
-                    ctxt->nodes[(int)attrib.z], ctxt, transformedRay, t_min, t_max, &isectTmp);
+                    ctxt->nodes[exid], ctxt, transformedRay, t_min, t_max, &isectTmp);
             }
             else {
                 // TODO
@@ -174,8 +188,8 @@ AT_CUDA_INLINE __device__ bool intersectQBVH(
 
             if (isIntersect) {
                 *isect = isectTmp;
-                isect->objid = (int)attrib.x;
-                isect->meshid = (isect->meshid < 0 ? (int)attrib.w : isect->meshid);
+                isect->objid = shapeid;
+                isect->meshid = (isect->meshid < 0 ? meshid : isect->meshid);
 
                 t_max = isect->t;
 
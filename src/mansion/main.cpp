@@ -455,8 +455,7 @@ int main()
 
             for (int i = 0; i < texNum; i++) {
                 auto t = g_ctxt.getTexture(i);
-                tex.push_back(
-                    idaten::TextureResource(t->colors(), t->width(), t->height()));
+                tex.push_back(idaten::TextureResource::create(t));
             }
         }
 